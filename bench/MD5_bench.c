@@ -0,0 +1,1257 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_bench.c
+**    Summary: Standalone benchmark of the MD5 unit for POSIX hosts. Hashing
+**             from memory (whole messages, and MD5_Update() in chunks at
+**             aligned and unaligned addresses) and hashing from files (page
+**             cache warm and cold) are timed as separate cases, so I/O never
+**             mixes into the hashing figures. Every case is repeated and
+**             reported as min / median / p99 time and MB/s, as a table or as
+**             JSON for tracking across releases.
+**
+**             With --kernels, the block compression engines are measured on
+**             data that stays in the L1 cache instead: cycles per byte and
+**             per block from the time stamp counter, and where the kernel
+**             permits perf_event_open(), instructions, IPC, branch misses and
+**             L1 data cache misses per block.
+**
+**             gcc -O2 -Isrc -o md5bench bench/MD5_bench.c src/MD5.c src/MD5_io.c
+**                 src/MD5_multi.c src/MD5_throttle.c -lpthread
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC                 1
+#else
+#define BENCH_HAVE_TSC                 0
+#endif
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "MD5.h"
+#include "MD5_io.h"
+#include "MD5_multi.h"
+
+/*****************************************************************************
+** Defines
+******************************************************************************
+*/
+#define DEFAULT_MAX_SIZE_MIB           1024
+#define DEFAULT_MIN_REPS               5
+#define DEFAULT_MIN_TIME_MS            200
+#define MAX_REPS                       10000
+#define CHUNK_MESSAGE_SIZE             ( 4U * 1024U * 1024U )
+#define BUFFER_ALIGNMENT               64
+#define FILL_BLOCK_SIZE                ( 1024U * 1024U )
+
+/*
+** The kernel cases hash KERNEL_DATA_SIZE bytes over and over, so the data
+** stays in the L1 cache. A timed run compresses about KERNEL_RUN_BLOCKS
+** blocks.
+*/
+#define KERNEL_DATA_SIZE               ( 16U * 1024U )
+#define KERNEL_RUN_BLOCKS              ( 4096U )
+
+/*
+** Hardware counters of the kernel cases
+*/
+#define COUNTER_CYCLES                 0
+#define COUNTER_INSTRUCTIONS           1
+#define COUNTER_BRANCH_MISSES          2
+#define COUNTER_L1D_MISSES             3
+#define NUM_COUNTERS                   4
+
+/*****************************************************************************
+** Typedefs
+******************************************************************************
+*/
+
+/*
+** Statistics of a case, times in ns
+*/
+typedef struct BenchResult
+{
+   const char* pacCase;
+   UINT64 lSize;      /* Message or file size */
+   UINT32 dwChunk;    /* MD5_Update() length, 0: whole message */
+   UINT32 dwOffset;   /* Bytes the data is off a 64 byte boundary */
+   UINT32 dwReps;
+   UINT64 lMinNs;
+   UINT64 lMedianNs;
+   UINT64 lP99Ns;
+   double rMBPerSec;  /* From the median, MB of 10^6 bytes */
+} BenchResultType;
+
+/*
+** A timed operation: hashes the case once, the digest goes to pbDigest
+*/
+typedef BOOL ( *BenchRunFunc )( void* pxCtx, UINT8* pbDigest );
+
+/*
+** Context of the memory cases
+*/
+typedef struct MemoryCase
+{
+   const UINT8* pbData;
+   UINT64 lSize;
+   UINT32 dwChunk;
+} MemoryCaseType;
+
+/*
+** Context of the file cases
+*/
+typedef struct FileCase
+{
+   const char* pacPath;
+   UINT64 lSize;
+   BOOL fCold;
+   MD5_IO_WorkerType* psWorker;
+} FileCaseType;
+
+/*
+** A block compression engine: hashes the kernel data for a run and returns
+** the number of blocks compressed
+*/
+typedef UINT32 ( *KernelRunFunc )( void );
+
+typedef struct KernelEngine
+{
+   const char* pacName;
+   KernelRunFunc pnRun;
+} KernelEngineType;
+
+/*
+** Statistics of a kernel case. Ticks are TSC cycles (ns without a TSC) per
+** run, the counters are totals of all timed runs.
+*/
+typedef struct KernelResult
+{
+   const char* pacEngine;
+   UINT32 dwBlocks;   /* Blocks compressed per run */
+   UINT32 dwReps;
+   UINT64 lMinTicks;
+   UINT64 lMedianTicks;
+   UINT64 lTotalNs;
+   UINT64 lTotalBlocks;
+   BOOL afCounted[ NUM_COUNTERS ];
+   UINT64 alCounts[ NUM_COUNTERS ];
+} KernelResultType;
+
+/*****************************************************************************
+** Static variables
+******************************************************************************
+*/
+
+/*
+** Message sizes of the memory and file cases (the file cases skip those
+** below 4 KiB); sizes above --max-size are skipped
+*/
+static const UINT64 alMessageSizes[] = { 0, 1, 55, 56, 63, 64, 1024, 4096, 65536,
+                                         1048576, 16777216, 268435456, 1073741824 };
+
+/*
+** MD5_Update() lengths of the chunked cases, around the 64 byte block size
+** and up to the largest length MD5_Update() takes
+*/
+static const UINT32 adwChunkSizes[] = { 1, 3, 63, 64, 65, 1000, 4096, 65535 };
+static const UINT32 adwChunkOffsets[] = { 0, 1, 3 };
+
+static BOOL fJson            = FALSE;
+static BOOL fFiles           = TRUE;
+static BOOL fKernels         = FALSE;
+static UINT64 lMaxSize       = (UINT64)DEFAULT_MAX_SIZE_MIB << 20;
+static UINT32 dwMinReps      = DEFAULT_MIN_REPS;
+static UINT32 dwMinTimeMs    = DEFAULT_MIN_TIME_MS;
+static const char* pacDir    = NULL;
+static UINT32 dwNumResults   = 0;
+
+/*
+** Hot data of the kernel cases, and a sink for their digests so the runs
+** can't be optimized away
+*/
+static UINT8* pbKernelData   = NULL;
+static volatile UINT32 dwKernelSink;
+
+/*
+** Counter file descriptors, -1 where the counter isn't available
+*/
+static int aiCounterFds[ NUM_COUNTERS ] = { -1, -1, -1, -1 };
+
+/*****************************************************************************
+** Function prototypes
+******************************************************************************
+*/
+static UINT64 GetTimeNs( void );
+static int CompareTimes( const void* pxA, const void* pxB );
+static BOOL MeasureCase( BenchRunFunc pnRun, void* pxCtx, UINT64 lSize, BenchResultType* psResult,
+                         UINT8* pbDigest );
+static void PrintResult( const BenchResultType* psResult );
+static void FillPattern( UINT8* pbData, UINT64 lSize );
+static BOOL RunMemoryCase( void* pxCtx, UINT8* pbDigest );
+static BOOL RunFileCase( void* pxCtx, UINT8* pbDigest );
+static BOOL BenchMemory( void );
+static BOOL BenchChunks( void );
+static BOOL WriteSampleFile( int iFd, UINT64 lSize );
+static BOOL BenchFiles( void );
+static UINT32 RunBlockKernel( void );
+static UINT32 RunUpdateKernel( void );
+static UINT32 RunMultiKernel( void );
+static UINT64 GetTicks( void );
+static void OpenCounters( void );
+static void CloseCounters( void );
+static void ReadCounters( UINT64* alCounts, BOOL* afCounted );
+static void SetCounters( BOOL fEnable );
+static BOOL MeasureKernel( const KernelEngineType* psEngine, KernelResultType* psResult );
+static void PrintKernelResult( const KernelResultType* psResult );
+static BOOL BenchKernels( void );
+static void PrintHeader( void );
+static void PrintFooter( void );
+static BOOL ParseArguments( int argc, char* argv[] );
+static void PrintHelp( void );
+
+/*****************************************************************************
+** Global routines
+******************************************************************************
+*/
+
+/*----------------------------------------------------------------------------
+** Benchmark application
+*-----------------------------------------------------------------------------
+*/
+int main( int argc, char* argv[] )
+{
+   BOOL fSuccess;
+
+   if( !ParseArguments( argc, argv ) )
+   {
+      PrintHelp();
+      return -1;
+   }
+
+   PrintHeader();
+
+   if( fKernels )
+   {
+      fSuccess = BenchKernels();
+   }
+   else
+   {
+      fSuccess = BenchMemory();
+      fSuccess = BenchChunks() && fSuccess;
+
+      if( fFiles )
+      {
+         fSuccess = BenchFiles() && fSuccess;
+      }
+   }
+
+   PrintFooter();
+
+   return fSuccess ? 0 : -1;
+}
+
+/*****************************************************************************
+** Local routines
+******************************************************************************
+*/
+
+/*----------------------------------------------------------------------------
+** Monotonic time in ns
+*-----------------------------------------------------------------------------
+*/
+static UINT64 GetTimeNs( void )
+{
+   struct timespec sNow;
+
+   clock_gettime( CLOCK_MONOTONIC, &sNow );
+
+   return (UINT64)sNow.tv_sec * 1000000000ULL + (UINT64)sNow.tv_nsec;
+}
+
+/*----------------------------------------------------------------------------
+** qsort() order of sample times
+*-----------------------------------------------------------------------------
+*/
+static int CompareTimes( const void* pxA, const void* pxB )
+{
+   UINT64 lA = *(const UINT64*)pxA;
+   UINT64 lB = *(const UINT64*)pxB;
+
+   return ( lA > lB ) - ( lA < lB );
+}
+
+/*----------------------------------------------------------------------------
+** Time a case: one untimed warm-up run, then at least --reps runs and as
+** many more as fit in --min-time (up to MAX_REPS). The p99 is the nearest
+** rank, so it is the slowest run below 100 samples.
+*-----------------------------------------------------------------------------
+*/
+static BOOL MeasureCase( BenchRunFunc pnRun, void* pxCtx, UINT64 lSize, BenchResultType* psResult,
+                         UINT8* pbDigest )
+{
+   UINT64* alSamples = malloc( MAX_REPS * sizeof( UINT64 ) );
+   UINT64 lTotalNs   = 0;
+   UINT32 dwReps     = 0;
+
+   if( ( alSamples == NULL ) || !pnRun( pxCtx, pbDigest ) )
+   {
+      free( alSamples );
+      return FALSE;
+   }
+
+   while( ( dwReps < MAX_REPS ) &&
+          ( ( dwReps < dwMinReps ) || ( lTotalNs < (UINT64)dwMinTimeMs * 1000000U ) ) )
+   {
+      UINT64 lStartNs = GetTimeNs();
+
+      if( !pnRun( pxCtx, pbDigest ) )
+      {
+         free( alSamples );
+         return FALSE;
+      }
+
+      alSamples[ dwReps ] = GetTimeNs() - lStartNs;
+      lTotalNs += alSamples[ dwReps++ ];
+   }
+
+   qsort( alSamples, dwReps, sizeof( UINT64 ), CompareTimes );
+
+   psResult->lSize     = lSize;
+   psResult->dwReps    = dwReps;
+   psResult->lMinNs    = alSamples[ 0 ];
+   psResult->lMedianNs = ( dwReps % 2 ) ? alSamples[ dwReps / 2 ] :
+                         ( alSamples[ dwReps / 2 - 1 ] + alSamples[ dwReps / 2 ] ) / 2;
+   psResult->lP99Ns    = alSamples[ ( dwReps * 99 + 99 ) / 100 - 1 ];
+   psResult->rMBPerSec =
+      ( psResult->lMedianNs != 0 ) ? (double)lSize * 1000.0 / (double)psResult->lMedianNs : 0.0;
+
+   free( alSamples );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Print a case as a table row or a JSON array element
+*-----------------------------------------------------------------------------
+*/
+static void PrintResult( const BenchResultType* psResult )
+{
+   if( fJson )
+   {
+      printf( "%s    {\"case\": \"%s\", \"size\": %llu, \"chunk\": %lu, \"offset\": %lu, "
+              "\"reps\": %lu, \"min_ns\": %llu, \"median_ns\": %llu, \"p99_ns\": %llu, "
+              "\"mb_per_s\": %.2f}",
+              ( dwNumResults != 0 ) ? ",\n" : "", psResult->pacCase,
+              (unsigned long long)psResult->lSize, (unsigned long)psResult->dwChunk,
+              (unsigned long)psResult->dwOffset, (unsigned long)psResult->dwReps,
+              (unsigned long long)psResult->lMinNs, (unsigned long long)psResult->lMedianNs,
+              (unsigned long long)psResult->lP99Ns, psResult->rMBPerSec );
+   }
+   else
+   {
+      printf( "%-12s %11llu %6lu %3lu %6lu %13llu %13llu %13llu %10.1f\n", psResult->pacCase,
+              (unsigned long long)psResult->lSize, (unsigned long)psResult->dwChunk,
+              (unsigned long)psResult->dwOffset, (unsigned long)psResult->dwReps,
+              (unsigned long long)psResult->lMinNs, (unsigned long long)psResult->lMedianNs,
+              (unsigned long long)psResult->lP99Ns, psResult->rMBPerSec );
+   }
+
+   dwNumResults++;
+   fflush( stdout );
+}
+
+/*----------------------------------------------------------------------------
+** Fill a message with a byte pattern that doesn't repeat within a block
+*-----------------------------------------------------------------------------
+*/
+static void FillPattern( UINT8* pbData, UINT64 lSize )
+{
+   UINT32 dwState = 0x12345678U;
+   UINT64 lIndex;
+
+   for( lIndex = 0; lIndex < lSize; lIndex++ )
+   {
+      dwState         = dwState * 1103515245U + 12345U;
+      pbData[ lIndex ] = (UINT8)( dwState >> 24 );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Hash a message from memory, whole or in MD5_Update() chunks
+*-----------------------------------------------------------------------------
+*/
+static BOOL RunMemoryCase( void* pxCtx, UINT8* pbDigest )
+{
+   const MemoryCaseType* psCase = pxCtx;
+   MD5_InstType sInst;
+   UINT64 lDone;
+
+   MD5_Init( &sInst );
+
+   if( psCase->dwChunk == 0 )
+   {
+      for( lDone = 0; lDone < psCase->lSize; )
+      {
+         UINT64 lLeft    = psCase->lSize - lDone;
+         UINT32 dwLength = ( lLeft > 0x80000000U ) ? 0x80000000U : (UINT32)lLeft;
+
+         MD5_UpdateLarge( &sInst, &psCase->pbData[ lDone ], dwLength );
+         lDone += dwLength;
+      }
+   }
+   else
+   {
+      for( lDone = 0; lDone < psCase->lSize; lDone += psCase->dwChunk )
+      {
+         UINT64 lLength = psCase->lSize - lDone;
+
+         MD5_Update( &sInst, &psCase->pbData[ lDone ],
+                     (UINT16)( ( lLength < psCase->dwChunk ) ? lLength : psCase->dwChunk ) );
+      }
+   }
+
+   MD5_Final( &sInst );
+   memcpy( pbDigest, sInst.adwDigest, MD5_DIGEST_SIZE );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Hash a file through an MD5_IO worker, dropping it from the page cache
+** first for the cold case
+*-----------------------------------------------------------------------------
+*/
+static BOOL RunFileCase( void* pxCtx, UINT8* pbDigest )
+{
+   const FileCaseType* psCase = pxCtx;
+
+   if( psCase->fCold )
+   {
+      int iFd = open( psCase->pacPath, O_RDONLY | O_CLOEXEC );
+
+      if( iFd >= 0 )
+      {
+         (void)posix_fadvise( iFd, 0, 0, POSIX_FADV_DONTNEED );
+         close( iFd );
+      }
+   }
+
+   if( !MD5_IO_HashPath( psCase->psWorker, psCase->pacPath, pbDigest, NULL ) )
+   {
+      fprintf( stderr, "md5bench: %s: %s\n", psCase->pacPath, strerror( errno ) );
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Whole messages hashed from memory, every size up to --max-size
+*-----------------------------------------------------------------------------
+*/
+static BOOL BenchMemory( void )
+{
+   UINT64 lLargest = 0;
+   MemoryCaseType sCase;
+   BenchResultType sResult;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   UINT8* pbData;
+   UINT16 iSize;
+
+   for( iSize = 0; iSize < sizeof( alMessageSizes ) / sizeof( alMessageSizes[ 0 ] ); iSize++ )
+   {
+      if( alMessageSizes[ iSize ] <= lMaxSize )
+      {
+         lLargest = alMessageSizes[ iSize ];
+      }
+   }
+
+   pbData = malloc( (size_t)lLargest + 1 );
+
+   if( pbData == NULL )
+   {
+      fprintf( stderr, "md5bench: no memory for a %llu byte message, lower --max-size\n",
+               (unsigned long long)lLargest );
+      return FALSE;
+   }
+
+   FillPattern( pbData, lLargest );
+
+   memset( &sResult, 0, sizeof( sResult ) );
+   sResult.pacCase = "memory";
+   sCase.pbData    = pbData;
+   sCase.dwChunk   = 0;
+
+   for( iSize = 0; ( iSize < sizeof( alMessageSizes ) / sizeof( alMessageSizes[ 0 ] ) ) &&
+                   ( alMessageSizes[ iSize ] <= lMaxSize ); iSize++ )
+   {
+      sCase.lSize = alMessageSizes[ iSize ];
+
+      if( MeasureCase( RunMemoryCase, &sCase, sCase.lSize, &sResult, abDigest ) )
+      {
+         PrintResult( &sResult );
+      }
+   }
+
+   free( pbData );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** A message hashed from memory in MD5_Update() chunks of every size, at a
+** 64 byte boundary and off it. Every digest is checked against the digest
+** of the whole message.
+*-----------------------------------------------------------------------------
+*/
+static BOOL BenchChunks( void )
+{
+   UINT32 dwSize   = ( lMaxSize < CHUNK_MESSAGE_SIZE ) ? (UINT32)lMaxSize : CHUNK_MESSAGE_SIZE;
+   UINT8* pbBuffer = malloc( (size_t)dwSize + 2 * BUFFER_ALIGNMENT );
+   BOOL fSuccess   = TRUE;
+   MemoryCaseType sCase;
+   BenchResultType sResult;
+   UINT8 abExpected[ MD5_DIGEST_SIZE ];
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   UINT8* pbAligned;
+   UINT16 iOffset;
+   UINT16 iChunk;
+
+   if( pbBuffer == NULL )
+   {
+      return FALSE;
+   }
+
+   pbAligned = pbBuffer + BUFFER_ALIGNMENT - ( (size_t)pbBuffer % BUFFER_ALIGNMENT );
+
+   memset( &sResult, 0, sizeof( sResult ) );
+   sResult.pacCase = "update";
+   sCase.lSize     = dwSize;
+
+   for( iOffset = 0; iOffset < sizeof( adwChunkOffsets ) / sizeof( adwChunkOffsets[ 0 ] );
+        iOffset++ )
+   {
+      /* The same message at every offset */
+      sCase.pbData  = pbAligned + adwChunkOffsets[ iOffset ];
+      sCase.dwChunk = 0;
+      FillPattern( (UINT8*)sCase.pbData, dwSize );
+      RunMemoryCase( &sCase, abExpected );
+
+      for( iChunk = 0; iChunk < sizeof( adwChunkSizes ) / sizeof( adwChunkSizes[ 0 ] ); iChunk++ )
+      {
+         sCase.dwChunk = adwChunkSizes[ iChunk ];
+
+         if( !MeasureCase( RunMemoryCase, &sCase, dwSize, &sResult, abDigest ) )
+         {
+            continue;
+         }
+
+         if( memcmp( abDigest, abExpected, MD5_DIGEST_SIZE ) != 0 )
+         {
+            fprintf( stderr, "md5bench: digest of %lu byte updates at offset %lu differs\n",
+                     (unsigned long)sCase.dwChunk, (unsigned long)adwChunkOffsets[ iOffset ] );
+            fSuccess = FALSE;
+         }
+
+         sResult.dwChunk  = sCase.dwChunk;
+         sResult.dwOffset = adwChunkOffsets[ iOffset ];
+         PrintResult( &sResult );
+      }
+   }
+
+   free( pbBuffer );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Write the pattern to a benchmark file and sync it, so the cold case can
+** drop it from the page cache
+*-----------------------------------------------------------------------------
+*/
+static BOOL WriteSampleFile( int iFd, UINT64 lSize )
+{
+   UINT8* pbBlock  = malloc( FILL_BLOCK_SIZE );
+   UINT64 lWritten = 0;
+
+   if( pbBlock == NULL )
+   {
+      return FALSE;
+   }
+
+   FillPattern( pbBlock, FILL_BLOCK_SIZE );
+
+   while( lWritten < lSize )
+   {
+      size_t iChunk =
+         ( lSize - lWritten < FILL_BLOCK_SIZE ) ? (size_t)( lSize - lWritten ) : FILL_BLOCK_SIZE;
+      ssize_t iBytesWritten = write( iFd, pbBlock, iChunk );
+
+      if( iBytesWritten < 0 )
+      {
+         if( errno != EINTR )
+         {
+            free( pbBlock );
+            return FALSE;
+         }
+
+         continue;
+      }
+
+      lWritten += (UINT64)iBytesWritten;
+   }
+
+   free( pbBlock );
+
+   return ( fsync( iFd ) == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Files of every size from 4 KiB up to --max-size hashed with the default
+** read buffer of the parallel modes, first from the page cache, then from
+** the device. Data that can't be dropped from the page cache (tmpfs) is
+** cached in both.
+*-----------------------------------------------------------------------------
+*/
+static BOOL BenchFiles( void )
+{
+   const char* pacTmp = getenv( "TMPDIR" );
+   size_t iPathLen;
+   MD5_IO_WorkerType sWorker;
+   FileCaseType sCase;
+   BenchResultType sResult;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   char* pacPath;
+   UINT16 iSize;
+
+   if( pacDir == NULL )
+   {
+      pacDir = ( ( pacTmp != NULL ) && ( pacTmp[ 0 ] != '\0' ) ) ? pacTmp : "/tmp";
+   }
+
+   iPathLen = strlen( pacDir ) + 32;
+   pacPath  = malloc( iPathLen );
+
+   if( ( pacPath == NULL ) || !MD5_IO_InitWorker( &sWorker, MD5_IO_DEFAULT_BUFFER_SIZE ) )
+   {
+      free( pacPath );
+      return FALSE;
+   }
+
+   memset( &sResult, 0, sizeof( sResult ) );
+   sCase.pacPath  = pacPath;
+   sCase.psWorker = &sWorker;
+
+   for( iSize = 0; ( iSize < sizeof( alMessageSizes ) / sizeof( alMessageSizes[ 0 ] ) ) &&
+                   ( alMessageSizes[ iSize ] <= lMaxSize ); iSize++ )
+   {
+      int iFd;
+
+      if( alMessageSizes[ iSize ] < MD5_IO_MIN_BUFFER_SIZE )
+      {
+         continue;
+      }
+
+      snprintf( pacPath, iPathLen, "%s/md5bench.XXXXXX", pacDir );
+      iFd = mkstemp( pacPath );
+
+      if( ( iFd < 0 ) || !WriteSampleFile( iFd, alMessageSizes[ iSize ] ) )
+      {
+         fprintf( stderr, "md5bench: %s: %s\n", pacPath, strerror( errno ) );
+
+         if( iFd >= 0 )
+         {
+            close( iFd );
+            unlink( pacPath );
+         }
+
+         break;
+      }
+
+      close( iFd );
+      sCase.lSize = alMessageSizes[ iSize ];
+
+      sCase.fCold     = FALSE;
+      sResult.pacCase = "file-cached";
+
+      if( MeasureCase( RunFileCase, &sCase, sCase.lSize, &sResult, abDigest ) )
+      {
+         PrintResult( &sResult );
+      }
+
+      sCase.fCold     = TRUE;
+      sResult.pacCase = "file-cold";
+
+      if( MeasureCase( RunFileCase, &sCase, sCase.lSize, &sResult, abDigest ) )
+      {
+         PrintResult( &sResult );
+      }
+
+      unlink( pacPath );
+   }
+
+   MD5_IO_FreeWorker( &sWorker );
+   free( pacPath );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** The scalar engine (MD5_ProcessBlock()) alone. MD5_UpdateByteRun()
+** compresses its block over and over without copying data into it, so apart
+** from the first two blocks a run is nothing but MD5_ProcessBlock() calls.
+** The cost of a block doesn't depend on its data.
+*-----------------------------------------------------------------------------
+*/
+static UINT32 RunBlockKernel( void )
+{
+   MD5_InstType sInst;
+
+   MD5_Init( &sInst );
+   MD5_UpdateByteRun( &sInst, 0x5A, (UINT64)KERNEL_RUN_BLOCKS * MD5_BLOCK_SIZE );
+   dwKernelSink = sInst.adwDigest[ 0 ];
+
+   return KERNEL_RUN_BLOCKS;
+}
+
+/*----------------------------------------------------------------------------
+** The scalar engine fed by MD5_Update(), which copies every block into the
+** working buffer first
+*-----------------------------------------------------------------------------
+*/
+static UINT32 RunUpdateKernel( void )
+{
+   MD5_InstType sInst;
+   UINT32 dwDone;
+
+   MD5_Init( &sInst );
+
+   for( dwDone = 0; dwDone < KERNEL_RUN_BLOCKS * MD5_BLOCK_SIZE; dwDone += KERNEL_DATA_SIZE )
+   {
+      MD5_Update( &sInst, pbKernelData, KERNEL_DATA_SIZE );
+   }
+
+   dwKernelSink = sInst.adwDigest[ 0 ];
+
+   return KERNEL_RUN_BLOCKS;
+}
+
+/*----------------------------------------------------------------------------
+** The multi-lane engine (MD5_MULTI_Compute()), the kernel data split
+** between all lanes. The padding block of every lane is counted, as it
+** costs as much as any other block.
+*-----------------------------------------------------------------------------
+*/
+static UINT32 RunMultiKernel( void )
+{
+   const UINT32 dwLaneSize = KERNEL_DATA_SIZE / MD5_MULTI_LANES;
+   const UINT8* apbMsg[ MD5_MULTI_LANES ];
+   UINT32 adwMsgLen[ MD5_MULTI_LANES ];
+   UINT8 aabDigest[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT32 dwBlocks = 0;
+   UINT8 bLane;
+
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+   {
+      apbMsg[ bLane ]    = &pbKernelData[ bLane * dwLaneSize ];
+      adwMsgLen[ bLane ] = dwLaneSize;
+   }
+
+   while( dwBlocks < KERNEL_RUN_BLOCKS )
+   {
+      MD5_MULTI_Compute( apbMsg, adwMsgLen, aabDigest, MD5_MULTI_LANES );
+      dwBlocks += MD5_MULTI_LANES * ( ( dwLaneSize + 8U ) / MD5_BLOCK_SIZE + 1U );
+   }
+
+   dwKernelSink = aabDigest[ 0 ][ 0 ];
+
+   return dwBlocks;
+}
+
+/*----------------------------------------------------------------------------
+** Time stamp counter, or ns on hosts without one
+*-----------------------------------------------------------------------------
+*/
+static UINT64 GetTicks( void )
+{
+#if( BENCH_HAVE_TSC == 1 )
+   return __rdtsc();
+#else
+   return GetTimeNs();
+#endif
+}
+
+/*----------------------------------------------------------------------------
+** Open the hardware counters of this thread, user space only, so they work
+** up to perf_event_paranoid 2. Each one is opened on its own, so a counter
+** the CPU lacks doesn't take the others with it.
+*-----------------------------------------------------------------------------
+*/
+static void OpenCounters( void )
+{
+#if defined( __linux__ )
+   static const UINT32 adwTypes[ NUM_COUNTERS ] =
+   {
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HARDWARE,
+      PERF_TYPE_HW_CACHE
+   };
+   static const UINT64 alConfigs[ NUM_COUNTERS ] =
+   {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) |
+      ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 )
+   };
+   int iError = 0;
+   UINT8 bCounter;
+
+   for( bCounter = 0; bCounter < NUM_COUNTERS; bCounter++ )
+   {
+      struct perf_event_attr sAttr;
+
+      memset( &sAttr, 0, sizeof( sAttr ) );
+      sAttr.size           = sizeof( sAttr );
+      sAttr.type           = adwTypes[ bCounter ];
+      sAttr.config         = alConfigs[ bCounter ];
+      sAttr.disabled       = 1;
+      sAttr.exclude_kernel = 1;
+      sAttr.exclude_hv     = 1;
+      sAttr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      aiCounterFds[ bCounter ] =
+         (int)syscall( __NR_perf_event_open, &sAttr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC );
+
+      if( aiCounterFds[ bCounter ] < 0 )
+      {
+         iError = errno;
+      }
+   }
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5bench: some hardware counters are not available: %s%s\n",
+               strerror( iError ),
+               ( ( iError == EACCES ) || ( iError == EPERM ) ) ?
+               " (see /proc/sys/kernel/perf_event_paranoid)" : "" );
+   }
+#else
+   fprintf( stderr, "md5bench: hardware counters are not available on this host\n" );
+#endif
+}
+
+/*----------------------------------------------------------------------------
+** Close the hardware counters
+*-----------------------------------------------------------------------------
+*/
+static void CloseCounters( void )
+{
+   UINT8 bCounter;
+
+   for( bCounter = 0; bCounter < NUM_COUNTERS; bCounter++ )
+   {
+      if( aiCounterFds[ bCounter ] >= 0 )
+      {
+         close( aiCounterFds[ bCounter ] );
+         aiCounterFds[ bCounter ] = -1;
+      }
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Read the hardware counters, scaled up when the kernel had to multiplex
+** them. A counter that never ran is not counted.
+*-----------------------------------------------------------------------------
+*/
+static void ReadCounters( UINT64* alCounts, BOOL* afCounted )
+{
+   UINT8 bCounter;
+
+   for( bCounter = 0; bCounter < NUM_COUNTERS; bCounter++ )
+   {
+      UINT64 alValues[ 3 ]; /* Value, time enabled, time running */
+
+      afCounted[ bCounter ] = FALSE;
+
+      if( ( aiCounterFds[ bCounter ] >= 0 ) &&
+          ( read( aiCounterFds[ bCounter ], alValues, sizeof( alValues ) ) ==
+            (ssize_t)sizeof( alValues ) ) && ( alValues[ 2 ] != 0 ) )
+      {
+         alCounts[ bCounter ]  =
+            (UINT64)( (double)alValues[ 0 ] * (double)alValues[ 1 ] / (double)alValues[ 2 ] );
+         afCounted[ bCounter ] = TRUE;
+      }
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Reset and start, or stop the hardware counters
+*-----------------------------------------------------------------------------
+*/
+static void SetCounters( BOOL fEnable )
+{
+#if defined( __linux__ )
+   UINT8 bCounter;
+
+   for( bCounter = 0; bCounter < NUM_COUNTERS; bCounter++ )
+   {
+      if( aiCounterFds[ bCounter ] >= 0 )
+      {
+         if( fEnable )
+         {
+            (void)ioctl( aiCounterFds[ bCounter ], PERF_EVENT_IOC_RESET, 0 );
+         }
+
+         (void)ioctl( aiCounterFds[ bCounter ],
+                      fEnable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0 );
+      }
+   }
+#else
+   (void)fEnable;
+#endif
+}
+
+/*----------------------------------------------------------------------------
+** Time an engine like MeasureCase(): one untimed warm-up run, then at least
+** --reps runs and as many more as fit in --min-time. The counters run over
+** all timed runs.
+*-----------------------------------------------------------------------------
+*/
+static BOOL MeasureKernel( const KernelEngineType* psEngine, KernelResultType* psResult )
+{
+   UINT64* alSamples = malloc( MAX_REPS * sizeof( UINT64 ) );
+   UINT64 lStartNs;
+   UINT32 dwReps = 0;
+
+   if( alSamples == NULL )
+   {
+      return FALSE;
+   }
+
+   memset( psResult, 0, sizeof( *psResult ) );
+   psResult->pacEngine = psEngine->pacName;
+   psResult->dwBlocks  = psEngine->pnRun();
+
+   SetCounters( TRUE );
+   lStartNs = GetTimeNs();
+
+   while( ( dwReps < MAX_REPS ) &&
+          ( ( dwReps < dwMinReps ) ||
+            ( GetTimeNs() - lStartNs < (UINT64)dwMinTimeMs * 1000000U ) ) )
+   {
+      UINT64 lStartTicks = GetTicks();
+
+      psEngine->pnRun();
+      alSamples[ dwReps++ ] = GetTicks() - lStartTicks;
+   }
+
+   psResult->lTotalNs = GetTimeNs() - lStartNs;
+   SetCounters( FALSE );
+   ReadCounters( psResult->alCounts, psResult->afCounted );
+
+   qsort( alSamples, dwReps, sizeof( UINT64 ), CompareTimes );
+
+   psResult->dwReps       = dwReps;
+   psResult->lTotalBlocks = (UINT64)dwReps * psResult->dwBlocks;
+   psResult->lMinTicks    = alSamples[ 0 ];
+   psResult->lMedianTicks = ( dwReps % 2 ) ? alSamples[ dwReps / 2 ] :
+                            ( alSamples[ dwReps / 2 - 1 ] + alSamples[ dwReps / 2 ] ) / 2;
+
+   free( alSamples );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Print a kernel case as a table row or a JSON array element. Figures that
+** weren't measured are left out of JSON and shown as "-" in the table.
+*-----------------------------------------------------------------------------
+*/
+static void PrintKernelResult( const KernelResultType* psResult )
+{
+   const double rBlocks     = (double)psResult->lTotalBlocks;
+   const double rNsPerBlock = (double)psResult->lTotalNs / rBlocks;
+   const double rMBPerSec   = MD5_BLOCK_SIZE * 1000.0 / rNsPerBlock;
+   const BOOL fIpc          = psResult->afCounted[ COUNTER_CYCLES ] &&
+                              psResult->afCounted[ COUNTER_INSTRUCTIONS ] &&
+                              ( psResult->alCounts[ COUNTER_CYCLES ] != 0 );
+   const char* apacKeys[ NUM_COUNTERS ] =
+   {
+      "core_cycles_per_block", "instructions_per_block", "branch_misses_per_block",
+      "l1d_misses_per_block"
+   };
+   double rCyclesPerBlock   = (double)psResult->lMedianTicks / psResult->dwBlocks;
+   double rMinCyclesPerByte = (double)psResult->lMinTicks / psResult->dwBlocks / MD5_BLOCK_SIZE;
+   char acField[ 32 ];
+   UINT8 bCounter;
+
+   if( fJson )
+   {
+      printf( "%s    {\"engine\": \"%s\", \"blocks\": %lu, \"reps\": %lu, \"ns_per_block\": %.2f, "
+              "\"mb_per_s\": %.2f", ( dwNumResults != 0 ) ? ",\n" : "", psResult->pacEngine,
+              (unsigned long)psResult->dwBlocks, (unsigned long)psResult->dwReps, rNsPerBlock,
+              rMBPerSec );
+#if( BENCH_HAVE_TSC == 1 )
+      printf( ", \"cycles_per_byte_min\": %.3f, \"cycles_per_byte\": %.3f, "
+              "\"cycles_per_block\": %.1f",
+              rMinCyclesPerByte, rCyclesPerBlock / MD5_BLOCK_SIZE, rCyclesPerBlock );
+#endif
+      for( bCounter = 0; bCounter < NUM_COUNTERS; bCounter++ )
+      {
+         if( psResult->afCounted[ bCounter ] )
+         {
+            printf( ", \"%s\": %.2f", apacKeys[ bCounter ],
+                    (double)psResult->alCounts[ bCounter ] / rBlocks );
+         }
+      }
+
+      if( fIpc )
+      {
+         printf( ", \"ipc\": %.2f", (double)psResult->alCounts[ COUNTER_INSTRUCTIONS ] /
+                 (double)psResult->alCounts[ COUNTER_CYCLES ] );
+      }
+
+      printf( "}" );
+   }
+   else
+   {
+#if( BENCH_HAVE_TSC == 0 )
+      rCyclesPerBlock   = 0.0;
+      rMinCyclesPerByte = 0.0;
+#endif
+      printf( "%-8s %6lu %6lu %9.3f %9.3f %9.1f %9.1f %9.1f", psResult->pacEngine,
+              (unsigned long)psResult->dwBlocks, (unsigned long)psResult->dwReps, rMinCyclesPerByte,
+              rCyclesPerBlock / MD5_BLOCK_SIZE, rCyclesPerBlock, rNsPerBlock, rMBPerSec );
+
+      for( bCounter = COUNTER_INSTRUCTIONS; bCounter < NUM_COUNTERS; bCounter++ )
+      {
+         snprintf( acField, sizeof( acField ), "%.2f",
+                   (double)psResult->alCounts[ bCounter ] / rBlocks );
+         printf( " %9s", psResult->afCounted[ bCounter ] ? acField : "-" );
+      }
+
+      snprintf( acField, sizeof( acField ), "%.2f",
+                fIpc ? (double)psResult->alCounts[ COUNTER_INSTRUCTIONS ] /
+                          (double)psResult->alCounts[ COUNTER_CYCLES ] :
+                       0.0 );
+      printf( " %6s\n", fIpc ? acField : "-" );
+   }
+
+   dwNumResults++;
+   fflush( stdout );
+}
+
+/*----------------------------------------------------------------------------
+** Every block compression engine on hot data
+*-----------------------------------------------------------------------------
+*/
+static BOOL BenchKernels( void )
+{
+   static const KernelEngineType asEngines[] =
+   {
+      { "block",  RunBlockKernel },
+      { "update", RunUpdateKernel },
+      { "multi",  RunMultiKernel }
+   };
+   UINT8* pbBuffer = malloc( KERNEL_DATA_SIZE + BUFFER_ALIGNMENT );
+   KernelResultType sResult;
+   UINT16 iEngine;
+
+   if( pbBuffer == NULL )
+   {
+      return FALSE;
+   }
+
+   pbKernelData = pbBuffer + BUFFER_ALIGNMENT - ( (size_t)pbBuffer % BUFFER_ALIGNMENT );
+   FillPattern( pbKernelData, KERNEL_DATA_SIZE );
+   OpenCounters();
+
+   for( iEngine = 0; iEngine < sizeof( asEngines ) / sizeof( asEngines[ 0 ] ); iEngine++ )
+   {
+      if( MeasureKernel( &asEngines[ iEngine ], &sResult ) )
+      {
+         PrintKernelResult( &sResult );
+      }
+   }
+
+   CloseCounters();
+   free( pbBuffer );
+   pbKernelData = NULL;
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Print what the results depend on: the host and the run parameters
+*-----------------------------------------------------------------------------
+*/
+static void PrintHeader( void )
+{
+   struct utsname sHost;
+
+   if( uname( &sHost ) != 0 )
+   {
+      memset( &sHost, 0, sizeof( sHost ) );
+   }
+
+   if( fJson )
+   {
+      printf( "{\n"
+              "  \"tool\": \"md5bench\",\n"
+              "  \"host\": {\"sysname\": \"%s\", \"release\": \"%s\", \"machine\": \"%s\", "
+              "\"cpus\": %ld},\n"
+              "  \"min_reps\": %lu,\n"
+              "  \"min_time_ms\": %lu,\n"
+              "  \"%s\": [\n",
+              sHost.sysname, sHost.release, sHost.machine, sysconf( _SC_NPROCESSORS_ONLN ),
+              (unsigned long)dwMinReps, (unsigned long)dwMinTimeMs,
+              fKernels ? "kernels" : "results" );
+   }
+   else
+   {
+      printf( "%s %s %s, CPUs: %ld\n\n", sHost.sysname, sHost.release, sHost.machine,
+              sysconf( _SC_NPROCESSORS_ONLN ) );
+
+      if( fKernels )
+      {
+         printf( "%-8s %6s %6s %9s %9s %9s %9s %9s %9s %9s %9s %6s\n", "engine", "blocks", "reps",
+                 "min c/B", "cyc/B", "cyc/block", "ns/block", "MB/s", "instr/blk", "brmis/blk",
+                 "l1dmis/blk", "IPC" );
+         return;
+      }
+
+      printf( "%-12s %11s %6s %3s %6s %13s %13s %13s %10s\n", "case", "size", "chunk", "off",
+              "reps", "min ns", "median ns", "p99 ns", "MB/s" );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Close the JSON document
+*-----------------------------------------------------------------------------
+*/
+static void PrintFooter( void )
+{
+   if( fJson )
+   {
+      printf( "\n  ]\n}\n" );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Parse the command line
+*-----------------------------------------------------------------------------
+*/
+static BOOL ParseArguments( int argc, char* argv[] )
+{
+   int iArgument;
+
+   for( iArgument = 1; iArgument < argc; iArgument++ )
+   {
+      const char* pacArgument = argv[ iArgument ];
+      char* pacEnd;
+
+      if( strcmp( pacArgument, "--json" ) == 0 )
+      {
+         fJson = TRUE;
+      }
+      else if( strcmp( pacArgument, "--no-files" ) == 0 )
+      {
+         fFiles = FALSE;
+      }
+      else if( strcmp( pacArgument, "--kernels" ) == 0 )
+      {
+         fKernels = TRUE;
+      }
+      else if( iArgument + 1 == argc )
+      {
+         return FALSE;
+      }
+      else if( strcmp( pacArgument, "--max-size" ) == 0 )
+      {
+         lMaxSize = (UINT64)strtoul( argv[ ++iArgument ], &pacEnd, 0 ) << 20;
+
+         if( ( *pacEnd != '\0' ) || ( lMaxSize == 0 ) )
+         {
+            return FALSE;
+         }
+      }
+      else if( strcmp( pacArgument, "--reps" ) == 0 )
+      {
+         dwMinReps = (UINT32)strtoul( argv[ ++iArgument ], &pacEnd, 0 );
+
+         if( ( *pacEnd != '\0' ) || ( dwMinReps == 0 ) || ( dwMinReps > MAX_REPS ) )
+         {
+            return FALSE;
+         }
+      }
+      else if( strcmp( pacArgument, "--min-time" ) == 0 )
+      {
+         dwMinTimeMs = (UINT32)strtoul( argv[ ++iArgument ], &pacEnd, 0 );
+
+         if( *pacEnd != '\0' )
+         {
+            return FALSE;
+         }
+      }
+      else if( strcmp( pacArgument, "--dir" ) == 0 )
+      {
+         pacDir = argv[ ++iArgument ];
+      }
+      else
+      {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Print the usage
+*-----------------------------------------------------------------------------
+*/
+static void PrintHelp( void )
+{
+   printf( "MD5 Benchmark\n"
+           "\n"
+           "USAGE :\n"
+           "  md5bench [--json] [--max-size <MiB>] [--reps <n>] [--min-time <ms>]\n"
+           "           [--dir <directory> | --no-files]\n"
+           "  md5bench --kernels [--json] [--reps <n>] [--min-time <ms>]\n"
+           "\n"
+           "OPTIONS :\n"
+           "  --json             Print the results as a JSON document.\n"
+           "  --max-size <MiB>   Largest message and file size (default: %u MiB).\n"
+           "  --reps <n>         Least number of timed runs per case (default: %u).\n"
+           "  --min-time <ms>    Runs continue until a case took this long in total,\n"
+           "                     at most %u runs (default: %u ms).\n"
+           "  --dir <directory>  Directory of the file cases (default: $TMPDIR or\n"
+           "                     /tmp). The file system of the device to measure.\n"
+           "  --no-files         Only the memory cases.\n"
+           "  --kernels          Measure the block compression engines on hot data\n"
+           "                     instead: cycles per byte and block, and hardware\n"
+           "                     counters where perf_event_open() is permitted.\n"
+           "\n",
+           DEFAULT_MAX_SIZE_MIB, DEFAULT_MIN_REPS, MAX_REPS, DEFAULT_MIN_TIME_MS );
+}
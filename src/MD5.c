@@ -57,6 +57,11 @@
 #define MD5_AUX_H(x,y,z)      ( x ^ y ^ z )
 #define MD5_AUX_I(x,y,z)      ( y ^ ( x | ~z ) )
 
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/* Message of the tests of the API functions against MD5_Update() */
+#define MD5_TEST_MSG_SIZE     ( 5U * MD5_BLOCK_SIZE )
+#endif
+
 /*******************************************************************************
 ** Typedefs
 ********************************************************************************
@@ -122,6 +127,16 @@ static const MD5_TestStructType MD5_asTestCases[] =
        0xac, 0x49, 0xda, 0x2e, 0x21, 0x07, 0xb6, 0x7a } },
 };
 
+/*----------------------------------------------------------------------------
+** Message lengths (odd lengths, and lengths around the block size and the
+** padding limit) and split points of the tests that check the API functions
+** against a plain MD5_Init(), MD5_Update() and MD5_Final()
+**----------------------------------------------------------------------------
+*/
+static const UINT16 MD5_aiTestLengths[] =
+   { 0, 1, 3, 55, 56, 63, 64, 65, 119, 127, 128, 129, 200, 255 };
+static const UINT16 MD5_aiTestSplits[]  = { 0, 1, 63 };
+
 #if( MD5_USE_T_TABLE == 1 )
 /*----------------------------------------------------------------------------
 ** 'T' is defined as the binary integer part of the expression:
@@ -222,6 +237,13 @@ static UINT32 MD5_AUXILIARY_I( UINT32 adwBufferABCD[] );
 static UINT32 MD5_RotateLeft( UINT32 dwRegister, UINT8 bRotateCount );
 static UINT32 MD5_GetValueT( UINT8 bIndex );
 static void MD5_ProcessBlock( MD5_InstType* psInst );
+#if( MD5_USE_TEST_ROUTINE == 1 ) && ( MD5_USE_16BIT_CHAR == 0 )
+static void MD5_TestReference( const UINT8* pbMsg, UINT16 iMsgLen, MD5_InstType* psRef );
+static BOOL MD5_TestUpdateByteRun( void );
+static BOOL MD5_TestExportState( void );
+static BOOL MD5_TestPeek( void );
+static BOOL MD5_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
 
 /*******************************************************************************
 ** Private Services
@@ -477,27 +499,232 @@ static void MD5_ProcessBlock( MD5_InstType* psInst )
    }
 }
 
-#if( MD5_USE_TEST_ROUTINE == 1 )
+#if( MD5_USE_TEST_ROUTINE == 1 ) && ( MD5_USE_16BIT_CHAR == 0 )
 /*------------------------------------------------------------------------------
-** Routine to print to stdout the formated MD5 digest.
+** Computes the digest of a message with MD5_Init(), MD5_Update() and
+** MD5_Final(), the reference of the API function tests.
 **------------------------------------------------------------------------------
 ** Arguments:
-**    psInst  - Pointer to an instance containing the current state of the MD5
+**    pbMsg   - Message
+**    iMsgLen - Length of the message
+**    psRef   - Receives the finalized instance
 **
 ** Returns:
 **    None
 **------------------------------------------------------------------------------
 */
-static void MD5_Print( MD5_InstType* psInst )
+static void MD5_TestReference( const UINT8* pbMsg, UINT16 iMsgLen, MD5_InstType* psRef )
 {
-   UINT8 bDigestIndex;
+   MD5_Init( psRef );
+   MD5_Update( psRef, pbMsg, iMsgLen );
+   MD5_Final( psRef );
+}
 
-   for( bDigestIndex = 0; bDigestIndex < MD5_DIGEST_SIZE; bDigestIndex++ )
+/*------------------------------------------------------------------------------
+** Checks MD5_UpdateByteRun() for runs of every test length, following
+** data that leaves the working buffer empty, nearly empty or nearly full.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all digests match the reference
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TestUpdateByteRun( void )
+{
+   const UINT8 bValue = 0xA5;
+   UINT8 abMsg[ MD5_TEST_MSG_SIZE ];
+   MD5_InstType sInst;
+   MD5_InstType sRef;
+   UINT16 iIndex;
+   UINT8 bSplit;
+   UINT8 bLength;
+
+   for( bSplit = 0; bSplit < sizeof( MD5_aiTestSplits ) / sizeof( MD5_aiTestSplits[ 0 ] );
+        bSplit++ )
    {
-      MD5_PRINTF( "%02X ", ( (UINT8*)psInst->adwDigest )[ bDigestIndex ] );
+      UINT16 iPrefix = MD5_aiTestSplits[ bSplit ];
+
+      for( bLength = 0; bLength < sizeof( MD5_aiTestLengths ) / sizeof( MD5_aiTestLengths[ 0 ] );
+           bLength++ )
+      {
+         UINT16 iRun = MD5_aiTestLengths[ bLength ];
+
+         for( iIndex = 0; iIndex < iPrefix + iRun; iIndex++ )
+         {
+            abMsg[ iIndex ] = ( iIndex < iPrefix ) ? (UINT8)( iIndex * 7 + 1 ) : bValue;
+         }
+
+         MD5_TestReference( abMsg, iPrefix + iRun, &sRef );
+
+         MD5_Init( &sInst );
+         MD5_Update( &sInst, abMsg, iPrefix );
+         MD5_UpdateByteRun( &sInst, bValue, iRun );
+         MD5_Final( &sInst );
+
+         if( MD5_MEMCMP( sInst.adwDigest, sRef.adwDigest, MD5_DIGEST_SIZE ) != 0 )
+         {
+            return FALSE;
+         }
+      }
    }
+
+   return TRUE;
 }
-#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*------------------------------------------------------------------------------
+** Checks that a state exported after every test length and imported into an
+** instance that was in use continues like the original, and exports again
+** unchanged.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all digests match the reference
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TestExportState( void )
+{
+   UINT8 abMsg[ MD5_TEST_MSG_SIZE ];
+   UINT8 abState[ MD5_STATE_SIZE ];
+   UINT8 abStateAgain[ MD5_STATE_SIZE ];
+   MD5_InstType sInst;
+   MD5_InstType sRef;
+   UINT16 iIndex;
+   UINT8 bSplit;
+   UINT8 bLength;
+
+   for( iIndex = 0; iIndex < MD5_TEST_MSG_SIZE; iIndex++ )
+   {
+      abMsg[ iIndex ] = (UINT8)( iIndex * 7 + 1 );
+   }
+
+   for( bLength = 0; bLength < sizeof( MD5_aiTestLengths ) / sizeof( MD5_aiTestLengths[ 0 ] );
+        bLength++ )
+   {
+      UINT16 iPrefix = MD5_aiTestLengths[ bLength ];
+
+      for( bSplit = 0; bSplit < sizeof( MD5_aiTestSplits ) / sizeof( MD5_aiTestSplits[ 0 ] );
+           bSplit++ )
+      {
+         UINT16 iSuffix = MD5_aiTestSplits[ bSplit ];
+
+         MD5_TestReference( abMsg, iPrefix + iSuffix, &sRef );
+
+         MD5_Init( &sInst );
+         MD5_Update( &sInst, abMsg, iPrefix );
+         MD5_ExportState( &sInst, abState );
+
+         /* Leave data of another message in the instance the state replaces */
+         MD5_Init( &sInst );
+         MD5_Update( &sInst, &abMsg[ 1 ], 100 );
+         MD5_ImportState( &sInst, abState );
+         MD5_ExportState( &sInst, abStateAgain );
+
+         MD5_Update( &sInst, &abMsg[ iPrefix ], iSuffix );
+         MD5_Final( &sInst );
+
+         if( ( MD5_MEMCMP( abState, abStateAgain, MD5_STATE_SIZE ) != 0 ) ||
+             ( MD5_MEMCMP( sInst.adwDigest, sRef.adwDigest, MD5_DIGEST_SIZE ) != 0 ) )
+         {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Checks that MD5_Peek() after every test length gives the digest of the
+** data so far, and that updating the instance after the peek still gives
+** the digest of the whole message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all digests match the reference
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TestPeek( void )
+{
+   UINT8 abMsg[ MD5_TEST_MSG_SIZE ];
+   UINT8 abPeek[ MD5_DIGEST_SIZE ];
+   MD5_InstType sInst;
+   MD5_InstType sRef;
+   UINT16 iIndex;
+   UINT8 bSplit;
+   UINT8 bLength;
+
+   for( iIndex = 0; iIndex < MD5_TEST_MSG_SIZE; iIndex++ )
+   {
+      abMsg[ iIndex ] = (UINT8)( iIndex * 7 + 1 );
+   }
+
+   for( bLength = 0; bLength < sizeof( MD5_aiTestLengths ) / sizeof( MD5_aiTestLengths[ 0 ] );
+        bLength++ )
+   {
+      UINT16 iPrefix = MD5_aiTestLengths[ bLength ];
+
+      MD5_Init( &sInst );
+      MD5_Update( &sInst, abMsg, iPrefix );
+      MD5_Peek( &sInst, abPeek );
+
+      /* The peeked digest is in octets, adwDigest holds them little endian */
+      MD5_TestReference( abMsg, iPrefix, &sRef );
+
+      for( iIndex = 0; iIndex < MD5_DIGEST_SIZE; iIndex++ )
+      {
+         if( abPeek[ iIndex ] !=
+             (UINT8)( sRef.adwDigest[ iIndex >> 2 ] >> ( 8 * ( iIndex & 3 ) ) ) )
+         {
+            return FALSE;
+         }
+      }
+
+      for( bSplit = 0; bSplit < sizeof( MD5_aiTestSplits ) / sizeof( MD5_aiTestSplits[ 0 ] );
+           bSplit++ )
+      {
+         MD5_InstType sCont = sInst;
+         UINT16 iSuffix     = MD5_aiTestSplits[ bSplit ];
+
+         MD5_TestReference( abMsg, iPrefix + iSuffix, &sRef );
+
+         MD5_Update( &sCont, &abMsg[ iPrefix ], iSuffix );
+         MD5_Final( &sCont );
+
+         if( MD5_MEMCMP( sCont.adwDigest, sRef.adwDigest, MD5_DIGEST_SIZE ) != 0 )
+         {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Prints the result of an API function test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Number of the test
+**    pacName    - Function tested
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "TEST_%03d: %s\t: %s\n", bTestEntry, pacName, fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) && ( MD5_USE_16BIT_CHAR == 0 ) */
 
 /*******************************************************************************
 ** Public Services
@@ -595,6 +822,35 @@ void MD5_Update( MD5_InstType* psInst, const UINT8* pbData, UINT16 iDataLen )
    }
 }
 
+/*------------------------------------------------------------------------------
+** Equivalent to MD5_Update() for host applications that process buffers
+** larger than what can be expressed by MD5_Update()'s length argument.
+** The data is handed to MD5_Update() in UINT16-sized portions.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst    - Pointer to an instance containing the current state of the MD5
+**    pbData    - Pointer to data to be sent to the working buffer
+**    dwDataLen - Length of the supplied data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_UpdateLarge( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwDataLen )
+{
+   /* Multiple of the block size (and even, for 16-bit char targets) */
+   const UINT16 iMaxPortion = 0x8000;
+
+   while( dwDataLen > iMaxPortion )
+   {
+      MD5_Update( psInst, pbData, iMaxPortion );
+      pbData += iMaxPortion / bCharNumBytes;
+      dwDataLen -= iMaxPortion;
+   }
+
+   MD5_Update( psInst, pbData, (UINT16)dwDataLen );
+}
+
 /*------------------------------------------------------------------------------
 ** This routine provides a simple way to apply a constant value to a range of
 ** bytes to be processed by the MD5-unit.
@@ -649,6 +905,47 @@ void MD5_UpdateByte( MD5_InstType* psInst, const UINT8 bValue, UINT16 iCount )
    }
 }
 
+/*------------------------------------------------------------------------------
+** Equivalent to MD5_UpdateByte() for runs of any length, such as the holes
+** of a sparse file. The working buffer is filled with the value once and then
+** processed as often as the run covers whole blocks.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to an instance containing the current state of the MD5
+**    bValue  - Value to apply to the to the working buffer
+**    lCount  - Number of times to apply the value to the working buffer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_UpdateByteRun( MD5_InstType* psInst, const UINT8 bValue, UINT64 lCount )
+{
+   UINT8 bBytesLeftInBlock = ( MD5_BLOCK_SIZE - psInst->iBlockOffset ) % MD5_BLOCK_SIZE;
+
+   if( lCount < (UINT64)bBytesLeftInBlock + MD5_BLOCK_SIZE )
+   {
+      MD5_UpdateByte( psInst, bValue, (UINT16)lCount );
+      return;
+   }
+
+   /* Complete the current block, then fill (and process) a whole block */
+   MD5_UpdateByte( psInst, bValue, bBytesLeftInBlock );
+   MD5_UpdateByte( psInst, bValue, MD5_BLOCK_SIZE );
+   lCount -= (UINT64)bBytesLeftInBlock + MD5_BLOCK_SIZE;
+
+   /* Processing a block leaves its data untouched, so it is simply reused */
+   while( lCount >= MD5_BLOCK_SIZE )
+   {
+      psInst->iBlockOffset = MD5_BLOCK_SIZE;
+      psInst->lTotalByteSize += MD5_BLOCK_SIZE;
+      MD5_ProcessBlock( psInst );
+      lCount -= MD5_BLOCK_SIZE;
+   }
+
+   MD5_UpdateByte( psInst, bValue, (UINT16)lCount );
+}
+
 /*------------------------------------------------------------------------------
 ** This routine processes any remaining data in the working buffer
 ** thus providing the final state of the MD5 digest.
@@ -697,6 +994,33 @@ void MD5_Final( MD5_InstType* psInst )
    MD5_Update( psInst, (UINT8*)&lTotalBitSize, sizeof(lTotalBitSize) * bCharNumBytes );
 }
 
+/*------------------------------------------------------------------------------
+** Provides the digest of all data supplied so far without ending the stream:
+** a copy of the instance is finalized, the instance itself is left as it is
+** and can be updated further. Costs one or two block computations.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst   - Pointer to an instance containing the current state of the MD5
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE octets, one per element)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_Peek( const MD5_InstType* psInst, UINT8* pbDigest )
+{
+   MD5_InstType sCopy = *psInst;
+   UINT8 bIndex;
+
+   MD5_Final( &sCopy );
+
+   for( bIndex = 0; bIndex < MD5_DIGEST_SIZE; bIndex++ )
+   {
+      pbDigest[ bIndex ] =
+         (UINT8)( ( sCopy.adwDigest[ bIndex >> 2 ] >> ( 8 * ( bIndex & 3 ) ) ) & 0xFF );
+   }
+}
+
 /*------------------------------------------------------------------------------
 ** Routine to perform a single call to compute and finalize an MD5 digest.
 ** This also illustrates basic usage of the underlying routines that can be
@@ -718,6 +1042,110 @@ void MD5_Compute( MD5_InstType* psInst, const UINT8* pbMsg, UINT16 iMsgLen )
    MD5_Final( psInst );
 }
 
+/*------------------------------------------------------------------------------
+** Exports the intermediate state of an instance (between MD5_Init() and
+** MD5_Final()) so that hashing can be continued later, e.g. by another
+** process. The state is serialized little endian, one octet per element, and
+** does not depend on the configuration of the MD5-unit.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to an instance containing the current state of the MD5
+**    pbState - Receives the state (MD5_STATE_SIZE octets)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_ExportState( const MD5_InstType* psInst, UINT8* pbState )
+{
+   UINT8 bIndex;
+
+   for( bIndex = 0; bIndex < 8; bIndex++ )
+   {
+      *pbState++ = (UINT8)( ( psInst->lTotalByteSize >> ( 8 * bIndex ) ) & 0xFF );
+   }
+
+   for( bIndex = 0; bIndex < MD5_DIGEST_SIZE; bIndex++ )
+   {
+      *pbState++ = (UINT8)( ( psInst->adwDigest[ bIndex >> 2 ] >> ( 8 * ( bIndex & 3 ) ) ) & 0xFF );
+   }
+
+   /* The block words hold the data little endian, whatever the char size */
+   for( bIndex = 0; bIndex < MD5_BLOCK_SIZE; bIndex++ )
+   {
+      *pbState++ =
+         (UINT8)( ( psInst->uBlockBuffer.adw[ bIndex >> 2 ] >> ( 8 * ( bIndex & 3 ) ) ) & 0xFF );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Restores an instance from a state exported by MD5_ExportState(). The
+** instance then continues as if the data had been supplied to it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to the instance to restore
+**    pbState - Exported state (MD5_STATE_SIZE octets)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_ImportState( MD5_InstType* psInst, const UINT8* pbState )
+{
+   UINT8 bIndex;
+
+   psInst->lTotalByteSize = 0;
+
+   for( bIndex = 0; bIndex < 8; bIndex++ )
+   {
+      psInst->lTotalByteSize |= (UINT64)( *pbState++ & 0xFF ) << ( 8 * bIndex );
+   }
+
+   for( bIndex = 0; bIndex < MD5_DIGEST_SIZE_DWORDS; bIndex++ )
+   {
+      psInst->adwDigest[ bIndex ] = 0;
+   }
+
+   for( bIndex = 0; bIndex < MD5_DIGEST_SIZE; bIndex++ )
+   {
+      psInst->adwDigest[ bIndex >> 2 ] |= (UINT32)( *pbState++ & 0xFF ) << ( 8 * ( bIndex & 3 ) );
+   }
+
+   for( bIndex = 0; bIndex < ( MD5_BLOCK_SIZE >> 2 ); bIndex++ )
+   {
+      psInst->uBlockBuffer.adw[ bIndex ] = 0;
+   }
+
+   for( bIndex = 0; bIndex < MD5_BLOCK_SIZE; bIndex++ )
+   {
+      psInst->uBlockBuffer.adw[ bIndex >> 2 ] |=
+         (UINT32)( *pbState++ & 0xFF ) << ( 8 * ( bIndex & 3 ) );
+   }
+
+   /* Completed blocks are always processed, only a partial block is buffered */
+   psInst->iBlockOffset = (UINT16)( psInst->lTotalByteSize % MD5_BLOCK_SIZE );
+}
+
+/*------------------------------------------------------------------------------
+** Routine to print to stdout the formated MD5 digest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to an instance containing the current state of the MD5
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_Print( MD5_InstType* psInst )
+{
+   UINT8 bDigestIndex;
+
+   for( bDigestIndex = 0; bDigestIndex < MD5_DIGEST_SIZE; bDigestIndex++ )
+   {
+      MD5_PRINTF( "%02X ", ( (UINT8*)psInst->adwDigest )[ bDigestIndex ] );
+   }
+}
+
 #if( MD5_USE_TEST_ROUTINE == 1 )
 /*------------------------------------------------------------------------------
 ** Routine to perform a set of predefine tests to ensure that the algorithm
@@ -748,7 +1176,7 @@ BOOL MD5_RunTests( MD5_InstType* psInst )
       MD5_PORT_StrCpyToPackedImpl( &adwExpectedDigest, 0, &MD5_asTestCases[ bTestEntry ].abExpectedDigest, MD5_DIGEST_SIZE );
       if( MD5_MEMCMP( psInst->adwDigest, adwExpectedDigest, MD5_DIGEST_SIZE ) != 0 )
 #else
-      MD5_PRINTF( "TEST_%03d: MSG_SIZE = %ld\t: ", bTestEntry, (UINT32)strlen( acTestMsg ) );
+      MD5_PRINTF( "TEST_%03d: MSG_SIZE = %lu\t: ", bTestEntry, (unsigned long)strlen( acTestMsg ) );
 
       MD5_Compute( psInst, (UINT8*)acTestMsg, (UINT16)strlen( acTestMsg ) );
 
@@ -774,6 +1202,15 @@ BOOL MD5_RunTests( MD5_InstType* psInst )
       }
    }
 
+#if( MD5_USE_16BIT_CHAR == 0 )
+   /* The API functions against a plain MD5_Update() of the same message */
+   fAllPassed =
+      MD5_ReportTest( bTestEntry++, "MD5_UpdateByteRun", MD5_TestUpdateByteRun() ) && fAllPassed;
+   fAllPassed =
+      MD5_ReportTest( bTestEntry++, "MD5_ExportState", MD5_TestExportState() ) && fAllPassed;
+   fAllPassed = MD5_ReportTest( bTestEntry++, "MD5_Peek", MD5_TestPeek() ) && fAllPassed;
+#endif
+
    return fAllPassed;
 }
 #endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
@@ -27,6 +27,12 @@
 #define MD5_DIGEST_SIZE          ( 16U )
 #define MD5_DIGEST_SIZE_DWORDS   ( MD5_DIGEST_SIZE >> 2 )
 
+/*
+** Size of an exported state: the byte count, the chaining values and the
+** working buffer, in octets
+*/
+#define MD5_STATE_SIZE           ( 8U + MD5_DIGEST_SIZE + MD5_BLOCK_SIZE )
+
 /*******************************************************************************
 ** Typedefs
 ********************************************************************************
@@ -80,6 +86,22 @@ void MD5_Init( MD5_InstType* psInst );
 */
 void MD5_Update( MD5_InstType* psInst, const UINT8* pbData, UINT16 iDataLen );
 
+/*------------------------------------------------------------------------------
+** Equivalent to MD5_Update() for host applications that process buffers
+** larger than what can be expressed by MD5_Update()'s length argument.
+** The data is handed to MD5_Update() in UINT16-sized portions.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst    - Pointer to an instance containing the current state of the MD5
+**    pbData    - Pointer to data to be sent to the working buffer
+**    dwDataLen - Length of the supplied data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_UpdateLarge( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwDataLen );
+
 /*------------------------------------------------------------------------------
 ** This routine provides a simple way to apply a constant value to a range of
 ** bytes to be processed by the MD5-unit.
@@ -95,6 +117,21 @@ void MD5_Update( MD5_InstType* psInst, const UINT8* pbData, UINT16 iDataLen );
 */
 void MD5_UpdateByte( MD5_InstType* psInst, const UINT8 bValue, UINT16 iCount );
 
+/*------------------------------------------------------------------------------
+** Equivalent to MD5_UpdateByte() for runs of any length, such as the holes
+** of a sparse file. The working buffer is filled with the value once and then
+** processed as often as the run covers whole blocks.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to an instance containing the current state of the MD5
+**    bValue  - Value to apply to the to the working buffer
+**    lCount  - Number of times to apply the value to the working buffer
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_UpdateByteRun( MD5_InstType* psInst, const UINT8 bValue, UINT64 lCount );
+
 /*------------------------------------------------------------------------------
 ** This routine processes any remaining data in the working buffer
 ** thus providing the final state of the MD5 digest.
@@ -114,6 +151,21 @@ void MD5_UpdateByte( MD5_InstType* psInst, const UINT8 bValue, UINT16 iCount );
 */
 void MD5_Final( MD5_InstType* psInst );
 
+/*------------------------------------------------------------------------------
+** Provides the digest of all data supplied so far without ending the stream:
+** a copy of the instance is finalized, the instance itself is left as it is
+** and can be updated further. Costs one or two block computations.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst   - Pointer to an instance containing the current state of the MD5
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE octets, one per element)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_Peek( const MD5_InstType* psInst, UINT8* pbDigest );
+
 /*------------------------------------------------------------------------------
 ** Routine to perform a single call to compute and finalize an MD5 digest.
 ** This also illustrates basic usage of the underlying routines that can be
@@ -130,6 +182,36 @@ void MD5_Final( MD5_InstType* psInst );
 */
 void MD5_Compute( MD5_InstType* psInst, const UINT8* pbMsg, UINT16 iMsgLen );
 
+/*------------------------------------------------------------------------------
+** Exports the intermediate state of an instance (between MD5_Init() and
+** MD5_Final()) so that hashing can be continued later, e.g. by another
+** process. The state is serialized little endian, one octet per element, and
+** does not depend on the configuration of the MD5-unit.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to an instance containing the current state of the MD5
+**    pbState - Receives the state (MD5_STATE_SIZE octets)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_ExportState( const MD5_InstType* psInst, UINT8* pbState );
+
+/*------------------------------------------------------------------------------
+** Restores an instance from a state exported by MD5_ExportState(). The
+** instance then continues as if the data had been supplied to it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst  - Pointer to the instance to restore
+**    pbState - Exported state (MD5_STATE_SIZE octets)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_ImportState( MD5_InstType* psInst, const UINT8* pbState );
+
 #if( MD5_USE_TEST_ROUTINE == 1 )
 /*------------------------------------------------------------------------------
 ** Routine to perform a set of predefine tests to ensure that the algorithm
@@ -0,0 +1,471 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_cache.c
+**    Summary: Persistent digest cache. Lookups run on the read-only mapping
+**             of the cache file; new entries are collected in memory and
+**             merged with the mapped ones when the cache is saved.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_cache.h"
+#include "MD5_io.h"
+#include "MD5_port.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static int MD5_CACHE_CompareId( const MD5_CACHE_KeyType* psKey1, const MD5_CACHE_KeyType* psKey2 );
+static int MD5_CACHE_CompareEntries( const void* pxEntry1, const void* pxEntry2 );
+static BOOL MD5_CACHE_Write( FILE* psFile, const MD5_CACHE_EntryType* psEntry );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Orders keys by the file they identify (device and inode).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psKey1 - First key
+**    psKey2 - Second key
+**
+** Returns:
+**    int - <0, 0 or >0 like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_CACHE_CompareId( const MD5_CACHE_KeyType* psKey1, const MD5_CACHE_KeyType* psKey2 )
+{
+   if( psKey1->lDevice != psKey2->lDevice )
+   {
+      return ( psKey1->lDevice < psKey2->lDevice ) ? -1 : 1;
+   }
+
+   if( psKey1->lInode != psKey2->lInode )
+   {
+      return ( psKey1->lInode < psKey2->lInode ) ? -1 : 1;
+   }
+
+   return 0;
+}
+
+/*------------------------------------------------------------------------------
+** qsort() routine for the inserted entries.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxEntry1 - First entry
+**    pxEntry2 - Second entry
+**
+** Returns:
+**    int - <0, 0 or >0 like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_CACHE_CompareEntries( const void* pxEntry1, const void* pxEntry2 )
+{
+   return MD5_CACHE_CompareId( &( (const MD5_CACHE_EntryType*)pxEntry1 )->sKey,
+                               &( (const MD5_CACHE_EntryType*)pxEntry2 )->sKey );
+}
+
+/*------------------------------------------------------------------------------
+** Writes one entry to the new cache file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile  - New cache file
+**    psEntry - Entry to write
+**
+** Returns:
+**    BOOL - FALSE on a write error
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_CACHE_Write( FILE* psFile, const MD5_CACHE_EntryType* psEntry )
+{
+   return fwrite( psEntry, sizeof( MD5_CACHE_EntryType ), 1, psFile ) == 1;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Opens a cache file. A missing, truncated or foreign file is treated as an
+** empty cache that the next MD5_CACHE_Save() replaces.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache     - Cache to open
+**    pacFilename - Cache file
+**
+** Returns:
+**    BOOL - FALSE if an existing file could not be read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Open( MD5_CACHE_Type* psCache, const char* pacFilename )
+{
+   const MD5_CACHE_HeaderType* psHeader;
+   struct timespec sNow;
+   struct stat sStat;
+   int iFd;
+
+   memset( psCache, 0, sizeof( MD5_CACHE_Type ) );
+
+   clock_gettime( CLOCK_REALTIME, &sNow );
+   psCache->lRacyNs =
+      (UINT64)sNow.tv_sec * 1000000000ULL + (UINT64)sNow.tv_nsec - MD5_CACHE_RACY_NS;
+
+   iFd = open( pacFilename, O_RDONLY | O_CLOEXEC );
+
+   if( iFd < 0 )
+   {
+      if( errno != ENOENT )
+      {
+         return FALSE;
+      }
+
+      pthread_mutex_init( &psCache->sLock, NULL );
+      return TRUE;
+   }
+
+   if( fstat( iFd, &sStat ) != 0 )
+   {
+      close( iFd );
+      return FALSE;
+   }
+
+   if( (UINT64)sStat.st_size >= sizeof( MD5_CACHE_HeaderType ) )
+   {
+      psCache->pxMap = mmap( NULL, (size_t)sStat.st_size, PROT_READ, MAP_SHARED, iFd, 0 );
+
+      if( psCache->pxMap == MAP_FAILED )
+      {
+         psCache->pxMap = NULL;
+         close( iFd );
+         return FALSE;
+      }
+
+      psCache->iMapSize = (size_t)sStat.st_size;
+      psHeader          = (const MD5_CACHE_HeaderType*)psCache->pxMap;
+
+      if( ( memcmp( psHeader->acMagic, MD5_CACHE_MAGIC, sizeof( psHeader->acMagic ) ) == 0 ) &&
+          ( psHeader->dwVersion == MD5_CACHE_VERSION ) &&
+          ( psHeader->dwEntrySize == sizeof( MD5_CACHE_EntryType ) ) &&
+          ( psHeader->lNumEntries <= ( psCache->iMapSize - sizeof( MD5_CACHE_HeaderType ) ) /
+                                     sizeof( MD5_CACHE_EntryType ) ) )
+      {
+         psCache->asEntries   = (const MD5_CACHE_EntryType*)( psHeader + 1 );
+         psCache->lNumEntries = psHeader->lNumEntries;
+         psCache->abSeen      = calloc( (size_t)psCache->lNumEntries + 1, 1 );
+
+         if( psCache->abSeen == NULL )
+         {
+            munmap( psCache->pxMap, psCache->iMapSize );
+            psCache->pxMap       = NULL;
+            psCache->asEntries   = NULL;
+            psCache->lNumEntries = 0;
+            close( iFd );
+            errno = ENOMEM;
+            return FALSE;
+         }
+      }
+   }
+
+   close( iFd );
+   pthread_mutex_init( &psCache->sLock, NULL );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Releases a cache without saving it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache - Cache to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CACHE_Close( MD5_CACHE_Type* psCache )
+{
+   if( psCache->pxMap != NULL )
+   {
+      munmap( psCache->pxMap, psCache->iMapSize );
+   }
+
+   free( psCache->abSeen );
+   free( psCache->asNew );
+   pthread_mutex_destroy( &psCache->sLock );
+
+   psCache->pxMap       = NULL;
+   psCache->asEntries   = NULL;
+   psCache->lNumEntries = 0;
+   psCache->abSeen      = NULL;
+   psCache->asNew       = NULL;
+   psCache->lNumNew     = 0;
+   psCache->lNewAlloc   = 0;
+}
+
+/*------------------------------------------------------------------------------
+** Fills in the cache key of a file from its status.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psKey  - Key to fill in
+**    psStat - Status of the file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CACHE_KeyFromStat( MD5_CACHE_KeyType* psKey, const struct stat* psStat )
+{
+   psKey->lDevice  = (UINT64)psStat->st_dev;
+   psKey->lInode   = (UINT64)psStat->st_ino;
+   psKey->lSize    = (UINT64)psStat->st_size;
+   psKey->lMtimeNs =
+      (UINT64)psStat->st_mtim.tv_sec * 1000000000ULL + (UINT64)psStat->st_mtim.tv_nsec;
+   psKey->lCtimeNs =
+      (UINT64)psStat->st_ctim.tv_sec * 1000000000ULL + (UINT64)psStat->st_ctim.tv_nsec;
+}
+
+/*------------------------------------------------------------------------------
+** Looks up the digest of a file. May be called from several threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache  - Cache to search
+**    psKey    - Identity of the file
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - TRUE on a hit, FALSE if the file has to be hashed
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Lookup( MD5_CACHE_Type* psCache, const MD5_CACHE_KeyType* psKey, UINT8* pbDigest )
+{
+   const MD5_CACHE_EntryType* psEntry = NULL;
+   UINT64 lLow                        = 0;
+   UINT64 lHigh                       = psCache->lNumEntries;
+   BOOL fHit                          = FALSE;
+
+   while( lLow < lHigh )
+   {
+      UINT64 lMid = lLow + ( lHigh - lLow ) / 2;
+      int iOrder  = MD5_CACHE_CompareId( psKey, &psCache->asEntries[ lMid ].sKey );
+
+      if( iOrder == 0 )
+      {
+         psEntry = &psCache->asEntries[ lMid ];
+
+         /* The file still exists, MD5_CACHE_Save() keeps the entry when pruning */
+         MD5_PORT_AtomicStore( &psCache->abSeen[ lMid ], 1 );
+         break;
+      }
+
+      if( iOrder < 0 )
+      {
+         lHigh = lMid;
+      }
+      else
+      {
+         lLow = lMid + 1;
+      }
+   }
+
+   /* The same file, but not necessarily the same contents */
+   if( ( psEntry != NULL ) && ( psEntry->sKey.lSize == psKey->lSize ) &&
+       ( psEntry->sKey.lMtimeNs == psKey->lMtimeNs ) &&
+       ( psEntry->sKey.lCtimeNs == psKey->lCtimeNs ) )
+   {
+      memcpy( pbDigest, psEntry->abDigest, MD5_DIGEST_SIZE );
+      fHit = TRUE;
+   }
+
+   MD5_PORT_AtomicAdd( fHit ? &psCache->lNumHits : &psCache->lNumMisses, 1 );
+
+   return fHit;
+}
+
+/*------------------------------------------------------------------------------
+** Records the digest of a hashed file. May be called from several threads.
+** A file whose times are within MD5_CACHE_RACY_NS of the time the cache was
+** opened is not recorded: it may change again without its times changing.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache  - Cache to update
+**    psKey    - Identity of the file when it was hashed
+**    pbDigest - Digest of the file
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Insert( MD5_CACHE_Type* psCache, const MD5_CACHE_KeyType* psKey,
+                       const UINT8* pbDigest )
+{
+   BOOL fSuccess = TRUE;
+
+   if( ( psKey->lMtimeNs >= psCache->lRacyNs ) || ( psKey->lCtimeNs >= psCache->lRacyNs ) )
+   {
+      return TRUE;
+   }
+
+   pthread_mutex_lock( &psCache->sLock );
+
+   if( psCache->lNumNew == psCache->lNewAlloc )
+   {
+      UINT64 lNewAlloc             = ( psCache->lNewAlloc == 0 ) ? 1024 : psCache->lNewAlloc * 2;
+      MD5_CACHE_EntryType* asNew =
+         realloc( psCache->asNew, (size_t)lNewAlloc * sizeof( MD5_CACHE_EntryType ) );
+
+      if( asNew == NULL )
+      {
+         fSuccess = FALSE;
+      }
+      else
+      {
+         psCache->asNew     = asNew;
+         psCache->lNewAlloc = lNewAlloc;
+      }
+   }
+
+   if( fSuccess )
+   {
+      psCache->asNew[ psCache->lNumNew ].sKey = *psKey;
+      memcpy( psCache->asNew[ psCache->lNumNew ].abDigest, pbDigest, MD5_DIGEST_SIZE );
+      psCache->lNumNew++;
+   }
+
+   pthread_mutex_unlock( &psCache->sLock );
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Writes the cache with all recorded entries (replacing older entries of the
+** same files) and atomically replaces the cache file. With fPrune set, the
+** entries of files that were not looked up since the cache was opened are
+** dropped: the files were deleted, or weren't part of this scan.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache     - Cache to save
+**    pacFilename - Cache file
+**    fPrune      - Drop the entries of files that were not looked up
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Save( MD5_CACHE_Type* psCache, const char* pacFilename, BOOL fPrune )
+{
+   MD5_CACHE_HeaderType sHeader;
+   MD5_IO_ReplaceType sReplace;
+   UINT64 lOld   = 0;
+   UINT64 lNew   = 0;
+   BOOL fSuccess = TRUE;
+
+   psCache->lNumPruned = 0;
+
+   if( fPrune )
+   {
+      for( lOld = 0; lOld < psCache->lNumEntries; lOld++ )
+      {
+         psCache->lNumPruned += ( psCache->abSeen[ lOld ] == 0 ) ? 1 : 0;
+      }
+
+      lOld = 0;
+   }
+
+   if( ( psCache->lNumNew == 0 ) && ( psCache->lNumPruned == 0 ) )
+   {
+      /* Nothing changed, keep the file as it is */
+      return TRUE;
+   }
+
+   if( !MD5_IO_BeginReplace( &sReplace, pacFilename ) )
+   {
+      return FALSE;
+   }
+
+   qsort( psCache->asNew, (size_t)psCache->lNumNew, sizeof( MD5_CACHE_EntryType ),
+          MD5_CACHE_CompareEntries );
+
+   /* The header is rewritten with the final count once the entries are out */
+   memset( &sHeader, 0, sizeof( sHeader ) );
+   fSuccess = ( fwrite( &sHeader, sizeof( sHeader ), 1, sReplace.psFile ) == 1 );
+
+   while( fSuccess && ( ( lOld < psCache->lNumEntries ) || ( lNew < psCache->lNumNew ) ) )
+   {
+      int iOrder;
+
+      if( lOld == psCache->lNumEntries )
+      {
+         iOrder = 1;
+      }
+      else if( lNew == psCache->lNumNew )
+      {
+         iOrder = -1;
+      }
+      else
+      {
+         iOrder =
+            MD5_CACHE_CompareId( &psCache->asEntries[ lOld ].sKey, &psCache->asNew[ lNew ].sKey );
+      }
+
+      if( iOrder < 0 )
+      {
+         if( fPrune && ( psCache->abSeen[ lOld ] == 0 ) )
+         {
+            /* The file wasn't visited, it was deleted or is out of the scan */
+            lOld++;
+            continue;
+         }
+
+         fSuccess = MD5_CACHE_Write( sReplace.psFile, &psCache->asEntries[ lOld++ ] );
+         sHeader.lNumEntries++;
+         continue;
+      }
+
+      if( iOrder == 0 )
+      {
+         /* The file was rehashed, the old entry is stale */
+         lOld++;
+      }
+
+      /* A file recorded more than once (several links) is written once */
+      while( ( lNew + 1 < psCache->lNumNew ) &&
+             ( MD5_CACHE_CompareId( &psCache->asNew[ lNew ].sKey,
+                                    &psCache->asNew[ lNew + 1 ].sKey ) == 0 ) )
+      {
+         lNew++;
+      }
+
+      fSuccess = MD5_CACHE_Write( sReplace.psFile, &psCache->asNew[ lNew++ ] );
+      sHeader.lNumEntries++;
+   }
+
+   memcpy( sHeader.acMagic, MD5_CACHE_MAGIC, sizeof( sHeader.acMagic ) );
+   sHeader.dwVersion   = MD5_CACHE_VERSION;
+   sHeader.dwEntrySize = sizeof( MD5_CACHE_EntryType );
+
+   fSuccess = fSuccess && ( fseek( sReplace.psFile, 0, SEEK_SET ) == 0 ) &&
+              ( fwrite( &sHeader, sizeof( sHeader ), 1, sReplace.psFile ) == 1 );
+
+   return MD5_IO_CommitReplace( &sReplace, fSuccess );
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
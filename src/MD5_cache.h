@@ -0,0 +1,185 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_cache.h
+**    Summary: Persistent digest cache. Files are identified by device,
+**             inode, size, modification and status change time (ns); a file
+**             whose identity is unchanged since it was hashed is answered
+**             from the cache without being read.
+**
+**             File format (host byte order, not portable between hosts): a
+**             header followed by fixed size entries sorted by device and
+**             inode, so the file is used in place through mmap() and looked
+**             up with a binary search. Updates are written to a temporary
+**             file that is renamed over the old one, so readers always see
+**             either the old or the new cache.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_CACHE_H_
+#define HMS_SC_MD5_CACHE_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_CACHE_MAGIC                "MD5CACHE"
+#define MD5_CACHE_VERSION              ( 1U )
+
+/*
+** A file changed again within this time after it was stamped could still
+** carry the same times, so such files are not cached (see MD5_CACHE_Insert)
+*/
+#define MD5_CACHE_RACY_NS              ( 2000000000ULL )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_CACHE_Key
+{
+   UINT64 lDevice;
+   UINT64 lInode;
+   UINT64 lSize;
+   UINT64 lMtimeNs; /* Modification time, ns since the epoch */
+   UINT64 lCtimeNs; /* Status change time, ns since the epoch */
+} MD5_CACHE_KeyType;
+
+typedef struct MD5_CACHE_Entry
+{
+   MD5_CACHE_KeyType sKey;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_CACHE_EntryType;
+
+typedef struct MD5_CACHE_Header
+{
+   char acMagic[ 8 ];
+   UINT32 dwVersion;
+   UINT32 dwEntrySize; /* sizeof( MD5_CACHE_EntryType ), guards the layout */
+   UINT64 lNumEntries;
+} MD5_CACHE_HeaderType;
+
+typedef struct MD5_CACHE
+{
+   void* pxMap;                        /* Mapping of the cache file, or NULL */
+   size_t iMapSize;
+   const MD5_CACHE_EntryType* asEntries;
+   UINT64 lNumEntries;
+   UINT8* abSeen;                      /* Per mapped entry, set once its file is looked up */
+   MD5_CACHE_EntryType* asNew;         /* Inserted entries, protected by sLock */
+   UINT64 lNumNew;
+   UINT64 lNewAlloc;
+   UINT64 lRacyNs;                     /* Files changed after this aren't cached */
+   UINT64 lNumHits;                    /* Statistics, updated atomically */
+   UINT64 lNumMisses;
+   UINT64 lNumPruned;                  /* Entries dropped by the last pruning save */
+   pthread_mutex_t sLock;
+} MD5_CACHE_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Opens a cache file. A missing, truncated or foreign file is treated as an
+** empty cache that the next MD5_CACHE_Save() replaces.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache     - Cache to open
+**    pacFilename - Cache file
+**
+** Returns:
+**    BOOL - FALSE if an existing file could not be read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Open( MD5_CACHE_Type* psCache, const char* pacFilename );
+
+/*------------------------------------------------------------------------------
+** Releases a cache without saving it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache - Cache to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CACHE_Close( MD5_CACHE_Type* psCache );
+
+/*------------------------------------------------------------------------------
+** Fills in the cache key of a file from its status.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psKey  - Key to fill in
+**    psStat - Status of the file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CACHE_KeyFromStat( MD5_CACHE_KeyType* psKey, const struct stat* psStat );
+
+/*------------------------------------------------------------------------------
+** Looks up the digest of a file. May be called from several threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache  - Cache to search
+**    psKey    - Identity of the file
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - TRUE on a hit, FALSE if the file has to be hashed
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Lookup( MD5_CACHE_Type* psCache, const MD5_CACHE_KeyType* psKey, UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Records the digest of a hashed file. May be called from several threads.
+** A file whose times are within MD5_CACHE_RACY_NS of the time the cache was
+** opened is not recorded: it may change again without its times changing.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache  - Cache to update
+**    psKey    - Identity of the file when it was hashed
+**    pbDigest - Digest of the file
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Insert( MD5_CACHE_Type* psCache, const MD5_CACHE_KeyType* psKey,
+                       const UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Writes the cache with all recorded entries (replacing older entries of the
+** same files) and atomically replaces the cache file. With fPrune set, the
+** entries of files that were not looked up since the cache was opened are
+** dropped: the files were deleted, or weren't part of this scan.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCache     - Cache to save
+**    pacFilename - Cache file
+**    fPrune      - Drop the entries of files that were not looked up
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CACHE_Save( MD5_CACHE_Type* psCache, const char* pacFilename, BOOL fPrune );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_CACHE_H_ */
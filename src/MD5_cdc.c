@@ -0,0 +1,553 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_cdc.c
+**    Summary: Content-defined chunking. The gear hash shifts left by one bit
+**             per byte, so its top bits depend on the last 32 bytes; a chunk
+**             ends where the masked top bits are all zero. The first
+**             dwMinSize bytes of a chunk are skipped without hashing.
+**
+**             ieeexplore.ieee.org/document/9055082 (FastCDC)
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_cdc.h"
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/* Chunker of the tests, on a pseudo-random input of some dozen chunks */
+#define MD5_CDC_TEST_MIN_SIZE          ( 64U )
+#define MD5_CDC_TEST_AVG_SIZE          ( 256U )
+#define MD5_CDC_TEST_MAX_SIZE          ( 1024U )
+#define MD5_CDC_TEST_INPUT_SIZE        ( 4096U )
+#define MD5_CDC_TEST_MAX_CHUNKS        ( 32U )
+#endif
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** Chunks reported to MD5_CDC_TestChunk()
+*/
+typedef struct MD5_CDC_TestChunks
+{
+   UINT8 bNumChunks;
+   BOOL fError;                         /* Chunks not contiguous, or too many */
+   UINT32 adwEnd[ MD5_CDC_TEST_MAX_CHUNKS ];
+   UINT8 aabDigest[ MD5_CDC_TEST_MAX_CHUNKS ][ MD5_DIGEST_SIZE ];
+} MD5_CDC_TestChunksType;
+#endif
+
+/*----------------------------------------------------------------------------
+** Gear table, random values for each byte value. Entry 'i' is the first four
+** bytes (little endian) of the MD5 of the single byte 'i'.
+**----------------------------------------------------------------------------
+*/
+static const UINT32 MD5_CDC_adwGear[ 256 ] =
+{
+   0xad85b893, 0x0840a555, 0x588c689e, 0x35686686,
+   0x7b7e7fec, 0x78c1b68b, 0xb4a1ec06, 0x644ee789,
+   0x5b90bae2, 0x182a735e, 0xda29b368, 0xd9ffc813,
+   0x6295c858, 0x2fbeb9dc, 0x24b2ed4d, 0x1e6938d8,
+   0xfabd316b, 0x3b73ed47, 0x195644a8, 0x3e1de5ff,
+   0x2e1af415, 0x77e4a7f5, 0x816c6dbf, 0xfa14ff84,
+   0xcd1aa8cb, 0xb57feae5, 0xa143bebe, 0x3fc816f6,
+   0x09b49803, 0xdb9e25eb, 0x072ac77b, 0xce411ead,
+   0x9cee1572, 0xe3e03390, 0xf13558b1, 0x75fcab01,
+   0xd67de9c3, 0xc4f9ce0b, 0x7804ff6c, 0x8acb9035,
+   0x7304c484, 0xa2d77193, 0xe3da8933, 0x2572b126,
+   0x0f5fcbc0, 0xbc5e6d33, 0xaff15850, 0x76cd6666,
+   0x8420cdcf, 0x3842cac4, 0x8d721ec8, 0x7ec8cbec,
+   0x79f67fa8, 0x7f3bdae4, 0x1c097916, 0x5fe4148f,
+   0x95f8f0c9, 0xce8cc445, 0x0fe93a85, 0xdbb7ec9e,
+   0x78504a52, 0x5d3eec43, 0xa08ddfce, 0x727b45d1,
+   0x95d28e51, 0x7062c57f, 0x78d65e9d, 0x37f8610d,
+   0x5ae723f6, 0x0ca03e3a, 0x94180680, 0xd028cfdf,
+   0x0ff5d9c1, 0x793675dd, 0x0a5744ff, 0xa1c6f3a5,
+   0xc3ae0cd2, 0x7b1c6969, 0x7c309c8d, 0x772186f1,
+   0xdb9ec244, 0xc96495f0, 0xd4d3e1e1, 0xdc98bc5d,
+   0x8ce1ecb9, 0x6043614c, 0x0a560652, 0x6ec0e961,
+   0xb89b1202, 0x13c4ce57, 0x95e5c221, 0x26175481,
+   0xe897d328, 0x7617bd0f, 0xfe2a6a7e, 0x807b4ab1,
+   0xd5443383, 0xb975c10c, 0xfe5feb92, 0xf0088a4a,
+   0x91e07782, 0x971767e1, 0xdd4ca18f, 0x47fff5b2,
+   0x90c31025, 0x0b0c5c86, 0x2c123b36, 0x6bb1e48c,
+   0x8e5eb92d, 0x71578f6f, 0x5a968b7b, 0x757956d9,
+   0x918c8783, 0xa6f49476, 0xaeb0434b, 0xacc0c703,
+   0xa4ef58e3, 0xff4e777b, 0xd169369e, 0x860129f1,
+   0x61e4d49d, 0x76905241, 0xe3e9adfb, 0xfd705bf9,
+   0xbc3498b9, 0xdd84b1cb, 0x171f764c, 0xe6b6ac83,
+   0x7edd398d, 0x1f0425cd, 0x8dec2e59, 0x0458d805,
+   0x731d63ec, 0xe52039a0, 0xd0a5abdc, 0x8737ec8f,
+   0x46634476, 0x2f275428, 0x3785941d, 0xe9d98d34,
+   0xa05b7797, 0x09de87cf, 0xba3a66f1, 0x9601b432,
+   0x1bbf9abc, 0x02224140, 0x0a595d68, 0xbaa25a5c,
+   0x9faaa89d, 0x74a18a75, 0x4637c73c, 0x80b544c4,
+   0x7cb01647, 0xf6604a6d, 0xae9b3a6d, 0x88463fb6,
+   0x7d9ad573, 0x836d470a, 0xb7c0f5ce, 0xdccc5edc,
+   0x17c1f79a, 0xd4f88773, 0x2bd7df4f, 0x07ca27d5,
+   0x386f7cf3, 0x56f83aab, 0x76a16760, 0xfe982b6b,
+   0x5d6aa485, 0xc8c252a2, 0x24f7e09f, 0x11ad0824,
+   0x0ff3a720, 0xf09ceb3b, 0x2235cb02, 0x2e71d900,
+   0x6d5b65ec, 0x4d5368c6, 0x79ae4199, 0x092187ec,
+   0x6e3a7313, 0x1e35f050, 0x000c63da, 0xa665e6da,
+   0xf005d36a, 0x57e261f3, 0x25afc16b, 0xa84284d6,
+   0x76e3cd4d, 0xcb57aeab, 0x7587bbb2, 0x6ea8e4d6,
+   0x86a44348, 0x96b34a19, 0xd1da6564, 0xf57682d7,
+   0x5dced0ff, 0xaa531fec, 0x8b9064f6, 0xfd13dc56,
+   0x5da8e399, 0xdb16b052, 0xdbe7b1ce, 0x95dbf8ad,
+   0xf170e9a2, 0xa82acfe6, 0x045ba9bd, 0x74d81255,
+   0x555a2c8f, 0x95541ead, 0x6d10af6b, 0x98403f7a,
+   0x202d4a99, 0x01d5a3d1, 0xa2755e73, 0x29800b7c,
+   0xf8ae780c, 0x1fd46eae, 0xf615c367, 0xd700fd98,
+   0xbe246ab9, 0xfd675331, 0xcb90b9af, 0x928567a2,
+   0x02112dec, 0x37e4ec2e, 0xb2d91fd8, 0x30a7b769,
+   0x55cc5bc1, 0x61332073, 0x3a1a5531, 0x3e275a9d,
+   0x2b515d78, 0x76870634, 0x697f2786, 0xfaf195ab,
+   0xf2867b16, 0x291ffc26, 0x746212fc, 0x9e077525,
+   0x433a498c, 0x3607b9ed, 0xd405947a, 0xaec23463,
+   0x4cdda697, 0xdca0e7ad, 0x0bc5f244, 0x84a63219,
+   0x35167431, 0x50fcde89, 0xeacf0189, 0xaad18fea,
+   0xe3ec0ecf, 0x384f56da, 0x91e03a40, 0xd44f5900
+};
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static UINT32 MD5_CDC_TopBitsMask( UINT8 bNumBits );
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static void MD5_CDC_TestChunk( UINT64 lOffset, UINT32 dwLength, const UINT8* pbDigest,
+                               void* pxCtx );
+static void MD5_CDC_TestChunkAll( const UINT8* pbData, UINT32 dwPieceSize,
+                                  MD5_CDC_TestChunksType* psChunks );
+static BOOL MD5_CDC_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns a mask of the upper bNumBits bits of a 32-bit word.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bNumBits - Number of bits (1..31)
+**
+** Returns:
+**    UINT32 - Mask
+**------------------------------------------------------------------------------
+*/
+static UINT32 MD5_CDC_TopBitsMask( UINT8 bNumBits )
+{
+   return ~( (UINT32)0xFFFFFFFF >> bNumBits );
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Records a chunk of the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lOffset  - Stream offset of the chunk
+**    dwLength - Length of the chunk in bytes
+**    pbDigest - Digest of the chunk
+**    pxCtx    - MD5_CDC_TestChunksType receiving the chunk
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_CDC_TestChunk( UINT64 lOffset, UINT32 dwLength, const UINT8* pbDigest,
+                               void* pxCtx )
+{
+   MD5_CDC_TestChunksType* psChunks = (MD5_CDC_TestChunksType*)pxCtx;
+   UINT32 dwStart                   = 0;
+
+   if( psChunks->bNumChunks > 0 )
+   {
+      dwStart = psChunks->adwEnd[ psChunks->bNumChunks - 1 ];
+   }
+
+   if( ( psChunks->bNumChunks == MD5_CDC_TEST_MAX_CHUNKS ) || ( lOffset != dwStart ) )
+   {
+      psChunks->fError = TRUE;
+      return;
+   }
+
+   psChunks->adwEnd[ psChunks->bNumChunks ] = dwStart + dwLength;
+   memcpy( psChunks->aabDigest[ psChunks->bNumChunks ], pbDigest, MD5_DIGEST_SIZE );
+   psChunks->bNumChunks++;
+}
+
+/*------------------------------------------------------------------------------
+** Chunks the test input, supplied in pieces of a given size.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbData      - Input (MD5_CDC_TEST_INPUT_SIZE bytes)
+**    dwPieceSize - Size of the pieces in bytes
+**    psChunks    - Receives the chunks
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_CDC_TestChunkAll( const UINT8* pbData, UINT32 dwPieceSize,
+                                  MD5_CDC_TestChunksType* psChunks )
+{
+   MD5_CDC_Type sCdc;
+   UINT32 dwDone;
+
+   /* Cleared in full, as the tests compare whole chunk records */
+   memset( psChunks, 0, sizeof( MD5_CDC_TestChunksType ) );
+
+   MD5_CDC_Init( &sCdc, MD5_CDC_TEST_MIN_SIZE, MD5_CDC_TEST_AVG_SIZE, MD5_CDC_TEST_MAX_SIZE );
+
+   for( dwDone = 0; dwDone < MD5_CDC_TEST_INPUT_SIZE; dwDone += dwPieceSize )
+   {
+      UINT32 dwLength = MD5_CDC_TEST_INPUT_SIZE - dwDone;
+
+      if( dwLength > dwPieceSize )
+      {
+         dwLength = dwPieceSize;
+      }
+
+      MD5_CDC_Update( &sCdc, &pbData[ dwDone ], dwLength, MD5_CDC_TestChunk, psChunks );
+   }
+
+   MD5_CDC_Final( &sCdc, MD5_CDC_TestChunk, psChunks );
+}
+
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Test number
+**    pacName    - Test name
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_CDC_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "CDC_TEST_%03d: %s\t: %s\n", bTestEntry, pacName, fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a chunker for a new stream.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker to initialize
+**    dwMinSize - Minimum chunk size (at least MD5_CDC_MIN_CHUNK_SIZE)
+**    dwAvgSize - Average chunk size, a power of two
+**    dwMaxSize - Maximum chunk size (at most MD5_CDC_MAX_CHUNK_SIZE)
+**
+** Returns:
+**    BOOL - FALSE if the sizes aren't min <= avg <= max within the limits
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_Init( MD5_CDC_Type* psCdc, UINT32 dwMinSize, UINT32 dwAvgSize, UINT32 dwMaxSize )
+{
+   UINT8 bAvgBits = 0;
+
+   if( ( dwMinSize < MD5_CDC_MIN_CHUNK_SIZE ) || ( dwMinSize > dwAvgSize ) ||
+       ( dwAvgSize > dwMaxSize ) || ( dwMaxSize > MD5_CDC_MAX_CHUNK_SIZE ) ||
+       ( ( dwAvgSize & ( dwAvgSize - 1 ) ) != 0 ) )
+   {
+      return FALSE;
+   }
+
+   while( ( (UINT32)1 << bAvgBits ) < dwAvgSize )
+   {
+      bAvgBits++;
+   }
+
+   /*
+   ** Normalized chunking: boundaries are harder to hit before the average
+   ** size and easier after it, which narrows the chunk size distribution
+   */
+   psCdc->dwMinSize    = dwMinSize;
+   psCdc->dwAvgSize    = dwAvgSize;
+   psCdc->dwMaxSize    = dwMaxSize;
+   psCdc->dwMaskSmall  = MD5_CDC_TopBitsMask( bAvgBits + 1 );
+   psCdc->dwMaskLarge  = MD5_CDC_TopBitsMask( bAvgBits - 1 );
+   psCdc->dwHash       = 0;
+   psCdc->dwChunkLen   = 0;
+   psCdc->lChunkOffset = 0;
+
+   MD5_Init( &psCdc->sInst );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Scans data for the end of the current chunk without hashing it. When a
+** boundary is found the chunker moves on to the next chunk, the remaining
+** data has to be scanned with another call.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker
+**    pbData    - Data following the previously scanned data
+**    dwDataLen - Length of the data in bytes
+**    pdwUsed   - Receives the number of bytes that belong to the current
+**                chunk
+**
+** Returns:
+**    BOOL - TRUE if the current chunk ends after *pdwUsed bytes
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_Scan( MD5_CDC_Type* psCdc, const UINT8* pbData, UINT32 dwDataLen, UINT32* pdwUsed )
+{
+   UINT32 dwHash     = psCdc->dwHash;
+   UINT32 dwChunkLen = psCdc->dwChunkLen;
+   UINT32 dwPos      = 0;
+   BOOL fBoundary    = FALSE;
+
+   /* No boundary can occur before the minimum size, skip it unhashed */
+   if( dwChunkLen < psCdc->dwMinSize )
+   {
+      dwPos = psCdc->dwMinSize - dwChunkLen;
+
+      if( dwPos > dwDataLen )
+      {
+         dwPos = dwDataLen;
+      }
+
+      dwChunkLen += dwPos;
+   }
+
+   while( !fBoundary && ( dwPos < dwDataLen ) && ( dwChunkLen < psCdc->dwAvgSize ) )
+   {
+      dwHash    = ( dwHash << 1 ) + MD5_CDC_adwGear[ pbData[ dwPos++ ] ];
+      fBoundary = ( ( dwHash & psCdc->dwMaskSmall ) == 0 );
+      dwChunkLen++;
+   }
+
+   while( !fBoundary && ( dwPos < dwDataLen ) && ( dwChunkLen < psCdc->dwMaxSize ) )
+   {
+      dwHash    = ( dwHash << 1 ) + MD5_CDC_adwGear[ pbData[ dwPos++ ] ];
+      fBoundary = ( ( dwHash & psCdc->dwMaskLarge ) == 0 );
+      dwChunkLen++;
+   }
+
+   *pdwUsed = dwPos;
+
+   if( fBoundary || ( dwChunkLen >= psCdc->dwMaxSize ) )
+   {
+      psCdc->lChunkOffset += dwChunkLen;
+      psCdc->dwHash        = 0;
+      psCdc->dwChunkLen    = 0;
+
+      return TRUE;
+   }
+
+   psCdc->dwHash     = dwHash;
+   psCdc->dwChunkLen = dwChunkLen;
+
+   return FALSE;
+}
+
+/*------------------------------------------------------------------------------
+** Splits data into chunks and hashes them in one pass. Completed chunks are
+** reported through pnChunk, the last chunk stays open for the next call.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker
+**    pbData    - Data following the previously supplied data
+**    dwDataLen - Length of the data in bytes
+**    pnChunk   - Called for every completed chunk
+**    pxCtx     - Context handed to pnChunk
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CDC_Update( MD5_CDC_Type* psCdc, const UINT8* pbData, UINT32 dwDataLen,
+                     MD5_CDC_ChunkFunc pnChunk, void* pxCtx )
+{
+   while( dwDataLen > 0 )
+   {
+      UINT64 lChunkOffset = psCdc->lChunkOffset;
+      UINT32 dwChunkLen   = psCdc->dwChunkLen;
+      UINT32 dwUsed;
+      BOOL fBoundary      = MD5_CDC_Scan( psCdc, pbData, dwDataLen, &dwUsed );
+
+      /* The scanned bytes are still in the cache, hash them right away */
+      MD5_UpdateLarge( &psCdc->sInst, pbData, dwUsed );
+
+      if( fBoundary )
+      {
+         MD5_Final( &psCdc->sInst );
+         pnChunk( lChunkOffset, dwChunkLen + dwUsed, (const UINT8*)psCdc->sInst.adwDigest, pxCtx );
+         MD5_Init( &psCdc->sInst );
+      }
+
+      pbData += dwUsed;
+      dwDataLen -= dwUsed;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Ends the stream, reporting the last chunk (if not empty).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc   - Chunker
+**    pnChunk - Called for the last chunk
+**    pxCtx   - Context handed to pnChunk
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CDC_Final( MD5_CDC_Type* psCdc, MD5_CDC_ChunkFunc pnChunk, void* pxCtx )
+{
+   if( psCdc->dwChunkLen > 0 )
+   {
+      MD5_Final( &psCdc->sInst );
+      pnChunk( psCdc->lChunkOffset, psCdc->dwChunkLen, (const UINT8*)psCdc->sInst.adwDigest,
+               pxCtx );
+      MD5_Init( &psCdc->sInst );
+
+      psCdc->lChunkOffset += psCdc->dwChunkLen;
+      psCdc->dwHash        = 0;
+      psCdc->dwChunkLen    = 0;
+   }
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the gear table against its definition, the chunk boundaries of a
+** pseudo-random input against known cut points, that the boundaries and
+** digests don't depend on how the input is split into pieces, that
+** MD5_CDC_Scan() alone finds the same boundaries and that an input without
+** boundaries is cut at the maximum size.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_RunTests( void )
+{
+   /* Chunk ends of the test input */
+   static const UINT32 adwCutPoints[] =
+   {
+      205, 538, 777, 1297, 1559, 1923, 1993, 2370, 2731, 2933, 3176, 3319, 3736, 3885, 4096
+   };
+
+   UINT8 abInput[ MD5_CDC_TEST_INPUT_SIZE ];
+   MD5_CDC_TestChunksType sChunks;
+   MD5_CDC_TestChunksType sSplit;
+   BOOL fAllPassed = TRUE;
+   BOOL fPassed    = TRUE;
+   MD5_InstType sInst;
+   MD5_CDC_Type sCdc;
+   UINT32 dwSeed   = 1;
+   UINT32 dwPos;
+   UINT16 iByte;
+   UINT8 bChunk;
+
+   /* Entry 'i' of the gear table is the start of the MD5 of the byte 'i' */
+   for( iByte = 0; iByte < 256; iByte++ )
+   {
+      UINT8 bByte = (UINT8)iByte;
+
+      MD5_Compute( &sInst, &bByte, 1 );
+      fPassed = fPassed && ( sInst.adwDigest[ 0 ] == MD5_CDC_adwGear[ iByte ] );
+   }
+
+   fAllPassed = MD5_CDC_ReportTest( 0, "GEAR TABLE", fPassed ) && fAllPassed;
+
+   for( dwPos = 0; dwPos < MD5_CDC_TEST_INPUT_SIZE; dwPos++ )
+   {
+      dwSeed           = dwSeed * 1103515245U + 12345U;
+      abInput[ dwPos ] = (UINT8)( dwSeed >> 24 );
+   }
+
+   MD5_CDC_TestChunkAll( abInput, MD5_CDC_TEST_INPUT_SIZE, &sChunks );
+
+   fPassed = !sChunks.fError &&
+             ( sChunks.bNumChunks == sizeof( adwCutPoints ) / sizeof( adwCutPoints[ 0 ] ) ) &&
+             ( memcmp( sChunks.adwEnd, adwCutPoints, sizeof( adwCutPoints ) ) == 0 );
+
+   for( bChunk = 0; fPassed && ( bChunk < sChunks.bNumChunks ); bChunk++ )
+   {
+      UINT32 dwStart = ( bChunk == 0 ) ? 0 : sChunks.adwEnd[ bChunk - 1 ];
+
+      MD5_Compute( &sInst, &abInput[ dwStart ], (UINT16)( sChunks.adwEnd[ bChunk ] - dwStart ) );
+      fPassed = ( memcmp( sChunks.aabDigest[ bChunk ], sInst.adwDigest, MD5_DIGEST_SIZE ) == 0 );
+   }
+
+   fAllPassed = MD5_CDC_ReportTest( 1, "CUT POINTS", fPassed ) && fAllPassed;
+
+   /* Pieces smaller than a gear window and pieces that end within the minimum size */
+   MD5_CDC_TestChunkAll( abInput, 7, &sSplit );
+   fPassed = !sSplit.fError && ( memcmp( &sSplit, &sChunks, sizeof( sChunks ) ) == 0 );
+   MD5_CDC_TestChunkAll( abInput, MD5_CDC_TEST_MIN_SIZE + 33, &sSplit );
+   fPassed = fPassed && !sSplit.fError && ( memcmp( &sSplit, &sChunks, sizeof( sChunks ) ) == 0 );
+
+   fAllPassed = MD5_CDC_ReportTest( 2, "SPLIT INPUT", fPassed ) && fAllPassed;
+
+   /* The boundaries alone */
+   MD5_CDC_Init( &sCdc, MD5_CDC_TEST_MIN_SIZE, MD5_CDC_TEST_AVG_SIZE, MD5_CDC_TEST_MAX_SIZE );
+   fPassed = TRUE;
+   dwPos   = 0;
+
+   for( bChunk = 0; fPassed && ( bChunk < sChunks.bNumChunks - 1 ); bChunk++ )
+   {
+      UINT32 dwUsed;
+
+      fPassed =
+         MD5_CDC_Scan( &sCdc, &abInput[ dwPos ], MD5_CDC_TEST_INPUT_SIZE - dwPos, &dwUsed ) &&
+         ( dwPos + dwUsed == sChunks.adwEnd[ bChunk ] );
+      dwPos += dwUsed;
+   }
+
+   fAllPassed = MD5_CDC_ReportTest( 3, "SCAN", fPassed ) && fAllPassed;
+
+   /* An input without boundaries is cut at the maximum size */
+   memset( abInput, 0, sizeof( abInput ) );
+   MD5_CDC_TestChunkAll( abInput, MD5_CDC_TEST_INPUT_SIZE, &sChunks );
+   fPassed = !sChunks.fError &&
+             ( sChunks.bNumChunks == MD5_CDC_TEST_INPUT_SIZE / MD5_CDC_TEST_MAX_SIZE );
+
+   for( bChunk = 0; fPassed && ( bChunk < sChunks.bNumChunks ); bChunk++ )
+   {
+      fPassed = ( sChunks.adwEnd[ bChunk ] == ( bChunk + 1U ) * MD5_CDC_TEST_MAX_SIZE );
+   }
+
+   fAllPassed = MD5_CDC_ReportTest( 4, "MAX SIZE", fPassed ) && fAllPassed;
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
@@ -0,0 +1,148 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_cdc.h
+**    Summary: Content-defined chunking with a per-chunk MD5. Chunk boundaries
+**             are found with a gear rolling hash (FastCDC style, with
+**             normalized chunking between a minimum, average and maximum
+**             chunk size), so an insertion only changes the chunks around
+**             it. MD5_CDC_Update() hashes every chunk in the same pass that
+**             finds its end, while the data is still in the cache;
+**             MD5_CDC_Scan() finds the boundaries alone for callers that
+**             hash the chunks elsewhere.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_CDC_H_
+#define HMS_SC_MD5_CDC_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_CDC_MIN_CHUNK_SIZE         ( 64U )
+#define MD5_CDC_MAX_CHUNK_SIZE         ( 64U * 1024U * 1024U )
+
+#define MD5_CDC_DEFAULT_MIN_SIZE       ( 2U * 1024U )
+#define MD5_CDC_DEFAULT_AVG_SIZE       ( 8U * 1024U )
+#define MD5_CDC_DEFAULT_MAX_SIZE       ( 64U * 1024U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Called for every completed chunk, in stream order.
+*/
+typedef void ( *MD5_CDC_ChunkFunc )( UINT64 lOffset, UINT32 dwLength, const UINT8* pbDigest,
+                                     void* pxCtx );
+
+typedef struct MD5_CDC
+{
+   UINT32 dwMinSize;
+   UINT32 dwAvgSize;
+   UINT32 dwMaxSize;
+   UINT32 dwMaskSmall;  /* Boundary mask below the average size (more bits) */
+   UINT32 dwMaskLarge;  /* Boundary mask above the average size (fewer bits) */
+   UINT32 dwHash;       /* Rolling hash of the current chunk */
+   UINT32 dwChunkLen;   /* Bytes of the current chunk scanned so far */
+   UINT64 lChunkOffset; /* Stream offset of the current chunk */
+   MD5_InstType sInst;  /* Digest of the current chunk (MD5_CDC_Update) */
+} MD5_CDC_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a chunker for a new stream.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker to initialize
+**    dwMinSize - Minimum chunk size (at least MD5_CDC_MIN_CHUNK_SIZE)
+**    dwAvgSize - Average chunk size, a power of two
+**    dwMaxSize - Maximum chunk size (at most MD5_CDC_MAX_CHUNK_SIZE)
+**
+** Returns:
+**    BOOL - FALSE if the sizes aren't min <= avg <= max within the limits
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_Init( MD5_CDC_Type* psCdc, UINT32 dwMinSize, UINT32 dwAvgSize, UINT32 dwMaxSize );
+
+/*------------------------------------------------------------------------------
+** Scans data for the end of the current chunk without hashing it. When a
+** boundary is found the chunker moves on to the next chunk, the remaining
+** data has to be scanned with another call.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker
+**    pbData    - Data following the previously scanned data
+**    dwDataLen - Length of the data in bytes
+**    pdwUsed   - Receives the number of bytes that belong to the current
+**                chunk
+**
+** Returns:
+**    BOOL - TRUE if the current chunk ends after *pdwUsed bytes
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_Scan( MD5_CDC_Type* psCdc, const UINT8* pbData, UINT32 dwDataLen, UINT32* pdwUsed );
+
+/*------------------------------------------------------------------------------
+** Splits data into chunks and hashes them in one pass. Completed chunks are
+** reported through pnChunk, the last chunk stays open for the next call.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc     - Chunker
+**    pbData    - Data following the previously supplied data
+**    dwDataLen - Length of the data in bytes
+**    pnChunk   - Called for every completed chunk
+**    pxCtx     - Context handed to pnChunk
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CDC_Update( MD5_CDC_Type* psCdc, const UINT8* pbData, UINT32 dwDataLen,
+                     MD5_CDC_ChunkFunc pnChunk, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Ends the stream, reporting the last chunk (if not empty).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCdc   - Chunker
+**    pnChunk - Called for the last chunk
+**    pxCtx   - Context handed to pnChunk
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_CDC_Final( MD5_CDC_Type* psCdc, MD5_CDC_ChunkFunc pnChunk, void* pxCtx );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the gear table against its definition, the chunk boundaries of a
+** pseudo-random input against known cut points, that the boundaries and
+** digests don't depend on how the input is split into pieces, that
+** MD5_CDC_Scan() alone finds the same boundaries and that an input without
+** boundaries is cut at the maximum size.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_CDC_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_CDC_H_ */
@@ -48,4 +48,15 @@
 */
 #define MD5_USE_TEST_ROUTINE        ( 1 )
 
+/*
+** Enable/disable the POSIX host services (thread pool, directory walker and
+** file I/O helpers) used by the example application. These rely on pthreads
+** and the POSIX file-system API and are therefore disabled on Windows.
+*/
+#if defined( _WIN32 )
+#define MD5_USE_POSIX_HOST          ( 0 )
+#else
+#define MD5_USE_POSIX_HOST          ( 1 )
+#endif
+
 #endif /* HMS_SC_MD5_CFG_H_ */
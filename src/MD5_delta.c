@@ -0,0 +1,801 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_delta.c
+**    Summary: rsync style delta engine. The weak sum is the rsync rolling
+**             checksum: 'a' is the sum of the window's bytes and 'b' the sum
+**             of the running 'a' values, both modulo 2^16. Dropping the
+**             oldest byte and adding a new one updates both in O(1).
+**
+**             rsync.samba.org/tech_report/
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_delta.h"
+#include "MD5_multi.h"
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** Basis of the tests: eight full blocks and a short one. The new file has
+** bytes inserted into block 1 and a byte of block 5 changed.
+*/
+#define MD5_DELTA_TEST_BLOCK_SIZE      ( MD5_DELTA_MIN_BLOCK_SIZE )
+#define MD5_DELTA_TEST_BASIS_SIZE      ( 8U * MD5_DELTA_TEST_BLOCK_SIZE + 20U )
+#define MD5_DELTA_TEST_NUM_BLOCKS      ( 9U )
+#define MD5_DELTA_TEST_NUM_BUCKETS     ( 16U )
+#define MD5_DELTA_TEST_INSERT_OFFSET   ( MD5_DELTA_TEST_BLOCK_SIZE + 36U )
+#define MD5_DELTA_TEST_INSERT_SIZE     ( 5U )
+#define MD5_DELTA_TEST_CHANGE_OFFSET   ( 5U * MD5_DELTA_TEST_BLOCK_SIZE + 10U )
+#define MD5_DELTA_TEST_NEW_SIZE        ( MD5_DELTA_TEST_BASIS_SIZE + MD5_DELTA_TEST_INSERT_SIZE )
+#endif
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** A file rebuilt by the tests from the basis and the delta instructions
+*/
+typedef struct MD5_DELTA_TestFile
+{
+   const MD5_DELTA_SigType* psSig;
+   const UINT8* pbBasis;
+   UINT8 abData[ MD5_DELTA_TEST_NEW_SIZE ];
+   UINT32 dwLength;
+   UINT32 dwNumCopies;
+   UINT32 dwNumLiterals;
+   BOOL fError;                         /* The instructions overflow abData */
+} MD5_DELTA_TestFileType;
+#endif
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static UINT32 MD5_DELTA_WeakSum( const UINT8* pbData, UINT32 dwLength, UINT32* pdwA, UINT32* pdwB );
+static UINT32 MD5_DELTA_Bucket( const MD5_DELTA_SigType* psSig, UINT32 dwWeak );
+static BOOL MD5_DELTA_HasWeak( const MD5_DELTA_SigType* psSig, UINT32 dwWeak );
+static UINT32 MD5_DELTA_FindBlock( const MD5_DELTA_SigType* psSig, UINT32 dwWeak,
+                                   const UINT8* pbStrong, UINT32 dwExpected );
+static void MD5_DELTA_StrongSums( const UINT8* const apbData[], const UINT32 adwLength[],
+                                  UINT8 aabStrong[][ MD5_DIGEST_SIZE ], UINT8 bNumSums );
+static UINT8 MD5_DELTA_MatchRun( const MD5_DELTA_SigType* psSig, const UINT8* pbData, UINT64 lSize,
+                                 UINT64 lPos, UINT32 dwWeak, UINT32* pdwExpected, UINT64* plLiteral,
+                                 const MD5_DELTA_OutputType* psOutput );
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static void MD5_DELTA_TestAppend( MD5_DELTA_TestFileType* psFile, const UINT8* pbData,
+                                  UINT64 lLength );
+static void MD5_DELTA_TestCopy( UINT32 dwBlock, void* pxCtx );
+static void MD5_DELTA_TestLiteral( const UINT8* pbData, UINT64 lLength, void* pxCtx );
+static void MD5_DELTA_TestRebuild( const MD5_DELTA_SigType* psSig, const UINT8* pbBasis,
+                                   const UINT8* pbData, UINT32 dwSize,
+                                   MD5_DELTA_TestFileType* psFile );
+static BOOL MD5_DELTA_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the weak sum of a window.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbData   - Window
+**    dwLength - Window length in bytes
+**    pdwA     - Receives the byte sum, for rolling (may be NULL)
+**    pdwB     - Receives the sum of byte sums, for rolling (may be NULL)
+**
+** Returns:
+**    UINT32 - Weak sum
+**------------------------------------------------------------------------------
+*/
+static UINT32 MD5_DELTA_WeakSum( const UINT8* pbData, UINT32 dwLength, UINT32* pdwA, UINT32* pdwB )
+{
+   UINT32 dwA = 0;
+   UINT32 dwB = 0;
+   UINT32 dwIndex;
+
+   for( dwIndex = 0; dwIndex < dwLength; dwIndex++ )
+   {
+      dwA += pbData[ dwIndex ];
+      dwB += dwA;
+   }
+
+   if( pdwA != NULL )
+   {
+      *pdwA = dwA;
+      *pdwB = dwB;
+   }
+
+   return ( dwA & 0xFFFF ) | ( dwB << 16 );
+}
+
+/*------------------------------------------------------------------------------
+** Returns the bucket of a weak sum. The sum is mixed first, as the sums of
+** similar blocks differ in few bits.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig  - Signature
+**    dwWeak - Weak sum
+**
+** Returns:
+**    UINT32 - Bucket index
+**------------------------------------------------------------------------------
+*/
+static UINT32 MD5_DELTA_Bucket( const MD5_DELTA_SigType* psSig, UINT32 dwWeak )
+{
+   dwWeak ^= dwWeak >> 16;
+   dwWeak *= 0x45D9F3BU;
+   dwWeak ^= dwWeak >> 16;
+
+   return dwWeak & psSig->dwBucketMask;
+}
+
+/*------------------------------------------------------------------------------
+** Tells whether any block has the given weak sum.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig  - Signature
+**    dwWeak - Weak sum
+**
+** Returns:
+**    BOOL - TRUE if a candidate block exists
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_DELTA_HasWeak( const MD5_DELTA_SigType* psSig, UINT32 dwWeak )
+{
+   UINT32 dwBlock = psSig->adwBuckets[ MD5_DELTA_Bucket( psSig, dwWeak ) ];
+
+   while( ( dwBlock != MD5_DELTA_NO_BLOCK ) && ( psSig->asBlocks[ dwBlock ].dwWeak != dwWeak ) )
+   {
+      dwBlock = psSig->asBlocks[ dwBlock ].dwNext;
+   }
+
+   return ( dwBlock != MD5_DELTA_NO_BLOCK );
+}
+
+/*------------------------------------------------------------------------------
+** Finds a block with the given weak and strong sums. The block following the
+** previous match is preferred, which keeps runs of blocks contiguous when the
+** basis file has duplicate blocks.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig      - Signature
+**    dwWeak     - Weak sum
+**    pbStrong   - Strong sum
+**    dwExpected - Preferred block, or MD5_DELTA_NO_BLOCK
+**
+** Returns:
+**    UINT32 - Block index, MD5_DELTA_NO_BLOCK if none matches
+**------------------------------------------------------------------------------
+*/
+static UINT32 MD5_DELTA_FindBlock( const MD5_DELTA_SigType* psSig, UINT32 dwWeak,
+                                   const UINT8* pbStrong, UINT32 dwExpected )
+{
+   UINT32 dwBlock;
+
+   /* Only full blocks are indexed, the short last block can't be expected */
+   if( ( dwExpected < psSig->lFileSize / psSig->dwBlockSize ) &&
+       ( psSig->asBlocks[ dwExpected ].dwWeak == dwWeak ) &&
+       ( memcmp( psSig->asBlocks[ dwExpected ].abStrong, pbStrong, MD5_DIGEST_SIZE ) == 0 ) )
+   {
+      return dwExpected;
+   }
+
+   dwBlock = psSig->adwBuckets[ MD5_DELTA_Bucket( psSig, dwWeak ) ];
+
+   while( ( dwBlock != MD5_DELTA_NO_BLOCK ) &&
+          ( ( psSig->asBlocks[ dwBlock ].dwWeak != dwWeak ) ||
+            ( memcmp( psSig->asBlocks[ dwBlock ].abStrong, pbStrong, MD5_DIGEST_SIZE ) != 0 ) ) )
+   {
+      dwBlock = psSig->asBlocks[ dwBlock ].dwNext;
+   }
+
+   return dwBlock;
+}
+
+/*------------------------------------------------------------------------------
+** Computes up to MD5_MULTI_LANES strong sums, with the multi-lane MD5 when
+** there is more than one.
+**------------------------------------------------------------------------------
+** Arguments:
+**    apbData   - Data to hash
+**    adwLength - Length of each data in bytes
+**    aabStrong - Receive the strong sums
+**    bNumSums  - Number of sums (1..MD5_MULTI_LANES)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DELTA_StrongSums( const UINT8* const apbData[], const UINT32 adwLength[],
+                                  UINT8 aabStrong[][ MD5_DIGEST_SIZE ], UINT8 bNumSums )
+{
+   if( bNumSums == 1 )
+   {
+      MD5_InstType sInst;
+
+      MD5_Init( &sInst );
+      MD5_UpdateLarge( &sInst, apbData[ 0 ], adwLength[ 0 ] );
+      MD5_Final( &sInst );
+      memcpy( aabStrong[ 0 ], sInst.adwDigest, MD5_DIGEST_SIZE );
+   }
+   else
+   {
+      MD5_MULTI_Compute( apbData, adwLength, aabStrong, bNumSums );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Confirms a weak sum candidate, together with the block-aligned windows
+** after it that are candidates as well, and reports the matches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig       - Signature
+**    pbData      - New file
+**    lSize       - Size of the new file
+**    lPos        - Position of the candidate window
+**    dwWeak      - Weak sum of the candidate window
+**    pdwExpected - Block expected to match next, updated
+**    plLiteral   - Start of the pending literal data, updated
+**    psOutput    - Instruction callbacks
+**
+** Returns:
+**    UINT8 - Number of consecutive windows that matched (0: none)
+**------------------------------------------------------------------------------
+*/
+static UINT8 MD5_DELTA_MatchRun( const MD5_DELTA_SigType* psSig, const UINT8* pbData, UINT64 lSize,
+                                 UINT64 lPos, UINT32 dwWeak, UINT32* pdwExpected, UINT64* plLiteral,
+                                 const MD5_DELTA_OutputType* psOutput )
+{
+   const UINT32 dwBlockSize = psSig->dwBlockSize;
+   const UINT8* apbWindow[ MD5_MULTI_LANES ];
+   UINT32 adwLength[ MD5_MULTI_LANES ];
+   UINT32 adwWeak[ MD5_MULTI_LANES ];
+   UINT8 aabStrong[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT8 bNumWindows = 0;
+   UINT8 bWindow;
+
+   /*
+   ** Speculate that the candidate starts a run of unchanged blocks: collect
+   ** the following windows as long as their weak sums are known
+   */
+   do
+   {
+      apbWindow[ bNumWindows ] = &pbData[ lPos + (UINT64)bNumWindows * dwBlockSize ];
+      adwLength[ bNumWindows ] = dwBlockSize;
+      adwWeak[ bNumWindows ]   = dwWeak;
+      bNumWindows++;
+
+      if( ( bNumWindows == MD5_MULTI_LANES ) ||
+          ( lPos + (UINT64)( bNumWindows + 1 ) * dwBlockSize > lSize ) )
+      {
+         break;
+      }
+
+      dwWeak = MD5_DELTA_WeakSum( &pbData[ lPos + (UINT64)bNumWindows * dwBlockSize ], dwBlockSize,
+                                  NULL, NULL );
+   } while( MD5_DELTA_HasWeak( psSig, dwWeak ) );
+
+   MD5_DELTA_StrongSums( apbWindow, adwLength, aabStrong, bNumWindows );
+
+   for( bWindow = 0; bWindow < bNumWindows; bWindow++ )
+   {
+      UINT64 lWindowPos = lPos + (UINT64)bWindow * dwBlockSize;
+      UINT32 dwBlock    =
+         MD5_DELTA_FindBlock( psSig, adwWeak[ bWindow ], aabStrong[ bWindow ], *pdwExpected );
+
+      if( dwBlock == MD5_DELTA_NO_BLOCK )
+      {
+         break;
+      }
+
+      if( lWindowPos > *plLiteral )
+      {
+         psOutput->pnLiteral( &pbData[ *plLiteral ], lWindowPos - *plLiteral, psOutput->pxCtx );
+      }
+
+      psOutput->pnCopy( dwBlock, psOutput->pxCtx );
+
+      *plLiteral   = lWindowPos + dwBlockSize;
+      *pdwExpected = dwBlock + 1;
+   }
+
+   return bWindow;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Appends data to a file rebuilt by the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile  - File being rebuilt
+**    pbData  - Data to append
+**    lLength - Length of the data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DELTA_TestAppend( MD5_DELTA_TestFileType* psFile, const UINT8* pbData,
+                                  UINT64 lLength )
+{
+   if( lLength > sizeof( psFile->abData ) - psFile->dwLength )
+   {
+      psFile->fError = TRUE;
+      return;
+   }
+
+   memcpy( &psFile->abData[ psFile->dwLength ], pbData, (size_t)lLength );
+   psFile->dwLength += (UINT32)lLength;
+}
+
+/*------------------------------------------------------------------------------
+** Applies a copy instruction to a file rebuilt by the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    dwBlock - Basis block to copy
+**    pxCtx   - MD5_DELTA_TestFileType being rebuilt
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DELTA_TestCopy( UINT32 dwBlock, void* pxCtx )
+{
+   MD5_DELTA_TestFileType* psFile = (MD5_DELTA_TestFileType*)pxCtx;
+   UINT64 lOffset                 = (UINT64)dwBlock * psFile->psSig->dwBlockSize;
+   UINT64 lLength                 = psFile->psSig->lFileSize - lOffset;
+
+   if( lLength > psFile->psSig->dwBlockSize )
+   {
+      lLength = psFile->psSig->dwBlockSize;
+   }
+
+   MD5_DELTA_TestAppend( psFile, &psFile->pbBasis[ lOffset ], lLength );
+   psFile->dwNumCopies++;
+}
+
+/*------------------------------------------------------------------------------
+** Applies a literal instruction to a file rebuilt by the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbData  - Literal data
+**    lLength - Length of the literal data in bytes
+**    pxCtx   - MD5_DELTA_TestFileType being rebuilt
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DELTA_TestLiteral( const UINT8* pbData, UINT64 lLength, void* pxCtx )
+{
+   MD5_DELTA_TestFileType* psFile = (MD5_DELTA_TestFileType*)pxCtx;
+
+   MD5_DELTA_TestAppend( psFile, pbData, lLength );
+   psFile->dwNumLiterals++;
+}
+
+/*------------------------------------------------------------------------------
+** Scans a file against a signature and rebuilds it from the basis and the
+** delta instructions.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig   - Indexed signature of the basis
+**    pbBasis - Basis
+**    pbData  - File to scan
+**    dwSize  - Size of the file in bytes
+**    psFile  - Receives the rebuilt file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DELTA_TestRebuild( const MD5_DELTA_SigType* psSig, const UINT8* pbBasis,
+                                   const UINT8* pbData, UINT32 dwSize,
+                                   MD5_DELTA_TestFileType* psFile )
+{
+   MD5_DELTA_OutputType sOutput;
+
+   psFile->psSig         = psSig;
+   psFile->pbBasis       = pbBasis;
+   psFile->dwLength      = 0;
+   psFile->dwNumCopies   = 0;
+   psFile->dwNumLiterals = 0;
+   psFile->fError        = FALSE;
+
+   sOutput.pnCopy    = MD5_DELTA_TestCopy;
+   sOutput.pnLiteral = MD5_DELTA_TestLiteral;
+   sOutput.pxCtx     = psFile;
+
+   MD5_DELTA_Scan( psSig, pbData, dwSize, &sOutput );
+}
+
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Test number
+**    pacName    - Test name
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_DELTA_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "DELTA_TEST_%03d: %s\t: %s\n", bTestEntry, pacName,
+               fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of blocks of a basis file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lFileSize   - Size of the basis file in bytes
+**    dwBlockSize - Block size in bytes
+**
+** Returns:
+**    UINT32 - Number of blocks (entries of the asBlocks array)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_DELTA_GetNumBlocks( UINT64 lFileSize, UINT32 dwBlockSize )
+{
+   return (UINT32)( ( lFileSize + dwBlockSize - 1 ) / dwBlockSize );
+}
+
+/*------------------------------------------------------------------------------
+** Returns the number of weak sum buckets for a signature.
+**------------------------------------------------------------------------------
+** Arguments:
+**    dwNumBlocks - Number of blocks
+**
+** Returns:
+**    UINT32 - Number of buckets (entries of the adwBuckets array)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_DELTA_GetNumBuckets( UINT32 dwNumBlocks )
+{
+   UINT32 dwNumBuckets = 1;
+
+   while( ( dwNumBuckets < dwNumBlocks ) && ( dwNumBuckets < 0x80000000U ) )
+   {
+      dwNumBuckets <<= 1;
+   }
+
+   return dwNumBuckets;
+}
+
+/*------------------------------------------------------------------------------
+** Initializes a signature over caller provided arrays. The blocks are then
+** either computed with MD5_DELTA_ComputeBlocks() or filled in by the caller
+** (e.g. from a stored signature) and indexed with MD5_DELTA_IndexBlocks().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig       - Signature to initialize
+**    lFileSize   - Size of the basis file in bytes
+**    dwBlockSize - Block size in bytes (at least MD5_DELTA_MIN_BLOCK_SIZE)
+**    asBlocks    - MD5_DELTA_GetNumBlocks() entries
+**    adwBuckets  - MD5_DELTA_GetNumBuckets() entries
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_InitSig( MD5_DELTA_SigType* psSig, UINT64 lFileSize, UINT32 dwBlockSize,
+                        MD5_DELTA_BlockType asBlocks[], UINT32 adwBuckets[] )
+{
+   psSig->lFileSize    = lFileSize;
+   psSig->dwBlockSize  = dwBlockSize;
+   psSig->dwNumBlocks  = MD5_DELTA_GetNumBlocks( lFileSize, dwBlockSize );
+   psSig->asBlocks     = asBlocks;
+   psSig->adwBuckets   = adwBuckets;
+   psSig->dwBucketMask = MD5_DELTA_GetNumBuckets( psSig->dwNumBlocks ) - 1;
+}
+
+/*------------------------------------------------------------------------------
+** Computes the weak and strong sums of all blocks of the basis file and
+** indexes them.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig  - Signature set up with MD5_DELTA_InitSig()
+**    pbData - Contents of the basis file (psSig->lFileSize bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_ComputeBlocks( MD5_DELTA_SigType* psSig, const UINT8* pbData )
+{
+   const UINT8* apbBlock[ MD5_MULTI_LANES ];
+   UINT32 adwLength[ MD5_MULTI_LANES ];
+   UINT8 aabStrong[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT32 dwFirst;
+
+   for( dwFirst = 0; dwFirst < psSig->dwNumBlocks; dwFirst += MD5_MULTI_LANES )
+   {
+      UINT8 bNumBlocks = 0;
+      UINT8 bBlock;
+
+      while( ( bNumBlocks < MD5_MULTI_LANES ) && ( dwFirst + bNumBlocks < psSig->dwNumBlocks ) )
+      {
+         UINT64 lOffset = (UINT64)( dwFirst + bNumBlocks ) * psSig->dwBlockSize;
+         UINT64 lLength = psSig->lFileSize - lOffset;
+
+         apbBlock[ bNumBlocks ]  = &pbData[ lOffset ];
+         adwLength[ bNumBlocks ] =
+            ( lLength < psSig->dwBlockSize ) ? (UINT32)lLength : psSig->dwBlockSize;
+         psSig->asBlocks[ dwFirst + bNumBlocks ].dwWeak =
+            MD5_DELTA_WeakSum( apbBlock[ bNumBlocks ], adwLength[ bNumBlocks ], NULL, NULL );
+         bNumBlocks++;
+      }
+
+      MD5_DELTA_StrongSums( apbBlock, adwLength, aabStrong, bNumBlocks );
+
+      for( bBlock = 0; bBlock < bNumBlocks; bBlock++ )
+      {
+         memcpy( psSig->asBlocks[ dwFirst + bBlock ].abStrong, aabStrong[ bBlock ],
+                 MD5_DIGEST_SIZE );
+      }
+   }
+
+   MD5_DELTA_IndexBlocks( psSig );
+}
+
+/*------------------------------------------------------------------------------
+** Builds the weak sum index from the dwWeak fields of all blocks.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig - Signature with its blocks filled in
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_IndexBlocks( MD5_DELTA_SigType* psSig )
+{
+   UINT32 dwBlock = (UINT32)( psSig->lFileSize / psSig->dwBlockSize ); /* Full blocks only */
+   UINT32 dwBucket;
+
+   for( dwBucket = 0; dwBucket <= psSig->dwBucketMask; dwBucket++ )
+   {
+      psSig->adwBuckets[ dwBucket ] = MD5_DELTA_NO_BLOCK;
+   }
+
+   /* Inserting from the back keeps every chain in ascending block order */
+   while( dwBlock-- > 0 )
+   {
+      dwBucket = MD5_DELTA_Bucket( psSig, psSig->asBlocks[ dwBlock ].dwWeak );
+
+      psSig->asBlocks[ dwBlock ].dwNext = psSig->adwBuckets[ dwBucket ];
+      psSig->adwBuckets[ dwBucket ]     = dwBlock;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Scans a new file against a signature and reports the delta instructions
+** that rebuild it from the basis file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig    - Indexed signature of the basis file
+**    pbData   - Contents of the new file
+**    lSize    - Size of the new file in bytes
+**    psOutput - Instruction callbacks
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_Scan( const MD5_DELTA_SigType* psSig, const UINT8* pbData, UINT64 lSize,
+                     const MD5_DELTA_OutputType* psOutput )
+{
+   const UINT32 dwBlockSize = psSig->dwBlockSize;
+   const UINT32 dwTailSize  = (UINT32)( psSig->lFileSize % dwBlockSize );
+   UINT32 dwExpected        = MD5_DELTA_NO_BLOCK;
+   UINT64 lLiteral          = 0;
+   UINT64 lPos              = 0;
+   BOOL fSumValid           = FALSE;
+   UINT32 dwA               = 0;
+   UINT32 dwB               = 0;
+
+   while( lPos + dwBlockSize <= lSize )
+   {
+      UINT32 dwWeak;
+      UINT8 bNumMatched = 0;
+
+      if( !fSumValid )
+      {
+         MD5_DELTA_WeakSum( &pbData[ lPos ], dwBlockSize, &dwA, &dwB );
+         fSumValid = TRUE;
+      }
+
+      dwWeak = ( dwA & 0xFFFF ) | ( dwB << 16 );
+
+      if( MD5_DELTA_HasWeak( psSig, dwWeak ) )
+      {
+         bNumMatched = MD5_DELTA_MatchRun( psSig, pbData, lSize, lPos, dwWeak, &dwExpected,
+                                           &lLiteral, psOutput );
+      }
+
+      if( bNumMatched > 0 )
+      {
+         lPos += (UINT64)bNumMatched * dwBlockSize;
+         fSumValid = FALSE;
+      }
+      else if( lPos + dwBlockSize < lSize )
+      {
+         /* Roll the window on by one byte */
+         dwA += pbData[ lPos + dwBlockSize ] - pbData[ lPos ];
+         dwB += dwA - dwBlockSize * pbData[ lPos ];
+         lPos++;
+      }
+      else
+      {
+         break;
+      }
+   }
+
+   /* The short last block of the basis can only match at the very end */
+   if( ( dwTailSize > 0 ) && ( lSize - lLiteral >= dwTailSize ) )
+   {
+      const UINT8* apbTail[ 1 ];
+      UINT8 aabStrong[ 1 ][ MD5_DIGEST_SIZE ];
+
+      apbTail[ 0 ] = &pbData[ lSize - dwTailSize ];
+      MD5_DELTA_StrongSums( apbTail, &dwTailSize, aabStrong, 1 );
+
+      if( memcmp( aabStrong[ 0 ], psSig->asBlocks[ psSig->dwNumBlocks - 1 ].abStrong,
+                  MD5_DIGEST_SIZE ) == 0 )
+      {
+         if( lSize - dwTailSize > lLiteral )
+         {
+            psOutput->pnLiteral( &pbData[ lLiteral ], lSize - dwTailSize - lLiteral,
+                                 psOutput->pxCtx );
+         }
+
+         psOutput->pnCopy( psSig->dwNumBlocks - 1, psOutput->pxCtx );
+         lLiteral = lSize;
+      }
+   }
+
+   if( lSize > lLiteral )
+   {
+      psOutput->pnLiteral( &pbData[ lLiteral ], lSize - lLiteral, psOutput->pxCtx );
+   }
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the weak sums of a signature against known values and its strong
+** sums against plain MD5. Rebuilds an edited copy of the basis and the
+** basis itself from the delta instructions, then the edited copy again with
+** a signature that is read back.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DELTA_RunTests( void )
+{
+   UINT8 abBasis[ MD5_DELTA_TEST_BASIS_SIZE ];
+   UINT8 abNew[ MD5_DELTA_TEST_NEW_SIZE ];
+   MD5_DELTA_BlockType asBlocks[ MD5_DELTA_TEST_NUM_BLOCKS ];
+   MD5_DELTA_BlockType asStored[ MD5_DELTA_TEST_NUM_BLOCKS ];
+   UINT32 adwBuckets[ MD5_DELTA_TEST_NUM_BUCKETS ];
+   UINT32 adwStoredBuckets[ MD5_DELTA_TEST_NUM_BUCKETS ];
+   MD5_DELTA_TestFileType sFile;
+   MD5_DELTA_SigType sSig;
+   MD5_DELTA_SigType sStored;
+   BOOL fAllPassed = TRUE;
+   BOOL fPassed;
+   MD5_InstType sInst;
+   UINT32 dwBlock;
+   UINT16 iByte;
+
+   for( iByte = 0; iByte < sizeof( abBasis ); iByte++ )
+   {
+      abBasis[ iByte ] = (UINT8)( iByte * 7 + 1 );
+   }
+
+   /* Bytes inserted into block 1, a byte of block 5 changed */
+   memcpy( abNew, abBasis, MD5_DELTA_TEST_INSERT_OFFSET );
+   memset( &abNew[ MD5_DELTA_TEST_INSERT_OFFSET ], 0xA5, MD5_DELTA_TEST_INSERT_SIZE );
+   memcpy( &abNew[ MD5_DELTA_TEST_INSERT_OFFSET + MD5_DELTA_TEST_INSERT_SIZE ],
+           &abBasis[ MD5_DELTA_TEST_INSERT_OFFSET ],
+           sizeof( abBasis ) - MD5_DELTA_TEST_INSERT_OFFSET );
+   abNew[ MD5_DELTA_TEST_CHANGE_OFFSET + MD5_DELTA_TEST_INSERT_SIZE ] ^= 0xFF;
+
+   fPassed = ( MD5_DELTA_GetNumBlocks( sizeof( abBasis ), MD5_DELTA_TEST_BLOCK_SIZE ) ==
+               MD5_DELTA_TEST_NUM_BLOCKS ) &&
+             ( MD5_DELTA_GetNumBuckets( MD5_DELTA_TEST_NUM_BLOCKS ) == MD5_DELTA_TEST_NUM_BUCKETS );
+
+   MD5_DELTA_InitSig( &sSig, sizeof( abBasis ), MD5_DELTA_TEST_BLOCK_SIZE, asBlocks, adwBuckets );
+   MD5_DELTA_ComputeBlocks( &sSig, abBasis );
+
+   /* Weak sums of the first and of the short last block */
+   fPassed = fPassed && ( asBlocks[ 0 ].dwWeak == 0x38801C60U ) &&
+             ( asBlocks[ MD5_DELTA_TEST_NUM_BLOCKS - 1 ].dwWeak == 0x25300546U );
+
+   for( dwBlock = 0; dwBlock < MD5_DELTA_TEST_NUM_BLOCKS; dwBlock++ )
+   {
+      UINT32 dwOffset = dwBlock * MD5_DELTA_TEST_BLOCK_SIZE;
+      UINT32 dwLength = sizeof( abBasis ) - dwOffset;
+
+      if( dwLength > MD5_DELTA_TEST_BLOCK_SIZE )
+      {
+         dwLength = MD5_DELTA_TEST_BLOCK_SIZE;
+      }
+
+      MD5_Compute( &sInst, &abBasis[ dwOffset ], (UINT16)dwLength );
+      fPassed = fPassed &&
+                ( memcmp( asBlocks[ dwBlock ].abStrong, sInst.adwDigest, MD5_DIGEST_SIZE ) == 0 );
+   }
+
+   fAllPassed = MD5_DELTA_ReportTest( 0, "SIGNATURE", fPassed ) && fAllPassed;
+
+   /* Blocks 0, 2 to 4 and 6 to 8 are copied */
+   MD5_DELTA_TestRebuild( &sSig, abBasis, abNew, sizeof( abNew ), &sFile );
+   fPassed = !sFile.fError && ( sFile.dwLength == sizeof( abNew ) ) &&
+             ( memcmp( sFile.abData, abNew, sizeof( abNew ) ) == 0 ) && ( sFile.dwNumCopies == 7 );
+
+   fAllPassed = MD5_DELTA_ReportTest( 1, "ROUND TRIP", fPassed ) && fAllPassed;
+
+   MD5_DELTA_TestRebuild( &sSig, abBasis, abBasis, sizeof( abBasis ), &sFile );
+   fPassed = !sFile.fError && ( sFile.dwLength == sizeof( abBasis ) ) &&
+             ( memcmp( sFile.abData, abBasis, sizeof( abBasis ) ) == 0 ) &&
+             ( sFile.dwNumCopies == MD5_DELTA_TEST_NUM_BLOCKS ) && ( sFile.dwNumLiterals == 0 );
+
+   fAllPassed = MD5_DELTA_ReportTest( 2, "UNCHANGED", fPassed ) && fAllPassed;
+
+   /* A signature read back has its sums filled in and is indexed anew */
+   MD5_DELTA_InitSig( &sStored, sizeof( abBasis ), MD5_DELTA_TEST_BLOCK_SIZE, asStored,
+                      adwStoredBuckets );
+
+   for( dwBlock = 0; dwBlock < MD5_DELTA_TEST_NUM_BLOCKS; dwBlock++ )
+   {
+      asStored[ dwBlock ].dwWeak = asBlocks[ dwBlock ].dwWeak;
+      memcpy( asStored[ dwBlock ].abStrong, asBlocks[ dwBlock ].abStrong, MD5_DIGEST_SIZE );
+   }
+
+   MD5_DELTA_IndexBlocks( &sStored );
+   MD5_DELTA_TestRebuild( &sStored, abBasis, abNew, sizeof( abNew ), &sFile );
+   fPassed = !sFile.fError && ( sFile.dwLength == sizeof( abNew ) ) &&
+             ( memcmp( sFile.abData, abNew, sizeof( abNew ) ) == 0 ) && ( sFile.dwNumCopies == 7 );
+
+   fAllPassed = MD5_DELTA_ReportTest( 3, "STORED SIGNATURE", fPassed ) && fAllPassed;
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
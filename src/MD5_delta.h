@@ -0,0 +1,183 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_delta.h
+**    Summary: rsync style delta engine. A signature holds a rolling weak sum
+**             and an MD5 strong sum for every block of a basis file. A new
+**             file is scanned with the rolling sum; positions whose weak sum
+**             is found in the signature are confirmed with MD5 and become
+**             block copies, everything else is literal data.
+**
+**             Strong sums are computed MD5_MULTI_LANES at a time: when a
+**             candidate is found, the block-aligned windows following it
+**             (where a run of unchanged blocks would continue) are checked
+**             against the weak sums too and all candidates are confirmed
+**             with one multi-lane MD5 call.
+**
+**             All memory is provided by the caller.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_DELTA_H_
+#define HMS_SC_MD5_DELTA_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_DELTA_MIN_BLOCK_SIZE       ( 64U )
+#define MD5_DELTA_DEFAULT_BLOCK_SIZE   ( 4U * 1024U )
+#define MD5_DELTA_NO_BLOCK             ( 0xFFFFFFFFU )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_DELTA_Block
+{
+   UINT32 dwWeak;
+   UINT32 dwNext; /* Next block in the same bucket, or MD5_DELTA_NO_BLOCK */
+   UINT8 abStrong[ MD5_DIGEST_SIZE ];
+} MD5_DELTA_BlockType;
+
+typedef struct MD5_DELTA_Sig
+{
+   UINT64 lFileSize;                /* Size of the basis file */
+   UINT32 dwBlockSize;
+   UINT32 dwNumBlocks;              /* The last block may be short */
+   MD5_DELTA_BlockType* asBlocks;
+   UINT32* adwBuckets;              /* First block of every weak sum bucket */
+   UINT32 dwBucketMask;
+} MD5_DELTA_SigType;
+
+/*
+** Delta instructions, reported in new file order. Copies refer to whole
+** basis blocks, literals to data of the new file.
+*/
+typedef void ( *MD5_DELTA_CopyFunc )( UINT32 dwBlock, void* pxCtx );
+typedef void ( *MD5_DELTA_LiteralFunc )( const UINT8* pbData, UINT64 lLength, void* pxCtx );
+
+typedef struct MD5_DELTA_Output
+{
+   MD5_DELTA_CopyFunc pnCopy;
+   MD5_DELTA_LiteralFunc pnLiteral;
+   void* pxCtx;
+} MD5_DELTA_OutputType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of blocks of a basis file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lFileSize   - Size of the basis file in bytes
+**    dwBlockSize - Block size in bytes
+**
+** Returns:
+**    UINT32 - Number of blocks (entries of the asBlocks array)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_DELTA_GetNumBlocks( UINT64 lFileSize, UINT32 dwBlockSize );
+
+/*------------------------------------------------------------------------------
+** Returns the number of weak sum buckets for a signature.
+**------------------------------------------------------------------------------
+** Arguments:
+**    dwNumBlocks - Number of blocks
+**
+** Returns:
+**    UINT32 - Number of buckets (entries of the adwBuckets array)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_DELTA_GetNumBuckets( UINT32 dwNumBlocks );
+
+/*------------------------------------------------------------------------------
+** Initializes a signature over caller provided arrays. The blocks are then
+** either computed with MD5_DELTA_ComputeBlocks() or filled in by the caller
+** (e.g. from a stored signature) and indexed with MD5_DELTA_IndexBlocks().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig       - Signature to initialize
+**    lFileSize   - Size of the basis file in bytes
+**    dwBlockSize - Block size in bytes (at least MD5_DELTA_MIN_BLOCK_SIZE)
+**    asBlocks    - MD5_DELTA_GetNumBlocks() entries
+**    adwBuckets  - MD5_DELTA_GetNumBuckets() entries
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_InitSig( MD5_DELTA_SigType* psSig, UINT64 lFileSize, UINT32 dwBlockSize,
+                        MD5_DELTA_BlockType asBlocks[], UINT32 adwBuckets[] );
+
+/*------------------------------------------------------------------------------
+** Computes the weak and strong sums of all blocks of the basis file and
+** indexes them.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig  - Signature set up with MD5_DELTA_InitSig()
+**    pbData - Contents of the basis file (psSig->lFileSize bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_ComputeBlocks( MD5_DELTA_SigType* psSig, const UINT8* pbData );
+
+/*------------------------------------------------------------------------------
+** Builds the weak sum index from the dwWeak fields of all blocks.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig - Signature with its blocks filled in
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_IndexBlocks( MD5_DELTA_SigType* psSig );
+
+/*------------------------------------------------------------------------------
+** Scans a new file against a signature and reports the delta instructions
+** that rebuild it from the basis file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSig    - Indexed signature of the basis file
+**    pbData   - Contents of the new file
+**    lSize    - Size of the new file in bytes
+**    psOutput - Instruction callbacks
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DELTA_Scan( const MD5_DELTA_SigType* psSig, const UINT8* pbData, UINT64 lSize,
+                     const MD5_DELTA_OutputType* psOutput );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the weak sums of a signature against known values and its strong
+** sums against plain MD5. Rebuilds an edited copy of the basis and the
+** basis itself from the delta instructions, then the edited copy again with
+** a signature that is read back.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DELTA_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_DELTA_H_ */
@@ -0,0 +1,545 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_dupes.c
+**    Summary: Duplicate file finder. The walk only collects sizes; every
+**             pass submits one job per worker, and the jobs claim the files
+**             still alike from a shared cursor.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_dupes.h"
+#include "MD5_port.h"
+#include "MD5_walk.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static void MD5_DUPES_Visit( MD5_WALK_FileType* psFile, UINT16 iWorker, void* pxCtx );
+static void MD5_DUPES_VisitBatch( MD5_WALK_FileType* apsFiles[], UINT16 iNumFiles, UINT16 iWorker,
+                                  void* pxCtx );
+static void MD5_DUPES_Emit( const MD5_WALK_FileType* psFile, void* pxCtx );
+static int MD5_DUPES_CompareFiles( const void* pxFile1, const void* pxFile2 );
+static void MD5_DUPES_Select( MD5_DUPES_Type* psDupes );
+static BOOL MD5_DUPES_HashEnds( MD5_IO_WorkerType* psWorker, int iFd, UINT64 lSize,
+                                UINT8* pbDigest );
+static void MD5_DUPES_HashFile( MD5_DUPES_FileType* psFile, MD5_IO_WorkerType* psWorker,
+                                BOOL fFullPass );
+static void MD5_DUPES_Job( void* pxArg, UINT16 iWorker );
+static UINT64 MD5_DUPES_RunPass( MD5_DUPES_Type* psDupes, MD5_POOL_Type* psPool, BOOL fFullPass );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Walk visit routines. The walk only collects the files, so there is nothing
+** to do on the workers.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile / apsFiles, iNumFiles - Files found by the walk
+**    iWorker                      - Index of the executing worker
+**    pxCtx                        - Duplicate finder
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DUPES_Visit( MD5_WALK_FileType* psFile, UINT16 iWorker, void* pxCtx )
+{
+   (void)psFile;
+   (void)iWorker;
+   (void)pxCtx;
+}
+
+static void MD5_DUPES_VisitBatch( MD5_WALK_FileType* apsFiles[], UINT16 iNumFiles, UINT16 iWorker,
+                                  void* pxCtx )
+{
+   (void)apsFiles;
+   (void)iNumFiles;
+   (void)iWorker;
+   (void)pxCtx;
+}
+
+/*------------------------------------------------------------------------------
+** Walk emit routine, collects the non-empty files. Hard links to a file that
+** was already found are the same file, not copies.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile - File found by the walk
+**    pxCtx  - Duplicate finder
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DUPES_Emit( const MD5_WALK_FileType* psFile, void* pxCtx )
+{
+   MD5_DUPES_Type* psDupes = (MD5_DUPES_Type*)pxCtx;
+   MD5_DUPES_FileType* psDupe;
+
+   if( psFile->iError != 0 )
+   {
+      psDupes->pnError( psFile->pacPath, psFile->iError, psDupes->pxCtx );
+      return;
+   }
+
+   if( psFile->fSkipped || ( psFile->lSize == 0 ) || psDupes->fOutOfMemory )
+   {
+      return;
+   }
+
+   if( psDupes->lNumFiles == psDupes->lAlloc )
+   {
+      UINT64 lAlloc                = ( psDupes->lAlloc == 0 ) ? 1024 : psDupes->lAlloc * 2;
+      MD5_DUPES_FileType* asFiles =
+         realloc( psDupes->asFiles, (size_t)lAlloc * sizeof( MD5_DUPES_FileType ) );
+
+      if( asFiles == NULL )
+      {
+         psDupes->fOutOfMemory = TRUE;
+         return;
+      }
+
+      psDupes->asFiles = asFiles;
+      psDupes->lAlloc  = lAlloc;
+   }
+
+   psDupe = &psDupes->asFiles[ psDupes->lNumFiles ];
+   memset( psDupe, 0, sizeof( MD5_DUPES_FileType ) );
+   psDupe->pacPath = strdup( psFile->pacPath );
+   psDupe->lSize   = psFile->lSize;
+
+   if( psDupe->pacPath == NULL )
+   {
+      psDupes->fOutOfMemory = TRUE;
+      return;
+   }
+
+   psDupes->lNumFiles++;
+}
+
+/*------------------------------------------------------------------------------
+** qsort() routine ordering files by size, digest and path.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxFile1 - First file
+**    pxFile2 - Second file
+**
+** Returns:
+**    int - <0, 0 or >0 like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_DUPES_CompareFiles( const void* pxFile1, const void* pxFile2 )
+{
+   const MD5_DUPES_FileType* psFile1 = (const MD5_DUPES_FileType*)pxFile1;
+   const MD5_DUPES_FileType* psFile2 = (const MD5_DUPES_FileType*)pxFile2;
+   int iResult;
+
+   if( psFile1->lSize != psFile2->lSize )
+   {
+      return ( psFile1->lSize < psFile2->lSize ) ? -1 : 1;
+   }
+
+   iResult = memcmp( psFile1->abDigest, psFile2->abDigest, MD5_DIGEST_SIZE );
+
+   return ( iResult != 0 ) ? iResult : strcmp( psFile1->pacPath, psFile2->pacPath );
+}
+
+/*------------------------------------------------------------------------------
+** Reports and drops the files that failed, then keeps only the files that
+** are still alike (same size and digest) to at least one other file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Duplicate finder
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DUPES_Select( MD5_DUPES_Type* psDupes )
+{
+   UINT64 lFile;
+   UINT64 lEnd;
+   UINT64 lKept = 0;
+
+   for( lFile = 0; lFile < psDupes->lNumFiles; lFile++ )
+   {
+      MD5_DUPES_FileType* psFile = &psDupes->asFiles[ lFile ];
+
+      if( ( psFile->iError == 0 ) && !psFile->fChanged )
+      {
+         psDupes->asFiles[ lKept++ ] = *psFile;
+         continue;
+      }
+
+      psDupes->pnError( psFile->pacPath, psFile->iError, psDupes->pxCtx );
+      free( psFile->pacPath );
+   }
+
+   psDupes->lNumFiles = lKept;
+   qsort( psDupes->asFiles, (size_t)psDupes->lNumFiles, sizeof( MD5_DUPES_FileType ),
+          MD5_DUPES_CompareFiles );
+
+   lKept = 0;
+
+   for( lFile = 0; lFile < psDupes->lNumFiles; lFile = lEnd )
+   {
+      for( lEnd = lFile + 1; ( lEnd < psDupes->lNumFiles ) && !MD5_DUPES_IsNewSet( psDupes, lEnd );
+           lEnd++ )
+      {
+      }
+
+      if( lEnd - lFile == 1 )
+      {
+         free( psDupes->asFiles[ lFile ].pacPath );
+         continue;
+      }
+
+      while( lFile < lEnd )
+      {
+         psDupes->asFiles[ lKept++ ] = psDupes->asFiles[ lFile++ ];
+      }
+   }
+
+   psDupes->lNumFiles = lKept;
+}
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of the first and the last MD5_DUPES_SAMPLE_SIZE bytes of a
+** file larger than twice that. A file that shrank yields the digest of the
+** bytes that were left, which the full pass then finds to be changed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File to read
+**    lSize    - Size of the file found by the walk
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_DUPES_HashEnds( MD5_IO_WorkerType* psWorker, int iFd, UINT64 lSize,
+                                UINT8* pbDigest )
+{
+   UINT64 alStart[ 2 ];
+   UINT16 iEnd;
+
+   alStart[ 0 ] = 0;
+   alStart[ 1 ] = lSize - MD5_DUPES_SAMPLE_SIZE;
+
+   MD5_Init( &psWorker->sInst );
+
+   for( iEnd = 0; iEnd < 2; iEnd++ )
+   {
+      UINT64 lOffset = alStart[ iEnd ];
+      UINT32 dwLeft  = MD5_DUPES_SAMPLE_SIZE;
+
+      while( dwLeft > 0 )
+      {
+         UINT32 dwChunk     = ( dwLeft < psWorker->dwBufferSize ) ? dwLeft : psWorker->dwBufferSize;
+         ssize_t iBytesRead =
+            MD5_IO_ReadAt( psWorker, iFd, psWorker->pbBuffer, dwChunk, (off_t)lOffset );
+
+         if( iBytesRead < 0 )
+         {
+            if( errno == EINTR )
+            {
+               continue;
+            }
+
+            return FALSE;
+         }
+
+         if( iBytesRead == 0 )
+         {
+            break;
+         }
+
+         MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+         lOffset += (UINT64)iBytesRead;
+         dwLeft  -= (UINT32)iBytesRead;
+      }
+   }
+
+   MD5_Peek( &psWorker->sInst, pbDigest );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Hashes a file for a pass: its ends in the partial pass, all of it in the
+** full pass. A file no larger than both ends is hashed in full right away,
+** there is nothing left to save on it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile    - File to hash, receives the digest or error
+**    psWorker  - Worker providing the MD5 instance and read buffer
+**    fFullPass - TRUE in the full pass
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DUPES_HashFile( MD5_DUPES_FileType* psFile, MD5_IO_WorkerType* psWorker,
+                                BOOL fFullPass )
+{
+   UINT64 lSize;
+   int iFd;
+
+   if( fFullPass || ( psFile->lSize <= 2 * MD5_DUPES_SAMPLE_SIZE ) )
+   {
+      if( !MD5_IO_HashPath( psWorker, psFile->pacPath, psFile->abDigest, &lSize ) )
+      {
+         psFile->iError = errno;
+         return;
+      }
+
+      psFile->fFull    = TRUE;
+      psFile->fChanged = ( lSize != psFile->lSize );
+      return;
+   }
+
+   iFd = open( psFile->pacPath, O_RDONLY | O_CLOEXEC );
+
+   if( ( iFd < 0 ) || !MD5_DUPES_HashEnds( psWorker, iFd, psFile->lSize, psFile->abDigest ) )
+   {
+      psFile->iError = errno;
+   }
+
+   if( iFd >= 0 )
+   {
+      close( iFd );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Pool job, hashes files of the running pass until all of them are claimed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Duplicate finder
+**    iWorker - Index of the executing worker
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_DUPES_Job( void* pxArg, UINT16 iWorker )
+{
+   MD5_DUPES_Type* psDupes = (MD5_DUPES_Type*)pxArg;
+   UINT64 lFile;
+
+   while( ( lFile = MD5_PORT_AtomicAdd( &psDupes->lNextFile, 1 ) - 1 ) < psDupes->lNumFiles )
+   {
+      MD5_DUPES_FileType* psFile = &psDupes->asFiles[ lFile ];
+
+      if( !psFile->fFull )
+      {
+         MD5_DUPES_HashFile( psFile, psDupes->apsWorkers[ iWorker ], psDupes->fFullPass );
+      }
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Runs one pass on the pool and narrows the files down to the ones still
+** alike.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes   - Duplicate finder
+**    psPool    - Pool to run on
+**    fFullPass - TRUE to hash the whole files, FALSE for their ends
+**
+** Returns:
+**    UINT64 - Number of bytes read
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_DUPES_RunPass( MD5_DUPES_Type* psDupes, MD5_POOL_Type* psPool, BOOL fFullPass )
+{
+   UINT64 lBytesRead = 0;
+   UINT64 lFile;
+   UINT16 iWorker;
+
+   for( lFile = 0; lFile < psDupes->lNumFiles; lFile++ )
+   {
+      const MD5_DUPES_FileType* psFile = &psDupes->asFiles[ lFile ];
+
+      if( psFile->fFull )
+      {
+         continue;
+      }
+
+      if( fFullPass || ( psFile->lSize <= 2 * MD5_DUPES_SAMPLE_SIZE ) )
+      {
+         lBytesRead += psFile->lSize;
+      }
+      else
+      {
+         lBytesRead += 2 * MD5_DUPES_SAMPLE_SIZE;
+      }
+   }
+
+   psDupes->fFullPass = fFullPass;
+   psDupes->lNextFile = 0;
+
+   for( iWorker = 0; ( iWorker < psPool->iNumWorkers ) && ( iWorker < psDupes->lNumFiles );
+        iWorker++ )
+   {
+      MD5_POOL_Submit( psPool, MD5_DUPES_Job, psDupes );
+   }
+
+   MD5_POOL_Wait( psPool );
+   MD5_DUPES_Select( psDupes );
+
+   return lBytesRead;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares a duplicate finder.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes    - Finder to initialize
+**    apsWorkers - Per-worker MD5 instance and read buffer of the pool that
+**                 MD5_DUPES_Find() runs on
+**    pnError    - Called for every file that could not be compared
+**    pxCtx      - Passed to pnError
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DUPES_Init( MD5_DUPES_Type* psDupes, MD5_IO_WorkerType* apsWorkers[],
+                     MD5_DUPES_ErrorFunc pnError, void* pxCtx )
+{
+   memset( psDupes, 0, sizeof( MD5_DUPES_Type ) );
+
+   psDupes->apsWorkers = apsWorkers;
+   psDupes->pnError    = pnError;
+   psDupes->pxCtx      = pxCtx;
+}
+
+/*------------------------------------------------------------------------------
+** Finds the sets of files with the same content below a directory. The
+** reads of every pass run on the pool workers.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder, receives the duplicates in asFiles
+**    psPool  - Pool to run on, not running other jobs
+**    pacRoot - Directory (or single file) to search
+**
+** Returns:
+**    BOOL - FALSE if the walk failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DUPES_Find( MD5_DUPES_Type* psDupes, MD5_POOL_Type* psPool, const char* pacRoot )
+{
+   MD5_WALK_ConfigType sWalkCfg;
+   UINT64 lFile;
+
+   sWalkCfg.pnVisit        = MD5_DUPES_Visit;
+   sWalkCfg.pnVisitBatch   = MD5_DUPES_VisitBatch;
+   sWalkCfg.pnEmit         = MD5_DUPES_Emit;
+   sWalkCfg.pxCtx          = psDupes;
+   sWalkCfg.lBatchFileSize = ~(UINT64)0;
+   sWalkCfg.fSkipHardLinks = TRUE;
+   sWalkCfg.pnPickWorker   = NULL;
+
+   if( !MD5_WALK_Run( psPool, pacRoot, &sWalkCfg ) )
+   {
+      return FALSE;
+   }
+
+   if( psDupes->fOutOfMemory )
+   {
+      errno = ENOMEM;
+      return FALSE;
+   }
+
+   psDupes->lNumFound   = psDupes->lNumFiles;
+   psDupes->lTotalBytes = 0;
+
+   for( lFile = 0; lFile < psDupes->lNumFiles; lFile++ )
+   {
+      psDupes->lTotalBytes += psDupes->asFiles[ lFile ].lSize;
+   }
+
+   /* Same size */
+   MD5_DUPES_Select( psDupes );
+   psDupes->lNumSameSize = psDupes->lNumFiles;
+
+   /* Same ends */
+   psDupes->lBytesRead   = MD5_DUPES_RunPass( psDupes, psPool, FALSE );
+   psDupes->lNumSameEnds = psDupes->lNumFiles;
+
+   /* Same MD5 */
+   psDupes->lBytesRead += MD5_DUPES_RunPass( psDupes, psPool, TRUE );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Tells whether a duplicate starts a new set, i.e. has another content than
+** the one before it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder after MD5_DUPES_Find()
+**    lFile   - Index of the file in asFiles
+**
+** Returns:
+**    BOOL - TRUE for the first file of a set
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DUPES_IsNewSet( const MD5_DUPES_Type* psDupes, UINT64 lFile )
+{
+   const MD5_DUPES_FileType* psFile = &psDupes->asFiles[ lFile ];
+
+   return ( lFile == 0 ) || ( psFile->lSize != psFile[ -1 ].lSize ) ||
+          ( memcmp( psFile->abDigest, psFile[ -1 ].abDigest, MD5_DIGEST_SIZE ) != 0 );
+}
+
+/*------------------------------------------------------------------------------
+** Releases the files of a duplicate finder.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DUPES_Free( MD5_DUPES_Type* psDupes )
+{
+   UINT64 lFile;
+
+   for( lFile = 0; lFile < psDupes->lNumFiles; lFile++ )
+   {
+      free( psDupes->asFiles[ lFile ].pacPath );
+   }
+
+   free( psDupes->asFiles );
+
+   psDupes->asFiles   = NULL;
+   psDupes->lNumFiles = 0;
+   psDupes->lAlloc    = 0;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
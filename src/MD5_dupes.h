@@ -0,0 +1,147 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_dupes.h
+**    Summary: Duplicate file finder. The files below a directory are
+**             narrowed down in passes that each only read the files all
+**             earlier passes left alike: same size (from the walk alone),
+**             then same MD5 of the first and last MD5_DUPES_SAMPLE_SIZE
+**             bytes, then same MD5 of the whole file. Most files are
+**             therefore never read completely.
+**
+**             Empty files and additional hard links of a file are not
+**             reported: they have no content to duplicate.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_DUPES_H_
+#define HMS_SC_MD5_DUPES_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_DUPES_SAMPLE_SIZE          ( 64U * 1024U )
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include "MD5_io.h"
+#include "MD5_pool.h"
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A file of the duplicate finder. The digest is that of the file's ends
+** after the partial pass and that of the whole file after the full pass.
+*/
+typedef struct MD5_DUPES_File
+{
+   char* pacPath;
+   UINT64 lSize;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   BOOL fFull;    /* abDigest is the MD5 of the whole file */
+   BOOL fChanged; /* The size differs from the one found by the walk */
+   int iError;
+} MD5_DUPES_FileType;
+
+/*
+** Called one at a time for every file that could not be compared, with the
+** errno of the failed operation, or 0 if the file changed during the scan.
+*/
+typedef void ( *MD5_DUPES_ErrorFunc )( const char* pacPath, int iError, void* pxCtx );
+
+typedef struct MD5_DUPES
+{
+   MD5_DUPES_FileType* asFiles;     /* The files still alike; after
+                                       MD5_DUPES_Find() the duplicates, by
+                                       size, digest and path */
+   UINT64 lNumFiles;
+   UINT64 lAlloc;
+   BOOL fOutOfMemory;
+   MD5_IO_WorkerType** apsWorkers;  /* Per-worker MD5 instance and read buffer */
+   MD5_DUPES_ErrorFunc pnError;
+   void* pxCtx;
+   BOOL fFullPass;                  /* Pass the jobs are running */
+   UINT64 lNextFile;                /* Next file claimed by a job, updated atomically */
+   UINT64 lNumFound;                /* Statistics of the last MD5_DUPES_Find() */
+   UINT64 lNumSameSize;
+   UINT64 lNumSameEnds;
+   UINT64 lTotalBytes;
+   UINT64 lBytesRead;
+} MD5_DUPES_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares a duplicate finder.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes    - Finder to initialize
+**    apsWorkers - Per-worker MD5 instance and read buffer of the pool that
+**                 MD5_DUPES_Find() runs on
+**    pnError    - Called for every file that could not be compared
+**    pxCtx      - Passed to pnError
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DUPES_Init( MD5_DUPES_Type* psDupes, MD5_IO_WorkerType* apsWorkers[],
+                     MD5_DUPES_ErrorFunc pnError, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Finds the sets of files with the same content below a directory. The
+** reads of every pass run on the pool workers.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder, receives the duplicates in asFiles
+**    psPool  - Pool to run on, not running other jobs
+**    pacRoot - Directory (or single file) to search
+**
+** Returns:
+**    BOOL - FALSE if the walk failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DUPES_Find( MD5_DUPES_Type* psDupes, MD5_POOL_Type* psPool, const char* pacRoot );
+
+/*------------------------------------------------------------------------------
+** Tells whether a duplicate starts a new set, i.e. has another content than
+** the one before it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder after MD5_DUPES_Find()
+**    lFile   - Index of the file in asFiles
+**
+** Returns:
+**    BOOL - TRUE for the first file of a set
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_DUPES_IsNewSet( const MD5_DUPES_Type* psDupes, UINT64 lFile );
+
+/*------------------------------------------------------------------------------
+** Releases the files of a duplicate finder.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDupes - Finder to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_DUPES_Free( MD5_DUPES_Type* psDupes );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_DUPES_H_ */
@@ -11,25 +11,90 @@
 ********************************************************************************
 */
 
+#if defined( _WIN32 )
 #include "windows.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
 
 #include "MD5.h"
+#include "MD5_cache.h"
+#include "MD5_cdc.h"
+#include "MD5_delta.h"
+#include "MD5_dupes.h"
+#include "MD5_fmt.h"
+#include "MD5_fprint.h"
+#include "MD5_index.h"
+#include "MD5_io.h"
+#include "MD5_live.h"
+#include "MD5_manifest.h"
+#include "MD5_multi.h"
+#include "MD5_numa.h"
+#include "MD5_piece.h"
+#include "MD5_pool.h"
+#include "MD5_rpc.h"
+#include "MD5_seq.h"
+#include "MD5_serve.h"
+#include "MD5_state.h"
+#include "MD5_tar.h"
+#include "MD5_throttle.h"
+#include "MD5_tree.h"
+#include "MD5_tune.h"
+#include "MD5_walk.h"
+#include "MD5_watch.h"
 
 /*****************************************************************************
 ** Defines
 ******************************************************************************
 */
 
-#define MAX_READ_FILE_SIZE             4096
+#define DEFAULT_READ_SIZE              4096
 #define CHARACTERS_PER_BYTE            2
 #define NUM_ITERATIONS_PER_BECHMARK    10
+#define DEFAULT_MEM_CAP_MIB            256
+#define CHECK_WINDOW_SIZE              4096
+#define MAX_PIECE_SIZE_KIB             ( 1024 * 1024 )
+#define CHUNK_BLOCK_SIZE               ( 4 * 1024 * 1024 )
+#define CHUNK_WINDOW_SIZE              256
+#define DELTA_SIGNATURE_TAG            "md5-delta"
+#define DEFAULT_SAVE_INTERVAL_SEC      60
+#define OUTPUT_BUFFER_SIZE             ( 1024U * 1024U )
+#define TAR_SMALL_MEMBER_SIZE          ( 64U * 1024U )
+#define TAR_WINDOW_PER_WORKER          4
+#define TAR_MAX_MEMBER_BUFFER          ( 256U * 1024U * 1024U )
+#define DEFAULT_DEBOUNCE_MS            200
+#define WATCH_MAX_DELAY_MS             10000
+#define SERVE_ACCEPT_RETRY_MS          100
+#define DEVICE_NODE_CACHE_SIZE         64
+#define TUNE_FILE_NAME                 "md5-tune"
+
+#define CHECK_RESULT_OK                0
+#define CHECK_RESULT_MISMATCH          1
+#define CHECK_RESULT_READ_ERROR        2
 
 #define CHECK_ARGUMENT( a, b ) CompareStrings( a, strlen( a ), b, strlen( b ) )
 
+#if !defined( _WIN32 )
+/*
+** Map the MSVC "secure" CRT routines onto their standard counterparts
+*/
+#define fopen_s( ppsFile, pacName, pacMode )  ( *( ppsFile ) = fopen( pacName, pacMode ) )
+#define scanf_s( pacFormat, pxValue, iSize )  scanf( pacFormat, pxValue )
+#define sprintf_s                             snprintf
+#endif
+
 /*****************************************************************************
 ** Static variables
 ******************************************************************************
@@ -37,7 +102,8 @@
 
 /*
 ** Set of "sizes" to use for feeding bytes of data into the MD5 algorithm
-** for benchmarking purposes.
+** for benchmarking purposes. Outside the benchmark, files are read in
+** dwReadSize portions.
 */
 static const UINT16 aiBenchmarkReadSizes[] = { 1,   3,   10,  13,  63,   64,   128,
                                                256, 511, 512, 513, 1024, 2048, 4096 };
@@ -53,6 +119,244 @@ static BOOL fPrintHelp         = FALSE;
 static BOOL fVerbose           = FALSE;
 static BOOL fBenchmark         = FALSE;
 static BOOL fWaitForInput      = FALSE;
+static char* pacInputDirectory = NULL;
+static char* pacCheckFilename  = NULL;
+static char* pacListFilename   = NULL;
+static char* pacPieceFilename  = NULL;
+static char* pacChunkFilename  = NULL;
+static char* pacBasisFilename  = NULL;
+static char* pacDeltaFilename  = NULL;
+static char* pacSigFilename    = NULL;
+static char* pacTreeFilename   = NULL;
+static char* pacAppendFilename = NULL;
+static char* pacStreamFilename = NULL;
+static char* pacDupeDirectory  = NULL;
+static char* pacFprintFilename = NULL;
+static char* pacIndexList      = NULL;
+static char* pacTarFilename    = NULL;
+static char* pacWatchDirectory = NULL;
+static char* pacServeSocket    = NULL;
+static char* pacTuneTarget     = NULL;
+static UINT32 dwReadSize       = DEFAULT_READ_SIZE;
+static UINT8 bDigestFormat     = MD5_FMT_HEX;
+static UINT8 bDisplayFormat    = MD5_FMT_HEX_BYTES;
+
+#if( MD5_USE_POSIX_HOST == 1 )
+/*
+** Parameters of the parallel modes
+*/
+static UINT16 iNumWorkers      = 0; /* 0: one worker per online processor */
+static UINT64 lMemCap          = (UINT64)DEFAULT_MEM_CAP_MIB << 20;
+static BOOL fQuiet             = FALSE;
+static BOOL fNulSeparated      = FALSE;
+static BOOL fSparse            = FALSE;
+static char* pacVerifyFilename = NULL;
+static UINT32 dwPieceSize      = MD5_PIECE_DEFAULT_SIZE;
+static UINT32 adwChunkSizes[ 3 ] = { MD5_CDC_DEFAULT_MIN_SIZE, MD5_CDC_DEFAULT_AVG_SIZE,
+                                     MD5_CDC_DEFAULT_MAX_SIZE };
+static UINT32 dwDeltaBlockSize = MD5_DELTA_DEFAULT_BLOCK_SIZE;
+static UINT32 dwLeafSize       = MD5_TREE_DEFAULT_LEAF_SIZE;
+static UINT16 iFanOut          = MD5_TREE_DEFAULT_FAN_OUT;
+static char* pacCacheFilename  = NULL;
+static BOOL fPruneCache        = FALSE;
+static char* pacStateFilename  = NULL;
+static UINT32 dwTailSample     = MD5_STATE_DEFAULT_SAMPLE_SIZE;
+static UINT32 dwCheckpointMiB  = 0; /* 0: checkpoints on SIGUSR1 only */
+static UINT32 dwSaveEverySec   = DEFAULT_SAVE_INTERVAL_SEC;
+static BOOL fResume            = FALSE;
+static UINT32 dwWindowSize     = MD5_FPRINT_DEFAULT_WINDOW_SIZE;
+static UINT32 dwNumWindows     = MD5_FPRINT_DEFAULT_WINDOWS;
+static char* pacLookupFilename = NULL;
+static UINT32 dwDebounceMs     = DEFAULT_DEBOUNCE_MS;
+static char* pacConnectSocket  = NULL;
+static BOOL fBackground        = FALSE;
+static UINT32 dwMaxRateMiB     = 0; /* 0: no limit */
+static UINT32 dwMaxIops        = 0; /* 0: no limit */
+static UINT32 dwCpuCapPercent  = 0; /* 0: no limit */
+static char* pacCpuList        = NULL;
+static char* pacNodeList       = NULL;
+static char* pacTuneFilename   = NULL; /* NULL: TUNE_FILE_NAME in the user's cache directory */
+
+/*
+** Per-worker MD5 instances and read buffers of the parallel modes, each
+** allocated on the node of its worker
+*/
+static MD5_IO_WorkerType** apsIoWorkers = NULL;
+static UINT32 dwNumFailedFiles          = 0;
+static UINT32 dwNumMismatches           = 0;
+
+/*
+** Worker placement given with --cpus or --nodes: the listed CPUs (or nodes)
+** are assigned to the workers round-robin. aiWorkerNodes holds the node of
+** every worker, -1 if unplaced or unknown. When the workers span more than
+** one node, files go preferably to a worker on the node of their storage
+** controller, looked up once per device.
+*/
+static UINT16 aiPlacement[ MD5_NUMA_MAX_CPUS ];
+static UINT16 iNumPlacement           = 0;
+static int aiWorkerNodes[ MD5_POOL_MAX_WORKERS ];
+static BOOL fPreferLocal              = FALSE;
+static UINT16 iNextLocalWorker        = 0;
+static UINT64 alKnownDevices[ DEVICE_NODE_CACHE_SIZE ];
+static int aiKnownDeviceNodes[ DEVICE_NODE_CACHE_SIZE ];
+static UINT32 dwNumKnownDevices       = 0;
+static pthread_mutex_t sPlacementLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+** Digest cache of the -r and --files-from modes, NULL without --cache
+*/
+static MD5_CACHE_Type sDigestCache;
+static MD5_CACHE_Type* psDigestCache = NULL;
+
+/*
+** Known-digest index given with --lookup, NULL if none
+*/
+static MD5_INDEX_Type sDigestIndex;
+static MD5_INDEX_Type* psDigestIndex = NULL;
+static UINT64 lNumKnown              = 0;
+
+/*
+** Read and CPU limits shared by all workers, NULL without --max-rate,
+** --max-iops and --cpu-cap
+*/
+static MD5_THROTTLE_Type sThrottle;
+static MD5_THROTTLE_Type* psThrottle = NULL;
+
+/*
+** Read settings of the device the input is stored on, as measured by
+** --autotune. fTuned is FALSE if the device was never tuned.
+*/
+static MD5_TUNE_SettingsType sTuned;
+static BOOL fTuned = FALSE;
+
+/*
+** Set by SIGUSR1, the stream mode prints a checkpoint at its next read
+*/
+static volatile sig_atomic_t fCheckpointRequested = 0;
+
+/*
+** Set by SIGINT and SIGTERM, the watch mode writes pending changes and stops,
+** the service mode stops accepting connections and ends the open ones
+*/
+static volatile sig_atomic_t fStopRequested = 0;
+
+/*
+** Buffered stdout of the modes that print a line per file, chunk or
+** instruction; handed to stdout in bulk
+*/
+static char acOutputBuffer[ OUTPUT_BUFFER_SIZE ];
+static MD5_FMT_WriterType sStdout;
+
+/*
+** Digest of the empty message, the only digest a zero-length file can have
+*/
+static const UINT8 abEmptyDigest[ MD5_DIGEST_SIZE ] = { 0xd4, 0x1d, 0x8c, 0xd9, 0x8f, 0x00,
+                                                        0xb2, 0x04, 0xe9, 0x80, 0x09, 0x98,
+                                                        0xec, 0xf8, 0x42, 0x7e };
+#endif
+
+/*****************************************************************************
+** Typedefs
+******************************************************************************
+*/
+
+#if( MD5_USE_POSIX_HOST == 1 )
+/*
+** A manifest entry being verified by the check mode
+*/
+typedef struct CheckEntry
+{
+   MD5_SEQ_Type* psSeq;
+   UINT64 lSeq;
+   char* pacName;
+   UINT8 abExpectedDigest[ MD5_DIGEST_SIZE ];
+   UINT8 bResult;
+   int iError;
+} CheckEntryType;
+
+/*
+** An input of the batch mode
+*/
+typedef struct BatchEntry
+{
+   MD5_SEQ_Type* psSeq;
+   UINT64 lSeq;
+   char* pacName;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   int iError;
+} BatchEntryType;
+
+/*
+** Consecutive chunks of the chunk mode, hashed together by one job. The
+** chunks point into a read block, the last batch of a block frees it.
+*/
+typedef struct ChunkBatch
+{
+   MD5_SEQ_Type* psSeq;
+   UINT64 lSeq;
+   UINT8* pbBlock; /* Freed once the batch is emitted, NULL if shared */
+   UINT64 lOffset; /* Stream offset of the first chunk */
+   const UINT8* apbChunk[ MD5_MULTI_LANES ];
+   UINT32 adwLength[ MD5_MULTI_LANES ];
+   UINT8 aabDigest[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT8 bNumChunks;
+} ChunkBatchType;
+
+/*
+** A sampled region of the fingerprint mode, read by one job
+*/
+typedef struct FprintRegion
+{
+   int iFd;
+   MD5_FPRINT_RegionType sRegion;
+   UINT8* pbData;
+   BOOL fShort; /* The input ended before the region did */
+   int iError;
+} FprintRegionType;
+
+/*
+** Members of the tar mode hashed together on a worker: up to
+** MD5_MULTI_LANES small members, or a single larger one. A member too large
+** to buffer is hashed by the reading thread while it is read (data NULL).
+*/
+typedef struct TarBatch
+{
+   MD5_SEQ_Type* psSeq;
+   UINT64 lSeq;
+   char* apacName[ MD5_MULTI_LANES ];
+   UINT8* apbData[ MD5_MULTI_LANES ];
+   UINT32 adwLength[ MD5_MULTI_LANES ];
+   UINT8 aabDigest[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT8 bNumMembers;
+} TarBatchType;
+
+/*
+** Reading side of the parallel tar mode
+*/
+typedef struct TarReader
+{
+   MD5_POOL_Type* psPool;
+   MD5_SEQ_Type* psSeq;
+   TarBatchType* psBatch; /* Batch being filled, NULL if none */
+   UINT32 dwFilled;       /* Bytes of the current member buffered so far */
+   UINT32 dwMemberLimit;  /* Larger members are hashed by the reading thread */
+   BOOL fInMember;        /* The last member of psBatch is still being read */
+   BOOL fOutOfMemory;
+   MD5_InstType sInst;    /* Digest of a member hashed by the reading thread */
+} TarReaderType;
+
+/*
+** Delta mode output state. Copies of consecutive basis blocks are merged.
+*/
+typedef struct DeltaOutput
+{
+   const MD5_DELTA_SigType* psSig;
+   UINT64 lNewOffset;   /* Position in the new file */
+   UINT64 lCopyOffset;  /* Pending copy from the basis file */
+   UINT64 lCopyLength;
+   UINT64 lLiteralBytes;
+} DeltaOutputType;
+#endif
 
 /*****************************************************************************
 ** Forward declarations
@@ -65,10 +369,102 @@ static void StartCounter( double* prFrequency, UINT64* plCounterStart );
 static double GetCounter( double rFrequency, UINT64 lCounterStart );
 static BOOL ParseMd5File( char* acMd5Filename, UINT8* pbMd5 );
 static BOOL CompareStrings( char* acStr1, UINT8 bStr1Len, char* acStr2, UINT8 bStr2Len );
+static char* GetValue( int argc, char* argv[], int* pdwArgument );
+#if( MD5_USE_POSIX_HOST == 1 )
+static BOOL GetNumber( int argc, char* argv[], int* pdwArgument, UINT32 dwMin, UINT32 dwMax,
+                       UINT32* pdwValue );
+#endif
 static BOOL ParseArguments( int argc, char* argv[] );
 static void WriteDigestToFile( const MD5_InstType* psInst, const char* pacOutputFilename );
 static void PrintDigest( const MD5_InstType* psInst );
-static BOOL ComputeMd5( FILE* psFile, UINT16 iRdSize, MD5_InstType* psMd5Inst, UINT8* pbExpectedDigest );
+static BOOL ComputeMd5( FILE* psFile, UINT32 dwRdSize, MD5_InstType* psMd5Inst,
+                        UINT8* pbExpectedDigest );
+#if( MD5_USE_POSIX_HOST == 1 )
+static BOOL ReadWholeFile( const char* pacFilename, char** ppacData, size_t* piSize );
+static void WriteName( MD5_FMT_WriterType* psWriter, const char* pacName, BOOL fEscape );
+static void WriteDigestLine( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest,
+                             const char* pacName );
+static BOOL CreateWorkers( MD5_POOL_Type* psPool );
+static UINT16 GetNumPlacedCpus( void );
+static BOOL PlaceWorkers( MD5_NUMA_CpuSetType* asCpus );
+static int PickLocalWorker( UINT64 lDevice, void* pxCtx );
+static BOOL OpenDigestCache( void );
+static BOOL CloseDigestCache( void );
+static void DestroyWorkers( MD5_POOL_Type* psPool );
+static BOOL OpenDigestIndex( void );
+static void CloseDigestIndex( void );
+static void StartBackgroundMode( void );
+static const char* GetTuneFilename( BOOL fCreateDirectory );
+static const char* GetTunePath( void );
+static void LoadTunedSettings( void );
+static BOOL WriteTuneSample( int iFd, UINT64 lSize );
+static void PrintTuneTrial( const MD5_TUNE_SettingsType* psTrial, void* pxCtx );
+static BOOL AutotuneDevice( const char* pacTarget );
+static void WriteResultLine( const UINT8* pbDigest, const char* pacName );
+static void GetWalkCacheKey( const MD5_WALK_FileType* psFile, MD5_CACHE_KeyType* psKey );
+static void HashTreeVisit( MD5_WALK_FileType* psFile, UINT16 iWorker, void* pxCtx );
+static void HashTreeVisitBatch( MD5_WALK_FileType* apsFiles[], UINT16 iNumFiles, UINT16 iWorker,
+                                void* pxCtx );
+static void HashTreeEmit( const MD5_WALK_FileType* psFile, void* pxCtx );
+static BOOL HashDirectoryTree( const char* pacRoot );
+static void CheckJob( void* pxArg, UINT16 iWorker );
+static void CheckEmit( void* pxItem, void* pxCtx );
+static BOOL CheckManifest( const char* pacManifest );
+static void BatchJob( void* pxArg, UINT16 iWorker );
+static void BatchEmit( void* pxItem, void* pxCtx );
+static BOOL HashFileList( const char* pacList, int iSeparator );
+static MD5_PIECE_ResultType* HashPieces( int iFd, UINT64 lSize, UINT32 dwSize, int iLeadByte );
+static BOOL WritePieceList( const char* pacInput, const char* pacList );
+static void PrintCorruptRange( const char* pacInput, UINT64 lStart, UINT64 lEnd );
+static void WriteChunkLine( UINT64 lOffset, UINT32 dwLength, const UINT8* pbDigest, void* pxCtx );
+static void ChunkJob( void* pxArg, UINT16 iWorker );
+static void ChunkEmit( void* pxItem, void* pxCtx );
+static size_t ReadFully( int iFd, UINT8* pbBuffer, size_t iSize, int* piError );
+static BOOL ChunkStream( const char* pacInput );
+static BOOL MapFile( const char* pacFilename, UINT8** ppbData, UINT64* plSize );
+static void UnmapFile( UINT8* pbData, UINT64 lSize );
+static BOOL WriteSignature( const char* pacBasis, const char* pacSig );
+static MD5_DELTA_SigType* ReadSignature( const char* pacSig );
+static void DeltaFlushCopy( DeltaOutputType* psOut );
+static void DeltaCopy( UINT32 dwBlock, void* pxCtx );
+static void DeltaLiteral( const UINT8* pbData, UINT64 lLength, void* pxCtx );
+static BOOL WriteDelta( const char* pacNew, const char* pacSig );
+static BOOL TreeHash( const char* pacInput );
+static BOOL AppendHash( const char* pacInput );
+static void RequestCheckpoint( int iSignal );
+static void WriteCheckpoint( const MD5_InstType* psInst );
+static BOOL SaveStreamState( int iFd, const MD5_InstType* psInst, UINT8* pbBuffer );
+static BOOL ResumeStream( int iFd, MD5_InstType* psInst, UINT8* pbBuffer );
+static BOOL StreamHash( const char* pacInput );
+static void ReportDupeError( const char* pacPath, int iError, void* pxCtx );
+static BOOL FindDuplicates( const char* pacRoot );
+static void FprintJob( void* pxArg, UINT16 iWorker );
+static BOOL Fingerprint( const char* pacInput );
+static BOOL MakeIndex( const char* pacList, const char* pacDb );
+static void TarWriteMember( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest,
+                            void* pxCtx );
+static void TarSubmitBatch( TarReaderType* psReader );
+static void TarBegin( const MD5_TAR_MemberType* psMember, void* pxCtx );
+static void TarData( const UINT8* pbData, UINT32 dwLength, void* pxCtx );
+static void TarEnd( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest, void* pxCtx );
+static void TarJob( void* pxArg, UINT16 iWorker );
+static void TarEmit( void* pxItem, void* pxCtx );
+static BOOL HashTarArchive( const char* pacInput );
+static void RequestStop( int iSignal );
+static void ReportWatchError( const char* pacPath, int iError, void* pxCtx );
+static void WriteWatchLine( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest,
+                            const char* pacPath, void* pxCtx );
+static BOOL WriteWatchManifest( MD5_LIVE_Type* psLive );
+static BOOL WatchFlush( MD5_POOL_Type* psPool, MD5_WATCH_Type* psWatch, MD5_LIVE_Type* psLive,
+                        const char* pacRoot );
+static BOOL WatchTree( const char* pacRoot, const char* pacFilename );
+static void ReportServeError( int iError, void* pxCtx );
+static BOOL ServeRequests( const char* pacSocket );
+static void WriteConnectResult( const char* pacName, const UINT8* pbDigest, int iError,
+                                void* pxCtx );
+static BOOL SubmitFileList( const char* pacList, int iSeparator, const char* pacSocket );
+static BOOL VerifyPieceList( const char* pacInput, const char* pacList );
+#endif
 
 /*****************************************************************************
 ** Global routines
@@ -106,10 +502,24 @@ int main( int argc, char* argv[] )
       printf( "[TEST_MODE]\n" );
 
       fAllTestsPassed = MD5_RunTests( &sMd5Inst );
+      fAllTestsPassed = MD5_MULTI_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_TREE_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_MANIFEST_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_CDC_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_DELTA_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_FMT_RunTests() && fAllTestsPassed;
+      fAllTestsPassed = MD5_TAR_RunTests() && fAllTestsPassed;
 
       printf( "\n" );
 
-      if( pacInputFilename == NULL )
+      if( ( pacInputFilename == NULL ) && ( pacInputDirectory == NULL ) &&
+          ( pacCheckFilename == NULL ) && ( pacListFilename == NULL ) &&
+          ( pacPieceFilename == NULL ) && ( pacChunkFilename == NULL ) &&
+          ( pacBasisFilename == NULL ) && ( pacDeltaFilename == NULL ) &&
+          ( pacTreeFilename == NULL ) && ( pacAppendFilename == NULL ) &&
+          ( pacStreamFilename == NULL ) && ( pacDupeDirectory == NULL ) &&
+          ( pacFprintFilename == NULL ) && ( pacIndexList == NULL ) && ( pacTarFilename == NULL ) &&
+          ( pacWatchDirectory == NULL ) && ( pacServeSocket == NULL ) && ( pacTuneTarget == NULL ) )
       {
          if( fAllTestsPassed == FALSE )
          {
@@ -121,6 +531,225 @@ int main( int argc, char* argv[] )
    }
 #endif
 
+#if( MD5_USE_POSIX_HOST == 1 )
+   /* Interactive output is shown line by line, anything else in bulk */
+   MD5_FMT_WriterInit( &sStdout, stdout, acOutputBuffer, sizeof( acOutputBuffer ),
+                       ( isatty( STDOUT_FILENO ) == 1 ) );
+   StartBackgroundMode();
+
+   if( pacTuneTarget != NULL )
+   {
+      if( !AutotuneDevice( pacTuneTarget ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   LoadTunedSettings();
+
+   if( pacCheckFilename != NULL )
+   {
+      if( !CheckManifest( pacCheckFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacInputDirectory != NULL )
+   {
+      if( !OpenDigestIndex() || !HashDirectoryTree( pacInputDirectory ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      CloseDigestIndex();
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacListFilename != NULL )
+   {
+      int iSeparator = fNulSeparated ? '\0' : '\n';
+      BOOL fListDone;
+
+      if( pacConnectSocket != NULL )
+      {
+         fListDone =
+            OpenDigestIndex() && SubmitFileList( pacListFilename, iSeparator, pacConnectSocket );
+      }
+      else
+      {
+         fListDone = OpenDigestIndex() && HashFileList( pacListFilename, iSeparator );
+      }
+
+      if( !fListDone || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      CloseDigestIndex();
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacPieceFilename != NULL )
+   {
+      if( pacVerifyFilename != NULL )
+      {
+         fAllTestsPassed =
+            VerifyPieceList( pacPieceFilename, pacVerifyFilename ) && fAllTestsPassed;
+      }
+      else
+      {
+         fAllTestsPassed = WritePieceList( pacPieceFilename, pacOutputFilename ) && fAllTestsPassed;
+      }
+
+      if( !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacChunkFilename != NULL )
+   {
+      if( !ChunkStream( pacChunkFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( ( pacBasisFilename != NULL ) || ( pacDeltaFilename != NULL ) )
+   {
+      if( pacBasisFilename != NULL )
+      {
+         fAllTestsPassed = WriteSignature( pacBasisFilename, pacOutputFilename ) && fAllTestsPassed;
+      }
+      else
+      {
+         fAllTestsPassed = WriteDelta( pacDeltaFilename, pacSigFilename ) && fAllTestsPassed;
+      }
+
+      if( !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacTreeFilename != NULL )
+   {
+      if( !TreeHash( pacTreeFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacAppendFilename != NULL )
+   {
+      if( !AppendHash( pacAppendFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacStreamFilename != NULL )
+   {
+      if( !StreamHash( pacStreamFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacDupeDirectory != NULL )
+   {
+      if( !FindDuplicates( pacDupeDirectory ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacFprintFilename != NULL )
+   {
+      if( !Fingerprint( pacFprintFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacIndexList != NULL )
+   {
+      if( !MakeIndex( pacIndexList, pacOutputFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacTarFilename != NULL )
+   {
+      if( !HashTarArchive( pacTarFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacWatchDirectory != NULL )
+   {
+      if( !WatchTree( pacWatchDirectory, pacOutputFilename ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+
+   if( pacServeSocket != NULL )
+   {
+      if( !ServeRequests( pacServeSocket ) || !fAllTestsPassed )
+      {
+         dwReturn = -1;
+      }
+
+      HandleWaitForInputOption();
+      return dwReturn;
+   }
+#endif
+
    if( fVerbose )
    {
       printf( "[INPUT_FILE]\n%s\n\n", pacInputFilename );
@@ -146,9 +775,13 @@ int main( int argc, char* argv[] )
 
          if( !fBenchmark )
          {
-            /* The last entry is assumed to be the default read size,
-            ** when not benchmarking */
-            iTestReadSizeEntry = iNumTestEntries - 1;
+            /* A single pass in the read size tuned for the device */
+            iTestReadSizeEntry = iNumTestEntries;
+
+            if( !ComputeMd5( psFile, dwReadSize, &sMd5Inst, pbDigest ) )
+            {
+               fAllTestsPassed = FALSE;
+            }
          }
 
          for( ; iTestReadSizeEntry < iNumTestEntries; iTestReadSizeEntry++ )
@@ -165,7 +798,7 @@ int main( int argc, char* argv[] )
       else
       {
          fAllTestsPassed = FALSE;
-         printf( "Error: Failed to open file! (%s)\n", pacInputFilename );
+         fprintf( stderr, "md5: %s: can't open the file\n", pacInputFilename );
       }
    }
 
@@ -243,6 +876,33 @@ static void PrintHelp( void )
       "\n"
       "USAGE :\n"
       "  MD5.exe -i <filename> [-o <filename>] ... [--help]\n"
+#if( MD5_USE_POSIX_HOST == 1 )
+      "  md5 -r <directory> [-j <workers>] [--mem-cap <MiB>]\n"
+      "         [--cache <file> [--prune-cache]] [--lookup <index>]\n"
+      "         [--background] [--max-rate <MiB/s>] [--max-iops <n>]\n"
+      "         [--cpu-cap <percent>] [--cpus <list> | --nodes <list>]\n"
+      "  md5 -c <manifest> [-j <workers>] [--quiet]\n"
+      "  md5 --files-from <list> [-0] [-j <workers>]\n"
+      "                   [--cache <file> [--prune-cache]] [--lookup <index>]\n"
+      "  md5 --files-from <list> [-0] --connect <socket> [--lookup <index>]\n"
+      "  md5 --pieces <file> [--piece-size <KiB>] [-o <list>]\n"
+      "  md5 --pieces <file> --verify-pieces <list> [--quiet]\n"
+      "  md5 --chunks <file> [--chunk-sizes <min>,<avg>,<max>] [-j <workers>]\n"
+      "  md5 --signature <basis> [--block-size <bytes>] [-o <signature>]\n"
+      "  md5 --delta <file> --from <signature>\n"
+      "  md5 --tree <file> [--leaf-size <KiB>] [--fan-out <n>] [-j <workers>]\n"
+      "  md5 --append <file> [--state <file>] [--tail-sample <KiB>]\n"
+      "  md5 --stream <file> [--checkpoint-every <MiB>]\n"
+      "               [--state <file> [--save-every <s>] [--resume]]\n"
+      "  md5 --dupes <directory> [-j <workers>]\n"
+      "  md5 --fingerprint <file> [--windows <n>] [--window-size <KiB>]\n"
+      "  md5 --make-index <list> -o <database>\n"
+      "  md5 --tar <archive> [-j <workers>]\n"
+      "  md5 --watch <directory> -o <manifest> [--debounce <ms>] [-j <workers>]\n"
+      "              [--cache <file>]\n"
+      "  md5 --serve <socket> [-j <workers>] [--mem-cap <MiB>]\n"
+      "  md5 --autotune <path> [-j <workers>] [--mem-cap <MiB>] [--tune-file <file>]\n"
+#endif
       "\n"
       "OPTIONS :\n"
       "  --help             Prints this help menu.\n"
@@ -259,10 +919,165 @@ static void PrintHelp( void )
       "  -o    <filename>   Output file to write the MD5 digest to. If no output file\n"
       "                     is provided, the digest will only be written to the\n"
       "                     console."
+      "\n"
+      "  --format <format>  Digest format of -i, -o and the md5sum lines of the\n"
+      "                     other modes: hex (lower case), upper, base64 or raw\n"
+      "                     (the 16 digest bytes alone, without name or newline).\n"
+#if( MD5_USE_POSIX_HOST == 1 )
+      "  -j    <workers>    Number of worker threads used by the parallel modes\n"
+      "                     (default: one per online processor).\n"
+      "  --mem-cap <MiB>    Cap on the read buffer memory of all workers combined\n"
+      "                     (at least 1, default: %u MiB).\n"
+      "  --quiet            Check mode: don't print a line for files that are OK.\n"
+      "  -0                 File list entries are NUL separated (find -print0).\n"
+      "                     Without --files-from the list is read from stdin.\n"
+      "  --cache <file>     -r and --files-from: answer files whose device, inode,\n"
+      "                     size, mtime and ctime are unchanged from a digest\n"
+      "                     cache without reading them, and update the cache.\n"
+      "  --prune-cache      Drop the cache entries of files this run didn't visit\n"
+      "                     (deleted files, or files outside the scanned trees).\n"
+      "  --lookup <index>   -r and --files-from: tag every digest KNOWN or UNKNOWN\n"
+      "                     by its membership in a --make-index database or a\n"
+      "                     text list of digests.\n"
+      "  --sparse           Parallel modes: skip the holes of sparse files instead\n"
+      "                     of reading them (same digest, less I/O).\n"
+      "  --piece-size <KiB> Piece size of a new piece list (default: %u KiB).\n"
+      "  --chunk-sizes <min>,<avg>,<max>\n"
+      "                     Chunk size limits in bytes, avg a power of two\n"
+      "                     (default: %u,%u,%u).\n"
+      "  --block-size <bytes>\n"
+      "                     Block size of a new delta signature (default: %u).\n"
+      "  --from <signature> Delta mode: signature of the basis file.\n"
+      "  --leaf-size <KiB>  Tree hash leaf size (default: %u KiB).\n"
+      "  --fan-out <n>      Tree hash children per node, %u..%u (default: %u).\n"
+      "  --state <file>     Append mode: state file (default: <file>.md5state).\n"
+      "                     Stream mode: save the hashing state of a regular\n"
+      "                     file there, so the job can be resumed.\n"
+      "  --save-every <s>   Stream mode: state save interval (default: %u s).\n"
+      "  --resume           Stream mode: continue from the saved state if the\n"
+      "                     input is unchanged up to it.\n"
+      "  --tail-sample <KiB>\n"
+      "                     Append and stream mode: bytes at the end of the\n"
+      "                     hashed prefix that are re-read to check it is\n"
+      "                     unchanged, 0 to trust the file identity and size\n"
+      "                     (default: %u KiB).\n"
+      "  --checkpoint-every <MiB>\n"
+      "                     Stream mode: print the digest of everything read so\n"
+      "                     far every <MiB> (default: only on SIGUSR1).\n"
+      "  --windows <n>      Fingerprint windows between head and tail, 0..%u\n"
+      "                     (default: %u).\n"
+      "  --window-size <KiB>\n"
+      "                     Fingerprint window size (default: %u KiB).\n"
+      "  --debounce <ms>    Watch mode: apply changes once the tree has been quiet\n"
+      "                     this long (default: %u ms, at most %u s later).\n"
+      "  --connect <socket> --files-from: have the files hashed by the service\n"
+      "                     listening on the socket (see --serve).\n"
+      "  --background       Parallel modes: run in the idle CPU and I/O scheduling\n"
+      "                     classes and keep the page cache as it was: data\n"
+      "                     read from the disk is dropped after hashing.\n"
+      "  --max-rate <MiB/s> Parallel modes: limit the read rate of all workers.\n"
+      "  --max-iops <n>     Parallel modes: limit the read calls per second.\n"
+      "  --cpu-cap <percent>\n"
+      "                     Parallel modes: limit the CPU time, in percent of\n"
+      "                     one CPU (200: two CPUs).\n"
+      "  --cpus <list>      Parallel modes: pin the workers to these CPUs, one CPU\n"
+      "                     each, round-robin (e.g. 0-7,16-23). Default number\n"
+      "                     of workers: one per listed CPU.\n"
+      "  --nodes <list>     Parallel modes: pin the workers to the CPUs of these\n"
+      "                     NUMA nodes, one node each, round-robin. Buffers are\n"
+      "                     allocated on the worker's node, and large files go\n"
+      "                     preferably to a worker on the node of their storage\n"
+      "                     controller (-r, --files-from, --watch).\n"
+      "  --tune-file <file> Read settings file of --autotune, used by every\n"
+      "                     mode (default: $XDG_CACHE_HOME/" TUNE_FILE_NAME ",\n"
+      "                     or ~/.cache/" TUNE_FILE_NAME ").\n"
+#endif
       "\n"
       "PARAMETERS :\n"
       "  -i    <filename>   Input file to compute the MD5 for.\n"
-      "\n" );
+#if( MD5_USE_POSIX_HOST == 1 )
+      "  -r    <directory>  Recursively hash all regular files below the directory\n"
+      "                     in parallel. Digests are printed in md5sum format in\n"
+      "                     sorted path order, hard links are hashed only once and\n"
+      "                     symbolic links are not followed.\n"
+      "  -c    <manifest>   Verify all files listed in an md5sum manifest (\"-\" for\n"
+      "                     stdin) in parallel. Results are reported like md5sum\n"
+      "                     -c, in manifest order.\n"
+      "  --files-from <list>\n"
+      "                     Hash every file named in the list (one per line, \"-\"\n"
+      "                     for stdin) in parallel. Digests are streamed in md5sum\n"
+      "                     format in list order.\n"
+      "  --pieces <file>    Hash a file or block device in fixed size pieces in\n"
+      "                     parallel and write the piece list.\n"
+      "  --verify-pieces <list>\n"
+      "                     Verify the --pieces file against a piece list and\n"
+      "                     report the corrupt byte ranges.\n"
+      "  --chunks <file>    Split a file (\"-\" for stdin) into content-defined\n"
+      "                     chunks and print \"<digest> <offset> <length>\" for\n"
+      "                     each chunk.\n"
+      "  --signature <basis>\n"
+      "                     Write the delta signature (weak and MD5 sum of every\n"
+      "                     block) of a basis file.\n"
+      "  --delta <file>     Print the copy/literal instructions that rebuild the\n"
+      "                     file from the basis file of a signature.\n"
+      "  --tree <file>      Compute the MD5 tree hash of a file or block device,\n"
+      "                     hashing its leaves on all workers. This is NOT the\n"
+      "                     MD5 of the file; the output names the leaf size and\n"
+      "                     fan-out it depends on.\n"
+      "  --append <file>    Digest of a file that only grows: continue from the\n"
+      "                     state saved by the previous run, hash only the bytes\n"
+      "                     appended since and save the new state.\n"
+      "  --stream <file>    Hash a file or stream (\"-\" for stdin) and print\n"
+      "                     \"checkpoint <offset> <digest>\" lines on the way:\n"
+      "                     each digest is the MD5 of the first <offset> bytes.\n"
+      "  --dupes <directory>\n"
+      "                     Find the files below the directory with the same\n"
+      "                     content and print each set in md5sum format, sets\n"
+      "                     separated by an empty line. Files are compared by\n"
+      "                     size, then by the MD5 of their first and last %u KiB,\n"
+      "                     and only files still alike are read in full.\n"
+      "  --fingerprint <file>\n"
+      "                     Quick change detector for huge files: the MD5 of the\n"
+      "                     size and of the head, tail and evenly spaced windows,\n"
+      "                     read in parallel. This is NOT the MD5 of the file;\n"
+      "                     the output names the window size and count.\n"
+      "  --make-index <list>\n"
+      "                     Build a known-digest database from a text list of\n"
+      "                     digests (bare or md5sum lines, \"-\" for stdin). The\n"
+      "                     database is used in place, without a load phase.\n"
+      "  --tar <archive>    Print the MD5 of every regular file in a tar archive\n"
+      "                     (ustar, pax or GNU; \"-\" for stdin) in md5sum\n"
+      "                     format, without extracting it. Members are hashed\n"
+      "                     on the workers unless -j 1 is given.\n"
+      "  --watch <directory>\n"
+      "                     Write the md5sum manifest of the tree to -o, then keep\n"
+      "                     it current until SIGINT or SIGTERM: only files that\n"
+      "                     are closed after writing or moved in are rehashed.\n"
+      "                     The manifest is replaced atomically (Linux only).\n"
+      "  --serve <socket>   Run as a local hashing service on a Unix domain socket\n"
+      "                     until SIGINT or SIGTERM. Clients submit paths, fds\n"
+      "                     (memfd, shared memory) or data, batched and\n"
+      "                     pipelined (protocol: MD5_rpc.h).\n"
+      "  --autotune <path>  Measure the hashing throughput of the device holding\n"
+      "                     the path with different read sizes, backends and\n"
+      "                     numbers of workers, and record the fastest in the\n"
+      "                     --tune-file. Every mode then uses them for input\n"
+      "                     on that device, unless -j or --cpus/--nodes is\n"
+      "                     given. A directory is measured with a temporary\n"
+      "                     sample file written to it; a file or block device\n"
+      "                     is read as it is.\n"
+#endif
+      "\n"
+#if( MD5_USE_POSIX_HOST == 1 )
+      , DEFAULT_MEM_CAP_MIB, MD5_PIECE_DEFAULT_SIZE / 1024, MD5_CDC_DEFAULT_MIN_SIZE,
+      MD5_CDC_DEFAULT_AVG_SIZE, MD5_CDC_DEFAULT_MAX_SIZE, MD5_DELTA_DEFAULT_BLOCK_SIZE,
+      MD5_TREE_DEFAULT_LEAF_SIZE / 1024, MD5_TREE_MIN_FAN_OUT, MD5_TREE_MAX_FAN_OUT,
+      MD5_TREE_DEFAULT_FAN_OUT,
+      DEFAULT_SAVE_INTERVAL_SEC, MD5_STATE_DEFAULT_SAMPLE_SIZE / 1024,
+      MD5_FPRINT_MAX_WINDOWS, MD5_FPRINT_DEFAULT_WINDOWS, MD5_FPRINT_DEFAULT_WINDOW_SIZE / 1024,
+      DEFAULT_DEBOUNCE_MS, WATCH_MAX_DELAY_MS / 1000, MD5_DUPES_SAMPLE_SIZE / 1024
+#endif
+      );
 }
 
 /*----------------------------------------------------------------------------
@@ -285,6 +1100,7 @@ static void HandleWaitForInputOption( void )
 */
 static void StartCounter( double* prFrequency, UINT64* plCounterStart )
 {
+#if defined( _WIN32 )
    LARGE_INTEGER lTmp;
 
    if( !QueryPerformanceFrequency( &lTmp ) )
@@ -296,6 +1112,15 @@ static void StartCounter( double* prFrequency, UINT64* plCounterStart )
 
    QueryPerformanceCounter( &lTmp );
    *plCounterStart = (UINT64)lTmp.QuadPart;
+#else
+   struct timespec sNow;
+
+   clock_gettime( CLOCK_MONOTONIC, &sNow );
+
+   /* Nanosecond ticks */
+   *prFrequency    = 1000000.0;
+   *plCounterStart = (UINT64)sNow.tv_sec * 1000000000ULL + (UINT64)sNow.tv_nsec;
+#endif
 }
 
 /*----------------------------------------------------------------------------
@@ -304,9 +1129,18 @@ static void StartCounter( double* prFrequency, UINT64* plCounterStart )
 */
 static double GetCounter( double rFrequency, UINT64 lCounterStart )
 {
+#if defined( _WIN32 )
    LARGE_INTEGER uPerfCounter;
    QueryPerformanceCounter( &uPerfCounter );
    return (double)( uPerfCounter.QuadPart - lCounterStart ) / rFrequency;
+#else
+   struct timespec sNow;
+
+   clock_gettime( CLOCK_MONOTONIC, &sNow );
+
+   return (double)( (UINT64)sNow.tv_sec * 1000000000ULL + (UINT64)sNow.tv_nsec - lCounterStart ) /
+          rFrequency;
+#endif
 }
 
 /*----------------------------------------------------------------------------
@@ -322,7 +1156,7 @@ static BOOL ParseMd5File( char* acMd5Filename, UINT8* pbMd5 )
 
    if( psFile == NULL )
    {
-      printf( "Error: Failed to open MD5 file! (%s)\n", acMd5Filename );
+      fprintf( stderr, "md5: %s: can't open the file\n", acMd5Filename );
       fSuccess = FALSE;
    }
    else
@@ -331,42 +1165,31 @@ static BOOL ParseMd5File( char* acMd5Filename, UINT8* pbMd5 )
       UINT16 iBytesToRead = CHARACTERS_PER_BYTE * MD5_DIGEST_SIZE + 1;
       UINT16 iBytesRead;
       char acReadBuffer[ CHARACTERS_PER_BYTE * MD5_DIGEST_SIZE + 1 ];
-      UINT8* pbReadData = (UINT8*)acReadBuffer;
 
       iBytesRead = (UINT16)fread( acReadBuffer, bElementSize, (size_t)iBytesToRead, psFile );
 
-      if( iBytesRead >= MD5_DIGEST_SIZE << 1 )
+      /*
+      ** Only the leading digest is used, so md5sum manifests with a single
+      ** entry are accepted as well
+      */
+      if( iBytesRead < MD5_DIGEST_SIZE << 1 )
       {
-         UINT8 iByteIndex;
-
-         if( fVerbose )
-         {
-            printf( "[INPUT_DIGEST]\n" );
-         }
-
-         for( iByteIndex = 0; iByteIndex < MD5_DIGEST_SIZE; iByteIndex++ )
-         {
-            int buf;
-
-            sscanf_s( (char*)pbReadData, "%02x", &buf );
-            pbMd5[ iByteIndex ] = (UINT8)buf;
-            if( fVerbose )
-            {
-               printf( "%02X ", pbMd5[ iByteIndex ] );
-            }
-            pbReadData += CHARACTERS_PER_BYTE;
-         }
-
-         if( fVerbose )
-         {
-            printf( "\n\n" );
-         }
+         fprintf( stderr, "md5: %s: digest too short\n", acMd5Filename );
+         fSuccess = FALSE;
       }
-      else
+      else if( !MD5_FMT_DecodeHex( acReadBuffer, pbMd5 ) )
       {
-         printf( "Error: Unexpected MD5 size read from file!\n" );
+         fprintf( stderr, "md5: %s: malformed digest\n", acMd5Filename );
          fSuccess = FALSE;
       }
+      else if( fVerbose )
+      {
+         char acText[ MD5_FMT_HEX_BYTES_LEN ];
+
+         printf( "[INPUT_DIGEST]\n" );
+         fwrite( acText, 1, MD5_FMT_Encode( pbMd5, MD5_FMT_HEX_BYTES, acText ), stdout );
+         printf( "\n\n" );
+      }
 
       fclose( psFile );
    }
@@ -395,30 +1218,84 @@ static BOOL CompareStrings( char* acStr1, UINT8 bStr1Len, char* acStr2, UINT8 bS
 }
 
 /*----------------------------------------------------------------------------
-** Parse argument passed in from console
+** Return the value of the option at *pdwArgument and step over it, or NULL
+** (after reporting it) if the option is the last argument. *pdwArgument is
+** then past the end of argv.
 *-----------------------------------------------------------------------------
 */
-static BOOL ParseArguments( int argc, char* argv[] )
+static char* GetValue( int argc, char* argv[], int* pdwArgument )
 {
-   BOOL fValidArguments = TRUE;
-
-   if( argc == 1 )
+   if( *pdwArgument + 1 >= argc )
    {
-      fPrintHelp = TRUE;
+      fprintf( stderr, "md5: %s: requires a value\n", argv[ *pdwArgument ] );
+      *pdwArgument = argc;
+      return NULL;
    }
-   else
-   {
-      int dwArgument = 1;
 
-      while( dwArgument < argc )
+   return argv[ ++*pdwArgument ];
+}
+
+#if( MD5_USE_POSIX_HOST == 1 )
+/*----------------------------------------------------------------------------
+** Parse the numeric value of the option at *pdwArgument and step over it.
+** The whole value must be a number from dwMin to dwMax.
+*-----------------------------------------------------------------------------
+*/
+static BOOL GetNumber( int argc, char* argv[], int* pdwArgument, UINT32 dwMin, UINT32 dwMax,
+                       UINT32* pdwValue )
+{
+   const char* pacOption = argv[ *pdwArgument ];
+   const char* pacValue  = GetValue( argc, argv, pdwArgument );
+   unsigned long dwValue;
+   char* pacEnd;
+
+   if( pacValue == NULL )
+   {
+      return FALSE;
+   }
+
+   errno   = 0;
+   dwValue = strtoul( pacValue, &pacEnd, 0 );
+
+   if( ( *pacValue < '0' ) || ( *pacValue > '9' ) || ( *pacEnd != '\0' ) || ( errno != 0 ) ||
+       ( dwValue < dwMin ) || ( dwValue > dwMax ) )
+   {
+      fprintf( stderr, "md5: %s: expected a number from %lu to %lu, not %s\n", pacOption,
+               (unsigned long)dwMin, (unsigned long)dwMax, pacValue );
+      return FALSE;
+   }
+
+   *pdwValue = (UINT32)dwValue;
+
+   return TRUE;
+}
+#endif
+
+/*----------------------------------------------------------------------------
+** Parse argument passed in from console
+*-----------------------------------------------------------------------------
+*/
+static BOOL ParseArguments( int argc, char* argv[] )
+{
+   BOOL fValidArguments = TRUE;
+
+   if( argc == 1 )
+   {
+      fPrintHelp = TRUE;
+   }
+   else
+   {
+      int dwArgument = 1;
+
+      while( dwArgument < argc )
       {
          if( CHECK_ARGUMENT( argv[ dwArgument ], "-i" ) )
          {
-            pacInputFilename = argv[ ++dwArgument ];
+            pacInputFilename = GetValue( argc, argv, &dwArgument );
          }
          else if( CHECK_ARGUMENT( argv[ dwArgument ], "-o" ) )
          {
-            pacOutputFilename = argv[ ++dwArgument ];
+            pacOutputFilename = GetValue( argc, argv, &dwArgument );
          }
          else if( CHECK_ARGUMENT( argv[ dwArgument ], "-v" ) )
          {
@@ -426,7 +1303,42 @@ static BOOL ParseArguments( int argc, char* argv[] )
          }
          else if( CHECK_ARGUMENT( argv[ dwArgument ], "--md5" ) )
          {
-            pacInMd5Filename = argv[ ++dwArgument ];
+            pacInMd5Filename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--format" ) )
+         {
+            char* pacFormat = GetValue( argc, argv, &dwArgument );
+
+            if( pacFormat == NULL )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            if( CHECK_ARGUMENT( pacFormat, "hex" ) )
+            {
+               bDigestFormat = MD5_FMT_HEX;
+            }
+            else if( CHECK_ARGUMENT( pacFormat, "upper" ) )
+            {
+               bDigestFormat = MD5_FMT_HEX_UPPER;
+            }
+            else if( CHECK_ARGUMENT( pacFormat, "base64" ) )
+            {
+               bDigestFormat = MD5_FMT_BASE64;
+            }
+            else if( CHECK_ARGUMENT( pacFormat, "raw" ) )
+            {
+               bDigestFormat = MD5_FMT_RAW;
+            }
+            else
+            {
+               printf( "Invalid digest format: %s\n", pacFormat );
+               fValidArguments = FALSE;
+               break;
+            }
+
+            bDisplayFormat = bDigestFormat;
          }
 #if( MD5_USE_TEST_ROUTINE == 1 )
          else if( CHECK_ARGUMENT( argv[ dwArgument ], "--test" ) )
@@ -444,6 +1356,348 @@ static BOOL ParseArguments( int argc, char* argv[] )
             fBenchmark = TRUE;
             fVerbose   = TRUE;
          }
+#if( MD5_USE_POSIX_HOST == 1 )
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "-r" ) )
+         {
+            pacInputDirectory = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "-j" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 1, MD5_POOL_MAX_WORKERS, &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            iNumWorkers = (UINT16)dwValue;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--mem-cap" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            lMemCap = (UINT64)dwValue << 20;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "-c" ) )
+         {
+            pacCheckFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--quiet" ) )
+         {
+            fQuiet = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--files-from" ) )
+         {
+            pacListFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "-0" ) )
+         {
+            fNulSeparated = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--sparse" ) )
+         {
+            fSparse = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--cache" ) )
+         {
+            pacCacheFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--prune-cache" ) )
+         {
+            fPruneCache = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--pieces" ) )
+         {
+            pacPieceFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--verify-pieces" ) )
+         {
+            pacVerifyFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--piece-size" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 1, MAX_PIECE_SIZE_KIB, &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            dwPieceSize = dwValue * 1024;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--chunks" ) )
+         {
+            pacChunkFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--chunk-sizes" ) )
+         {
+            MD5_CDC_Type sCdc;
+            char* pacSize = GetValue( argc, argv, &dwArgument );
+            BOOL fParsed  = TRUE;
+            UINT8 bSize;
+
+            if( pacSize == NULL )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            for( bSize = 0; fParsed && ( bSize < 3 ); bSize++ )
+            {
+               unsigned long dwSize;
+
+               errno   = 0;
+               dwSize  = strtoul( pacSize, &pacSize, 0 );
+               fParsed = ( errno == 0 ) && ( dwSize <= MD5_CDC_MAX_CHUNK_SIZE ) &&
+                         ( *pacSize == ( ( bSize < 2 ) ? ',' : '\0' ) );
+               adwChunkSizes[ bSize ] = (UINT32)dwSize;
+               pacSize += ( bSize < 2 ) ? 1 : 0;
+            }
+
+            if( !fParsed ||
+                !MD5_CDC_Init( &sCdc, adwChunkSizes[ 0 ], adwChunkSizes[ 1 ], adwChunkSizes[ 2 ] ) )
+            {
+               printf( "Invalid chunk sizes: %s\n", argv[ dwArgument ] );
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--signature" ) )
+         {
+            pacBasisFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--delta" ) )
+         {
+            pacDeltaFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--from" ) )
+         {
+            pacSigFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--block-size" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, MD5_DELTA_MIN_BLOCK_SIZE,
+                            MD5_CDC_MAX_CHUNK_SIZE, &dwDeltaBlockSize ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--tree" ) )
+         {
+            pacTreeFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--leaf-size" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 1, MAX_PIECE_SIZE_KIB, &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            dwLeafSize = dwValue * 1024;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--fan-out" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, MD5_TREE_MIN_FAN_OUT, MD5_TREE_MAX_FAN_OUT,
+                            &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            iFanOut = (UINT16)dwValue;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--append" ) )
+         {
+            pacAppendFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--stream" ) )
+         {
+            pacStreamFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--dupes" ) )
+         {
+            pacDupeDirectory = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--fingerprint" ) )
+         {
+            pacFprintFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--lookup" ) )
+         {
+            pacLookupFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--make-index" ) )
+         {
+            pacIndexList = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--tar" ) )
+         {
+            pacTarFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--watch" ) )
+         {
+            pacWatchDirectory = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--serve" ) )
+         {
+            pacServeSocket = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--connect" ) )
+         {
+            pacConnectSocket = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--cpus" ) )
+         {
+            pacCpuList = GetValue( argc, argv, &dwArgument );
+
+            if( pacCpuList == NULL )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            if( !MD5_NUMA_ParseList( pacCpuList, MD5_NUMA_MAX_CPUS, aiPlacement, MD5_NUMA_MAX_CPUS,
+                                     &iNumPlacement ) )
+            {
+               printf( "Invalid CPU list: %s\n", pacCpuList );
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--nodes" ) )
+         {
+            pacNodeList = GetValue( argc, argv, &dwArgument );
+
+            if( pacNodeList == NULL )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            if( !MD5_NUMA_ParseList( pacNodeList, MD5_NUMA_MAX_NODES, aiPlacement,
+                                     MD5_NUMA_MAX_NODES, &iNumPlacement ) )
+            {
+               printf( "Invalid node list: %s\n", pacNodeList );
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--autotune" ) )
+         {
+            pacTuneTarget = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--tune-file" ) )
+         {
+            pacTuneFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--background" ) )
+         {
+            fBackground = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--max-rate" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwMaxRateMiB ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--max-iops" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwMaxIops ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--cpu-cap" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwCpuCapPercent ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--debounce" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 0, WATCH_MAX_DELAY_MS, &dwDebounceMs ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--windows" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 0, MD5_FPRINT_MAX_WINDOWS, &dwNumWindows ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--window-size" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 1, MD5_FPRINT_MAX_WINDOW_SIZE / 1024,
+                            &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            dwWindowSize = dwValue * 1024;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--checkpoint-every" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwCheckpointMiB ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--state" ) )
+         {
+            pacStateFilename = GetValue( argc, argv, &dwArgument );
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--save-every" ) )
+         {
+            if( !GetNumber( argc, argv, &dwArgument, 1, 0xFFFFFFFFU, &dwSaveEverySec ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--resume" ) )
+         {
+            fResume = TRUE;
+         }
+         else if( CHECK_ARGUMENT( argv[ dwArgument ], "--tail-sample" ) )
+         {
+            UINT32 dwValue;
+
+            if( !GetNumber( argc, argv, &dwArgument, 0, MAX_PIECE_SIZE_KIB, &dwValue ) )
+            {
+               fValidArguments = FALSE;
+               break;
+            }
+
+            dwTailSample = dwValue * 1024;
+         }
+#endif
          else if( CHECK_ARGUMENT( argv[ dwArgument ], "--help" ) )
          {
             fPrintHelp = TRUE;
@@ -456,12 +1710,82 @@ static BOOL ParseArguments( int argc, char* argv[] )
             break;
          }
 
+         /* The last option lacked its value */
+         if( dwArgument >= argc )
+         {
+            fValidArguments = FALSE;
+            break;
+         }
+
          dwArgument++;
       }
    }
 
-   if( ( pacInputFilename == NULL ) && ( fTestMode == FALSE ) )
+#if( MD5_USE_POSIX_HOST == 1 )
+   if( ( pacIndexList != NULL ) && ( pacOutputFilename == NULL ) )
+   {
+      fprintf( stderr, "md5: --make-index: requires -o <database>\n" );
+      fValidArguments = FALSE;
+   }
+
+   if( ( pacWatchDirectory != NULL ) &&
+       ( ( pacOutputFilename == NULL ) || ( bDigestFormat == MD5_FMT_RAW ) ) )
    {
+      fprintf( stderr, "md5: --watch: requires -o <manifest> and a text --format\n" );
+      fValidArguments = FALSE;
+   }
+
+   if( fResume && ( pacStateFilename == NULL ) )
+   {
+      fprintf( stderr, "md5: --resume: requires --state\n" );
+      fValidArguments = FALSE;
+   }
+
+   if( fPruneCache && ( pacCacheFilename == NULL ) )
+   {
+      fprintf( stderr, "md5: --prune-cache: requires --cache\n" );
+      fValidArguments = FALSE;
+   }
+
+   /*
+   ** "-0" on its own reads the NUL separated list from stdin (find -print0)
+   */
+   if( fNulSeparated && ( pacListFilename == NULL ) )
+   {
+      pacListFilename = "-";
+   }
+
+   if( ( pacConnectSocket != NULL ) &&
+       ( ( pacListFilename == NULL ) || ( pacCacheFilename != NULL ) ) )
+   {
+      fprintf( stderr,
+               "md5: --connect: requires --files-from and can't be combined with --cache\n" );
+      fValidArguments = FALSE;
+   }
+
+   if( ( pacCpuList != NULL ) && ( pacNodeList != NULL ) )
+   {
+      fprintf( stderr, "md5: --cpus: can't be combined with --nodes\n" );
+      fValidArguments = FALSE;
+   }
+#endif
+
+   if( ( pacInputFilename == NULL ) && ( pacInputDirectory == NULL ) &&
+       ( pacCheckFilename == NULL ) && ( pacListFilename == NULL ) &&
+       ( pacPieceFilename == NULL ) && ( pacChunkFilename == NULL ) &&
+       ( pacBasisFilename == NULL ) && ( pacDeltaFilename == NULL ) &&
+       ( pacTreeFilename == NULL ) && ( pacAppendFilename == NULL ) &&
+       ( pacStreamFilename == NULL ) && ( pacDupeDirectory == NULL ) &&
+       ( pacFprintFilename == NULL ) && ( pacIndexList == NULL ) && ( pacTarFilename == NULL ) &&
+       ( pacWatchDirectory == NULL ) && ( pacServeSocket == NULL ) && ( pacTuneTarget == NULL ) &&
+       ( fTestMode == FALSE ) )
+   {
+      fValidArguments = FALSE;
+   }
+
+   if( ( pacDeltaFilename != NULL ) && ( pacSigFilename == NULL ) )
+   {
+      printf( "--delta requires --from <signature>\n" );
       fValidArguments = FALSE;
    }
 
@@ -480,22 +1804,14 @@ static BOOL ParseArguments( int argc, char* argv[] )
 static void WriteDigestToFile( const MD5_InstType* psInst, const char* pacOutputFilename )
 {
    FILE* psFile;
-   char acDigest[ ( 2 * MD5_DIGEST_SIZE ) + 1 ];
-   UINT8 bDigestIndex;
+   char acDigest[ MD5_FMT_MAX_LEN ];
+   UINT16 iDigestLen = MD5_FMT_Encode( (const UINT8*)psInst->adwDigest, bDigestFormat, acDigest );
 
-   fopen_s( &psFile, pacOutputFilename, "w" );
-
-   for( bDigestIndex = 0; bDigestIndex < MD5_DIGEST_SIZE; bDigestIndex++ )
-   {
-      UINT8 bCharOffset = 2 * bDigestIndex;
-      sprintf_s( &acDigest[ bCharOffset ],
-                 sizeof( acDigest ) - bCharOffset,
-                 "%02x", ( (UINT8*)psInst->adwDigest )[ bDigestIndex ] );
-   }
+   fopen_s( &psFile, pacOutputFilename, "wb" );
 
    if( psFile != NULL )
    {
-      fwrite( acDigest, 1, sizeof( acDigest ) - 1, psFile );
+      fwrite( acDigest, 1, iDigestLen, psFile );
       fclose( psFile );
 
       if( fVerbose )
@@ -513,17 +1829,15 @@ static void WriteDigestToFile( const MD5_InstType* psInst, const char* pacOutput
 */
 static void PrintDigest( const MD5_InstType* psInst )
 {
-   UINT8 bDigestIndex;
+   char acDigest[ MD5_FMT_MAX_LEN ];
 
    if( fVerbose )
    {
       printf( "[DIGEST]\n" );
    }
 
-   for( bDigestIndex = 0; bDigestIndex < MD5_DIGEST_SIZE; bDigestIndex++ )
-   {
-      printf( "%02X ", ( (UINT8*)psInst->adwDigest )[ bDigestIndex ] );
-   }
+   fwrite( acDigest, 1, MD5_FMT_Encode( (const UINT8*)psInst->adwDigest, bDisplayFormat, acDigest ),
+           stdout );
 
    if( fVerbose )
    {
@@ -535,33 +1849,27 @@ static void PrintDigest( const MD5_InstType* psInst )
 ** Compute the MD5 of the provided file
 *-----------------------------------------------------------------------------
 */
-static BOOL ComputeMd5( FILE* psFile, UINT16 iRdSize, MD5_InstType* psMd5Inst, UINT8* pbExpectedDigest )
+static BOOL ComputeMd5( FILE* psFile, UINT32 dwRdSize, MD5_InstType* psMd5Inst,
+                        UINT8* pbExpectedDigest )
 {
    BOOL fAllIterationsPassed = TRUE;
    UINT16 iIterationsPerSize = NUM_ITERATIONS_PER_BECHMARK;
    UINT16 iIteration;
    double rAvgElapsedMilliseconds = 0.0f;
    double rElapsedMilliseconds;
-   UINT8 abReadBuffer[ MAX_READ_FILE_SIZE ];
-   UINT16 iElemsToRead = iRdSize;
-   UINT16 iElemsRead;
+   UINT8* pbReadBuffer = malloc( dwRdSize );
+   size_t iElemsRead;
    UINT16 iElemSize = sizeof( UINT8 );
 
-   if( iElemsToRead > sizeof( abReadBuffer ) )
+   if( pbReadBuffer == NULL )
    {
-      if( fBenchmark || fVerbose )
-      {
-         printf( "[WARNING]\nTest size %d exceeds buffer size %d!\n\n",
-                     iElemsToRead,
-                     sizeof( abReadBuffer ) );
-      }
-
-      iElemsToRead = sizeof( abReadBuffer );
+      fprintf( stderr, "md5: can't allocate a %lu byte read buffer\n", (unsigned long)dwRdSize );
+      return FALSE;
    }
 
    if( fBenchmark )
    {
-      printf( "[BENCHMARK]\nRead Size: %d\n\n", iElemsToRead );
+      printf( "[BENCHMARK]\nRead Size: %lu\n\n", (unsigned long)dwRdSize );
    }
    else
    {
@@ -581,8 +1889,8 @@ static BOOL ComputeMd5( FILE* psFile, UINT16 iRdSize, MD5_InstType* psMd5Inst, U
 
       do
       {
-         iElemsRead = (UINT16)fread( abReadBuffer, iElemSize, (size_t)iElemsToRead, psFile );
-         MD5_Update( psMd5Inst, abReadBuffer, iElemsRead );
+         iElemsRead = fread( pbReadBuffer, iElemSize, (size_t)dwRdSize, psFile );
+         MD5_UpdateLarge( psMd5Inst, pbReadBuffer, (UINT32)iElemsRead );
 
          if( feof( psFile ) || ferror( psFile ) )
          {
@@ -625,5 +1933,4063 @@ static BOOL ComputeMd5( FILE* psFile, UINT16 iRdSize, MD5_InstType* psMd5Inst, U
               rAvgElapsedMilliseconds / (double)iIterationsPerSize );
    }
 
+   free( pbReadBuffer );
+
    return fAllIterationsPassed;
 }
+
+#if( MD5_USE_POSIX_HOST == 1 )
+/*----------------------------------------------------------------------------
+** Read a whole file (or stdin for "-") into a NUL terminated buffer
+*-----------------------------------------------------------------------------
+*/
+static BOOL ReadWholeFile( const char* pacFilename, char** ppacData, size_t* piSize )
+{
+   FILE* psFile   = stdin;
+   size_t iSize   = 0;
+   size_t iAlloc  = 64 * 1024;
+   char* pacData  = malloc( iAlloc );
+   BOOL fSuccess  = TRUE;
+
+   if( !CHECK_ARGUMENT( (char*)pacFilename, "-" ) )
+   {
+      fopen_s( &psFile, pacFilename, "rb" );
+   }
+
+   if( ( psFile == NULL ) || ( pacData == NULL ) )
+   {
+      free( pacData );
+      return FALSE;
+   }
+
+   while( TRUE )
+   {
+      size_t iRead;
+
+      if( iSize + 1 == iAlloc )
+      {
+         char* pacNew = realloc( pacData, iAlloc * 2 );
+
+         if( pacNew == NULL )
+         {
+            fSuccess = FALSE;
+            break;
+         }
+
+         pacData = pacNew;
+         iAlloc *= 2;
+      }
+
+      iRead = fread( &pacData[ iSize ], 1, iAlloc - iSize - 1, psFile );
+      iSize += iRead;
+
+      if( iRead == 0 )
+      {
+         fSuccess = !ferror( psFile );
+         break;
+      }
+   }
+
+   if( psFile != stdin )
+   {
+      fclose( psFile );
+   }
+
+   if( !fSuccess )
+   {
+      free( pacData );
+      return FALSE;
+   }
+
+   pacData[ iSize ] = '\0';
+   *ppacData        = pacData;
+   *piSize          = iSize;
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Write a file name to the output, escaping backslashes and newlines like
+** md5sum
+*-----------------------------------------------------------------------------
+*/
+static void WriteName( MD5_FMT_WriterType* psWriter, const char* pacName, BOOL fEscape )
+{
+   if( !fEscape )
+   {
+      MD5_FMT_WriteString( psWriter, pacName );
+      return;
+   }
+
+   for( ; *pacName != '\0'; pacName++ )
+   {
+      if( *pacName == '\\' )
+      {
+         MD5_FMT_Write( psWriter, "\\\\", 2 );
+      }
+      else if( *pacName == '\n' )
+      {
+         MD5_FMT_Write( psWriter, "\\n", 2 );
+      }
+      else
+      {
+         MD5_FMT_WriteChar( psWriter, *pacName );
+      }
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Write a digest line in md5sum format (the digest in the --format format).
+** Names containing a backslash or a newline are escaped and the line is
+** prefixed with a backslash, like md5sum. Raw digests are written alone.
+*-----------------------------------------------------------------------------
+*/
+static void WriteDigestLine( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest,
+                             const char* pacName )
+{
+   BOOL fEscape;
+
+   if( bDigestFormat == MD5_FMT_RAW )
+   {
+      MD5_FMT_WriteDigest( psWriter, pbDigest, MD5_FMT_RAW );
+      return;
+   }
+
+   fEscape = ( strpbrk( pacName, "\\\n" ) != NULL );
+
+   if( fEscape )
+   {
+      MD5_FMT_WriteChar( psWriter, '\\' );
+   }
+
+   MD5_FMT_WriteDigest( psWriter, pbDigest, bDigestFormat );
+   MD5_FMT_Write( psWriter, "  ", 2 );
+   WriteName( psWriter, pacName, fEscape );
+   MD5_FMT_EndLine( psWriter );
+}
+
+/*----------------------------------------------------------------------------
+** Start the worker pool and the per-worker MD5 instances and read buffers
+*-----------------------------------------------------------------------------
+*/
+static BOOL CreateWorkers( MD5_POOL_Type* psPool )
+{
+   MD5_NUMA_CpuSetType* asCpus = NULL;
+   UINT16 iWorker;
+   UINT32 dwBufferSize;
+
+   if( iNumWorkers == 0 )
+   {
+      iNumWorkers = GetNumPlacedCpus();
+   }
+
+   if( ( iNumWorkers == 0 ) && fTuned )
+   {
+      iNumWorkers =
+         ( sTuned.iNumWorkers < MD5_POOL_MAX_WORKERS ) ? sTuned.iNumWorkers : MD5_POOL_MAX_WORKERS;
+   }
+
+   if( iNumWorkers == 0 )
+   {
+      iNumWorkers = MD5_POOL_GetDefaultNumWorkers();
+   }
+
+   dwBufferSize = MD5_IO_GetBufferSize( fTuned ? sTuned.dwReadSize : MD5_IO_DEFAULT_BUFFER_SIZE,
+                                        iNumWorkers, lMemCap );
+
+   /* Fewer workers when even the smallest buffers would exceed the cap */
+   while( ( iNumWorkers > 1 ) && ( (UINT64)dwBufferSize * iNumWorkers > lMemCap ) )
+   {
+      iNumWorkers--;
+   }
+
+   for( iWorker = 0; iWorker < iNumWorkers; iWorker++ )
+   {
+      aiWorkerNodes[ iWorker ] = -1;
+   }
+
+   fPreferLocal = FALSE;
+
+   if( iNumPlacement != 0 )
+   {
+      asCpus = malloc( iNumWorkers * sizeof( MD5_NUMA_CpuSetType ) );
+
+      if( ( asCpus == NULL ) || !PlaceWorkers( asCpus ) )
+      {
+         free( asCpus );
+         return FALSE;
+      }
+   }
+
+   apsIoWorkers = calloc( iNumWorkers, sizeof( MD5_IO_WorkerType* ) );
+
+   if( apsIoWorkers == NULL )
+   {
+      free( asCpus );
+      return FALSE;
+   }
+
+   for( iWorker = 0; iWorker < iNumWorkers; iWorker++ )
+   {
+      apsIoWorkers[ iWorker ] =
+         MD5_NUMA_Alloc( sizeof( MD5_IO_WorkerType ), aiWorkerNodes[ iWorker ] );
+
+      if( ( apsIoWorkers[ iWorker ] == NULL ) ||
+          !MD5_IO_InitWorker( apsIoWorkers[ iWorker ], dwBufferSize ) )
+      {
+         DestroyWorkers( NULL );
+         free( asCpus );
+         return FALSE;
+      }
+
+      /* The buffer isn't touched yet, its pages come from the node */
+      if( aiWorkerNodes[ iWorker ] >= 0 )
+      {
+         (void)MD5_NUMA_Bind( apsIoWorkers[ iWorker ]->pbBuffer,
+                              apsIoWorkers[ iWorker ]->dwBufferSize, aiWorkerNodes[ iWorker ] );
+      }
+
+      apsIoWorkers[ iWorker ]->fSparse    = fSparse;
+      apsIoWorkers[ iWorker ]->fDropCache = fBackground;
+      apsIoWorkers[ iWorker ]->psThrottle = psThrottle;
+      apsIoWorkers[ iWorker ]->bBackend   = fTuned ? sTuned.bBackend : MD5_IO_BACKEND_READ;
+   }
+
+   if( !MD5_POOL_Create( psPool, iNumWorkers ) )
+   {
+      DestroyWorkers( NULL );
+      free( asCpus );
+      return FALSE;
+   }
+
+   for( iWorker = 0; ( asCpus != NULL ) && ( iWorker < iNumWorkers ); iWorker++ )
+   {
+      if( !MD5_POOL_PinWorker( psPool, iWorker, &asCpus[ iWorker ] ) )
+      {
+         fprintf( stderr, "md5: worker %u: %s\n", iWorker, strerror( errno ) );
+         DestroyWorkers( psPool );
+         free( asCpus );
+         return FALSE;
+      }
+   }
+
+   free( asCpus );
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[WORKERS]\n%u x %u byte buffers, %s backend\n", iNumWorkers, dwBufferSize,
+               MD5_TUNE_GetBackendName( apsIoWorkers[ 0 ]->bBackend ) );
+
+      for( iWorker = 0; ( iNumPlacement != 0 ) && ( iWorker < iNumWorkers ); iWorker++ )
+      {
+         fprintf( stderr, "worker %u: node %d\n", iWorker, aiWorkerNodes[ iWorker ] );
+      }
+
+      fprintf( stderr, "\n" );
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Number of CPUs given with --cpus or --nodes, the default number of
+** workers when either is given (0 otherwise)
+*-----------------------------------------------------------------------------
+*/
+static UINT16 GetNumPlacedCpus( void )
+{
+   MD5_NUMA_CpuSetType sCpus;
+   UINT32 dwNumCpus = 0;
+   UINT32 dwCpu;
+   UINT16 iItem;
+
+   if( pacCpuList != NULL )
+   {
+      return iNumPlacement;
+   }
+
+   for( iItem = 0; ( pacNodeList != NULL ) && ( iItem < iNumPlacement ); iItem++ )
+   {
+      if( MD5_NUMA_GetNodeCpus( aiPlacement[ iItem ], &sCpus ) )
+      {
+         for( dwCpu = 0; dwCpu < MD5_NUMA_MAX_CPUS; dwCpu++ )
+         {
+            dwNumCpus += MD5_NUMA_HAS_CPU( &sCpus, dwCpu );
+         }
+      }
+   }
+
+   return (UINT16)( ( dwNumCpus < MD5_POOL_MAX_WORKERS ) ? dwNumCpus : MD5_POOL_MAX_WORKERS );
+}
+
+/*----------------------------------------------------------------------------
+** Assign the CPUs or nodes of --cpus or --nodes to the workers round-robin:
+** a worker is pinned to one listed CPU, or to all CPUs of one listed node
+*-----------------------------------------------------------------------------
+*/
+static BOOL PlaceWorkers( MD5_NUMA_CpuSetType* asCpus )
+{
+   UINT16 iWorker;
+
+   for( iWorker = 0; iWorker < iNumWorkers; iWorker++ )
+   {
+      UINT16 iItem = aiPlacement[ iWorker % iNumPlacement ];
+
+      if( pacCpuList != NULL )
+      {
+         memset( &asCpus[ iWorker ], 0, sizeof( MD5_NUMA_CpuSetType ) );
+         MD5_NUMA_SET_CPU( &asCpus[ iWorker ], iItem );
+         aiWorkerNodes[ iWorker ] = MD5_NUMA_GetCpuNode( iItem );
+      }
+      else if( MD5_NUMA_GetNodeCpus( iItem, &asCpus[ iWorker ] ) )
+      {
+         aiWorkerNodes[ iWorker ] = iItem;
+      }
+      else
+      {
+         fprintf( stderr, "md5: node %u: %s\n", iItem, strerror( errno ) );
+         return FALSE;
+      }
+
+      if( ( aiWorkerNodes[ iWorker ] >= 0 ) && ( aiWorkerNodes[ iWorker ] != aiWorkerNodes[ 0 ] ) )
+      {
+         fPreferLocal = TRUE;
+      }
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Walk and list job placement: a worker on the node of the storage
+** controller holding a file, taking turns among the node's workers, or -1
+** if the node is unknown or the workers don't span several nodes
+*-----------------------------------------------------------------------------
+*/
+static int PickLocalWorker( UINT64 lDevice, void* pxCtx )
+{
+   int iWorker = -1;
+   UINT32 dwEntry;
+   UINT16 iStep;
+   int iNode;
+
+   (void)pxCtx;
+
+   if( !fPreferLocal )
+   {
+      return -1;
+   }
+
+   pthread_mutex_lock( &sPlacementLock );
+
+   for( dwEntry = 0; ( dwEntry < dwNumKnownDevices ) && ( alKnownDevices[ dwEntry ] != lDevice );
+        dwEntry++ )
+   {
+   }
+
+   if( dwEntry < dwNumKnownDevices )
+   {
+      iNode = aiKnownDeviceNodes[ dwEntry ];
+   }
+   else
+   {
+      iNode = MD5_NUMA_GetDeviceNode( lDevice );
+
+      if( dwNumKnownDevices < DEVICE_NODE_CACHE_SIZE )
+      {
+         alKnownDevices[ dwNumKnownDevices ]       = lDevice;
+         aiKnownDeviceNodes[ dwNumKnownDevices++ ] = iNode;
+      }
+   }
+
+   for( iStep = 0; ( iNode >= 0 ) && ( iStep < iNumWorkers ); iStep++ )
+   {
+      UINT16 iCandidate = (UINT16)( ( iNextLocalWorker + iStep ) % iNumWorkers );
+
+      if( aiWorkerNodes[ iCandidate ] == iNode )
+      {
+         iWorker          = iCandidate;
+         iNextLocalWorker = (UINT16)( iCandidate + 1 );
+         break;
+      }
+   }
+
+   pthread_mutex_unlock( &sPlacementLock );
+
+   return iWorker;
+}
+
+/*----------------------------------------------------------------------------
+** Stop the worker pool (if given) and free the per-worker resources
+*-----------------------------------------------------------------------------
+*/
+static void DestroyWorkers( MD5_POOL_Type* psPool )
+{
+   UINT16 iWorker;
+
+   if( psPool != NULL )
+   {
+      MD5_POOL_Destroy( psPool );
+   }
+
+   for( iWorker = 0; ( apsIoWorkers != NULL ) && ( iWorker < iNumWorkers ); iWorker++ )
+   {
+      if( apsIoWorkers[ iWorker ] != NULL )
+      {
+         MD5_IO_FreeWorker( apsIoWorkers[ iWorker ] );
+         MD5_NUMA_Free( apsIoWorkers[ iWorker ], sizeof( MD5_IO_WorkerType ) );
+      }
+   }
+
+   free( apsIoWorkers );
+   apsIoWorkers = NULL;
+}
+
+/*----------------------------------------------------------------------------
+** Open the digest cache given with --cache, if any
+*-----------------------------------------------------------------------------
+*/
+static BOOL OpenDigestCache( void )
+{
+   if( pacCacheFilename == NULL )
+   {
+      return TRUE;
+   }
+
+   if( !MD5_CACHE_Open( &sDigestCache, pacCacheFilename ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacCacheFilename, strerror( errno ) );
+      return FALSE;
+   }
+
+   psDigestCache = &sDigestCache;
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Save the new entries of the digest cache and release it
+*-----------------------------------------------------------------------------
+*/
+static BOOL CloseDigestCache( void )
+{
+   BOOL fSuccess = TRUE;
+
+   if( psDigestCache == NULL )
+   {
+      return TRUE;
+   }
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[CACHE] %llu hits, %llu misses, %llu new entries\n",
+               (unsigned long long)psDigestCache->lNumHits,
+               (unsigned long long)psDigestCache->lNumMisses,
+               (unsigned long long)psDigestCache->lNumNew );
+   }
+
+   if( !MD5_CACHE_Save( psDigestCache, pacCacheFilename, fPruneCache ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacCacheFilename, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+   else if( fVerbose && fPruneCache )
+   {
+      fprintf( stderr, "[CACHE] %llu entries pruned\n",
+               (unsigned long long)psDigestCache->lNumPruned );
+   }
+
+   MD5_CACHE_Close( psDigestCache );
+   psDigestCache = NULL;
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Open the known-digest index given with --lookup, if any
+*-----------------------------------------------------------------------------
+*/
+static BOOL OpenDigestIndex( void )
+{
+   UINT64 lBadLine = 0;
+
+   if( pacLookupFilename == NULL )
+   {
+      return TRUE;
+   }
+
+   if( !MD5_INDEX_Open( &sDigestIndex, pacLookupFilename, &lBadLine ) )
+   {
+      if( lBadLine != 0 )
+      {
+         fprintf( stderr, "md5: %s:%llu: improperly formatted digest line\n", pacLookupFilename,
+                  (unsigned long long)lBadLine );
+      }
+      else
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacLookupFilename, strerror( errno ) );
+      }
+
+      return FALSE;
+   }
+
+   psDigestIndex = &sDigestIndex;
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[INDEX]\n%llu known digests\n\n",
+               (unsigned long long)MD5_INDEX_GetNumEntries( psDigestIndex ) );
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Release the known-digest index
+*-----------------------------------------------------------------------------
+*/
+static void CloseDigestIndex( void )
+{
+   if( psDigestIndex == NULL )
+   {
+      return;
+   }
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[LOOKUP] %llu known\n", (unsigned long long)lNumKnown );
+   }
+
+   MD5_INDEX_Close( psDigestIndex );
+   psDigestIndex = NULL;
+}
+
+/*----------------------------------------------------------------------------
+** Apply --background, --max-rate, --max-iops and --cpu-cap before any worker
+** is started (the workers inherit the scheduling classes)
+*-----------------------------------------------------------------------------
+*/
+static void StartBackgroundMode( void )
+{
+   if( fBackground && !MD5_THROTTLE_SetIdlePriority() )
+   {
+      /* Still runs, only without yielding to other processes */
+      fprintf( stderr, "md5: idle priority: %s\n", strerror( errno ) );
+   }
+
+   if( ( dwMaxRateMiB != 0 ) || ( dwMaxIops != 0 ) || ( dwCpuCapPercent != 0 ) )
+   {
+      MD5_THROTTLE_Init( &sThrottle, (UINT64)dwMaxRateMiB << 20, dwMaxIops, dwCpuCapPercent );
+      psThrottle = &sThrottle;
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Path of the --autotune settings file, NULL if there is no cache directory
+** to keep it in. With fCreateDirectory, a missing cache directory is created.
+*-----------------------------------------------------------------------------
+*/
+static const char* GetTuneFilename( BOOL fCreateDirectory )
+{
+   static char acFilename[ 4096 ];
+   const char* pacCacheDir = getenv( "XDG_CACHE_HOME" );
+   const char* pacHome     = getenv( "HOME" );
+   size_t iLen;
+
+   if( pacTuneFilename != NULL )
+   {
+      return pacTuneFilename;
+   }
+
+   /* Relative XDG paths are invalid and to be ignored */
+   if( ( pacCacheDir != NULL ) && ( pacCacheDir[ 0 ] == '/' ) )
+   {
+      snprintf( acFilename, sizeof( acFilename ), "%s", pacCacheDir );
+   }
+   else if( ( pacHome != NULL ) && ( pacHome[ 0 ] != '\0' ) )
+   {
+      snprintf( acFilename, sizeof( acFilename ), "%s/.cache", pacHome );
+   }
+   else
+   {
+      return NULL;
+   }
+
+   if( fCreateDirectory )
+   {
+      (void)mkdir( acFilename, 0700 );
+   }
+
+   iLen = strlen( acFilename );
+   snprintf( &acFilename[ iLen ], sizeof( acFilename ) - iLen, "/%s", TUNE_FILE_NAME );
+
+   return acFilename;
+}
+
+/*----------------------------------------------------------------------------
+** Path on the device the input of the selected mode is stored on: the first
+** named input that isn't stdin, otherwise the working directory (file lists
+** and manifests name paths relative to it)
+*-----------------------------------------------------------------------------
+*/
+static const char* GetTunePath( void )
+{
+   static char** const appacInputs[] = { &pacInputDirectory, &pacDupeDirectory, &pacWatchDirectory,
+                                         &pacPieceFilename,  &pacTreeFilename,  &pacFprintFilename,
+                                         &pacTarFilename,    &pacStreamFilename, &pacAppendFilename,
+                                         &pacChunkFilename,  &pacInputFilename };
+   UINT16 iInput;
+
+   for( iInput = 0; iInput < sizeof( appacInputs ) / sizeof( appacInputs[ 0 ] ); iInput++ )
+   {
+      const char* pacInput = *appacInputs[ iInput ];
+
+      if( ( pacInput != NULL ) && ( strcmp( pacInput, "-" ) != 0 ) )
+      {
+         return pacInput;
+      }
+   }
+
+   return ".";
+}
+
+/*----------------------------------------------------------------------------
+** Look up the read settings --autotune recorded for the device of the input.
+** A device that was never tuned keeps the built-in defaults.
+*-----------------------------------------------------------------------------
+*/
+static void LoadTunedSettings( void )
+{
+   const char* pacFilename = GetTuneFilename( FALSE );
+   char acKey[ MD5_TUNE_KEY_SIZE ];
+
+   if( ( pacFilename == NULL ) || !MD5_TUNE_GetKey( GetTunePath(), acKey ) )
+   {
+      return;
+   }
+
+   if( !MD5_TUNE_Load( pacFilename, acKey, &sTuned ) )
+   {
+      if( ( pacTuneFilename != NULL ) && ( errno != ENOENT ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacFilename, strerror( errno ) );
+      }
+
+      return;
+   }
+
+   fTuned     = TRUE;
+   dwReadSize = sTuned.dwReadSize;
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[TUNED]\n%s: read size %lu, workers %u, backend %s\n\n", acKey,
+               (unsigned long)sTuned.dwReadSize, sTuned.iNumWorkers,
+               MD5_TUNE_GetBackendName( sTuned.bBackend ) );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Fill the --autotune sample file with pseudo-random data (which compressing
+** and deduplicating file systems have to store as it is) and sync it
+*-----------------------------------------------------------------------------
+*/
+static BOOL WriteTuneSample( int iFd, UINT64 lSize )
+{
+   static UINT64 alBlock[ 64 * 1024 / sizeof( UINT64 ) ];
+   UINT64 lState   = 0x9E3779B97F4A7C15ULL;
+   UINT64 lWritten = 0;
+   UINT32 dwWord;
+
+   while( lWritten < lSize )
+   {
+      size_t iChunk = sizeof( alBlock );
+      size_t iDone  = 0;
+
+      for( dwWord = 0; dwWord < sizeof( alBlock ) / sizeof( alBlock[ 0 ] ); dwWord++ )
+      {
+         lState ^= lState << 13;
+         lState ^= lState >> 7;
+         lState ^= lState << 17;
+         alBlock[ dwWord ] = lState;
+      }
+
+      if( lSize - lWritten < iChunk )
+      {
+         iChunk = (size_t)( lSize - lWritten );
+      }
+
+      while( iDone < iChunk )
+      {
+         ssize_t iBytesWritten = write( iFd, (const UINT8*)alBlock + iDone, iChunk - iDone );
+
+         if( iBytesWritten < 0 )
+         {
+            if( errno != EINTR )
+            {
+               return FALSE;
+            }
+
+            continue;
+         }
+
+         iDone += (size_t)iBytesWritten;
+      }
+
+      lWritten += iChunk;
+   }
+
+   return ( fsync( iFd ) == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Print an --autotune trial as it completes
+*-----------------------------------------------------------------------------
+*/
+static void PrintTuneTrial( const MD5_TUNE_SettingsType* psTrial, void* pxCtx )
+{
+   (void)pxCtx;
+
+   printf( "%8lu B x %-4u %-10s ", (unsigned long)psTrial->dwReadSize, psTrial->iNumWorkers,
+           MD5_TUNE_GetBackendName( psTrial->bBackend ) );
+
+   if( psTrial->lBytesPerSec == 0 )
+   {
+      printf( "failed: %s\n", strerror( errno ) );
+   }
+   else
+   {
+      printf( "%9.1f MiB/s\n", (double)psTrial->lBytesPerSec / ( 1024.0 * 1024.0 ) );
+   }
+
+   fflush( stdout );
+}
+
+/*----------------------------------------------------------------------------
+** Measure the read settings of the device holding a path and record the
+** fastest in the settings file. A directory gets a temporary sample file;
+** a file or block device is read as it is, at most MD5_TUNE_SAMPLE_SIZE.
+*-----------------------------------------------------------------------------
+*/
+static BOOL AutotuneDevice( const char* pacTarget )
+{
+   const char* pacFilename = GetTuneFilename( TRUE );
+   UINT64 lSize            = MD5_TUNE_SAMPLE_SIZE;
+   UINT16 iMaxWorkers      = ( iNumWorkers != 0 ) ? iNumWorkers : MD5_POOL_GetDefaultNumWorkers();
+   char* pacSample         = NULL;
+   MD5_TUNE_SettingsType sBest;
+   char acKey[ MD5_TUNE_KEY_SIZE ];
+   struct stat sStat;
+   BOOL fSuccess;
+   int iError;
+   int iFd;
+
+   if( pacFilename == NULL )
+   {
+      fprintf( stderr, "md5: no cache directory for the settings, use --tune-file\n" );
+      return FALSE;
+   }
+
+   if( !MD5_TUNE_GetKey( pacTarget, acKey ) || ( stat( pacTarget, &sStat ) != 0 ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacTarget, strerror( errno ) );
+      return FALSE;
+   }
+
+   if( S_ISDIR( sStat.st_mode ) )
+   {
+      size_t iLen = strlen( pacTarget ) + 32;
+
+      pacSample = malloc( iLen );
+
+      if( pacSample == NULL )
+      {
+         return FALSE;
+      }
+
+      snprintf( pacSample, iLen, "%s/.md5-tune.XXXXXX", pacTarget );
+      iFd = mkstemp( pacSample );
+
+      /* Synced, so the trials can drop it from the page cache */
+      if( ( iFd < 0 ) || !WriteTuneSample( iFd, lSize ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacSample, strerror( errno ) );
+
+         if( iFd >= 0 )
+         {
+            close( iFd );
+            unlink( pacSample );
+         }
+
+         free( pacSample );
+         return FALSE;
+      }
+
+      close( iFd );
+   }
+   else
+   {
+      off_t lEnd = -1;
+
+      iFd = open( pacTarget, O_RDONLY | O_CLOEXEC );
+
+      if( iFd >= 0 )
+      {
+         lEnd = lseek( iFd, 0, SEEK_END );
+         close( iFd );
+      }
+
+      if( lEnd < 0 )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacTarget, strerror( errno ) );
+         return FALSE;
+      }
+
+      if( (UINT64)lEnd < lSize )
+      {
+         lSize = (UINT64)lEnd;
+      }
+
+      if( lSize < MD5_IO_MIN_BUFFER_SIZE )
+      {
+         fprintf( stderr, "md5: %s: too small to measure, give a larger file or a directory\n",
+                  pacTarget );
+         return FALSE;
+      }
+   }
+
+   printf( "[AUTOTUNE]\n%s (%s), %llu byte sample\n\n", pacTarget, acKey,
+           (unsigned long long)lSize );
+
+   fSuccess = MD5_TUNE_Run( ( pacSample != NULL ) ? pacSample : pacTarget, lSize, iMaxWorkers,
+                            lMemCap, PrintTuneTrial, NULL, &sBest );
+   iError   = errno;
+
+   if( pacSample != NULL )
+   {
+      unlink( pacSample );
+      free( pacSample );
+   }
+
+   if( !fSuccess )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacTarget, strerror( iError ) );
+      return FALSE;
+   }
+
+   printf( "\n[BEST]\nread size %lu, workers %u, backend %s: %.1f MiB/s\n",
+           (unsigned long)sBest.dwReadSize, sBest.iNumWorkers,
+           MD5_TUNE_GetBackendName( sBest.bBackend ),
+           (double)sBest.lBytesPerSec / ( 1024.0 * 1024.0 ) );
+
+   if( !MD5_TUNE_Store( pacFilename, acKey, &sBest ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacFilename, strerror( errno ) );
+      return FALSE;
+   }
+
+   printf( "Saved to %s\n", pacFilename );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Write the result of a hashed file: an md5sum line, preceded by KNOWN or
+** UNKNOWN when a known-digest index is in use
+*-----------------------------------------------------------------------------
+*/
+static void WriteResultLine( const UINT8* pbDigest, const char* pacName )
+{
+   BOOL fKnown;
+
+   if( psDigestIndex != NULL )
+   {
+      MD5_INDEX_Lookup( psDigestIndex, (const UINT8( * )[ MD5_DIGEST_SIZE ])pbDigest, 1, &fKnown );
+      MD5_FMT_WriteString( &sStdout, fKnown ? "KNOWN   " : "UNKNOWN " );
+
+      if( fKnown )
+      {
+         lNumKnown++;
+      }
+   }
+
+   WriteDigestLine( &sStdout, pbDigest, pacName );
+}
+
+/*----------------------------------------------------------------------------
+** Build the digest cache key of a file from the identity the walker found
+*-----------------------------------------------------------------------------
+*/
+static void GetWalkCacheKey( const MD5_WALK_FileType* psFile, MD5_CACHE_KeyType* psKey )
+{
+   psKey->lDevice  = psFile->lDevice;
+   psKey->lInode   = psFile->lInode;
+   psKey->lSize    = psFile->lSize;
+   psKey->lMtimeNs = psFile->lMtimeNs;
+   psKey->lCtimeNs = psFile->lCtimeNs;
+}
+
+/*----------------------------------------------------------------------------
+** Tree walk visit routine, hashes a file on a pool worker unless the digest
+** cache knows it
+*-----------------------------------------------------------------------------
+*/
+static void HashTreeVisit( MD5_WALK_FileType* psFile, UINT16 iWorker, void* pxCtx )
+{
+   MD5_CACHE_KeyType sKey;
+
+   (void)pxCtx;
+
+   if( psDigestCache != NULL )
+   {
+      GetWalkCacheKey( psFile, &sKey );
+
+      if( MD5_CACHE_Lookup( psDigestCache, &sKey, psFile->abDigest ) )
+      {
+         return;
+      }
+   }
+
+   if( !MD5_IO_HashAt( apsIoWorkers[ iWorker ], psFile->iDirFd, psFile->pacName, psFile->lSize,
+                       psFile->abDigest, NULL ) )
+   {
+      psFile->iError = errno;
+   }
+   else if( psDigestCache != NULL )
+   {
+      MD5_CACHE_Insert( psDigestCache, &sKey, psFile->abDigest );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Tree walk batch visit routine, hashes the small files of a directory that
+** the digest cache doesn't know on the multi-lane path
+*-----------------------------------------------------------------------------
+*/
+static void HashTreeVisitBatch( MD5_WALK_FileType* apsFiles[], UINT16 iNumFiles, UINT16 iWorker,
+                                void* pxCtx )
+{
+   MD5_IO_FileType asFiles[ MD5_WALK_BATCH_SIZE ];
+   MD5_WALK_FileType* apsMissed[ MD5_WALK_BATCH_SIZE ];
+   MD5_CACHE_KeyType sKey;
+   UINT16 iNumMissed = 0;
+   UINT16 iFile;
+
+   (void)pxCtx;
+
+   /* Files answered from the cache drop out of the batch */
+   for( iFile = 0; iFile < iNumFiles; iFile++ )
+   {
+      if( psDigestCache != NULL )
+      {
+         GetWalkCacheKey( apsFiles[ iFile ], &sKey );
+
+         if( MD5_CACHE_Lookup( psDigestCache, &sKey, apsFiles[ iFile ]->abDigest ) )
+         {
+            continue;
+         }
+      }
+
+      asFiles[ iNumMissed ].iDirFd    = apsFiles[ iFile ]->iDirFd;
+      asFiles[ iNumMissed ].pacName   = apsFiles[ iFile ]->pacName;
+      asFiles[ iNumMissed ].lSizeHint = apsFiles[ iFile ]->lSize;
+      apsMissed[ iNumMissed++ ]       = apsFiles[ iFile ];
+   }
+
+   if( iNumMissed == 0 )
+   {
+      return;
+   }
+
+   MD5_IO_HashFiles( apsIoWorkers[ iWorker ], asFiles, iNumMissed );
+
+   for( iFile = 0; iFile < iNumMissed; iFile++ )
+   {
+      apsMissed[ iFile ]->iError = asFiles[ iFile ].iError;
+      memcpy( apsMissed[ iFile ]->abDigest, asFiles[ iFile ].abDigest, MD5_DIGEST_SIZE );
+
+      if( ( psDigestCache != NULL ) && ( asFiles[ iFile ].iError == 0 ) )
+      {
+         GetWalkCacheKey( apsMissed[ iFile ], &sKey );
+         MD5_CACHE_Insert( psDigestCache, &sKey, asFiles[ iFile ].abDigest );
+      }
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Tree walk emit routine, prints the results in deterministic order
+*-----------------------------------------------------------------------------
+*/
+static void HashTreeEmit( const MD5_WALK_FileType* psFile, void* pxCtx )
+{
+   (void)pxCtx;
+
+   if( psFile->iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", psFile->pacPath, strerror( psFile->iError ) );
+      dwNumFailedFiles++;
+   }
+   else if( !psFile->fSkipped )
+   {
+      WriteResultLine( psFile->abDigest, psFile->pacPath );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Hash all regular files below a directory on the worker pool
+*-----------------------------------------------------------------------------
+*/
+static BOOL HashDirectoryTree( const char* pacRoot )
+{
+   MD5_POOL_Type sPool;
+   MD5_WALK_ConfigType sWalkCfg;
+   BOOL fSuccess;
+
+   if( !OpenDigestCache() )
+   {
+      return FALSE;
+   }
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacRoot );
+      CloseDigestCache();
+      return FALSE;
+   }
+
+   sWalkCfg.pnVisit        = HashTreeVisit;
+   sWalkCfg.pnVisitBatch   = HashTreeVisitBatch;
+   sWalkCfg.pnEmit         = HashTreeEmit;
+   sWalkCfg.pxCtx          = NULL;
+   sWalkCfg.lBatchFileSize = MD5_IO_GetSmallFileSize( apsIoWorkers[ 0 ] );
+   sWalkCfg.fSkipHardLinks = TRUE;
+   sWalkCfg.pnPickWorker   = PickLocalWorker;
+
+   fSuccess = MD5_WALK_Run( &sPool, pacRoot, &sWalkCfg );
+
+   if( !fSuccess )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+   }
+
+   DestroyWorkers( &sPool );
+   MD5_FMT_Flush( &sStdout );
+
+   fSuccess = CloseDigestCache() && fSuccess;
+
+   return fSuccess && ( dwNumFailedFiles == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Check mode job, verifies one manifest entry on a pool worker. A digest that
+** contradicts the file size (only the empty message has the empty digest) is
+** reported as a mismatch without reading the file.
+*-----------------------------------------------------------------------------
+*/
+static void CheckJob( void* pxArg, UINT16 iWorker )
+{
+   CheckEntryType* psEntry = (CheckEntryType*)pxArg;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   struct stat sStat;
+   int iFd = open( psEntry->pacName, O_RDONLY | O_CLOEXEC );
+
+   psEntry->bResult = CHECK_RESULT_READ_ERROR;
+
+   if( ( iFd < 0 ) || ( fstat( iFd, &sStat ) != 0 ) )
+   {
+      psEntry->iError = errno;
+   }
+   else if( S_ISREG( sStat.st_mode ) &&
+            ( ( sStat.st_size == 0 ) !=
+              ( memcmp( psEntry->abExpectedDigest, abEmptyDigest, MD5_DIGEST_SIZE ) == 0 ) ) )
+   {
+      psEntry->bResult = CHECK_RESULT_MISMATCH;
+   }
+   else if( !MD5_IO_HashFd( apsIoWorkers[ iWorker ], iFd, abDigest, NULL ) )
+   {
+      psEntry->iError = errno;
+   }
+   else if( memcmp( abDigest, psEntry->abExpectedDigest, MD5_DIGEST_SIZE ) != 0 )
+   {
+      psEntry->bResult = CHECK_RESULT_MISMATCH;
+   }
+   else
+   {
+      psEntry->bResult = CHECK_RESULT_OK;
+   }
+
+   if( iFd >= 0 )
+   {
+      close( iFd );
+   }
+
+   MD5_SEQ_Complete( psEntry->psSeq, psEntry->lSeq, psEntry );
+}
+
+/*----------------------------------------------------------------------------
+** Check mode emit routine, reports the results in manifest order. Like
+** md5sum -c, names are only escaped if they contain a newline.
+*-----------------------------------------------------------------------------
+*/
+static void CheckEmit( void* pxItem, void* pxCtx )
+{
+   CheckEntryType* psEntry = (CheckEntryType*)pxItem;
+   BOOL fEscape            = ( strchr( psEntry->pacName, '\n' ) != NULL );
+
+   (void)pxCtx;
+
+   if( psEntry->bResult == CHECK_RESULT_READ_ERROR )
+   {
+      fprintf( stderr, "md5: %s: %s\n", psEntry->pacName, strerror( psEntry->iError ) );
+      dwNumFailedFiles++;
+   }
+   else if( psEntry->bResult == CHECK_RESULT_MISMATCH )
+   {
+      dwNumMismatches++;
+   }
+
+   if( !fQuiet || ( psEntry->bResult != CHECK_RESULT_OK ) )
+   {
+      if( fEscape )
+      {
+         MD5_FMT_WriteChar( &sStdout, '\\' );
+      }
+
+      WriteName( &sStdout, psEntry->pacName, fEscape );
+
+      if( psEntry->bResult == CHECK_RESULT_OK )
+      {
+         MD5_FMT_WriteString( &sStdout, ": OK" );
+      }
+      else if( psEntry->bResult == CHECK_RESULT_MISMATCH )
+      {
+         MD5_FMT_WriteString( &sStdout, ": FAILED" );
+      }
+      else
+      {
+         MD5_FMT_WriteString( &sStdout, ": FAILED open or read" );
+      }
+
+      MD5_FMT_EndLine( &sStdout );
+   }
+
+   free( psEntry );
+}
+
+/*----------------------------------------------------------------------------
+** Verify all entries of an md5sum manifest in parallel (md5sum -c)
+*-----------------------------------------------------------------------------
+*/
+static BOOL CheckManifest( const char* pacManifest )
+{
+   MD5_POOL_Type sPool;
+   MD5_SEQ_Type sSeq;
+   UINT32 dwNumImproper = 0;
+   UINT32 dwNumEntries  = 0;
+   BOOL fSuccess        = TRUE;
+   char* pacManifestData;
+   char* pacLine;
+   size_t iManifestSize;
+
+   if( !ReadWholeFile( pacManifest, &pacManifestData, &iManifestSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacManifest, strerror( errno ) );
+      return FALSE;
+   }
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacManifest );
+      free( pacManifestData );
+      return FALSE;
+   }
+
+   if( !MD5_SEQ_Init( &sSeq, CHECK_WINDOW_SIZE, CheckEmit, NULL ) )
+   {
+      DestroyWorkers( &sPool );
+      free( pacManifestData );
+      return FALSE;
+   }
+
+   for( pacLine = pacManifestData; pacLine < pacManifestData + iManifestSize; )
+   {
+      char* pacLineEnd =
+         memchr( pacLine, '\n', (size_t)( pacManifestData + iManifestSize - pacLine ) );
+      CheckEntryType* psEntry;
+      char* pacNext;
+
+      if( pacLineEnd == NULL )
+      {
+         pacLineEnd = pacManifestData + iManifestSize;
+      }
+
+      pacNext     = pacLineEnd + 1;
+      *pacLineEnd = '\0';
+
+      if( ( pacLineEnd > pacLine ) && ( pacLineEnd[ -1 ] == '\r' ) )
+      {
+         pacLineEnd[ -1 ] = '\0';
+      }
+
+      if( *pacLine != '\0' )
+      {
+         psEntry = malloc( sizeof( CheckEntryType ) );
+
+         if( psEntry == NULL )
+         {
+            /* The lines left unchecked fail the check */
+            fprintf( stderr, "md5: %s: %s\n", pacManifest, strerror( ENOMEM ) );
+            fSuccess = FALSE;
+            break;
+         }
+
+         if( !MD5_MANIFEST_ParseLine( pacLine, psEntry->abExpectedDigest, &psEntry->pacName ) ||
+             ( *psEntry->pacName == '\0' ) )
+         {
+            dwNumImproper++;
+            free( psEntry );
+         }
+         else
+         {
+            psEntry->psSeq  = &sSeq;
+            psEntry->lSeq   = MD5_SEQ_Reserve( &sSeq );
+            psEntry->iError = 0;
+            MD5_POOL_Submit( &sPool, CheckJob, psEntry );
+            dwNumEntries++;
+         }
+      }
+
+      pacLine = pacNext;
+   }
+
+   MD5_POOL_Wait( &sPool );
+   MD5_SEQ_Free( &sSeq );
+   DestroyWorkers( &sPool );
+   free( pacManifestData );
+   MD5_FMT_Flush( &sStdout );
+
+   if( fSuccess && ( dwNumEntries == 0 ) )
+   {
+      fprintf( stderr, "md5: %s: no properly formatted MD5 checksum lines found\n", pacManifest );
+      return FALSE;
+   }
+
+   if( dwNumImproper != 0 )
+   {
+      fprintf( stderr, "md5: WARNING: %u line%s improperly formatted\n",
+               dwNumImproper, ( dwNumImproper == 1 ) ? " is" : "s are" );
+   }
+
+   if( dwNumFailedFiles != 0 )
+   {
+      fprintf( stderr, "md5: WARNING: %u listed file%s could not be read\n",
+               dwNumFailedFiles, ( dwNumFailedFiles == 1 ) ? "" : "s" );
+   }
+
+   if( dwNumMismatches != 0 )
+   {
+      fprintf( stderr, "md5: WARNING: %u computed checksum%s did NOT match\n",
+               dwNumMismatches, ( dwNumMismatches == 1 ) ? "" : "s" );
+   }
+
+   return fSuccess && ( dwNumFailedFiles == 0 ) && ( dwNumMismatches == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Batch mode job, hashes one listed file on a pool worker unless the digest
+** cache knows it
+*-----------------------------------------------------------------------------
+*/
+static void BatchJob( void* pxArg, UINT16 iWorker )
+{
+   BatchEntryType* psEntry = (BatchEntryType*)pxArg;
+   MD5_CACHE_KeyType sKey;
+   struct stat sStat;
+   int iFd;
+
+   psEntry->iError = 0;
+
+   if( psDigestCache == NULL )
+   {
+      if( !MD5_IO_HashPath( apsIoWorkers[ iWorker ], psEntry->pacName, psEntry->abDigest, NULL ) )
+      {
+         psEntry->iError = errno;
+      }
+   }
+   else if( ( iFd = open( psEntry->pacName, O_RDONLY | O_CLOEXEC ) ) < 0 )
+   {
+      psEntry->iError = errno;
+   }
+   else
+   {
+      /* The identity is taken from the open file, which is what gets hashed */
+      if( fstat( iFd, &sStat ) != 0 )
+      {
+         psEntry->iError = errno;
+      }
+      else if( !S_ISREG( sStat.st_mode ) )
+      {
+         /* Pipes and devices have no identity the contents could be tied to */
+         if( !MD5_IO_HashFd( apsIoWorkers[ iWorker ], iFd, psEntry->abDigest, NULL ) )
+         {
+            psEntry->iError = errno;
+         }
+      }
+      else
+      {
+         MD5_CACHE_KeyFromStat( &sKey, &sStat );
+
+         if( !MD5_CACHE_Lookup( psDigestCache, &sKey, psEntry->abDigest ) )
+         {
+            if( MD5_IO_HashFd( apsIoWorkers[ iWorker ], iFd, psEntry->abDigest, NULL ) )
+            {
+               MD5_CACHE_Insert( psDigestCache, &sKey, psEntry->abDigest );
+            }
+            else
+            {
+               psEntry->iError = errno;
+            }
+         }
+      }
+
+      close( iFd );
+   }
+
+   MD5_SEQ_Complete( psEntry->psSeq, psEntry->lSeq, psEntry );
+}
+
+/*----------------------------------------------------------------------------
+** Batch mode emit routine, streams the digests in list order
+*-----------------------------------------------------------------------------
+*/
+static void BatchEmit( void* pxItem, void* pxCtx )
+{
+   BatchEntryType* psEntry = (BatchEntryType*)pxItem;
+
+   (void)pxCtx;
+
+   if( psEntry->iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", psEntry->pacName, strerror( psEntry->iError ) );
+      dwNumFailedFiles++;
+   }
+   else
+   {
+      WriteResultLine( psEntry->abDigest, psEntry->pacName );
+   }
+
+   free( psEntry->pacName );
+   free( psEntry );
+}
+
+/*----------------------------------------------------------------------------
+** Hash every file named in a list in one process. The list is consumed as a
+** stream, so hashing starts with the first entry and the window of
+** CHECK_WINDOW_SIZE inputs in flight bounds the memory used for long lists.
+*-----------------------------------------------------------------------------
+*/
+static BOOL HashFileList( const char* pacList, int iSeparator )
+{
+   MD5_POOL_Type sPool;
+   MD5_SEQ_Type sSeq;
+   struct stat sStat;
+   int iTarget;
+   FILE* psList      = stdin;
+   char* pacLine     = NULL;
+   size_t iLineAlloc = 0;
+   ssize_t iLineLen;
+   BOOL fSuccess     = TRUE;
+
+   if( !CHECK_ARGUMENT( (char*)pacList, "-" ) )
+   {
+      fopen_s( &psList, pacList, "rb" );
+
+      if( psList == NULL )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+         return FALSE;
+      }
+   }
+
+   if( !OpenDigestCache() )
+   {
+      fSuccess = FALSE;
+   }
+   else if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacList );
+      CloseDigestCache();
+      fSuccess = FALSE;
+   }
+   else if( !MD5_SEQ_Init( &sSeq, CHECK_WINDOW_SIZE, BatchEmit, NULL ) )
+   {
+      DestroyWorkers( &sPool );
+      CloseDigestCache();
+      fSuccess = FALSE;
+   }
+
+   if( !fSuccess )
+   {
+      if( psList != stdin )
+      {
+         fclose( psList );
+      }
+
+      return FALSE;
+   }
+
+   while( ( iLineLen = getdelim( &pacLine, &iLineAlloc, iSeparator, psList ) ) > 0 )
+   {
+      BatchEntryType* psEntry;
+
+      if( pacLine[ iLineLen - 1 ] == (char)iSeparator )
+      {
+         pacLine[ --iLineLen ] = '\0';
+      }
+
+      if( ( iSeparator == '\n' ) && ( iLineLen > 0 ) && ( pacLine[ iLineLen - 1 ] == '\r' ) )
+      {
+         pacLine[ --iLineLen ] = '\0';
+      }
+
+      if( iLineLen == 0 )
+      {
+         continue;
+      }
+
+      psEntry = malloc( sizeof( BatchEntryType ) );
+
+      if( psEntry == NULL )
+      {
+         fSuccess = FALSE;
+         break;
+      }
+
+      /*
+      ** The entry takes over the line buffer, getdelim allocates a new one
+      */
+      psEntry->pacName = pacLine;
+      psEntry->psSeq   = &sSeq;
+      psEntry->lSeq    = MD5_SEQ_Reserve( &sSeq );
+      pacLine          = NULL;
+      iLineAlloc       = 0;
+
+      /* The stat() is only paid when the workers span several nodes */
+      if( fPreferLocal && ( stat( psEntry->pacName, &sStat ) == 0 ) &&
+          ( ( iTarget = PickLocalWorker( (UINT64)sStat.st_dev, NULL ) ) >= 0 ) )
+      {
+         MD5_POOL_SubmitTo( &sPool, (UINT16)iTarget, BatchJob, psEntry );
+      }
+      else
+      {
+         MD5_POOL_Submit( &sPool, BatchJob, psEntry );
+      }
+   }
+
+   if( ferror( psList ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   if( psList != stdin )
+   {
+      fclose( psList );
+   }
+
+   free( pacLine );
+
+   MD5_POOL_Wait( &sPool );
+   MD5_SEQ_Free( &sSeq );
+   DestroyWorkers( &sPool );
+
+   MD5_FMT_Flush( &sStdout );
+
+   fSuccess = CloseDigestCache() && fSuccess;
+
+   return fSuccess && ( dwNumFailedFiles == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Hash the first lSize bytes of a file in dwSize byte pieces on all workers.
+** Returns the per-piece results (free() them), or NULL if the workers or the
+** result array could not be allocated.
+*-----------------------------------------------------------------------------
+*/
+static MD5_PIECE_ResultType* HashPieces( int iFd, UINT64 lSize, UINT32 dwSize, int iLeadByte )
+{
+   MD5_POOL_Type sPool;
+   UINT64 lNumPieces               = MD5_PIECE_GetNumPieces( lSize, dwSize );
+   MD5_PIECE_ResultType* asResults = malloc( ( lNumPieces + 1 ) * sizeof( MD5_PIECE_ResultType ) );
+
+   if( asResults == NULL )
+   {
+      fprintf( stderr, "md5: %s\n", strerror( ENOMEM ) );
+      return NULL;
+   }
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: failed to start the worker threads\n" );
+      free( asResults );
+      return NULL;
+   }
+
+   MD5_PIECE_HashAll( &sPool, apsIoWorkers, iFd, lSize, dwSize, iLeadByte, asResults );
+
+   DestroyWorkers( &sPool );
+
+   return asResults;
+}
+
+/*----------------------------------------------------------------------------
+** Hash a file or block device in pieces and write its piece list to pacList
+** (stdout if NULL). No list is written if a piece could not be read.
+*-----------------------------------------------------------------------------
+*/
+static BOOL WritePieceList( const char* pacInput, const char* pacList )
+{
+   MD5_PIECE_ResultType* asResults;
+   FILE* psList = stdout;
+   UINT64 lSize;
+   UINT64 lNumPieces;
+   UINT64 lPiece;
+   BOOL fSuccess = TRUE;
+   int iFd       = open( pacInput, O_RDONLY );
+
+   if( ( iFd < 0 ) || !MD5_PIECE_GetSize( iFd, &lSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      return FALSE;
+   }
+
+   asResults = HashPieces( iFd, lSize, dwPieceSize, MD5_PIECE_NO_LEAD_BYTE );
+   close( iFd );
+
+   if( asResults == NULL )
+   {
+      return FALSE;
+   }
+
+   lNumPieces = MD5_PIECE_GetNumPieces( lSize, dwPieceSize );
+
+   for( lPiece = 0; lPiece < lNumPieces; lPiece++ )
+   {
+      if( asResults[ lPiece ].iError != 0 )
+      {
+         fprintf( stderr, "md5: %s: offset %llu: %s\n", pacInput,
+                  (unsigned long long)( lPiece * dwPieceSize ),
+                  strerror( asResults[ lPiece ].iError ) );
+         fSuccess = FALSE;
+      }
+   }
+
+   if( fSuccess && ( pacList != NULL ) )
+   {
+      fopen_s( &psList, pacList, "w" );
+
+      if( psList == NULL )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+         fSuccess = FALSE;
+      }
+   }
+
+   if( fSuccess )
+   {
+      char acLine[ MD5_FMT_HEX_LEN + 1 ];
+
+      acLine[ MD5_FMT_HEX_LEN ] = '\n';
+
+      MD5_PIECE_WriteHeader( psList, lSize, dwPieceSize );
+
+      for( lPiece = 0; lPiece < lNumPieces; lPiece++ )
+      {
+         MD5_FMT_EncodeHex( asResults[ lPiece ].abDigest, acLine );
+         fwrite( acLine, 1, sizeof( acLine ), psList );
+      }
+
+      if( psList != stdout )
+      {
+         fSuccess = ( fclose( psList ) == 0 );
+      }
+      else
+      {
+         fSuccess = ( fflush( stdout ) == 0 );
+      }
+   }
+
+   free( asResults );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Print one corrupt byte range (lEnd exclusive) of a verified file
+*-----------------------------------------------------------------------------
+*/
+static void PrintCorruptRange( const char* pacInput, UINT64 lStart, UINT64 lEnd )
+{
+   printf( "%s: bytes %llu-%llu FAILED\n", pacInput, (unsigned long long)lStart,
+           (unsigned long long)( lEnd - 1 ) );
+}
+
+/*----------------------------------------------------------------------------
+** Verify a file or block device against a piece list. Adjacent corrupt
+** pieces are merged, so only the corrupt byte ranges are reported. A size
+** change shows up as corrupt bytes at the end of the file.
+*-----------------------------------------------------------------------------
+*/
+static BOOL VerifyPieceList( const char* pacInput, const char* pacList )
+{
+   MD5_PIECE_ResultType* asResults;
+   char* pacText;
+   char* pacLine;
+   char* pacNextLine;
+   size_t iTextSize;
+   UINT8* pbExpected;
+   UINT64 lListSize;
+   UINT32 dwListPieceSize;
+   UINT64 lNumPieces;
+   UINT64 lNumHashed;
+   UINT64 lNumLines     = 0;
+   UINT64 lNumCorrupt   = 0;
+   UINT64 lRangeStart   = 0;
+   UINT64 lRangeEnd     = 0;
+   UINT64 lSize;
+   UINT64 lPiece;
+   BOOL fListValid;
+   int iFd;
+
+   if( !ReadWholeFile( pacList, &pacText, &iTextSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+      return FALSE;
+   }
+
+   pacNextLine = strchr( pacText, '\n' );
+
+   if( pacNextLine != NULL )
+   {
+      *pacNextLine++ = '\0';
+   }
+
+   pacLine    = pacText;
+   fListValid = MD5_PIECE_ParseHeader( pacLine, &lListSize, &dwListPieceSize );
+   lNumPieces = fListValid ? MD5_PIECE_GetNumPieces( lListSize, dwListPieceSize ) : 0;
+   pbExpected = malloc( ( lNumPieces + 1 ) * MD5_DIGEST_SIZE );
+
+   while( fListValid && ( pbExpected != NULL ) && ( pacNextLine != NULL ) &&
+          ( *pacNextLine != '\0' ) )
+   {
+      size_t iLineLen;
+
+      pacLine     = pacNextLine;
+      pacNextLine = strchr( pacLine, '\n' );
+
+      if( pacNextLine != NULL )
+      {
+         *pacNextLine++ = '\0';
+      }
+
+      iLineLen = strlen( pacLine );
+
+      if( ( iLineLen > 0 ) && ( pacLine[ iLineLen - 1 ] == '\r' ) )
+      {
+         pacLine[ --iLineLen ] = '\0';
+      }
+
+      fListValid = ( lNumLines < lNumPieces ) && ( iLineLen == MD5_FMT_HEX_LEN ) &&
+                   MD5_FMT_DecodeHex( pacLine, &pbExpected[ lNumLines * MD5_DIGEST_SIZE ] );
+      lNumLines++;
+   }
+
+   free( pacText );
+
+   if( !fListValid || ( pbExpected == NULL ) || ( lNumLines != lNumPieces ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacList,
+               ( pbExpected == NULL ) ? strerror( ENOMEM ) : "improperly formatted piece list" );
+      free( pbExpected );
+      return FALSE;
+   }
+
+   iFd = open( pacInput, O_RDONLY );
+
+   if( ( iFd < 0 ) || !MD5_PIECE_GetSize( iFd, &lSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      free( pbExpected );
+      return FALSE;
+   }
+
+   /*
+   ** Hash along the listed piece boundaries, up to the smaller of both sizes
+   */
+   dwPieceSize = dwListPieceSize;
+   asResults   = HashPieces( iFd, ( lSize < lListSize ) ? lSize : lListSize, dwPieceSize,
+                              MD5_PIECE_NO_LEAD_BYTE );
+   lNumHashed  = MD5_PIECE_GetNumPieces( ( lSize < lListSize ) ? lSize : lListSize, dwPieceSize );
+   close( iFd );
+
+   if( asResults == NULL )
+   {
+      free( pbExpected );
+      return FALSE;
+   }
+
+   /* One pass beyond the last piece covers bytes appended to the file */
+   for( lPiece = 0; lPiece <= lNumPieces; lPiece++ )
+   {
+      UINT64 lStart = lPiece * dwPieceSize;
+      UINT64 lEnd;
+      BOOL fCorrupt;
+
+      if( lPiece < lNumPieces )
+      {
+         lEnd     = ( lListSize - lStart > dwPieceSize ) ? lStart + dwPieceSize : lListSize;
+         fCorrupt = ( lPiece >= lNumHashed ) || ( asResults[ lPiece ].iError != 0 ) ||
+                    ( memcmp( asResults[ lPiece ].abDigest, &pbExpected[ lPiece * MD5_DIGEST_SIZE ],
+                              MD5_DIGEST_SIZE ) != 0 );
+
+         if( ( lPiece < lNumHashed ) && ( asResults[ lPiece ].iError != 0 ) )
+         {
+            fprintf( stderr, "md5: %s: offset %llu: %s\n", pacInput, (unsigned long long)lStart,
+                     strerror( asResults[ lPiece ].iError ) );
+         }
+
+         lNumCorrupt += fCorrupt ? 1 : 0;
+      }
+      else
+      {
+         lStart   = lListSize;
+         lEnd     = lSize;
+         fCorrupt = ( lSize > lListSize );
+      }
+
+      if( !fCorrupt )
+      {
+         continue;
+      }
+
+      if( ( lRangeEnd > lRangeStart ) && ( lRangeEnd != lStart ) )
+      {
+         PrintCorruptRange( pacInput, lRangeStart, lRangeEnd );
+         lRangeEnd = lRangeStart;
+      }
+
+      if( lRangeEnd == lRangeStart )
+      {
+         lRangeStart = lStart;
+      }
+
+      lRangeEnd = lEnd;
+   }
+
+   if( lRangeEnd > lRangeStart )
+   {
+      PrintCorruptRange( pacInput, lRangeStart, lRangeEnd );
+   }
+   else if( !fQuiet )
+   {
+      printf( "%s: OK\n", pacInput );
+   }
+
+   if( lSize != lListSize )
+   {
+      fprintf( stderr, "md5: WARNING: %s is %llu bytes, the piece list expects %llu\n", pacInput,
+               (unsigned long long)lSize, (unsigned long long)lListSize );
+   }
+
+   if( lNumCorrupt > 0 )
+   {
+      fprintf( stderr, "md5: WARNING: %llu of %llu piece%s did NOT match\n",
+               (unsigned long long)lNumCorrupt, (unsigned long long)lNumPieces,
+               ( lNumPieces == 1 ) ? "" : "s" );
+   }
+
+   MD5_FMT_Flush( &sStdout );
+
+   free( asResults );
+   free( pbExpected );
+
+   return ( lRangeEnd == lRangeStart );
+}
+
+/*----------------------------------------------------------------------------
+** Write one chunk line: "<digest> <offset> <length>"
+*-----------------------------------------------------------------------------
+*/
+static void WriteChunkLine( UINT64 lOffset, UINT32 dwLength, const UINT8* pbDigest, void* pxCtx )
+{
+   (void)pxCtx;
+
+   MD5_FMT_WriteDigest( &sStdout, pbDigest, MD5_FMT_HEX );
+   MD5_FMT_WriteChar( &sStdout, ' ' );
+   MD5_FMT_WriteDecimal( &sStdout, lOffset );
+   MD5_FMT_WriteChar( &sStdout, ' ' );
+   MD5_FMT_WriteDecimal( &sStdout, dwLength );
+   MD5_FMT_EndLine( &sStdout );
+}
+
+/*----------------------------------------------------------------------------
+** Chunk mode job, hashes a batch of chunks on a pool worker. Full batches
+** use the multi-lane MD5, chunk lengths are close enough to keep the lanes
+** busy.
+*-----------------------------------------------------------------------------
+*/
+static void ChunkJob( void* pxArg, UINT16 iWorker )
+{
+   ChunkBatchType* psBatch = (ChunkBatchType*)pxArg;
+
+   if( psBatch->bNumChunks == 1 )
+   {
+      MD5_InstType* psInst = &apsIoWorkers[ iWorker ]->sInst;
+
+      MD5_Init( psInst );
+      MD5_UpdateLarge( psInst, psBatch->apbChunk[ 0 ], psBatch->adwLength[ 0 ] );
+      MD5_Final( psInst );
+      memcpy( psBatch->aabDigest[ 0 ], psInst->adwDigest, MD5_DIGEST_SIZE );
+   }
+   else
+   {
+      MD5_MULTI_Compute( psBatch->apbChunk, psBatch->adwLength, psBatch->aabDigest,
+                         psBatch->bNumChunks );
+   }
+
+   MD5_SEQ_Complete( psBatch->psSeq, psBatch->lSeq, psBatch );
+}
+
+/*----------------------------------------------------------------------------
+** Chunk mode emit routine, prints the chunks in stream order
+*-----------------------------------------------------------------------------
+*/
+static void ChunkEmit( void* pxItem, void* pxCtx )
+{
+   ChunkBatchType* psBatch = (ChunkBatchType*)pxItem;
+   UINT64 lOffset          = psBatch->lOffset;
+   UINT8 bChunk;
+
+   for( bChunk = 0; bChunk < psBatch->bNumChunks; bChunk++ )
+   {
+      WriteChunkLine( lOffset, psBatch->adwLength[ bChunk ], psBatch->aabDigest[ bChunk ], pxCtx );
+      lOffset += psBatch->adwLength[ bChunk ];
+   }
+
+   /* Batches are emitted in order, so the block's other batches are done */
+   free( psBatch->pbBlock );
+   free( psBatch );
+}
+
+/*----------------------------------------------------------------------------
+** Read until the buffer is full or the end of the input is reached. A read
+** error ends the input and sets *piError to its errno.
+*-----------------------------------------------------------------------------
+*/
+static size_t ReadFully( int iFd, UINT8* pbBuffer, size_t iSize, int* piError )
+{
+   size_t iTotal = 0;
+
+   while( iTotal < iSize )
+   {
+      ssize_t iBytesRead = read( iFd, &pbBuffer[ iTotal ], iSize - iTotal );
+
+      if( iBytesRead > 0 )
+      {
+         iTotal += (size_t)iBytesRead;
+      }
+      else if( iBytesRead == 0 )
+      {
+         break;
+      }
+      else if( errno != EINTR )
+      {
+         *piError = errno;
+         break;
+      }
+   }
+
+   return iTotal;
+}
+
+/*----------------------------------------------------------------------------
+** Split a stream into content-defined chunks and print the digest of every
+** chunk. With one worker the chunks are hashed in the same pass that finds
+** their boundaries (MD5_CDC_Update). Otherwise the reading thread only finds
+** the boundaries and runs ahead, while the workers hash batches of chunks;
+** the unfinished chunk at the end of a read block is copied to the start of
+** the next block, so a chunk never spans two blocks.
+*-----------------------------------------------------------------------------
+*/
+static BOOL ChunkStream( const char* pacInput )
+{
+   MD5_CDC_Type sCdc;
+   MD5_POOL_Type sPool;
+   MD5_SEQ_Type sSeq;
+   const UINT32 dwBlockAlloc = CHUNK_BLOCK_SIZE + adwChunkSizes[ 2 ];
+   UINT8* pbBlock            = NULL;
+   UINT32 dwCarry            = 0;
+   BOOL fEndOfInput          = FALSE;
+   int iError                = 0;
+   int iFd                   = STDIN_FILENO;
+
+   MD5_CDC_Init( &sCdc, adwChunkSizes[ 0 ], adwChunkSizes[ 1 ], adwChunkSizes[ 2 ] );
+
+   if( !CHECK_ARGUMENT( (char*)pacInput, "-" ) )
+   {
+      iFd = open( pacInput, O_RDONLY );
+
+      if( iFd < 0 )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+         return FALSE;
+      }
+   }
+
+   if( iNumWorkers == 0 )
+   {
+      iNumWorkers = MD5_POOL_GetDefaultNumWorkers();
+   }
+
+   if( iNumWorkers == 1 )
+   {
+      pbBlock = malloc( MD5_IO_DEFAULT_BUFFER_SIZE );
+      iError  = ( pbBlock == NULL ) ? ENOMEM : 0;
+
+      while( !fEndOfInput && ( iError == 0 ) )
+      {
+         size_t iFill = ReadFully( iFd, pbBlock, MD5_IO_DEFAULT_BUFFER_SIZE, &iError );
+
+         fEndOfInput = ( iFill < MD5_IO_DEFAULT_BUFFER_SIZE );
+         MD5_CDC_Update( &sCdc, pbBlock, (UINT32)iFill, WriteChunkLine, NULL );
+      }
+
+      if( iError == 0 )
+      {
+         MD5_CDC_Final( &sCdc, WriteChunkLine, NULL );
+      }
+
+      free( pbBlock );
+   }
+   else if( !CreateWorkers( &sPool ) )
+   {
+      iError = ENOMEM;
+   }
+   else if( !MD5_SEQ_Init( &sSeq, CHUNK_WINDOW_SIZE, ChunkEmit, NULL ) )
+   {
+      DestroyWorkers( &sPool );
+      iError = ENOMEM;
+   }
+   else
+   {
+      pbBlock = malloc( dwBlockAlloc );
+      iError  = ( pbBlock == NULL ) ? ENOMEM : 0;
+
+      while( !fEndOfInput && ( iError == 0 ) )
+      {
+         ChunkBatchType* psBatch = NULL;
+         UINT8* pbNextBlock      = NULL;
+         UINT32 dwChunkStart     = 0;
+         UINT32 dwPos            = dwCarry; /* The carried over bytes were scanned already */
+         UINT32 dwFill           = dwCarry + (UINT32)ReadFully( iFd, &pbBlock[ dwCarry ],
+                                                                CHUNK_BLOCK_SIZE, &iError );
+
+         fEndOfInput = ( dwFill < dwCarry + CHUNK_BLOCK_SIZE );
+
+         while( ( dwPos < dwFill ) || ( fEndOfInput && ( dwChunkStart < dwFill ) ) )
+         {
+            UINT64 lOffset = sCdc.lChunkOffset; /* Start of the chunk being scanned */
+            UINT32 dwUsed  = 0;
+            BOOL fBoundary = TRUE; /* The end of the stream ends the last chunk */
+
+            if( dwPos < dwFill )
+            {
+               fBoundary = MD5_CDC_Scan( &sCdc, &pbBlock[ dwPos ], dwFill - dwPos, &dwUsed );
+               dwPos += dwUsed;
+            }
+
+            if( !fBoundary )
+            {
+               continue;
+            }
+
+            /* A full batch is submitted once it's known not to be the last one of the block */
+            if( ( psBatch != NULL ) && ( psBatch->bNumChunks == MD5_MULTI_LANES ) )
+            {
+               MD5_POOL_Submit( &sPool, ChunkJob, psBatch );
+               psBatch = NULL;
+            }
+
+            if( psBatch == NULL )
+            {
+               psBatch = malloc( sizeof( ChunkBatchType ) );
+
+               if( psBatch == NULL )
+               {
+                  iError = ENOMEM;
+                  break;
+               }
+
+               psBatch->psSeq      = &sSeq;
+               psBatch->lSeq       = MD5_SEQ_Reserve( &sSeq );
+               psBatch->pbBlock    = NULL;
+               psBatch->lOffset    = lOffset;
+               psBatch->bNumChunks = 0;
+            }
+
+            psBatch->apbChunk[ psBatch->bNumChunks ]  = &pbBlock[ dwChunkStart ];
+            psBatch->adwLength[ psBatch->bNumChunks ] = dwPos - dwChunkStart;
+            psBatch->bNumChunks++;
+            dwChunkStart = dwPos;
+         }
+
+         if( ( psBatch == NULL ) && ( dwChunkStart > 0 ) )
+         {
+            /* Batch allocation failed, submitted batches still use the block */
+            break;
+         }
+
+         dwCarry = dwFill - dwChunkStart;
+
+         if( !fEndOfInput )
+         {
+            pbNextBlock = malloc( dwBlockAlloc );
+
+            if( pbNextBlock == NULL )
+            {
+               iError = ENOMEM;
+            }
+            else
+            {
+               memcpy( pbNextBlock, &pbBlock[ dwChunkStart ], dwCarry );
+            }
+         }
+
+         /* The last batch of the block frees it once it has been emitted */
+         if( psBatch != NULL )
+         {
+            psBatch->pbBlock = pbBlock;
+            MD5_POOL_Submit( &sPool, ChunkJob, psBatch );
+         }
+         else
+         {
+            free( pbBlock );
+         }
+
+         pbBlock = pbNextBlock;
+      }
+
+      MD5_POOL_Wait( &sPool );
+      MD5_SEQ_Free( &sSeq );
+      DestroyWorkers( &sPool );
+
+      free( pbBlock );
+   }
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( iError ) );
+   }
+
+   if( iFd != STDIN_FILENO )
+   {
+      close( iFd );
+   }
+
+   MD5_FMT_Flush( &sStdout );
+
+   return ( iError == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Map a whole file into memory. An empty file gives a NULL mapping.
+*-----------------------------------------------------------------------------
+*/
+static BOOL MapFile( const char* pacFilename, UINT8** ppbData, UINT64* plSize )
+{
+   struct stat sStat;
+   int iFd = open( pacFilename, O_RDONLY );
+
+   *ppbData = NULL;
+
+   if( ( iFd < 0 ) || ( fstat( iFd, &sStat ) != 0 ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacFilename, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      return FALSE;
+   }
+
+   *plSize = (UINT64)sStat.st_size;
+
+   if( *plSize > 0 )
+   {
+      void* pxMap = mmap( NULL, (size_t)*plSize, PROT_READ, MAP_PRIVATE, iFd, 0 );
+
+      if( pxMap == MAP_FAILED )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacFilename, strerror( errno ) );
+         close( iFd );
+         return FALSE;
+      }
+
+      madvise( pxMap, (size_t)*plSize, MADV_SEQUENTIAL );
+      *ppbData = (UINT8*)pxMap;
+   }
+
+   close( iFd );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Unmap a file mapped with MapFile()
+*-----------------------------------------------------------------------------
+*/
+static void UnmapFile( UINT8* pbData, UINT64 lSize )
+{
+   if( pbData != NULL )
+   {
+      munmap( pbData, (size_t)lSize );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Compute the delta signature of a basis file and write it to pacSig (stdout
+** if NULL): a "md5-delta <block size> <file size>" header followed by
+** "<weak sum> <MD5>" per block.
+*-----------------------------------------------------------------------------
+*/
+static BOOL WriteSignature( const char* pacBasis, const char* pacSig )
+{
+   MD5_DELTA_SigType sSig;
+   MD5_DELTA_BlockType* asBlocks;
+   UINT32* adwBuckets;
+   UINT8* pbData;
+   UINT64 lSize;
+   UINT32 dwBlock;
+   UINT32 dwNumBlocks;
+   FILE* psSig   = stdout;
+   BOOL fSuccess = TRUE;
+
+   if( !MapFile( pacBasis, &pbData, &lSize ) )
+   {
+      return FALSE;
+   }
+
+   dwNumBlocks = MD5_DELTA_GetNumBlocks( lSize, dwDeltaBlockSize );
+   asBlocks    = malloc( ( dwNumBlocks + 1 ) * sizeof( MD5_DELTA_BlockType ) );
+   adwBuckets  = malloc( MD5_DELTA_GetNumBuckets( dwNumBlocks ) * sizeof( UINT32 ) );
+
+   if( ( asBlocks == NULL ) || ( adwBuckets == NULL ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacBasis, strerror( ENOMEM ) );
+      fSuccess = FALSE;
+   }
+   else if( pacSig != NULL )
+   {
+      fopen_s( &psSig, pacSig, "w" );
+
+      if( psSig == NULL )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacSig, strerror( errno ) );
+         fSuccess = FALSE;
+      }
+   }
+
+   if( fSuccess )
+   {
+      char acStrong[ MD5_FMT_HEX_LEN + 1 ];
+
+      acStrong[ MD5_FMT_HEX_LEN ] = '\0';
+
+      MD5_DELTA_InitSig( &sSig, lSize, dwDeltaBlockSize, asBlocks, adwBuckets );
+      MD5_DELTA_ComputeBlocks( &sSig, pbData );
+
+      fprintf( psSig, "%s %u %llu\n", DELTA_SIGNATURE_TAG, (unsigned int)dwDeltaBlockSize,
+               (unsigned long long)lSize );
+
+      for( dwBlock = 0; dwBlock < sSig.dwNumBlocks; dwBlock++ )
+      {
+         MD5_FMT_EncodeHex( asBlocks[ dwBlock ].abStrong, acStrong );
+         fprintf( psSig, "%08x %s\n", (unsigned int)asBlocks[ dwBlock ].dwWeak, acStrong );
+      }
+
+      fSuccess = ( psSig != stdout ) ? ( fclose( psSig ) == 0 ) : ( fflush( stdout ) == 0 );
+   }
+
+   free( asBlocks );
+   free( adwBuckets );
+   UnmapFile( pbData, lSize );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Read and index a signature written by WriteSignature(). The signature and
+** its arrays are one allocation, free() it when done.
+*-----------------------------------------------------------------------------
+*/
+static MD5_DELTA_SigType* ReadSignature( const char* pacSig )
+{
+   MD5_DELTA_SigType* psSig = NULL;
+   char* pacText;
+   char* pacLine;
+   size_t iTextSize;
+   unsigned int dwBlockSize;
+   unsigned long long lSize;
+   UINT32 dwNumBlocks = 0;
+   UINT32 dwBlock     = 0;
+   int iHeaderLen     = 0;
+
+   if( !ReadWholeFile( pacSig, &pacText, &iTextSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacSig, strerror( errno ) );
+      return NULL;
+   }
+
+   if( ( sscanf( pacText, DELTA_SIGNATURE_TAG " %u %llu\n%n", &dwBlockSize, &lSize,
+                 &iHeaderLen ) == 2 ) &&
+       ( iHeaderLen > 0 ) && ( dwBlockSize >= MD5_DELTA_MIN_BLOCK_SIZE ) )
+   {
+      dwNumBlocks = MD5_DELTA_GetNumBlocks( lSize, dwBlockSize );
+      psSig       = malloc( sizeof( MD5_DELTA_SigType ) +
+                            ( dwNumBlocks + 1 ) * sizeof( MD5_DELTA_BlockType ) +
+                            MD5_DELTA_GetNumBuckets( dwNumBlocks ) * sizeof( UINT32 ) );
+   }
+
+   if( psSig != NULL )
+   {
+      MD5_DELTA_BlockType* asBlocks = (MD5_DELTA_BlockType*)( psSig + 1 );
+
+      MD5_DELTA_InitSig( psSig, lSize, dwBlockSize, asBlocks,
+                         (UINT32*)&asBlocks[ dwNumBlocks + 1 ] );
+
+      /* "<8 hex digits> <32 hex digits>" per block */
+      for( pacLine = &pacText[ iHeaderLen ]; dwBlock < dwNumBlocks; dwBlock++ )
+      {
+         char* pacEnd;
+
+         asBlocks[ dwBlock ].dwWeak = (UINT32)strtoul( pacLine, &pacEnd, 16 );
+
+         if( ( pacEnd != pacLine + 8 ) || ( *pacEnd != ' ' ) ||
+             !MD5_FMT_DecodeHex( pacEnd + 1, asBlocks[ dwBlock ].abStrong ) ||
+             ( pacEnd[ 1 + MD5_FMT_HEX_LEN ] != '\n' ) )
+         {
+            break;
+         }
+
+         pacLine = pacEnd + 2 + MD5_FMT_HEX_LEN;
+      }
+
+      if( ( dwBlock == dwNumBlocks ) && ( *pacLine == '\0' ) )
+      {
+         MD5_DELTA_IndexBlocks( psSig );
+      }
+      else
+      {
+         free( psSig );
+         psSig = NULL;
+      }
+   }
+
+   if( psSig == NULL )
+   {
+      fprintf( stderr, "md5: %s: improperly formatted signature\n", pacSig );
+   }
+
+   free( pacText );
+
+   return psSig;
+}
+
+/*----------------------------------------------------------------------------
+** Print the pending copy instruction of the delta mode, if any
+*-----------------------------------------------------------------------------
+*/
+static void DeltaFlushCopy( DeltaOutputType* psOut )
+{
+   if( psOut->lCopyLength > 0 )
+   {
+      MD5_FMT_Write( &sStdout, "copy ", 5 );
+      MD5_FMT_WriteDecimal( &sStdout, psOut->lCopyOffset );
+      MD5_FMT_WriteChar( &sStdout, ' ' );
+      MD5_FMT_WriteDecimal( &sStdout, psOut->lCopyLength );
+      MD5_FMT_EndLine( &sStdout );
+      psOut->lCopyLength = 0;
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Delta mode copy callback, merges copies of consecutive basis blocks
+*-----------------------------------------------------------------------------
+*/
+static void DeltaCopy( UINT32 dwBlock, void* pxCtx )
+{
+   DeltaOutputType* psOut = (DeltaOutputType*)pxCtx;
+   UINT64 lOffset         = (UINT64)dwBlock * psOut->psSig->dwBlockSize;
+   UINT64 lLength         = psOut->psSig->lFileSize - lOffset;
+
+   if( lLength > psOut->psSig->dwBlockSize )
+   {
+      lLength = psOut->psSig->dwBlockSize;
+   }
+
+   if( ( psOut->lCopyLength > 0 ) && ( psOut->lCopyOffset + psOut->lCopyLength != lOffset ) )
+   {
+      DeltaFlushCopy( psOut );
+   }
+
+   if( psOut->lCopyLength == 0 )
+   {
+      psOut->lCopyOffset = lOffset;
+   }
+
+   psOut->lCopyLength += lLength;
+   psOut->lNewOffset += lLength;
+}
+
+/*----------------------------------------------------------------------------
+** Delta mode literal callback, refers to the data by its new file position
+*-----------------------------------------------------------------------------
+*/
+static void DeltaLiteral( const UINT8* pbData, UINT64 lLength, void* pxCtx )
+{
+   DeltaOutputType* psOut = (DeltaOutputType*)pxCtx;
+
+   (void)pbData;
+
+   DeltaFlushCopy( psOut );
+
+   MD5_FMT_Write( &sStdout, "literal ", 8 );
+   MD5_FMT_WriteDecimal( &sStdout, psOut->lNewOffset );
+   MD5_FMT_WriteChar( &sStdout, ' ' );
+   MD5_FMT_WriteDecimal( &sStdout, lLength );
+   MD5_FMT_EndLine( &sStdout );
+
+   psOut->lNewOffset += lLength;
+   psOut->lLiteralBytes += lLength;
+}
+
+/*----------------------------------------------------------------------------
+** Scan a new file against the signature of its basis file and print the
+** instructions that rebuild it: "copy <basis offset> <length>" and
+** "literal <offset> <length>" (data taken from the new file).
+*-----------------------------------------------------------------------------
+*/
+static BOOL WriteDelta( const char* pacNew, const char* pacSig )
+{
+   MD5_DELTA_SigType* psSig = ReadSignature( pacSig );
+   MD5_DELTA_OutputType sOutput;
+   DeltaOutputType sOut;
+   UINT8* pbData;
+   UINT64 lSize;
+
+   if( psSig == NULL )
+   {
+      return FALSE;
+   }
+
+   if( !MapFile( pacNew, &pbData, &lSize ) )
+   {
+      free( psSig );
+      return FALSE;
+   }
+
+   memset( &sOut, 0, sizeof( sOut ) );
+   sOut.psSig        = psSig;
+   sOutput.pnCopy    = DeltaCopy;
+   sOutput.pnLiteral = DeltaLiteral;
+   sOutput.pxCtx     = &sOut;
+
+   MD5_DELTA_Scan( psSig, pbData, lSize, &sOutput );
+   DeltaFlushCopy( &sOut );
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[DELTA]\n%llu of %llu bytes copied from the basis file\n\n",
+               (unsigned long long)( lSize - sOut.lLiteralBytes ), (unsigned long long)lSize );
+   }
+
+   MD5_FMT_Flush( &sStdout );
+
+   UnmapFile( pbData, lSize );
+   free( psSig );
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Compute the tree hash of a file or block device and print it as
+** "md5tree:<leaf size>:<fan-out>:<root>  <name>". The leaves are hashed in
+** parallel, the interior levels are small enough to do on one thread.
+*-----------------------------------------------------------------------------
+*/
+static BOOL TreeHash( const char* pacInput )
+{
+   MD5_PIECE_ResultType* asResults;
+   MD5_InstType sInst;
+   UINT8( *aabLeaves )[ MD5_DIGEST_SIZE ];
+   UINT8 abRoot[ MD5_DIGEST_SIZE ];
+   char acRoot[ MD5_FMT_HEX_LEN + 1 ];
+   UINT64 lSize;
+   UINT64 lNumLeaves;
+   UINT64 lLeaf;
+   BOOL fSuccess = TRUE;
+   int iFd       = open( pacInput, O_RDONLY );
+
+   if( ( iFd < 0 ) || !MD5_PIECE_GetSize( iFd, &lSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      return FALSE;
+   }
+
+   asResults = HashPieces( iFd, lSize, dwLeafSize, MD5_TREE_LEAF_MARKER );
+   close( iFd );
+
+   lNumLeaves = MD5_PIECE_GetNumPieces( lSize, dwLeafSize );
+   aabLeaves  = malloc( ( lNumLeaves + 1 ) * MD5_DIGEST_SIZE );
+
+   if( ( asResults == NULL ) || ( aabLeaves == NULL ) )
+   {
+      free( asResults );
+      free( aabLeaves );
+      return FALSE;
+   }
+
+   /* An empty input has one empty leaf */
+   if( lNumLeaves == 0 )
+   {
+      MD5_TREE_HashLeaf( &sInst, NULL, 0, aabLeaves[ 0 ] );
+      lNumLeaves = 1;
+   }
+   else
+   {
+      for( lLeaf = 0; lLeaf < lNumLeaves; lLeaf++ )
+      {
+         if( asResults[ lLeaf ].iError != 0 )
+         {
+            fprintf( stderr, "md5: %s: offset %llu: %s\n", pacInput,
+                     (unsigned long long)( lLeaf * dwLeafSize ),
+                     strerror( asResults[ lLeaf ].iError ) );
+            fSuccess = FALSE;
+         }
+
+         memcpy( aabLeaves[ lLeaf ], asResults[ lLeaf ].abDigest, MD5_DIGEST_SIZE );
+      }
+   }
+
+   if( fSuccess )
+   {
+      MD5_TREE_Reduce( &sInst, aabLeaves, lNumLeaves, iFanOut, lSize, abRoot );
+      MD5_FMT_EncodeHex( abRoot, acRoot );
+      acRoot[ MD5_FMT_HEX_LEN ] = '\0';
+
+      printf( "md5tree:%u:%u:%s  %s\n", (unsigned int)dwLeafSize, (unsigned int)iFanOut, acRoot,
+              pacInput );
+      MD5_FMT_Flush( &sStdout );
+   }
+
+   free( asResults );
+   free( aabLeaves );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Compute the digest of a file that only grows. The MD5 state after the part
+** hashed by the previous run is restored from the state file if that part is
+** unchanged, so only the appended bytes are read; the final digest is taken
+** from a copy of the state, which is saved again for the next run.
+*-----------------------------------------------------------------------------
+*/
+static BOOL AppendHash( const char* pacInput )
+{
+   MD5_IO_WorkerType sWorker;
+   MD5_STATE_RecordType sRecord;
+   MD5_InstType sFinal;
+   struct stat sStat;
+   char* pacState       = pacStateFilename;
+   char* pacDefault     = NULL;
+   const char* pacStale = NULL;
+   UINT64 lResumed      = 0;
+   BOOL fSuccess        = TRUE;
+   int iFd;
+
+   if( pacState == NULL )
+   {
+      pacDefault = malloc( strlen( pacInput ) + sizeof( ".md5state" ) );
+
+      if( pacDefault == NULL )
+      {
+         return FALSE;
+      }
+
+      sprintf( pacDefault, "%s.md5state", pacInput );
+      pacState = pacDefault;
+   }
+
+   iFd = open( pacInput, O_RDONLY | O_CLOEXEC );
+
+   if( ( iFd < 0 ) || !MD5_IO_InitWorker( &sWorker, MD5_IO_DEFAULT_BUFFER_SIZE ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      free( pacDefault );
+      return FALSE;
+   }
+
+   sWorker.fSparse    = fSparse;
+   sWorker.fDropCache = fBackground;
+   sWorker.psThrottle = psThrottle;
+
+   if( MD5_STATE_Read( pacState, &sRecord ) )
+   {
+      pacStale =
+         MD5_STATE_CheckPrefix( &sRecord, iFd, TRUE, sWorker.pbBuffer, sWorker.dwBufferSize );
+
+      if( ( pacStale == NULL ) && ( lseek( iFd, (off_t)sRecord.lOffset, SEEK_SET ) < 0 ) )
+      {
+         pacStale = strerror( errno );
+      }
+   }
+   else if( errno != ENOENT )
+   {
+      pacStale = ( errno == EINVAL ) ? "invalid state file" : strerror( errno );
+   }
+   else
+   {
+      pacStale = "";
+   }
+
+   if( pacStale == NULL )
+   {
+      MD5_ImportState( &sWorker.sInst, sRecord.abState );
+      lResumed = sRecord.lOffset;
+   }
+   else
+   {
+      /* No state yet is the normal first run, anything else is worth a note */
+      if( *pacStale != '\0' )
+      {
+         fprintf( stderr, "md5: %s: saved state not used: %s\n", pacState, pacStale );
+      }
+
+      MD5_Init( &sWorker.sInst );
+   }
+
+   if( !MD5_IO_UpdateFd( &sWorker, iFd ) || ( fstat( iFd, &sStat ) != 0 ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   if( fSuccess )
+   {
+      MD5_STATE_SetFile( &sRecord, &sStat );
+      sRecord.lOffset      = sWorker.sInst.lTotalByteSize;
+      sRecord.dwSampleSize = dwTailSample;
+      MD5_ExportState( &sWorker.sInst, sRecord.abState );
+
+      if( !MD5_STATE_SampleTail( iFd, sRecord.lOffset, dwTailSample, sWorker.pbBuffer,
+                                 sWorker.dwBufferSize, sRecord.abSample ) ||
+          !MD5_STATE_Write( pacState, &sRecord ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacState, strerror( errno ) );
+         fSuccess = FALSE;
+      }
+   }
+
+   if( fSuccess )
+   {
+      sFinal = sWorker.sInst;
+      MD5_Final( &sFinal );
+      WriteDigestLine( &sStdout, (const UINT8*)sFinal.adwDigest, pacInput );
+      MD5_FMT_Flush( &sStdout );
+
+      if( fVerbose )
+      {
+         fprintf( stderr, "[APPEND]\nresumed at %llu, hashed %llu new bytes\n\n",
+                  (unsigned long long)lResumed,
+                  (unsigned long long)( sRecord.lOffset - lResumed ) );
+      }
+   }
+
+   close( iFd );
+   MD5_IO_FreeWorker( &sWorker );
+   free( pacDefault );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** SIGUSR1 handler, requests a checkpoint from the stream mode
+*-----------------------------------------------------------------------------
+*/
+static void RequestCheckpoint( int iSignal )
+{
+   (void)iSignal;
+
+   fCheckpointRequested = 1;
+}
+
+/*----------------------------------------------------------------------------
+** Print the digest of everything hashed so far, leaving the stream open
+*-----------------------------------------------------------------------------
+*/
+static void WriteCheckpoint( const MD5_InstType* psInst )
+{
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+
+   MD5_Peek( psInst, abDigest );
+
+   MD5_FMT_Write( &sStdout, "checkpoint ", 11 );
+   MD5_FMT_WriteDecimal( &sStdout, psInst->lTotalByteSize );
+   MD5_FMT_WriteChar( &sStdout, ' ' );
+   MD5_FMT_WriteDigest( &sStdout, abDigest, MD5_FMT_HEX );
+   MD5_FMT_EndLine( &sStdout );
+   MD5_FMT_Flush( &sStdout );
+}
+
+/*----------------------------------------------------------------------------
+** Save the stream mode state (midstate, offset, input identity, size and
+** times) to the --state file. The write is synced, so the state survives a
+** crash.
+*-----------------------------------------------------------------------------
+*/
+static BOOL SaveStreamState( int iFd, const MD5_InstType* psInst, UINT8* pbBuffer )
+{
+   MD5_STATE_RecordType sRecord;
+   struct stat sStat;
+
+   /* The size and times are those the file has when the state is saved */
+   if( fstat( iFd, &sStat ) != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacStateFilename, strerror( errno ) );
+      return FALSE;
+   }
+
+   MD5_STATE_SetFile( &sRecord, &sStat );
+   sRecord.lOffset      = psInst->lTotalByteSize;
+   sRecord.dwSampleSize = dwTailSample;
+   MD5_ExportState( psInst, sRecord.abState );
+
+   if( !MD5_STATE_SampleTail( iFd, sRecord.lOffset, dwTailSample, pbBuffer,
+                              MD5_IO_DEFAULT_BUFFER_SIZE, sRecord.abSample ) ||
+       !MD5_STATE_Write( pacStateFilename, &sRecord ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacStateFilename, strerror( errno ) );
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Continue a stream mode job from the --state file: restore the midstate
+** and seek past the hashed part if the input is unchanged up to it. Without
+** a usable state the job starts over; FALSE only if the input can't be seeked.
+*-----------------------------------------------------------------------------
+*/
+static BOOL ResumeStream( int iFd, MD5_InstType* psInst, UINT8* pbBuffer )
+{
+   MD5_STATE_RecordType sRecord;
+   const char* pacStale;
+
+   if( !MD5_STATE_Read( pacStateFilename, &sRecord ) )
+   {
+      if( errno == ENOENT )
+      {
+         /* Nothing saved yet, this is the first run of the job */
+         return TRUE;
+      }
+
+      pacStale = ( errno == EINVAL ) ? "invalid state file" : strerror( errno );
+   }
+   else
+   {
+      pacStale =
+         MD5_STATE_CheckPrefix( &sRecord, iFd, FALSE, pbBuffer, MD5_IO_DEFAULT_BUFFER_SIZE );
+   }
+
+   if( pacStale != NULL )
+   {
+      fprintf( stderr, "md5: %s: not resumed: %s\n", pacStateFilename, pacStale );
+      return TRUE;
+   }
+
+   if( lseek( iFd, (off_t)sRecord.lOffset, SEEK_SET ) < 0 )
+   {
+      return FALSE;
+   }
+
+   MD5_ImportState( psInst, sRecord.abState );
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[RESUME]\ncontinuing at %llu\n\n", (unsigned long long)sRecord.lOffset );
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Hash a file or stream, printing checkpoint digests every dwCheckpointMiB
+** (at exact multiples of it) and whenever SIGUSR1 arrives. The signal also
+** interrupts a blocked read, so a stalled stream still answers it. With
+** --state, the hashing state is saved every dwSaveEverySec seconds (a small
+** synced write, negligible next to the reads) and removed once the digest
+** is complete; --resume continues from it.
+*-----------------------------------------------------------------------------
+*/
+static BOOL StreamHash( const char* pacInput )
+{
+   struct sigaction sAction;
+   struct stat sStat;
+   MD5_InstType sInst;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   double rFrequency;
+   UINT64 lSaveStart;
+   const UINT64 lInterval = (UINT64)dwCheckpointMiB << 20;
+   UINT64 lNextCheckpoint = lInterval;
+   UINT8* pbBuffer        = malloc( MD5_IO_DEFAULT_BUFFER_SIZE );
+   int iError             = ( pbBuffer == NULL ) ? ENOMEM : 0;
+   int iFd                = STDIN_FILENO;
+
+   if( ( iError == 0 ) && !CHECK_ARGUMENT( (char*)pacInput, "-" ) )
+   {
+      iFd    = open( pacInput, O_RDONLY | O_CLOEXEC );
+      iError = ( iFd < 0 ) ? errno : 0;
+   }
+
+   if( ( iError == 0 ) && ( pacStateFilename != NULL ) )
+   {
+      if( fstat( iFd, &sStat ) != 0 )
+      {
+         iError = errno;
+      }
+      else if( ( iFd == STDIN_FILENO ) || !S_ISREG( sStat.st_mode ) )
+      {
+         /* A stream can neither be identified nor read again */
+         fprintf( stderr, "md5: %s: --state needs a regular file\n", pacInput );
+         free( pbBuffer );
+
+         if( iFd != STDIN_FILENO )
+         {
+            close( iFd );
+         }
+
+         return FALSE;
+      }
+   }
+
+   MD5_Init( &sInst );
+
+   if( ( iError == 0 ) && fResume && !ResumeStream( iFd, &sInst, pbBuffer ) )
+   {
+      iError = errno;
+   }
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( iError ) );
+      free( pbBuffer );
+
+      if( ( iFd >= 0 ) && ( iFd != STDIN_FILENO ) )
+      {
+         close( iFd );
+      }
+
+      return FALSE;
+   }
+
+   /* Checkpoints continue from where a resumed job stands */
+   while( ( lInterval != 0 ) && ( lNextCheckpoint <= sInst.lTotalByteSize ) )
+   {
+      lNextCheckpoint += lInterval;
+   }
+
+   StartCounter( &rFrequency, &lSaveStart );
+
+   /* No SA_RESTART: the signal has to end a read that is waiting for data */
+   memset( &sAction, 0, sizeof( sAction ) );
+   sAction.sa_handler = RequestCheckpoint;
+   sigemptyset( &sAction.sa_mask );
+   sigaction( SIGUSR1, &sAction, NULL );
+
+   for( ;; )
+   {
+      const UINT8* pbData;
+      ssize_t iBytesRead;
+      UINT32 dwLeft;
+
+      if( fCheckpointRequested )
+      {
+         fCheckpointRequested = 0;
+         WriteCheckpoint( &sInst );
+      }
+
+      iBytesRead = read( iFd, pbBuffer, MD5_IO_DEFAULT_BUFFER_SIZE );
+
+      if( iBytesRead <= 0 )
+      {
+         if( ( iBytesRead < 0 ) && ( errno == EINTR ) )
+         {
+            continue;
+         }
+
+         iError = ( iBytesRead < 0 ) ? errno : 0;
+         break;
+      }
+
+      pbData = pbBuffer;
+      dwLeft = (UINT32)iBytesRead;
+
+      /* Split the data at the checkpoints, so they fall on exact offsets */
+      while( dwLeft > 0 )
+      {
+         UINT32 dwPortion = dwLeft;
+
+         if( ( lInterval != 0 ) && ( sInst.lTotalByteSize + dwPortion >= lNextCheckpoint ) )
+         {
+            dwPortion = (UINT32)( lNextCheckpoint - sInst.lTotalByteSize );
+         }
+
+         MD5_UpdateLarge( &sInst, pbData, dwPortion );
+         pbData += dwPortion;
+         dwLeft -= dwPortion;
+
+         if( ( lInterval != 0 ) && ( sInst.lTotalByteSize == lNextCheckpoint ) )
+         {
+            WriteCheckpoint( &sInst );
+            lNextCheckpoint += lInterval;
+         }
+      }
+
+      if( ( pacStateFilename != NULL ) &&
+          ( GetCounter( rFrequency, lSaveStart ) >= dwSaveEverySec * 1000.0 ) )
+      {
+         if( !SaveStreamState( iFd, &sInst, pbBuffer ) )
+         {
+            iError = errno;
+            break;
+         }
+
+         StartCounter( &rFrequency, &lSaveStart );
+      }
+   }
+
+   sAction.sa_handler = SIG_DFL;
+   sigaction( SIGUSR1, &sAction, NULL );
+
+   if( iFd != STDIN_FILENO )
+   {
+      close( iFd );
+   }
+
+   free( pbBuffer );
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( iError ) );
+      return FALSE;
+   }
+
+   MD5_Peek( &sInst, abDigest );
+   WriteDigestLine( &sStdout, abDigest, pacInput );
+   MD5_FMT_Flush( &sStdout );
+
+   /* The job is done, there is nothing left to resume */
+   if( pacStateFilename != NULL )
+   {
+      unlink( pacStateFilename );
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Duplicate finder error routine, reports a file that could not be compared
+*-----------------------------------------------------------------------------
+*/
+static void ReportDupeError( const char* pacPath, int iError, void* pxCtx )
+{
+   (void)pxCtx;
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacPath, strerror( iError ) );
+   }
+   else
+   {
+      fprintf( stderr, "md5: %s: file changed during the scan\n", pacPath );
+   }
+
+   dwNumFailedFiles++;
+}
+
+/*----------------------------------------------------------------------------
+** Find the sets of files with the same content below a directory (see
+** MD5_dupes.h) and print each set in md5sum format
+*-----------------------------------------------------------------------------
+*/
+static BOOL FindDuplicates( const char* pacRoot )
+{
+   MD5_POOL_Type sPool;
+   MD5_DUPES_Type sDupes;
+   UINT64 lFile;
+   BOOL fSuccess;
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacRoot );
+      return FALSE;
+   }
+
+   MD5_DUPES_Init( &sDupes, apsIoWorkers, ReportDupeError, NULL );
+
+   fSuccess = MD5_DUPES_Find( &sDupes, &sPool, pacRoot );
+
+   if( !fSuccess )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+   }
+   else
+   {
+      if( fVerbose )
+      {
+         fprintf( stderr, "[DUPES]\n%llu files, %llu of the same size\n%llu with the same ends\n"
+                  "%llu duplicates\n%llu of %llu bytes read\n\n",
+                  (unsigned long long)sDupes.lNumFound, (unsigned long long)sDupes.lNumSameSize,
+                  (unsigned long long)sDupes.lNumSameEnds, (unsigned long long)sDupes.lNumFiles,
+                  (unsigned long long)sDupes.lBytesRead, (unsigned long long)sDupes.lTotalBytes );
+      }
+
+      for( lFile = 0; lFile < sDupes.lNumFiles; lFile++ )
+      {
+         /* An empty line ends each set */
+         if( ( lFile > 0 ) && MD5_DUPES_IsNewSet( &sDupes, lFile ) )
+         {
+            MD5_FMT_EndLine( &sStdout );
+         }
+
+         WriteDigestLine( &sStdout, sDupes.asFiles[ lFile ].abDigest,
+                          sDupes.asFiles[ lFile ].pacPath );
+      }
+   }
+
+   DestroyWorkers( &sPool );
+   MD5_FMT_Flush( &sStdout );
+   MD5_DUPES_Free( &sDupes );
+
+   return fSuccess && ( dwNumFailedFiles == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Fingerprint mode job, reads one sampled region on a pool worker
+*-----------------------------------------------------------------------------
+*/
+static void FprintJob( void* pxArg, UINT16 iWorker )
+{
+   FprintRegionType* psRegion = (FprintRegionType*)pxArg;
+   UINT32 dwDone              = 0;
+
+   while( dwDone < psRegion->sRegion.dwLength )
+   {
+      ssize_t iBytesRead = MD5_IO_ReadAt( apsIoWorkers[ iWorker ], psRegion->iFd,
+                                          psRegion->pbData + dwDone,
+                                          psRegion->sRegion.dwLength - dwDone,
+                                          (off_t)( psRegion->sRegion.lOffset + dwDone ) );
+
+      if( iBytesRead < 0 )
+      {
+         if( errno == EINTR )
+         {
+            continue;
+         }
+
+         psRegion->iError = errno;
+         return;
+      }
+
+      if( iBytesRead == 0 )
+      {
+         psRegion->fShort = TRUE;
+         return;
+      }
+
+      dwDone += (UINT32)iBytesRead;
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Print the quick fingerprint of a file or block device. The sampled regions
+** are read in parallel, one job each, and hashed in order after the header.
+*-----------------------------------------------------------------------------
+*/
+static BOOL Fingerprint( const char* pacInput )
+{
+   MD5_POOL_Type sPool;
+   MD5_FPRINT_RegionType* asLayout;
+   FprintRegionType* asRegions;
+   MD5_InstType sInst;
+   char acDigest[ MD5_FMT_HEX_LEN + 1 ];
+   UINT8* pbData;
+   UINT64 lSize;
+   UINT64 lDataSize = 0;
+   UINT32 dwNumRegions;
+   UINT32 dwRegion;
+   BOOL fSuccess    = TRUE;
+   int iFd          = open( pacInput, O_RDONLY | O_CLOEXEC );
+
+   if( ( iFd < 0 ) || !MD5_PIECE_GetSize( iFd, &lSize ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+      }
+
+      return FALSE;
+   }
+
+   asLayout     = malloc( ( dwNumWindows + 2 ) * sizeof( MD5_FPRINT_RegionType ) );
+   asRegions    = calloc( dwNumWindows + 2, sizeof( FprintRegionType ) );
+   dwNumRegions = ( asLayout != NULL ) ?
+                  MD5_FPRINT_GetRegions( lSize, dwWindowSize, dwNumWindows, asLayout ) : 0;
+
+   for( dwRegion = 0; dwRegion < dwNumRegions; dwRegion++ )
+   {
+      lDataSize += asLayout[ dwRegion ].dwLength;
+   }
+
+   pbData = malloc( (size_t)lDataSize + 1 );
+
+   if( ( asLayout == NULL ) || ( asRegions == NULL ) || ( pbData == NULL ) )
+   {
+      fprintf( stderr, "md5: %s\n", strerror( ENOMEM ) );
+      fSuccess = FALSE;
+   }
+   else if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacInput );
+      fSuccess = FALSE;
+   }
+   else
+   {
+      lDataSize = 0;
+
+      for( dwRegion = 0; dwRegion < dwNumRegions; dwRegion++ )
+      {
+         asRegions[ dwRegion ].iFd     = iFd;
+         asRegions[ dwRegion ].sRegion = asLayout[ dwRegion ];
+         asRegions[ dwRegion ].pbData  = pbData + lDataSize;
+         lDataSize += asLayout[ dwRegion ].dwLength;
+
+         MD5_POOL_Submit( &sPool, FprintJob, &asRegions[ dwRegion ] );
+      }
+
+      MD5_POOL_Wait( &sPool );
+      DestroyWorkers( &sPool );
+
+      MD5_FPRINT_Begin( &sInst, lSize, dwWindowSize, dwNumWindows );
+
+      for( dwRegion = 0; dwRegion < dwNumRegions; dwRegion++ )
+      {
+         const FprintRegionType* psRegion = &asRegions[ dwRegion ];
+
+         if( psRegion->iError != 0 )
+         {
+            fprintf( stderr, "md5: %s: offset %llu: %s\n", pacInput,
+                     (unsigned long long)psRegion->sRegion.lOffset, strerror( psRegion->iError ) );
+            fSuccess = FALSE;
+         }
+         else if( psRegion->fShort )
+         {
+            fprintf( stderr, "md5: %s: file shrank while it was sampled\n", pacInput );
+            fSuccess = FALSE;
+         }
+         else
+         {
+            MD5_UpdateLarge( &sInst, psRegion->pbData, psRegion->sRegion.dwLength );
+         }
+      }
+
+      if( fSuccess )
+      {
+         MD5_Final( &sInst );
+         MD5_FMT_EncodeHex( (const UINT8*)sInst.adwDigest, acDigest );
+         acDigest[ MD5_FMT_HEX_LEN ] = '\0';
+
+         printf( "md5fp:%u:%u:%s  %s\n", (unsigned int)dwWindowSize, (unsigned int)dwNumWindows,
+                 acDigest, pacInput );
+         MD5_FMT_Flush( &sStdout );
+      }
+   }
+
+   close( iFd );
+   free( asLayout );
+   free( asRegions );
+   free( pbData );
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Build a known-digest database from a text list of digests
+*-----------------------------------------------------------------------------
+*/
+static BOOL MakeIndex( const char* pacList, const char* pacDb )
+{
+   MD5_INDEX_SetType sSet;
+   UINT64 lBadLine = 0;
+   BOOL fSuccess;
+
+   if( !MD5_INDEX_SetCreate( &sSet, 0 ) )
+   {
+      fprintf( stderr, "md5: %s\n", strerror( ENOMEM ) );
+      return FALSE;
+   }
+
+   fSuccess = MD5_INDEX_LoadList( &sSet, pacList, &lBadLine );
+
+   if( !fSuccess && ( lBadLine != 0 ) )
+   {
+      fprintf( stderr, "md5: %s:%llu: improperly formatted digest line\n", pacList,
+               (unsigned long long)lBadLine );
+   }
+   else if( !fSuccess )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+   }
+   else if( !MD5_INDEX_WriteDb( &sSet, pacDb ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacDb, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+   else if( fVerbose )
+   {
+      fprintf( stderr, "[INDEX]\n%llu digests written\n", (unsigned long long)sSet.lNumEntries );
+   }
+
+   MD5_INDEX_SetDestroy( &sSet );
+
+   return fSuccess;
+}
+/*----------------------------------------------------------------------------
+** Tar mode member routine of the single-threaded path, the parser hashed
+** the member
+*-----------------------------------------------------------------------------
+*/
+static void TarWriteMember( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest, void* pxCtx )
+{
+   (void)pxCtx;
+
+   WriteDigestLine( &sStdout, pbDigest, psMember->acName );
+}
+
+/*----------------------------------------------------------------------------
+** Hand the batch being filled to a worker. A batch without buffered data
+** (a member hashed by the reading thread, or none at all) is complete as is.
+*-----------------------------------------------------------------------------
+*/
+static void TarSubmitBatch( TarReaderType* psReader )
+{
+   TarBatchType* psBatch = psReader->psBatch;
+
+   if( psBatch == NULL )
+   {
+      return;
+   }
+
+   psReader->psBatch = NULL;
+
+   if( ( psBatch->bNumMembers > 0 ) && ( psBatch->apbData[ 0 ] != NULL ) )
+   {
+      MD5_POOL_Submit( psReader->psPool, TarJob, psBatch );
+   }
+   else
+   {
+      MD5_SEQ_Complete( psBatch->psSeq, psBatch->lSeq, psBatch );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Tar mode member header: small members are added to the current batch,
+** larger ones start a batch of their own
+*-----------------------------------------------------------------------------
+*/
+static void TarBegin( const MD5_TAR_MemberType* psMember, void* pxCtx )
+{
+   TarReaderType* psReader = (TarReaderType*)pxCtx;
+   BOOL fSmall             = ( psMember->lSize <= TAR_SMALL_MEMBER_SIZE );
+   BOOL fBuffered          = ( psMember->lSize <= psReader->dwMemberLimit );
+   TarBatchType* psBatch;
+   UINT8 bMember;
+
+   if( psReader->fOutOfMemory )
+   {
+      return;
+   }
+
+   if( !fSmall )
+   {
+      TarSubmitBatch( psReader );
+   }
+
+   if( psReader->psBatch == NULL )
+   {
+      psBatch = calloc( 1, sizeof( TarBatchType ) );
+
+      if( psBatch == NULL )
+      {
+         psReader->fOutOfMemory = TRUE;
+         return;
+      }
+
+      psBatch->psSeq    = psReader->psSeq;
+      psBatch->lSeq     = MD5_SEQ_Reserve( psReader->psSeq );
+      psReader->psBatch = psBatch;
+   }
+
+   psBatch = psReader->psBatch;
+   bMember = psBatch->bNumMembers;
+
+   psBatch->apacName[ bMember ]  = strdup( psMember->acName );
+   psBatch->adwLength[ bMember ] = fBuffered ? (UINT32)psMember->lSize : 0;
+
+   if( fBuffered )
+   {
+      /* At least one byte, so a buffered member is never NULL */
+      psBatch->apbData[ bMember ] = malloc( (size_t)psMember->lSize + 1 );
+   }
+   else
+   {
+      MD5_Init( &psReader->sInst );
+   }
+
+   if( ( psBatch->apacName[ bMember ] == NULL ) ||
+       ( fBuffered && ( psBatch->apbData[ bMember ] == NULL ) ) )
+   {
+      free( psBatch->apacName[ bMember ] );
+      free( psBatch->apbData[ bMember ] );
+      psBatch->apacName[ bMember ] = NULL;
+      psBatch->apbData[ bMember ]  = NULL;
+      psReader->fOutOfMemory       = TRUE;
+      return;
+   }
+
+   psBatch->bNumMembers++;
+   psReader->dwFilled  = 0;
+   psReader->fInMember = TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Tar mode member data, straight from the read buffer
+*-----------------------------------------------------------------------------
+*/
+static void TarData( const UINT8* pbData, UINT32 dwLength, void* pxCtx )
+{
+   TarReaderType* psReader = (TarReaderType*)pxCtx;
+   TarBatchType* psBatch   = psReader->psBatch;
+   UINT8* pbMember;
+
+   if( !psReader->fInMember )
+   {
+      return;
+   }
+
+   pbMember = psBatch->apbData[ psBatch->bNumMembers - 1 ];
+
+   if( pbMember != NULL )
+   {
+      memcpy( &pbMember[ psReader->dwFilled ], pbData, dwLength );
+      psReader->dwFilled += dwLength;
+   }
+   else
+   {
+      MD5_UpdateLarge( &psReader->sInst, pbData, dwLength );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Tar mode member end: a full batch or a batch of a larger member is handed
+** to a worker
+*-----------------------------------------------------------------------------
+*/
+static void TarEnd( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest, void* pxCtx )
+{
+   TarReaderType* psReader = (TarReaderType*)pxCtx;
+   TarBatchType* psBatch   = psReader->psBatch;
+   UINT8 bMember;
+
+   (void)pbDigest;
+
+   if( !psReader->fInMember )
+   {
+      return;
+   }
+
+   psReader->fInMember = FALSE;
+   bMember             = psBatch->bNumMembers - 1;
+
+   if( psBatch->apbData[ bMember ] == NULL )
+   {
+      MD5_Final( &psReader->sInst );
+      memcpy( psBatch->aabDigest[ bMember ], psReader->sInst.adwDigest, MD5_DIGEST_SIZE );
+   }
+
+   if( ( psMember->lSize > TAR_SMALL_MEMBER_SIZE ) || ( psBatch->bNumMembers == MD5_MULTI_LANES ) )
+   {
+      TarSubmitBatch( psReader );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Tar mode job, hashes a batch of buffered members on a pool worker
+*-----------------------------------------------------------------------------
+*/
+static void TarJob( void* pxArg, UINT16 iWorker )
+{
+   TarBatchType* psBatch = (TarBatchType*)pxArg;
+   UINT8 bMember;
+
+   if( psBatch->bNumMembers == 1 )
+   {
+      MD5_InstType* psInst = &apsIoWorkers[ iWorker ]->sInst;
+
+      MD5_Init( psInst );
+      MD5_UpdateLarge( psInst, psBatch->apbData[ 0 ], psBatch->adwLength[ 0 ] );
+      MD5_Final( psInst );
+      memcpy( psBatch->aabDigest[ 0 ], psInst->adwDigest, MD5_DIGEST_SIZE );
+   }
+   else
+   {
+      MD5_MULTI_Compute( (const UINT8* const*)psBatch->apbData, psBatch->adwLength,
+                         psBatch->aabDigest, psBatch->bNumMembers );
+   }
+
+   for( bMember = 0; bMember < psBatch->bNumMembers; bMember++ )
+   {
+      free( psBatch->apbData[ bMember ] );
+      psBatch->apbData[ bMember ] = NULL;
+   }
+
+   MD5_SEQ_Complete( psBatch->psSeq, psBatch->lSeq, psBatch );
+}
+
+/*----------------------------------------------------------------------------
+** Tar mode emit routine, prints the members of a batch in archive order
+*-----------------------------------------------------------------------------
+*/
+static void TarEmit( void* pxItem, void* pxCtx )
+{
+   TarBatchType* psBatch = (TarBatchType*)pxItem;
+   UINT8 bMember;
+
+   (void)pxCtx;
+
+   for( bMember = 0; bMember < psBatch->bNumMembers; bMember++ )
+   {
+      WriteDigestLine( &sStdout, psBatch->aabDigest[ bMember ], psBatch->apacName[ bMember ] );
+      free( psBatch->apacName[ bMember ] );
+   }
+
+   free( psBatch );
+}
+
+/*----------------------------------------------------------------------------
+** Print the digest of every regular file member of a tar archive, reading
+** the archive once without extracting it. With one worker the parser hashes
+** the member data straight from the read buffer. Otherwise the members are
+** copied out and hashed on the workers, small members several at a time
+** with the multi-lane MD5; member data in flight is bounded by half the
+** memory cap.
+*-----------------------------------------------------------------------------
+*/
+static BOOL HashTarArchive( const char* pacInput )
+{
+   MD5_TAR_Type* psTar = malloc( sizeof( MD5_TAR_Type ) );
+   MD5_TAR_OutputType sTarOutput;
+   TarReaderType sReader;
+   MD5_POOL_Type sPool;
+   MD5_SEQ_Type sSeq;
+   UINT8* pbBlock   = NULL;
+   BOOL fParallel   = FALSE;
+   BOOL fEndOfInput = FALSE;
+   BOOL fValid      = TRUE;
+   int iError       = 0;
+   int iFd          = STDIN_FILENO;
+
+   if( psTar == NULL )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( ENOMEM ) );
+      return FALSE;
+   }
+
+   if( !CHECK_ARGUMENT( (char*)pacInput, "-" ) )
+   {
+      iFd = open( pacInput, O_RDONLY );
+
+      if( iFd < 0 )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( errno ) );
+         free( psTar );
+         return FALSE;
+      }
+   }
+
+   if( iNumWorkers == 0 )
+   {
+      iNumWorkers = MD5_POOL_GetDefaultNumWorkers();
+   }
+
+   MD5_TAR_Init( psTar );
+   memset( &sReader, 0, sizeof( sReader ) );
+
+   sTarOutput.pnBegin = NULL;
+   sTarOutput.pnData  = NULL;
+   sTarOutput.pnEnd   = TarWriteMember;
+   sTarOutput.pxCtx   = NULL;
+
+   if( iNumWorkers > 1 )
+   {
+      if( !CreateWorkers( &sPool ) )
+      {
+         iError = ENOMEM;
+      }
+      else if( !MD5_SEQ_Init( &sSeq, TAR_WINDOW_PER_WORKER * iNumWorkers, TarEmit, NULL ) )
+      {
+         DestroyWorkers( &sPool );
+         iError = ENOMEM;
+      }
+      else
+      {
+         UINT64 lMemberLimit = ( lMemCap / 2 ) / ( TAR_WINDOW_PER_WORKER * iNumWorkers );
+
+         sReader.psPool        = &sPool;
+         sReader.psSeq         = &sSeq;
+         sReader.dwMemberLimit = (UINT32)( ( lMemberLimit < TAR_MAX_MEMBER_BUFFER ) ?
+                                              lMemberLimit : TAR_MAX_MEMBER_BUFFER );
+
+         sTarOutput.pnBegin = TarBegin;
+         sTarOutput.pnData  = TarData;
+         sTarOutput.pnEnd   = TarEnd;
+         sTarOutput.pxCtx   = &sReader;
+         fParallel          = TRUE;
+      }
+   }
+
+   if( iError == 0 )
+   {
+      pbBlock = malloc( MD5_IO_DEFAULT_BUFFER_SIZE );
+      iError  = ( pbBlock == NULL ) ? ENOMEM : 0;
+   }
+
+   while( !fEndOfInput && fValid && ( iError == 0 ) )
+   {
+      size_t iFill = ReadFully( iFd, pbBlock, MD5_IO_DEFAULT_BUFFER_SIZE, &iError );
+
+      fEndOfInput = ( iFill < MD5_IO_DEFAULT_BUFFER_SIZE );
+      fValid      = MD5_TAR_Update( psTar, pbBlock, (UINT32)iFill, &sTarOutput );
+
+      if( sReader.fOutOfMemory )
+      {
+         iError = ENOMEM;
+      }
+   }
+
+   if( fValid && ( iError == 0 ) )
+   {
+      fValid = MD5_TAR_Final( psTar );
+   }
+
+   if( fParallel )
+   {
+      /* The member cut short by an error is dropped, the others are printed */
+      if( sReader.fInMember )
+      {
+         TarBatchType* psBatch = sReader.psBatch;
+
+         psBatch->bNumMembers--;
+         free( psBatch->apacName[ psBatch->bNumMembers ] );
+         free( psBatch->apbData[ psBatch->bNumMembers ] );
+         psBatch->apbData[ psBatch->bNumMembers ] = NULL;
+      }
+
+      TarSubmitBatch( &sReader );
+      MD5_POOL_Wait( &sPool );
+      MD5_SEQ_Free( &sSeq );
+      DestroyWorkers( &sPool );
+   }
+
+   if( iError != 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacInput, strerror( iError ) );
+   }
+   else if( !fValid )
+   {
+      fprintf( stderr, "md5: %s: %s at offset %llu\n", pacInput, psTar->pacError,
+               (unsigned long long)psTar->lHeaderOffset );
+   }
+
+   if( iFd != STDIN_FILENO )
+   {
+      close( iFd );
+   }
+
+   MD5_FMT_Flush( &sStdout );
+
+   free( pbBlock );
+   free( psTar );
+
+   return ( iError == 0 ) && fValid;
+}
+
+/*----------------------------------------------------------------------------
+** SIGINT/SIGTERM handler of the watch and service modes
+*-----------------------------------------------------------------------------
+*/
+static void RequestStop( int iSignal )
+{
+   (void)iSignal;
+
+   fStopRequested = 1;
+}
+
+/*----------------------------------------------------------------------------
+** Watch mode error routine, reports a file that could not be hashed
+*-----------------------------------------------------------------------------
+*/
+static void ReportWatchError( const char* pacPath, int iError, void* pxCtx )
+{
+   (void)pxCtx;
+
+   fprintf( stderr, "md5: %s: %s\n", pacPath, strerror( iError ) );
+   dwNumFailedFiles++;
+}
+
+/*----------------------------------------------------------------------------
+** Watch mode line routine, writes a manifest line in md5sum format
+*-----------------------------------------------------------------------------
+*/
+static void WriteWatchLine( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest,
+                            const char* pacPath, void* pxCtx )
+{
+   (void)pxCtx;
+
+   WriteDigestLine( psWriter, pbDigest, pacPath );
+}
+
+/*----------------------------------------------------------------------------
+** Replace the watch manifest file (see MD5_LIVE_Write())
+*-----------------------------------------------------------------------------
+*/
+static BOOL WriteWatchManifest( MD5_LIVE_Type* psLive )
+{
+   if( !MD5_LIVE_Write( psLive ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", psLive->pacFilename, strerror( errno ) );
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+** Bring the watch manifest up to date after a burst of changes and write it
+** if anything changed. Lost events mean starting over with a full scan.
+*-----------------------------------------------------------------------------
+*/
+static BOOL WatchFlush( MD5_POOL_Type* psPool, MD5_WATCH_Type* psWatch, MD5_LIVE_Type* psLive,
+                        const char* pacRoot )
+{
+   BOOL fRescan = psLive->fRescan;
+
+   if( fRescan && fVerbose )
+   {
+      fprintf( stderr, "[WATCH] events lost, rescanning %s\n", pacRoot );
+   }
+
+   if( !MD5_LIVE_Update( psLive, psPool, psWatch, pacRoot ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+      return FALSE;
+   }
+
+   if( !fRescan && fVerbose )
+   {
+      fprintf( stderr, "[WATCH] %llu rehashed, %llu removed, %llu files\n",
+               (unsigned long long)psLive->lNumRehashed, (unsigned long long)psLive->lNumRemoved,
+               (unsigned long long)psLive->lNumEntries );
+   }
+
+   return !psLive->fModified || WriteWatchManifest( psLive );
+}
+
+/*----------------------------------------------------------------------------
+** Keep an md5sum manifest of a directory tree current: write the manifest of
+** the whole tree once, then rehash only the files that inotify reports as
+** written (or moved in) and drop the removed ones. Changes are applied once
+** the tree has been quiet for --debounce ms (at the latest after
+** WATCH_MAX_DELAY_MS), until SIGINT or SIGTERM.
+*-----------------------------------------------------------------------------
+*/
+static BOOL WatchTree( const char* pacRoot, const char* pacFilename )
+{
+   MD5_WALK_ConfigType sWalkCfg;
+   MD5_LIVE_Type sLive;
+   MD5_WATCH_Type sWatch;
+   MD5_POOL_Type sPool;
+   struct sigaction sAction;
+   double rFrequency;
+   UINT64 lQuietStart;
+   UINT64 lBurstStart;
+   BOOL fSuccess;
+
+   if( !MD5_WATCH_Open( &sWatch ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+      return FALSE;
+   }
+
+   if( !OpenDigestCache() )
+   {
+      MD5_WATCH_Close( &sWatch );
+      return FALSE;
+   }
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacRoot );
+      CloseDigestCache();
+      MD5_WATCH_Close( &sWatch );
+      return FALSE;
+   }
+
+   /* The full scans answer from the digest cache like -r */
+   sWalkCfg.pnVisit        = HashTreeVisit;
+   sWalkCfg.pnVisitBatch   = HashTreeVisitBatch;
+   sWalkCfg.lBatchFileSize = MD5_IO_GetSmallFileSize( apsIoWorkers[ 0 ] );
+   sWalkCfg.pnPickWorker   = PickLocalWorker;
+
+   fSuccess = MD5_LIVE_Init( &sLive, pacFilename, apsIoWorkers, &sWalkCfg, ReportWatchError,
+                             WriteWatchLine, NULL );
+
+   if( !fSuccess )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( ENOMEM ) );
+   }
+
+   /* Watched before the scan, so nothing written during the scan is missed */
+   if( fSuccess && !MD5_WATCH_AddTree( &sWatch, pacRoot, NULL, NULL ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   if( fSuccess && !MD5_LIVE_Scan( &sLive, &sPool, pacRoot ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   fSuccess = fSuccess && WriteWatchManifest( &sLive );
+
+   if( fSuccess && fVerbose )
+   {
+      fprintf( stderr, "[WATCH] %llu files, watching %lu directories\n",
+               (unsigned long long)sLive.lNumEntries, (unsigned long)sWatch.dwNumDirs );
+   }
+
+   /* No SA_RESTART: the signal has to end the wait for events */
+   memset( &sAction, 0, sizeof( sAction ) );
+   sAction.sa_handler = RequestStop;
+   sigemptyset( &sAction.sa_mask );
+   sigaction( SIGINT, &sAction, NULL );
+   sigaction( SIGTERM, &sAction, NULL );
+
+   StartCounter( &rFrequency, &lQuietStart );
+   lBurstStart = lQuietStart;
+
+   while( fSuccess && !fStopRequested )
+   {
+      BOOL fPending = MD5_LIVE_IsPending( &sLive );
+      long lTimeoutMs = -1;
+      long lNumEvents;
+
+      if( fPending )
+      {
+         double rQuiet = (double)dwDebounceMs - GetCounter( rFrequency, lQuietStart );
+         double rBurst = (double)WATCH_MAX_DELAY_MS - GetCounter( rFrequency, lBurstStart );
+         double rWait  = ( rQuiet < rBurst ) ? rQuiet : rBurst;
+
+         if( rWait <= 0.0 )
+         {
+            fSuccess = WatchFlush( &sPool, &sWatch, &sLive, pacRoot );
+            continue;
+         }
+
+         lTimeoutMs = (long)rWait + 1;
+      }
+
+      lNumEvents = MD5_WATCH_Read( &sWatch, lTimeoutMs, MD5_LIVE_Event, &sLive );
+
+      if( ( lNumEvents < 0 ) && ( errno != EINTR ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( errno ) );
+         fSuccess = FALSE;
+      }
+      else if( sLive.fOutOfMemory )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacRoot, strerror( ENOMEM ) );
+         fSuccess = FALSE;
+      }
+      else if( lNumEvents > 0 )
+      {
+         /* Every event restarts the quiet time, the first of a burst the delay limit */
+         StartCounter( &rFrequency, &lQuietStart );
+
+         if( !fPending )
+         {
+            lBurstStart = lQuietStart;
+         }
+      }
+   }
+
+   /* Changes that arrived before the stop are not lost */
+   if( fSuccess && MD5_LIVE_IsPending( &sLive ) )
+   {
+      fSuccess = WatchFlush( &sPool, &sWatch, &sLive, pacRoot );
+   }
+
+   sAction.sa_handler = SIG_DFL;
+   sigaction( SIGINT, &sAction, NULL );
+   sigaction( SIGTERM, &sAction, NULL );
+
+   DestroyWorkers( &sPool );
+   MD5_WATCH_Close( &sWatch );
+   fSuccess = CloseDigestCache() && fSuccess;
+   MD5_LIVE_Free( &sLive );
+
+   return fSuccess && ( dwNumFailedFiles == 0 );
+}
+
+/*----------------------------------------------------------------------------
+** Service mode error routine, reports a connection that broke off
+*-----------------------------------------------------------------------------
+*/
+static void ReportServeError( int iError, void* pxCtx )
+{
+   (void)pxCtx;
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[SERVE] connection ended: %s\n", strerror( iError ) );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Run the local hashing service on a Unix domain socket until SIGINT or
+** SIGTERM. The workers and their MD5 instances and read buffers are set up
+** once and shared by all connections, so a client pays for neither thread
+** start-up nor buffer allocation. Every connection has a thread of its own
+** that hands the requests of its messages to the workers.
+*-----------------------------------------------------------------------------
+*/
+static BOOL ServeRequests( const char* pacSocket )
+{
+   MD5_SERVE_Type sServer;
+   MD5_POOL_Type sPool;
+   struct sigaction sAction;
+   sigset_t sStopSignals;
+   sigset_t sOldSignals;
+   BOOL fSuccess = TRUE;
+   int iListen;
+
+   iListen = MD5_RPC_Listen( pacSocket );
+
+   if( iListen < 0 )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+      return FALSE;
+   }
+
+   /*
+   ** Only the accepting thread takes SIGINT and SIGTERM, and only while it
+   ** waits, so a stop can't slip in between the check and the wait. The
+   ** workers and connection threads inherit the blocked signals.
+   */
+   sigemptyset( &sStopSignals );
+   sigaddset( &sStopSignals, SIGINT );
+   sigaddset( &sStopSignals, SIGTERM );
+   pthread_sigmask( SIG_BLOCK, &sStopSignals, &sOldSignals );
+
+   if( !CreateWorkers( &sPool ) )
+   {
+      fprintf( stderr, "md5: %s: failed to start the worker threads\n", pacSocket );
+      pthread_sigmask( SIG_SETMASK, &sOldSignals, NULL );
+      close( iListen );
+      unlink( pacSocket );
+      return FALSE;
+   }
+
+   MD5_SERVE_Init( &sServer, &sPool, apsIoWorkers, ReportServeError, NULL );
+
+   memset( &sAction, 0, sizeof( sAction ) );
+   sAction.sa_handler = RequestStop;
+   sigemptyset( &sAction.sa_mask );
+   sigaction( SIGINT, &sAction, NULL );
+   sigaction( SIGTERM, &sAction, NULL );
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[SERVE] listening on %s\n", pacSocket );
+   }
+
+   while( !fStopRequested )
+   {
+      fd_set sReadable;
+      int iSocket;
+
+      FD_ZERO( &sReadable );
+      FD_SET( iListen, &sReadable );
+
+      if( pselect( iListen + 1, &sReadable, NULL, NULL, NULL, &sOldSignals ) < 0 )
+      {
+         if( errno != EINTR )
+         {
+            fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+            fSuccess = FALSE;
+            break;
+         }
+
+         continue;
+      }
+
+      iSocket = accept( iListen, NULL, NULL );
+
+      if( iSocket < 0 )
+      {
+         /* A client that gave up before it was accepted is no error */
+         if( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) && ( errno != ECONNABORTED ) &&
+             ( errno != EINTR ) )
+         {
+            /* Out of fds or memory: the pending clients wait */
+            fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+            poll( NULL, 0, SERVE_ACCEPT_RETRY_MS );
+         }
+
+         continue;
+      }
+
+      if( !MD5_SERVE_Accept( &sServer, iSocket ) && fVerbose )
+      {
+         fprintf( stderr, "[SERVE] connection refused\n" );
+      }
+   }
+
+   /* New clients are refused from here on */
+   close( iListen );
+   unlink( pacSocket );
+
+   /* The connection threads end once their current message is answered */
+   MD5_SERVE_Stop( &sServer );
+
+   sAction.sa_handler = SIG_DFL;
+   sigaction( SIGINT, &sAction, NULL );
+   sigaction( SIGTERM, &sAction, NULL );
+   pthread_sigmask( SIG_SETMASK, &sOldSignals, NULL );
+
+   DestroyWorkers( &sPool );
+
+   if( fVerbose )
+   {
+      fprintf( stderr, "[SERVE] stopped\n" );
+   }
+
+   return fSuccess;
+}
+
+/*----------------------------------------------------------------------------
+** Client mode result routine, prints a digest in list order
+*-----------------------------------------------------------------------------
+*/
+static void WriteConnectResult( const char* pacName, const UINT8* pbDigest, int iError,
+                                void* pxCtx )
+{
+   (void)pxCtx;
+
+   if( pbDigest == NULL )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacName, strerror( iError ) );
+      dwNumFailedFiles++;
+   }
+   else
+   {
+      WriteResultLine( pbDigest, pacName );
+   }
+}
+
+/*----------------------------------------------------------------------------
+** Hash every file named in a list through the service listening on
+** pacSocket (--connect). Requests are batched into messages and the
+** messages pipelined; relative names are resolved against our working
+** directory, as the service has a different one. Digests are printed in
+** list order, like HashFileList().
+*-----------------------------------------------------------------------------
+*/
+static BOOL SubmitFileList( const char* pacList, int iSeparator, const char* pacSocket )
+{
+   MD5_SERVE_ClientType* psClient;
+   FILE* psList      = stdin;
+   char* pacLine     = NULL;
+   size_t iLineAlloc = 0;
+   char* pacCwd      = NULL;
+   ssize_t iLineLen;
+   BOOL fSuccess = TRUE;
+
+   psClient = malloc( sizeof( MD5_SERVE_ClientType ) );
+
+   if( psClient == NULL )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( ENOMEM ) );
+      return FALSE;
+   }
+
+   if( !MD5_SERVE_Connect( psClient, pacSocket, WriteConnectResult, NULL ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+      free( psClient );
+      return FALSE;
+   }
+
+   if( !CHECK_ARGUMENT( (char*)pacList, "-" ) )
+   {
+      fopen_s( &psList, pacList, "rb" );
+
+      if( psList == NULL )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+         MD5_SERVE_Disconnect( psClient );
+         free( psClient );
+         return FALSE;
+      }
+   }
+
+   while( fSuccess && ( ( iLineLen = getdelim( &pacLine, &iLineAlloc, iSeparator, psList ) ) > 0 ) )
+   {
+      char* pacPath = pacLine;
+
+      if( pacLine[ iLineLen - 1 ] == (char)iSeparator )
+      {
+         pacLine[ --iLineLen ] = '\0';
+      }
+
+      if( ( iSeparator == '\n' ) && ( iLineLen > 0 ) && ( pacLine[ iLineLen - 1 ] == '\r' ) )
+      {
+         pacLine[ --iLineLen ] = '\0';
+      }
+
+      if( iLineLen == 0 )
+      {
+         continue;
+      }
+
+      if( ( pacLine[ 0 ] != '/' ) && ( pacCwd == NULL ) &&
+          ( ( pacCwd = getcwd( NULL, 0 ) ) == NULL ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacLine, strerror( errno ) );
+         fSuccess = FALSE;
+         break;
+      }
+
+      if( pacLine[ 0 ] != '/' )
+      {
+         pacPath = malloc( strlen( pacCwd ) + 1 + (size_t)iLineLen + 1 );
+
+         if( pacPath == NULL )
+         {
+            fprintf( stderr, "md5: %s: %s\n", pacLine, strerror( ENOMEM ) );
+            fSuccess = FALSE;
+            break;
+         }
+
+         sprintf( pacPath, "%s/%s", pacCwd, pacLine );
+      }
+
+      /*
+      ** The client takes over the line buffer, getdelim allocates a new one
+      */
+      if( !MD5_SERVE_Submit( psClient, pacLine, pacPath ) )
+      {
+         fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+         fSuccess = FALSE;
+      }
+
+      if( pacPath != pacLine )
+      {
+         free( pacPath );
+      }
+
+      pacLine    = NULL;
+      iLineAlloc = 0;
+   }
+
+   if( ferror( psList ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacList, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   if( psList != stdin )
+   {
+      fclose( psList );
+   }
+
+   free( pacLine );
+   free( pacCwd );
+
+   if( fSuccess && !MD5_SERVE_Finish( psClient ) )
+   {
+      fprintf( stderr, "md5: %s: %s\n", pacSocket, strerror( errno ) );
+      fSuccess = FALSE;
+   }
+
+   MD5_SERVE_Disconnect( psClient );
+   free( psClient );
+
+   MD5_FMT_Flush( &sStdout );
+
+   return fSuccess && ( dwNumFailedFiles == 0 );
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,663 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_fmt.c
+**    Summary: Digest formatting and buffered bulk output.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+
+#include "MD5_fmt.h"
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_FMT_INVALID_NIBBLE         ( 0xFF )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** A digest of MD5_FMT_abTestDigests and its expected encoding, NULL for
+** the digest bytes themselves
+*/
+typedef struct MD5_FMT_TestCase
+{
+   const char* pacDesc;
+   UINT8 bFormat;
+   UINT8 bDigest;
+   const char* pacEncoded;
+} MD5_FMT_TestCaseType;
+#endif
+
+/*******************************************************************************
+** Private Globals
+********************************************************************************
+*/
+
+/*----------------------------------------------------------------------------
+** The two hexadecimal characters of every byte value, so a byte is encoded
+** with a single lookup instead of two.
+**----------------------------------------------------------------------------
+*/
+static const char MD5_FMT_acHexLower[ 2 * 256 + 1 ] =
+   "000102030405060708090a0b0c0d0e0f"
+   "101112131415161718191a1b1c1d1e1f"
+   "202122232425262728292a2b2c2d2e2f"
+   "303132333435363738393a3b3c3d3e3f"
+   "404142434445464748494a4b4c4d4e4f"
+   "505152535455565758595a5b5c5d5e5f"
+   "606162636465666768696a6b6c6d6e6f"
+   "707172737475767778797a7b7c7d7e7f"
+   "808182838485868788898a8b8c8d8e8f"
+   "909192939495969798999a9b9c9d9e9f"
+   "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+   "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+   "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+   "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+   "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+   "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char MD5_FMT_acHexUpper[ 2 * 256 + 1 ] =
+   "000102030405060708090A0B0C0D0E0F"
+   "101112131415161718191A1B1C1D1E1F"
+   "202122232425262728292A2B2C2D2E2F"
+   "303132333435363738393A3B3C3D3E3F"
+   "404142434445464748494A4B4C4D4E4F"
+   "505152535455565758595A5B5C5D5E5F"
+   "606162636465666768696A6B6C6D6E6F"
+   "707172737475767778797A7B7C7D7E7F"
+   "808182838485868788898A8B8C8D8E8F"
+   "909192939495969798999A9B9C9D9E9F"
+   "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+   "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+   "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+   "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+   "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+   "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/*----------------------------------------------------------------------------
+** Hexadecimal character to nibble value, MD5_FMT_INVALID_NIBBLE for
+** characters that are not hexadecimal digits.
+**----------------------------------------------------------------------------
+*/
+static const UINT8 MD5_FMT_abHexValue[ 256 ] =
+{
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/*----------------------------------------------------------------------------
+** Base64 alphabet (RFC 4648)
+**----------------------------------------------------------------------------
+*/
+static const char MD5_FMT_acBase64[ 64 + 1 ] =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*----------------------------------------------------------------------------
+** The two decimal digits of 0 to 99
+**----------------------------------------------------------------------------
+*/
+static const char MD5_FMT_acDecimalPairs[ 2 * 100 + 1 ] =
+   "00010203040506070809"
+   "10111213141516171819"
+   "20212223242526272829"
+   "30313233343536373839"
+   "40414243444546474849"
+   "50515253545556575859"
+   "60616263646566676869"
+   "70717273747576777879"
+   "80818283848586878889"
+   "90919293949596979899";
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*----------------------------------------------------------------------------
+** MD5( "abc" ) and MD5( "" ) (RFC 1321) and their encodings
+**----------------------------------------------------------------------------
+*/
+static const UINT8 MD5_FMT_abTestDigests[ 2 ][ MD5_DIGEST_SIZE ] =
+{
+   { 0x90, 0x01, 0x50, 0x98, 0x3C, 0xD2, 0x4F, 0xB0,
+     0xD6, 0x96, 0x3F, 0x7D, 0x28, 0xE1, 0x7F, 0x72 },
+   { 0xD4, 0x1D, 0x8C, 0xD9, 0x8F, 0x00, 0xB2, 0x04,
+     0xE9, 0x80, 0x09, 0x98, 0xEC, 0xF8, 0x42, 0x7E }
+};
+
+static const MD5_FMT_TestCaseType MD5_FMT_asTestCases[] =
+{
+   { "HEX",        MD5_FMT_HEX,       0, "900150983cd24fb0d6963f7d28e17f72" },
+   { "HEX UPPER",  MD5_FMT_HEX_UPPER, 1, "D41D8CD98F00B204E9800998ECF8427E" },
+   { "HEX BYTES",  MD5_FMT_HEX_BYTES, 0, "90 01 50 98 3C D2 4F B0 D6 96 3F 7D 28 E1 7F 72 " },
+   { "BASE64",     MD5_FMT_BASE64,    0, "kAFQmDzST7DWlj99KOF/cg==" },
+   { "BASE64",     MD5_FMT_BASE64,    1, "1B2M2Y8AsgTpgAmY7PhCfg==" },
+   { "RAW",        MD5_FMT_RAW,       1, NULL }
+};
+
+/*----------------------------------------------------------------------------
+** Characters around the hexadecimal digits, and one with the top bit set
+**----------------------------------------------------------------------------
+*/
+static const char MD5_FMT_acTestNonHex[] = "/:@G`g \xC6";
+#endif
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static void MD5_FMT_EncodeHexPairs( const UINT8* pbDigest, const char* pacPairs, char* pacHex );
+static UINT16 MD5_FMT_EncodeBase64( const UINT8* pbDigest, char* pacOut );
+static void MD5_FMT_Drain( MD5_FMT_WriterType* psWriter );
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static BOOL MD5_FMT_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Encodes a digest with one of the hexadecimal pair tables.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    pacPairs - MD5_FMT_acHexLower or MD5_FMT_acHexUpper
+**    pacHex   - Receives MD5_FMT_HEX_LEN characters
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_FMT_EncodeHexPairs( const UINT8* pbDigest, const char* pacPairs, char* pacHex )
+{
+   UINT8 bByteIndex;
+
+   for( bByteIndex = 0; bByteIndex < MD5_DIGEST_SIZE; bByteIndex++ )
+   {
+      memcpy( &pacHex[ 2 * bByteIndex ], &pacPairs[ 2 * pbDigest[ bByteIndex ] ], 2 );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Encodes a digest in base64, padded to a multiple of four characters.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    pacOut   - Receives MD5_FMT_BASE64_LEN characters
+**
+** Returns:
+**    UINT16 - MD5_FMT_BASE64_LEN
+**------------------------------------------------------------------------------
+*/
+static UINT16 MD5_FMT_EncodeBase64( const UINT8* pbDigest, char* pacOut )
+{
+   UINT16 iLen = 0;
+   UINT8 bByteIndex;
+   UINT32 dwGroup;
+
+   for( bByteIndex = 0; bByteIndex + 3U <= MD5_DIGEST_SIZE; bByteIndex += 3 )
+   {
+      dwGroup = ( (UINT32)pbDigest[ bByteIndex ] << 16 ) |
+                ( (UINT32)pbDigest[ bByteIndex + 1 ] << 8 ) | pbDigest[ bByteIndex + 2 ];
+
+      pacOut[ iLen++ ] = MD5_FMT_acBase64[ ( dwGroup >> 18 ) & 0x3F ];
+      pacOut[ iLen++ ] = MD5_FMT_acBase64[ ( dwGroup >> 12 ) & 0x3F ];
+      pacOut[ iLen++ ] = MD5_FMT_acBase64[ ( dwGroup >> 6 ) & 0x3F ];
+      pacOut[ iLen++ ] = MD5_FMT_acBase64[ dwGroup & 0x3F ];
+   }
+
+   /* MD5_DIGEST_SIZE is one more than a multiple of three */
+   dwGroup = (UINT32)pbDigest[ bByteIndex ] << 16;
+
+   pacOut[ iLen++ ] = MD5_FMT_acBase64[ ( dwGroup >> 18 ) & 0x3F ];
+   pacOut[ iLen++ ] = MD5_FMT_acBase64[ ( dwGroup >> 12 ) & 0x3F ];
+   pacOut[ iLen++ ] = '=';
+   pacOut[ iLen++ ] = '=';
+
+   return iLen;
+}
+
+/*------------------------------------------------------------------------------
+** Hands the buffered output to the stream, without flushing the stream.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_FMT_Drain( MD5_FMT_WriterType* psWriter )
+{
+   if( ( psWriter->dwUsed > 0 ) &&
+       ( fwrite( psWriter->pacBuffer, 1, psWriter->dwUsed, psWriter->psFile ) !=
+         psWriter->dwUsed ) )
+   {
+      psWriter->fError = TRUE;
+   }
+
+   psWriter->dwUsed = 0;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Test number
+**    pacName    - Test name
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_FMT_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "FMT_TEST_%03d: %s\t: %s\n", bTestEntry, pacName, fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Encodes a digest as MD5_FMT_HEX_LEN lower case hexadecimal characters.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    pacHex   - Receives the characters (not NUL terminated)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_EncodeHex( const UINT8* pbDigest, char* pacHex )
+{
+   MD5_FMT_EncodeHexPairs( pbDigest, MD5_FMT_acHexLower, pacHex );
+}
+
+/*------------------------------------------------------------------------------
+** Decodes a digest from MD5_FMT_HEX_LEN hexadecimal characters of either
+** case.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacHex   - Hexadecimal characters (need not be NUL terminated)
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE if a character is not a hexadecimal digit
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_DecodeHex( const char* pacHex, UINT8* pbDigest )
+{
+   UINT8 bInvalid = 0;
+   UINT8 bByteIndex;
+
+   for( bByteIndex = 0; bByteIndex < MD5_DIGEST_SIZE; bByteIndex++ )
+   {
+      UINT8 bHigh = MD5_FMT_abHexValue[ (UINT8)pacHex[ 2 * bByteIndex ] ];
+      UINT8 bLow  = MD5_FMT_abHexValue[ (UINT8)pacHex[ 2 * bByteIndex + 1 ] ];
+
+      /* Invalid entries have the upper nibble set, check once at the end */
+      bInvalid |= bHigh | bLow;
+      pbDigest[ bByteIndex ] = (UINT8)( ( bHigh << 4 ) | ( bLow & 0x0F ) );
+   }
+
+   return ( bInvalid & 0xF0 ) == 0;
+}
+
+/*------------------------------------------------------------------------------
+** Encodes a digest in one of the MD5_FMT_... formats.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    bFormat  - MD5_FMT_... format
+**    pacOut   - Receives the encoded digest (up to MD5_FMT_MAX_LEN
+**               characters, not NUL terminated)
+**
+** Returns:
+**    UINT16 - Length of the encoded digest
+**------------------------------------------------------------------------------
+*/
+UINT16 MD5_FMT_Encode( const UINT8* pbDigest, UINT8 bFormat, char* pacOut )
+{
+   UINT8 bByteIndex;
+
+   switch( bFormat )
+   {
+   case MD5_FMT_HEX_UPPER:
+      MD5_FMT_EncodeHexPairs( pbDigest, MD5_FMT_acHexUpper, pacOut );
+      return MD5_FMT_HEX_LEN;
+
+   case MD5_FMT_HEX_BYTES:
+      for( bByteIndex = 0; bByteIndex < MD5_DIGEST_SIZE; bByteIndex++ )
+      {
+         memcpy( &pacOut[ 3 * bByteIndex ], &MD5_FMT_acHexUpper[ 2 * pbDigest[ bByteIndex ] ], 2 );
+         pacOut[ 3 * bByteIndex + 2 ] = ' ';
+      }
+      return MD5_FMT_HEX_BYTES_LEN;
+
+   case MD5_FMT_BASE64:
+      return MD5_FMT_EncodeBase64( pbDigest, pacOut );
+
+   case MD5_FMT_RAW:
+      memcpy( pacOut, pbDigest, MD5_DIGEST_SIZE );
+      return MD5_DIGEST_SIZE;
+
+   default:
+      MD5_FMT_EncodeHexPairs( pbDigest, MD5_FMT_acHexLower, pacOut );
+      return MD5_FMT_HEX_LEN;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Sets up a writer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter    - Writer to set up
+**    psFile      - Stream the output goes to
+**    pacBuffer   - Output buffer (NULL: unbuffered)
+**    dwSize      - Size of the output buffer in bytes
+**    fFlushLines - TRUE to flush the writer whenever a line is complete
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriterInit( MD5_FMT_WriterType* psWriter, FILE* psFile, char* pacBuffer, UINT32 dwSize,
+                         BOOL fFlushLines )
+{
+   psWriter->psFile      = psFile;
+   psWriter->pacBuffer   = pacBuffer;
+   psWriter->dwSize      = ( pacBuffer != NULL ) ? dwSize : 0;
+   psWriter->dwUsed      = 0;
+   psWriter->fFlushLines = fFlushLines;
+   psWriter->fError      = FALSE;
+}
+
+/*------------------------------------------------------------------------------
+** Writes data. Data that doesn't fit the free space of the buffer makes the
+** writer hand the buffer to the stream first; data larger than the buffer
+** goes to the stream directly.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pxData   - Data to write
+**    dwLen    - Length of the data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_Write( MD5_FMT_WriterType* psWriter, const void* pxData, UINT32 dwLen )
+{
+   if( ( dwLen > psWriter->dwSize - psWriter->dwUsed ) || ( psWriter->pacBuffer == NULL ) )
+   {
+      MD5_FMT_Drain( psWriter );
+
+      if( dwLen >= psWriter->dwSize )
+      {
+         if( fwrite( pxData, 1, dwLen, psWriter->psFile ) != dwLen )
+         {
+            psWriter->fError = TRUE;
+         }
+
+         return;
+      }
+   }
+
+   memcpy( &psWriter->pacBuffer[ psWriter->dwUsed ], pxData, dwLen );
+   psWriter->dwUsed += dwLen;
+}
+
+/*------------------------------------------------------------------------------
+** Writes a NUL terminated string.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pacText  - String to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteString( MD5_FMT_WriterType* psWriter, const char* pacText )
+{
+   MD5_FMT_Write( psWriter, pacText, (UINT32)strlen( pacText ) );
+}
+
+/*------------------------------------------------------------------------------
+** Writes a single character.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    cChar    - Character to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteChar( MD5_FMT_WriterType* psWriter, char cChar )
+{
+   if( psWriter->dwUsed < psWriter->dwSize )
+   {
+      psWriter->pacBuffer[ psWriter->dwUsed++ ] = cChar;
+   }
+   else
+   {
+      MD5_FMT_Write( psWriter, &cChar, 1 );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Writes an unsigned number in decimal.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    lValue   - Number to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteDecimal( MD5_FMT_WriterType* psWriter, UINT64 lValue )
+{
+   char acDigits[ 20 ]; /* 2^64 - 1 has 20 digits */
+   UINT8 bStart = sizeof( acDigits );
+
+   /* Two digits per division, from the end */
+   while( lValue >= 100 )
+   {
+      UINT8 bPair = (UINT8)( lValue % 100 );
+
+      lValue /= 100;
+      bStart -= 2;
+      memcpy( &acDigits[ bStart ], &MD5_FMT_acDecimalPairs[ 2 * bPair ], 2 );
+   }
+
+   if( lValue >= 10 )
+   {
+      bStart -= 2;
+      memcpy( &acDigits[ bStart ], &MD5_FMT_acDecimalPairs[ 2 * lValue ], 2 );
+   }
+   else
+   {
+      acDigits[ --bStart ] = (char)( '0' + lValue );
+   }
+
+   MD5_FMT_Write( psWriter, &acDigits[ bStart ], sizeof( acDigits ) - bStart );
+}
+
+/*------------------------------------------------------------------------------
+** Writes a digest in one of the MD5_FMT_... formats.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pbDigest - Digest to write (MD5_DIGEST_SIZE bytes)
+**    bFormat  - MD5_FMT_... format
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteDigest( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest, UINT8 bFormat )
+{
+   char acText[ MD5_FMT_MAX_LEN ];
+
+   /* Encode in place when there is room, the common case */
+   if( psWriter->dwSize - psWriter->dwUsed >= MD5_FMT_MAX_LEN )
+   {
+      psWriter->dwUsed += MD5_FMT_Encode( pbDigest, bFormat,
+                                          &psWriter->pacBuffer[ psWriter->dwUsed ] );
+   }
+   else
+   {
+      MD5_FMT_Write( psWriter, acText, MD5_FMT_Encode( pbDigest, bFormat, acText ) );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Ends a line with a newline, flushing the writer if it flushes lines.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_EndLine( MD5_FMT_WriterType* psWriter )
+{
+   MD5_FMT_WriteChar( psWriter, '\n' );
+
+   if( psWriter->fFlushLines )
+   {
+      MD5_FMT_Flush( psWriter );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Hands the buffered output to the stream and flushes the stream.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**
+** Returns:
+**    BOOL - FALSE if any write to the stream failed since the writer was set
+**           up
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_Flush( MD5_FMT_WriterType* psWriter )
+{
+   MD5_FMT_Drain( psWriter );
+
+   if( fflush( psWriter->psFile ) != 0 )
+   {
+      psWriter->fError = TRUE;
+   }
+
+   return !psWriter->fError;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the encodings of the RFC 1321 test digests in all formats, that
+** hexadecimal digits of either case decode to the digest and that a single
+** character other than a hexadecimal digit fails the decoding.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_RunTests( void )
+{
+   char acOut[ MD5_FMT_MAX_LEN ];
+   char acHex[ MD5_FMT_HEX_LEN ];
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   BOOL fAllPassed = TRUE;
+   BOOL fPassed;
+   UINT8 bTestEntry;
+   UINT8 bChar;
+
+   for( bTestEntry = 0;
+        bTestEntry < sizeof( MD5_FMT_asTestCases ) / sizeof( MD5_FMT_asTestCases[ 0 ] );
+        bTestEntry++ )
+   {
+      const MD5_FMT_TestCaseType* psCase = &MD5_FMT_asTestCases[ bTestEntry ];
+      const UINT8* pbDigest              = MD5_FMT_abTestDigests[ psCase->bDigest ];
+      const char* pacEncoded             = psCase->pacEncoded;
+      UINT16 iLen                        = MD5_FMT_Encode( pbDigest, psCase->bFormat, acOut );
+
+      if( pacEncoded == NULL )
+      {
+         fPassed = ( iLen == MD5_DIGEST_SIZE ) &&
+                   ( memcmp( acOut, pbDigest, MD5_DIGEST_SIZE ) == 0 );
+      }
+      else
+      {
+         fPassed = ( iLen == strlen( pacEncoded ) ) && ( memcmp( acOut, pacEncoded, iLen ) == 0 );
+      }
+
+      fAllPassed = MD5_FMT_ReportTest( bTestEntry, psCase->pacDesc, fPassed ) && fAllPassed;
+   }
+
+   /* Upper case digits decode the same, and encode back to lower case */
+   fPassed = MD5_FMT_DecodeHex( "900150983CD24FB0d6963f7d28e17f72", abDigest ) &&
+             ( memcmp( abDigest, MD5_FMT_abTestDigests[ 0 ], MD5_DIGEST_SIZE ) == 0 );
+
+   MD5_FMT_EncodeHex( abDigest, acHex );
+   fPassed = fPassed &&
+             ( memcmp( acHex, MD5_FMT_asTestCases[ 0 ].pacEncoded, MD5_FMT_HEX_LEN ) == 0 );
+
+   fAllPassed = MD5_FMT_ReportTest( bTestEntry++, "DECODE HEX", fPassed ) && fAllPassed;
+
+   /* Every invalid character, at a different position each */
+   fPassed = TRUE;
+
+   for( bChar = 0; bChar < sizeof( MD5_FMT_acTestNonHex ) - 1; bChar++ )
+   {
+      memcpy( acHex, MD5_FMT_asTestCases[ 0 ].pacEncoded, MD5_FMT_HEX_LEN );
+      acHex[ ( bChar * 5 ) % MD5_FMT_HEX_LEN ] = MD5_FMT_acTestNonHex[ bChar ];
+
+      fPassed = fPassed && !MD5_FMT_DecodeHex( acHex, abDigest );
+   }
+
+   fAllPassed = MD5_FMT_ReportTest( bTestEntry++, "DECODE INVALID", fPassed ) && fAllPassed;
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
@@ -0,0 +1,233 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_fmt.h
+**    Summary: Digest formatting. Table driven encoding of digests as
+**             hexadecimal (lower or upper case), base64 or raw bytes, hex
+**             decoding, and a writer that collects output in a large buffer
+**             and hands it to the stream in bulk.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_FMT_H_
+#define HMS_SC_MD5_FMT_H_
+
+#include "MD5.h"
+
+#include <stdio.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+/*
+** Digest formats
+*/
+#define MD5_FMT_HEX                    ( 0U ) /* Lower case hexadecimal */
+#define MD5_FMT_HEX_UPPER              ( 1U ) /* Upper case hexadecimal */
+#define MD5_FMT_HEX_BYTES              ( 2U ) /* Upper case, a space after every byte */
+#define MD5_FMT_BASE64                 ( 3U ) /* Base64 with padding */
+#define MD5_FMT_RAW                    ( 4U ) /* The MD5_DIGEST_SIZE digest bytes */
+
+/*
+** Encoded lengths in characters
+*/
+#define MD5_FMT_HEX_LEN                ( 2U * MD5_DIGEST_SIZE )
+#define MD5_FMT_HEX_BYTES_LEN          ( 3U * MD5_DIGEST_SIZE )
+#define MD5_FMT_BASE64_LEN             ( 4U * ( ( MD5_DIGEST_SIZE + 2U ) / 3U ) )
+#define MD5_FMT_MAX_LEN                MD5_FMT_HEX_BYTES_LEN
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_FMT_Writer
+{
+   FILE* psFile;
+   char* pacBuffer;  /* NULL: every write goes to the stream directly */
+   UINT32 dwSize;
+   UINT32 dwUsed;
+   BOOL fFlushLines; /* Flush at the end of every line (interactive output) */
+   BOOL fError;      /* A write to the stream failed */
+} MD5_FMT_WriterType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Encodes a digest as MD5_FMT_HEX_LEN lower case hexadecimal characters.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    pacHex   - Receives the characters (not NUL terminated)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_EncodeHex( const UINT8* pbDigest, char* pacHex );
+
+/*------------------------------------------------------------------------------
+** Decodes a digest from MD5_FMT_HEX_LEN hexadecimal characters of either
+** case.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacHex   - Hexadecimal characters (need not be NUL terminated)
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE if a character is not a hexadecimal digit
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_DecodeHex( const char* pacHex, UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Encodes a digest in one of the MD5_FMT_... formats.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to encode (MD5_DIGEST_SIZE bytes)
+**    bFormat  - MD5_FMT_... format
+**    pacOut   - Receives the encoded digest (up to MD5_FMT_MAX_LEN
+**               characters, not NUL terminated)
+**
+** Returns:
+**    UINT16 - Length of the encoded digest
+**------------------------------------------------------------------------------
+*/
+UINT16 MD5_FMT_Encode( const UINT8* pbDigest, UINT8 bFormat, char* pacOut );
+
+/*------------------------------------------------------------------------------
+** Sets up a writer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter    - Writer to set up
+**    psFile      - Stream the output goes to
+**    pacBuffer   - Output buffer (NULL: unbuffered)
+**    dwSize      - Size of the output buffer in bytes
+**    fFlushLines - TRUE to flush the writer whenever a line is complete
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriterInit( MD5_FMT_WriterType* psWriter, FILE* psFile, char* pacBuffer, UINT32 dwSize,
+                         BOOL fFlushLines );
+
+/*------------------------------------------------------------------------------
+** Writes data. Data that doesn't fit the free space of the buffer makes the
+** writer hand the buffer to the stream first; data larger than the buffer
+** goes to the stream directly.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pxData   - Data to write
+**    dwLen    - Length of the data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_Write( MD5_FMT_WriterType* psWriter, const void* pxData, UINT32 dwLen );
+
+/*------------------------------------------------------------------------------
+** Writes a NUL terminated string.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pacText  - String to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteString( MD5_FMT_WriterType* psWriter, const char* pacText );
+
+/*------------------------------------------------------------------------------
+** Writes a single character.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    cChar    - Character to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteChar( MD5_FMT_WriterType* psWriter, char cChar );
+
+/*------------------------------------------------------------------------------
+** Writes an unsigned number in decimal.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    lValue   - Number to write
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteDecimal( MD5_FMT_WriterType* psWriter, UINT64 lValue );
+
+/*------------------------------------------------------------------------------
+** Writes a digest in one of the MD5_FMT_... formats.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**    pbDigest - Digest to write (MD5_DIGEST_SIZE bytes)
+**    bFormat  - MD5_FMT_... format
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_WriteDigest( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest, UINT8 bFormat );
+
+/*------------------------------------------------------------------------------
+** Ends a line with a newline, flushing the writer if it flushes lines.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FMT_EndLine( MD5_FMT_WriterType* psWriter );
+
+/*------------------------------------------------------------------------------
+** Hands the buffered output to the stream and flushes the stream.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWriter - Writer
+**
+** Returns:
+**    BOOL - FALSE if any write to the stream failed since the writer was set
+**           up
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_Flush( MD5_FMT_WriterType* psWriter );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the encodings of the RFC 1321 test digests in all formats, that
+** hexadecimal digits of either case decode to the digest and that a single
+** character other than a hexadecimal digit fails the decoding.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_FMT_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_FMT_H_ */
@@ -0,0 +1,142 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_fprint.c
+**    Summary: Quick fingerprint, sample layout and header. The regions are
+**             read by the caller (e.g. in parallel with pread()).
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_fprint.h"
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static void MD5_FPRINT_StoreLittleEndian( UINT8* pbDest, UINT64 lValue, UINT16 iNumBytes );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Stores a value little endian.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDest    - Destination
+**    lValue    - Value to store
+**    iNumBytes - Number of bytes to store
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_FPRINT_StoreLittleEndian( UINT8* pbDest, UINT64 lValue, UINT16 iNumBytes )
+{
+   UINT16 iByte;
+
+   for( iByte = 0; iByte < iNumBytes; iByte++ )
+   {
+      pbDest[ iByte ] = (UINT8)( lValue >> ( 8 * iByte ) );
+   }
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the regions of an input that make up its fingerprint, in the
+** order they are hashed. The regions don't overlap and are in input order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lSize        - Size of the input
+**    dwWindowSize - Window size in bytes (1 .. MD5_FPRINT_MAX_WINDOW_SIZE)
+**    dwNumWindows - Windows between head and tail (0 ..
+**                   MD5_FPRINT_MAX_WINDOWS)
+**    asRegions    - Receives the regions, room for dwNumWindows + 2
+**
+** Returns:
+**    UINT32 - Number of regions (0 for an empty input)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_FPRINT_GetRegions( UINT64 lSize, UINT32 dwWindowSize, UINT32 dwNumWindows,
+                              MD5_FPRINT_RegionType asRegions[] )
+{
+   UINT32 dwNumRegions = 0;
+   UINT64 lGap;
+   UINT32 dwWindow;
+
+   /* Small enough to sample in full, in at most dwNumWindows + 2 windows */
+   if( lSize <= (UINT64)dwWindowSize * ( dwNumWindows + 2 ) )
+   {
+      UINT64 lOffset;
+
+      for( lOffset = 0; lOffset < lSize; lOffset += dwWindowSize )
+      {
+         asRegions[ dwNumRegions ].lOffset  = lOffset;
+         asRegions[ dwNumRegions ].dwLength =
+            ( lSize - lOffset < dwWindowSize ) ? (UINT32)( lSize - lOffset ) : dwWindowSize;
+         dwNumRegions++;
+      }
+
+      return dwNumRegions;
+   }
+
+   asRegions[ dwNumRegions ].lOffset    = 0;
+   asRegions[ dwNumRegions++ ].dwLength = dwWindowSize;
+
+   /*
+   ** The gap between head and tail is split into K equal slots and window i
+   ** is centered in slot i. The gap holds more than K windows, so every slot
+   ** is longer than a window and the windows can't overlap each other, the
+   ** head or the tail, however close the size is to the full-sample limit.
+   */
+   lGap = lSize - 2 * (UINT64)dwWindowSize;
+
+   for( dwWindow = 0; dwWindow < dwNumWindows; dwWindow++ )
+   {
+      asRegions[ dwNumRegions ].lOffset = dwWindowSize + ( lGap * ( 2 * dwWindow + 1 ) -
+                                                           (UINT64)dwWindowSize * dwNumWindows ) /
+                                                         ( 2 * (UINT64)dwNumWindows );
+      asRegions[ dwNumRegions++ ].dwLength = dwWindowSize;
+   }
+
+   asRegions[ dwNumRegions ].lOffset    = lSize - dwWindowSize;
+   asRegions[ dwNumRegions++ ].dwLength = dwWindowSize;
+
+   return dwNumRegions;
+}
+
+/*------------------------------------------------------------------------------
+** Starts a fingerprint: initializes the instance and hashes the header. The
+** caller continues with the regions and finalizes the instance.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst       - MD5 instance to start
+**    lSize        - Size of the input
+**    dwWindowSize - Window size in bytes
+**    dwNumWindows - Windows between head and tail
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FPRINT_Begin( MD5_InstType* psInst, UINT64 lSize, UINT32 dwWindowSize,
+                       UINT32 dwNumWindows )
+{
+   UINT8 abHeader[ 16 ];
+
+   MD5_FPRINT_StoreLittleEndian( &abHeader[ 0 ], lSize, 8 );
+   MD5_FPRINT_StoreLittleEndian( &abHeader[ 8 ], dwWindowSize, 4 );
+   MD5_FPRINT_StoreLittleEndian( &abHeader[ 12 ], dwNumWindows, 4 );
+
+   MD5_Init( psInst );
+   MD5_Update( psInst, abHeader, sizeof( abHeader ) );
+}
@@ -0,0 +1,90 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_fprint.h
+**    Summary: Quick fingerprint of a large input. NOT the MD5 of the input:
+**             only the size and a fixed sample of regions are hashed, so it
+**             detects appends, truncations and most rewrites at the cost of
+**             a few reads, but misses changes between the sampled regions.
+**
+**                fingerprint = MD5( size || window size || windows ||
+**                                   head || window 1 .. window K || tail )
+**
+**             The header values are little endian (8, 4 and 4 bytes). The
+**             head and tail are the first and last window of the input and
+**             the K windows are centered in K equal slots of the part
+**             between them, so no two regions overlap.
+**             An input no larger than K + 2 windows is sampled in full.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_FPRINT_H_
+#define HMS_SC_MD5_FPRINT_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_FPRINT_DEFAULT_WINDOW_SIZE ( 1024U * 1024U )
+#define MD5_FPRINT_MAX_WINDOW_SIZE     ( 64U * 1024U * 1024U )
+#define MD5_FPRINT_DEFAULT_WINDOWS     ( 16U )
+#define MD5_FPRINT_MAX_WINDOWS         ( 1024U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_FPRINT_Region
+{
+   UINT64 lOffset;
+   UINT32 dwLength;
+} MD5_FPRINT_RegionType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the regions of an input that make up its fingerprint, in the
+** order they are hashed. The regions don't overlap and are in input order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lSize        - Size of the input
+**    dwWindowSize - Window size in bytes (1 .. MD5_FPRINT_MAX_WINDOW_SIZE)
+**    dwNumWindows - Windows between head and tail (0 ..
+**                   MD5_FPRINT_MAX_WINDOWS)
+**    asRegions    - Receives the regions, room for dwNumWindows + 2
+**
+** Returns:
+**    UINT32 - Number of regions (0 for an empty input)
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_FPRINT_GetRegions( UINT64 lSize, UINT32 dwWindowSize, UINT32 dwNumWindows,
+                              MD5_FPRINT_RegionType asRegions[] );
+
+/*------------------------------------------------------------------------------
+** Starts a fingerprint: initializes the instance and hashes the header. The
+** caller continues with the regions and finalizes the instance.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst       - MD5 instance to start
+**    lSize        - Size of the input
+**    dwWindowSize - Window size in bytes
+**    dwNumWindows - Windows between head and tail
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_FPRINT_Begin( MD5_InstType* psInst, UINT64 lSize, UINT32 dwWindowSize,
+                       UINT32 dwNumWindows );
+
+#endif /* HMS_SC_MD5_FPRINT_H_ */
@@ -0,0 +1,779 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_index.c
+**    Summary: Known-digest index. The set probes linearly from the slot the
+**             first digest bytes select; the database is searched by
+**             interpolation on the first eight digest bytes, falling back to
+**             bisection if the guesses don't converge.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_index.h"
+#include "MD5_io.h"
+#include "MD5_manifest.h"
+#include "MD5_port.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_INDEX_MIN_SLOTS            ( 1024U )
+#define MD5_INDEX_BATCH_SIZE           ( 16U )   /* Lookups prefetched together */
+#define MD5_INDEX_MAX_GUESSES          ( 8U )    /* Interpolation steps before bisecting */
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static BOOL MD5_INDEX_IsZero( const UINT8* pbDigest );
+static UINT64 MD5_INDEX_GetHash( const UINT8* pbDigest );
+static UINT64 MD5_INDEX_GetKey( const UINT8* pbDigest );
+static void MD5_INDEX_StoreLittleEndian( UINT8* pbDest, UINT64 lValue, UINT16 iNumBytes );
+static UINT64 MD5_INDEX_LoadLittleEndian( const UINT8* pbSrc, UINT16 iNumBytes );
+static BOOL MD5_INDEX_Grow( MD5_INDEX_SetType* psSet );
+static int MD5_INDEX_CompareDigests( const void* pxDigest1, const void* pxDigest2 );
+static UINT64 MD5_INDEX_Guess( const MD5_INDEX_Type* psIndex, UINT64 lKey, UINT64 lLow,
+                               UINT64 lHigh );
+static BOOL MD5_INDEX_SearchDb( const MD5_INDEX_Type* psIndex, const UINT8* pbDigest );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Checks for the all-zero digest, which marks the free slots of a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest to check
+**
+** Returns:
+**    BOOL - TRUE if every byte is zero
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_INDEX_IsZero( const UINT8* pbDigest )
+{
+   UINT64 alHalves[ 2 ];
+
+   memcpy( alHalves, pbDigest, MD5_DIGEST_SIZE );
+
+   return ( alHalves[ 0 ] | alHalves[ 1 ] ) == 0;
+}
+
+/*------------------------------------------------------------------------------
+** Returns the set hash of a digest: its first eight bytes, in host order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest
+**
+** Returns:
+**    UINT64 - Hash
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_INDEX_GetHash( const UINT8* pbDigest )
+{
+   UINT64 lHash;
+
+   memcpy( &lHash, pbDigest, sizeof( lHash ) );
+
+   return lHash;
+}
+
+/*------------------------------------------------------------------------------
+** Returns the search key of a digest: its first eight bytes big endian, so
+** keys are ordered like the digests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDigest - Digest
+**
+** Returns:
+**    UINT64 - Key
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_INDEX_GetKey( const UINT8* pbDigest )
+{
+   UINT64 lKey = 0;
+   UINT16 iByte;
+
+   for( iByte = 0; iByte < 8; iByte++ )
+   {
+      lKey = ( lKey << 8 ) | pbDigest[ iByte ];
+   }
+
+   return lKey;
+}
+
+/*------------------------------------------------------------------------------
+** Stores a value little endian.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbDest    - Destination
+**    lValue    - Value to store
+**    iNumBytes - Number of bytes to store
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_INDEX_StoreLittleEndian( UINT8* pbDest, UINT64 lValue, UINT16 iNumBytes )
+{
+   UINT16 iByte;
+
+   for( iByte = 0; iByte < iNumBytes; iByte++ )
+   {
+      pbDest[ iByte ] = (UINT8)( lValue >> ( 8 * iByte ) );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Loads a little endian value.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbSrc     - Source
+**    iNumBytes - Number of bytes to load
+**
+** Returns:
+**    UINT64 - Value
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_INDEX_LoadLittleEndian( const UINT8* pbSrc, UINT16 iNumBytes )
+{
+   UINT64 lValue = 0;
+
+   while( iNumBytes-- > 0 )
+   {
+      lValue = ( lValue << 8 ) | pbSrc[ iNumBytes ];
+   }
+
+   return lValue;
+}
+
+/*------------------------------------------------------------------------------
+** Doubles the number of slots of a set and rehashes its entries.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet - Set to grow
+**
+** Returns:
+**    BOOL - FALSE if memory ran out (the set is unchanged)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_INDEX_Grow( MD5_INDEX_SetType* psSet )
+{
+   UINT64 lMask = psSet->lMask * 2 + 1;
+   UINT8( *aabSlots )[ MD5_DIGEST_SIZE ] = calloc( (size_t)( lMask + 1 ), MD5_DIGEST_SIZE );
+   UINT64 lSlot;
+
+   if( aabSlots == NULL )
+   {
+      return FALSE;
+   }
+
+   for( lSlot = 0; lSlot <= psSet->lMask; lSlot++ )
+   {
+      UINT64 lNewSlot;
+
+      if( MD5_INDEX_IsZero( psSet->aabSlots[ lSlot ] ) )
+      {
+         continue;
+      }
+
+      lNewSlot = MD5_INDEX_GetHash( psSet->aabSlots[ lSlot ] ) & lMask;
+
+      while( !MD5_INDEX_IsZero( aabSlots[ lNewSlot ] ) )
+      {
+         lNewSlot = ( lNewSlot + 1 ) & lMask;
+      }
+
+      memcpy( aabSlots[ lNewSlot ], psSet->aabSlots[ lSlot ], MD5_DIGEST_SIZE );
+   }
+
+   free( psSet->aabSlots );
+   psSet->aabSlots = aabSlots;
+   psSet->lMask    = lMask;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** qsort() routine ordering digests like memcmp().
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxDigest1 - First digest
+**    pxDigest2 - Second digest
+**
+** Returns:
+**    int - <0, 0 or >0 like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_INDEX_CompareDigests( const void* pxDigest1, const void* pxDigest2 )
+{
+   return memcmp( pxDigest1, pxDigest2, MD5_DIGEST_SIZE );
+}
+
+/*------------------------------------------------------------------------------
+** Guesses the position of a key within a range of database entries from the
+** keys at both ends of the range.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex - Database
+**    lKey    - Key to find
+**    lLow    - First entry of the range
+**    lHigh   - End of the range (exclusive, > lLow)
+**
+** Returns:
+**    UINT64 - Entry to compare with, in lLow .. lHigh - 1
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_INDEX_Guess( const MD5_INDEX_Type* psIndex, UINT64 lKey, UINT64 lLow,
+                               UINT64 lHigh )
+{
+   UINT64 lLowKey  = MD5_INDEX_GetKey( psIndex->aabEntries[ lLow ] );
+   UINT64 lHighKey = MD5_INDEX_GetKey( psIndex->aabEntries[ lHigh - 1 ] );
+
+   if( lKey <= lLowKey )
+   {
+      return lLow;
+   }
+
+   if( lKey >= lHighKey )
+   {
+      return lHigh - 1;
+   }
+
+   return lLow + (UINT64)( (double)( lKey - lLowKey ) / (double)( lHighKey - lLowKey ) *
+                           (double)( lHigh - 1 - lLow ) );
+}
+
+/*------------------------------------------------------------------------------
+** Searches the database for a digest. Digests are uniformly distributed, so
+** interpolation finds them in a few steps; bisection bounds the worst case.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex  - Database
+**    pbDigest - Digest to find
+**
+** Returns:
+**    BOOL - TRUE if the digest is in the database
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_INDEX_SearchDb( const MD5_INDEX_Type* psIndex, const UINT8* pbDigest )
+{
+   UINT64 lKey   = MD5_INDEX_GetKey( pbDigest );
+   UINT64 lLow   = 0;
+   UINT64 lHigh  = psIndex->lNumEntries;
+   UINT16 iGuess = 0;
+
+   while( lLow < lHigh )
+   {
+      UINT64 lMid;
+      int iOrder;
+
+      if( iGuess++ < MD5_INDEX_MAX_GUESSES )
+      {
+         lMid = MD5_INDEX_Guess( psIndex, lKey, lLow, lHigh );
+      }
+      else
+      {
+         lMid = lLow + ( lHigh - lLow ) / 2;
+      }
+
+      iOrder = memcmp( psIndex->aabEntries[ lMid ], pbDigest, MD5_DIGEST_SIZE );
+
+      if( iOrder == 0 )
+      {
+         return TRUE;
+      }
+
+      if( iOrder < 0 )
+      {
+         lLow = lMid + 1;
+      }
+      else
+      {
+         lHigh = lMid;
+      }
+   }
+
+   return FALSE;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Creates an empty set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet     - Set to create
+**    lExpected - Expected number of entries (the set grows beyond it)
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetCreate( MD5_INDEX_SetType* psSet, UINT64 lExpected )
+{
+   UINT64 lNumSlots = MD5_INDEX_MIN_SLOTS;
+
+   /* At most half of the slots are used, which keeps the probe runs short */
+   while( lNumSlots < 2 * lExpected )
+   {
+      lNumSlots *= 2;
+   }
+
+   memset( psSet, 0, sizeof( MD5_INDEX_SetType ) );
+   psSet->aabSlots = calloc( (size_t)lNumSlots, MD5_DIGEST_SIZE );
+   psSet->lMask    = lNumSlots - 1;
+
+   return psSet->aabSlots != NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Releases a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet - Set to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_SetDestroy( MD5_INDEX_SetType* psSet )
+{
+   free( psSet->aabSlots );
+   memset( psSet, 0, sizeof( MD5_INDEX_SetType ) );
+}
+
+/*------------------------------------------------------------------------------
+** Adds a digest to a set. Adding a member again has no effect.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet    - Set to update
+**    pbDigest - Digest to add (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetInsert( MD5_INDEX_SetType* psSet, const UINT8* pbDigest )
+{
+   UINT64 lSlot;
+
+   if( MD5_INDEX_IsZero( pbDigest ) )
+   {
+      if( !psSet->fHasZero )
+      {
+         psSet->fHasZero = TRUE;
+         psSet->lNumEntries++;
+      }
+
+      return TRUE;
+   }
+
+   if( ( ( psSet->lNumEntries + 1 ) * 2 > psSet->lMask + 1 ) && !MD5_INDEX_Grow( psSet ) )
+   {
+      return FALSE;
+   }
+
+   lSlot = MD5_INDEX_GetHash( pbDigest ) & psSet->lMask;
+
+   while( !MD5_INDEX_IsZero( psSet->aabSlots[ lSlot ] ) )
+   {
+      if( memcmp( psSet->aabSlots[ lSlot ], pbDigest, MD5_DIGEST_SIZE ) == 0 )
+      {
+         return TRUE;
+      }
+
+      lSlot = ( lSlot + 1 ) & psSet->lMask;
+   }
+
+   memcpy( psSet->aabSlots[ lSlot ], pbDigest, MD5_DIGEST_SIZE );
+   psSet->lNumEntries++;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Checks whether a digest is a member of a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet    - Set to search
+**    pbDigest - Digest to look up (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - TRUE if the digest is a member
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetContains( const MD5_INDEX_SetType* psSet, const UINT8* pbDigest )
+{
+   UINT64 lSlot;
+
+   if( MD5_INDEX_IsZero( pbDigest ) )
+   {
+      return psSet->fHasZero;
+   }
+
+   lSlot = MD5_INDEX_GetHash( pbDigest ) & psSet->lMask;
+
+   while( !MD5_INDEX_IsZero( psSet->aabSlots[ lSlot ] ) )
+   {
+      if( memcmp( psSet->aabSlots[ lSlot ], pbDigest, MD5_DIGEST_SIZE ) == 0 )
+      {
+         return TRUE;
+      }
+
+      lSlot = ( lSlot + 1 ) & psSet->lMask;
+   }
+
+   return FALSE;
+}
+
+/*------------------------------------------------------------------------------
+** Reads a text list into a set: one digest per line, either bare or as an
+** md5sum line. Empty lines and lines starting with '#' are skipped.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet       - Set to add the digests to
+**    pacFilename - Text list ("-" for stdin)
+**    plBadLine   - Receives the number of the first invalid line
+**
+** Returns:
+**    BOOL - FALSE if the list could not be read or memory ran out (errno is
+**           set), or a line is invalid (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_LoadList( MD5_INDEX_SetType* psSet, const char* pacFilename, UINT64* plBadLine )
+{
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   char* pacLine    = NULL;
+   size_t iAlloc    = 0;
+   UINT64 lLine     = 0;
+   BOOL fSuccess    = TRUE;
+   BOOL fStdin      = ( strcmp( pacFilename, "-" ) == 0 );
+   FILE* psFile     = fStdin ? stdin : fopen( pacFilename, "r" );
+   ssize_t iLen;
+   int iError       = 0;
+
+   if( psFile == NULL )
+   {
+      return FALSE;
+   }
+
+   while( fSuccess && ( ( iLen = getline( &pacLine, &iAlloc, psFile ) ) >= 0 ) )
+   {
+      char* pacName;
+
+      lLine++;
+
+      while( ( iLen > 0 ) &&
+             ( ( pacLine[ iLen - 1 ] == '\n' ) || ( pacLine[ iLen - 1 ] == '\r' ) ) )
+      {
+         pacLine[ --iLen ] = '\0';
+      }
+
+      if( ( iLen == 0 ) || ( pacLine[ 0 ] == '#' ) )
+      {
+         continue;
+      }
+
+      if( !MD5_MANIFEST_ParseLine( pacLine, abDigest, &pacName ) )
+      {
+         *plBadLine = lLine;
+         iError     = EINVAL;
+         fSuccess   = FALSE;
+      }
+      else if( !MD5_INDEX_SetInsert( psSet, abDigest ) )
+      {
+         iError   = ENOMEM;
+         fSuccess = FALSE;
+      }
+   }
+
+   if( fSuccess && ferror( psFile ) )
+   {
+      iError   = errno;
+      fSuccess = FALSE;
+   }
+
+   free( pacLine );
+
+   if( !fStdin )
+   {
+      fclose( psFile );
+   }
+
+   errno = iError;
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Writes the members of a set as a database. The database is written to a
+** temporary file that is synced and renamed over pacFilename.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet       - Set to write
+**    pacFilename - Database file
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written or memory ran out (errno
+**           is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_WriteDb( const MD5_INDEX_SetType* psSet, const char* pacFilename )
+{
+   MD5_INDEX_HeaderType sHeader;
+   MD5_IO_ReplaceType sReplace;
+   UINT8( *aabEntries )[ MD5_DIGEST_SIZE ] =
+      malloc( (size_t)( psSet->lNumEntries + 1 ) * MD5_DIGEST_SIZE );
+   UINT64 lNum = 0;
+   UINT64 lSlot;
+   BOOL fSuccess;
+
+   if( aabEntries == NULL )
+   {
+      errno = ENOMEM;
+      return FALSE;
+   }
+
+   if( psSet->fHasZero )
+   {
+      memset( aabEntries[ lNum++ ], 0, MD5_DIGEST_SIZE );
+   }
+
+   for( lSlot = 0; lSlot <= psSet->lMask; lSlot++ )
+   {
+      if( !MD5_INDEX_IsZero( psSet->aabSlots[ lSlot ] ) )
+      {
+         memcpy( aabEntries[ lNum++ ], psSet->aabSlots[ lSlot ], MD5_DIGEST_SIZE );
+      }
+   }
+
+   qsort( aabEntries, (size_t)lNum, MD5_DIGEST_SIZE, MD5_INDEX_CompareDigests );
+
+   memset( &sHeader, 0, sizeof( sHeader ) );
+   memcpy( sHeader.acMagic, MD5_INDEX_MAGIC, sizeof( sHeader.acMagic ) );
+   MD5_INDEX_StoreLittleEndian( sHeader.abVersion, MD5_INDEX_VERSION, sizeof( sHeader.abVersion ) );
+   MD5_INDEX_StoreLittleEndian( sHeader.abNumEntries, lNum, sizeof( sHeader.abNumEntries ) );
+
+   fSuccess = MD5_IO_BeginReplace( &sReplace, pacFilename );
+
+   if( fSuccess )
+   {
+      fSuccess = ( fwrite( &sHeader, sizeof( sHeader ), 1, sReplace.psFile ) == 1 ) &&
+                 ( fwrite( aabEntries, MD5_DIGEST_SIZE, (size_t)lNum, sReplace.psFile ) ==
+                   (size_t)lNum );
+      fSuccess = MD5_IO_CommitReplace( &sReplace, fSuccess );
+   }
+
+   free( aabEntries );
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Opens an index: a database is mapped, anything else is read as a text
+** list into a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex     - Index to open
+**    pacFilename - Database or text list
+**    plBadLine   - Receives the number of the first invalid line of a list
+**
+** Returns:
+**    BOOL - FALSE if the file could not be read (errno is set), is a damaged
+**           database or a list with an invalid line (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_Open( MD5_INDEX_Type* psIndex, const char* pacFilename, UINT64* plBadLine )
+{
+   const MD5_INDEX_HeaderType* psHeader;
+   char acMagic[ sizeof( psHeader->acMagic ) ];
+   struct stat sStat;
+   int iFd = -1;
+
+   memset( psIndex, 0, sizeof( MD5_INDEX_Type ) );
+
+   if( strcmp( pacFilename, "-" ) != 0 )
+   {
+      iFd = open( pacFilename, O_RDONLY | O_CLOEXEC );
+
+      if( ( iFd < 0 ) || ( fstat( iFd, &sStat ) != 0 ) )
+      {
+         if( iFd >= 0 )
+         {
+            close( iFd );
+         }
+
+         return FALSE;
+      }
+   }
+
+   if( ( iFd >= 0 ) && ( (UINT64)sStat.st_size >= MD5_INDEX_HEADER_SIZE ) &&
+       ( pread( iFd, acMagic, sizeof( acMagic ), 0 ) == (ssize_t)sizeof( acMagic ) ) &&
+       ( memcmp( acMagic, MD5_INDEX_MAGIC, sizeof( acMagic ) ) == 0 ) )
+   {
+      psIndex->pxMap = mmap( NULL, (size_t)sStat.st_size, PROT_READ, MAP_SHARED, iFd, 0 );
+      close( iFd );
+
+      if( psIndex->pxMap == MAP_FAILED )
+      {
+         psIndex->pxMap = NULL;
+         return FALSE;
+      }
+
+      psIndex->iMapSize    = (size_t)sStat.st_size;
+      psHeader             = (const MD5_INDEX_HeaderType*)psIndex->pxMap;
+      psIndex->aabEntries  = (const UINT8( * )[ MD5_DIGEST_SIZE ])( (const UINT8*)psIndex->pxMap +
+                                                                    MD5_INDEX_HEADER_SIZE );
+      psIndex->lNumEntries =
+         MD5_INDEX_LoadLittleEndian( psHeader->abNumEntries, sizeof( psHeader->abNumEntries ) );
+
+      if( ( MD5_INDEX_LoadLittleEndian( psHeader->abVersion, sizeof( psHeader->abVersion ) ) !=
+            MD5_INDEX_VERSION ) ||
+          ( psIndex->lNumEntries !=
+            ( psIndex->iMapSize - MD5_INDEX_HEADER_SIZE ) / MD5_DIGEST_SIZE ) )
+      {
+         MD5_INDEX_Close( psIndex );
+         errno = EINVAL;
+         return FALSE;
+      }
+
+      /* Lookups touch a few scattered pages, read-ahead would be wasted */
+      madvise( psIndex->pxMap, psIndex->iMapSize, MADV_RANDOM );
+
+      return TRUE;
+   }
+
+   if( iFd >= 0 )
+   {
+      close( iFd );
+   }
+
+   if( !MD5_INDEX_SetCreate( &psIndex->sSet, 0 ) )
+   {
+      errno = ENOMEM;
+      return FALSE;
+   }
+
+   if( !MD5_INDEX_LoadList( &psIndex->sSet, pacFilename, plBadLine ) )
+   {
+      int iError = errno;
+
+      MD5_INDEX_Close( psIndex );
+      errno = iError;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Releases an index.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex - Index to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_Close( MD5_INDEX_Type* psIndex )
+{
+   if( psIndex->pxMap != NULL )
+   {
+      munmap( psIndex->pxMap, psIndex->iMapSize );
+   }
+
+   MD5_INDEX_SetDestroy( &psIndex->sSet );
+   memset( psIndex, 0, sizeof( MD5_INDEX_Type ) );
+}
+
+/*------------------------------------------------------------------------------
+** Returns the number of digests in an index.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex - Index
+**
+** Returns:
+**    UINT64 - Number of members
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_INDEX_GetNumEntries( const MD5_INDEX_Type* psIndex )
+{
+   return ( psIndex->pxMap != NULL ) ? psIndex->lNumEntries : psIndex->sSet.lNumEntries;
+}
+
+/*------------------------------------------------------------------------------
+** Checks whether digests are members of an index. The slots (or database
+** pages) of a batch are prefetched before they are probed, so the cache
+** misses of the lookups overlap. May be called from several threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex    - Index to search
+**    aabDigests - Digests to look up
+**    dwNum      - Number of digests
+**    afFound    - Receives TRUE for every digest that is a member
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_Lookup( const MD5_INDEX_Type* psIndex, const UINT8 aabDigests[][ MD5_DIGEST_SIZE ],
+                       UINT32 dwNum, BOOL afFound[] )
+{
+   UINT32 dwFirst;
+   UINT32 dwIndex;
+
+   for( dwFirst = 0; dwFirst < dwNum; dwFirst += MD5_INDEX_BATCH_SIZE )
+   {
+      UINT32 dwEnd =
+         ( dwNum - dwFirst < MD5_INDEX_BATCH_SIZE ) ? dwNum : dwFirst + MD5_INDEX_BATCH_SIZE;
+
+      /* The first probe of each lookup: the home slot, or the first interpolation guess */
+      for( dwIndex = dwFirst; dwIndex < dwEnd; dwIndex++ )
+      {
+         if( psIndex->pxMap == NULL )
+         {
+            MD5_PORT_Prefetch( psIndex->sSet.aabSlots[ MD5_INDEX_GetHash( aabDigests[ dwIndex ] ) &
+                                                       psIndex->sSet.lMask ] );
+         }
+         else if( psIndex->lNumEntries > 0 )
+         {
+            UINT64 lGuess = MD5_INDEX_Guess( psIndex, MD5_INDEX_GetKey( aabDigests[ dwIndex ] ), 0,
+                                             psIndex->lNumEntries );
+
+            MD5_PORT_Prefetch( psIndex->aabEntries[ lGuess ] );
+         }
+      }
+
+      for( dwIndex = dwFirst; dwIndex < dwEnd; dwIndex++ )
+      {
+         afFound[ dwIndex ] = ( psIndex->pxMap == NULL ) ?
+                              MD5_INDEX_SetContains( &psIndex->sSet, aabDigests[ dwIndex ] ) :
+                              MD5_INDEX_SearchDb( psIndex, aabDigests[ dwIndex ] );
+      }
+   }
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
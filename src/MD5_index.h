@@ -0,0 +1,223 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_index.h
+**    Summary: Known-digest index, answers whether a digest is a member of a
+**             reference set (allowlist, known-bad list). Two forms:
+**
+**             - Set: open-addressed hash table in memory, built from a text
+**               list (md5sum lines or bare digests). Digests are uniformly
+**               distributed, so their first bytes are the hash directly.
+**
+**             - Database: header followed by the sorted digests, used in
+**               place through mmap() and searched by interpolation, so it
+**               needs no load phase however large it is. Digests are stored
+**               as bytes and the header numbers little endian, so database
+**               files are portable between hosts.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_INDEX_H_
+#define HMS_SC_MD5_INDEX_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <stddef.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_INDEX_MAGIC                "MD5INDEX"
+#define MD5_INDEX_VERSION              ( 1U )
+#define MD5_INDEX_HEADER_SIZE          ( 32U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Database header (MD5_INDEX_HEADER_SIZE bytes), followed by lNumEntries
+** digests in ascending memcmp() order without duplicates
+*/
+typedef struct MD5_INDEX_Header
+{
+   char acMagic[ 8 ];
+   UINT8 abVersion[ 4 ];    /* Little endian */
+   UINT8 abReserved[ 4 ];
+   UINT8 abNumEntries[ 8 ]; /* Little endian */
+   UINT8 abReserved2[ 8 ];
+} MD5_INDEX_HeaderType;
+
+typedef struct MD5_INDEX_Set
+{
+   UINT8 ( *aabSlots )[ MD5_DIGEST_SIZE ]; /* The all-zero digest marks a free slot */
+   UINT64 lMask;                           /* Number of slots - 1 */
+   UINT64 lNumEntries;
+   BOOL fHasZero;                          /* The all-zero digest is a member */
+} MD5_INDEX_SetType;
+
+typedef struct MD5_INDEX
+{
+   MD5_INDEX_SetType sSet;                 /* Text list, loaded into a set */
+   void* pxMap;                            /* Mapping of a database, or NULL */
+   size_t iMapSize;
+   const UINT8 ( *aabEntries )[ MD5_DIGEST_SIZE ];
+   UINT64 lNumEntries;
+} MD5_INDEX_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Creates an empty set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet     - Set to create
+**    lExpected - Expected number of entries (the set grows beyond it)
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetCreate( MD5_INDEX_SetType* psSet, UINT64 lExpected );
+
+/*------------------------------------------------------------------------------
+** Releases a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet - Set to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_SetDestroy( MD5_INDEX_SetType* psSet );
+
+/*------------------------------------------------------------------------------
+** Adds a digest to a set. Adding a member again has no effect.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet    - Set to update
+**    pbDigest - Digest to add (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetInsert( MD5_INDEX_SetType* psSet, const UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Checks whether a digest is a member of a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet    - Set to search
+**    pbDigest - Digest to look up (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - TRUE if the digest is a member
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_SetContains( const MD5_INDEX_SetType* psSet, const UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Reads a text list into a set: one digest per line, either bare or as an
+** md5sum line. Empty lines and lines starting with '#' are skipped.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet       - Set to add the digests to
+**    pacFilename - Text list ("-" for stdin)
+**    plBadLine   - Receives the number of the first invalid line
+**
+** Returns:
+**    BOOL - FALSE if the list could not be read or memory ran out (errno is
+**           set), or a line is invalid (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_LoadList( MD5_INDEX_SetType* psSet, const char* pacFilename, UINT64* plBadLine );
+
+/*------------------------------------------------------------------------------
+** Writes the members of a set as a database. The database is written to a
+** temporary file that is synced and renamed over pacFilename.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSet       - Set to write
+**    pacFilename - Database file
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written or memory ran out (errno
+**           is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_WriteDb( const MD5_INDEX_SetType* psSet, const char* pacFilename );
+
+/*------------------------------------------------------------------------------
+** Opens an index: a database is mapped, anything else is read as a text
+** list into a set.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex     - Index to open
+**    pacFilename - Database or text list
+**    plBadLine   - Receives the number of the first invalid line of a list
+**
+** Returns:
+**    BOOL - FALSE if the file could not be read (errno is set), is a damaged
+**           database or a list with an invalid line (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_INDEX_Open( MD5_INDEX_Type* psIndex, const char* pacFilename, UINT64* plBadLine );
+
+/*------------------------------------------------------------------------------
+** Releases an index.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex - Index to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_Close( MD5_INDEX_Type* psIndex );
+
+/*------------------------------------------------------------------------------
+** Returns the number of digests in an index.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex - Index
+**
+** Returns:
+**    UINT64 - Number of members
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_INDEX_GetNumEntries( const MD5_INDEX_Type* psIndex );
+
+/*------------------------------------------------------------------------------
+** Checks whether digests are members of an index. The slots (or database
+** pages) of a batch are prefetched before they are probed, so the cache
+** misses of the lookups overlap. May be called from several threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psIndex    - Index to search
+**    aabDigests - Digests to look up
+**    dwNum      - Number of digests
+**    afFound    - Receives TRUE for every digest that is a member
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_INDEX_Lookup( const MD5_INDEX_Type* psIndex, const UINT8 aabDigests[][ MD5_DIGEST_SIZE ],
+                       UINT32 dwNum, BOOL afFound[] );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_INDEX_H_ */
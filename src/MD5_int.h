@@ -35,8 +35,13 @@
 #endif
 
 #ifndef UINT32
+#if defined( __LP64__ ) || defined( _LP64 )
+/* 'long' is 64-bit on LP64 hosts (e.g. 64-bit Linux), 'int' is 32-bit */
+#define UINT32 unsigned int
+#else
 #define UINT32 unsigned long
 #endif
+#endif
 
 #ifndef UINT64
 #define UINT64 unsigned long long
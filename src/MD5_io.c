@@ -0,0 +1,1041 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_io.c
+**    Summary: POSIX file hashing helpers shared by the host applications.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* SEEK_DATA, SEEK_HOLE, O_DIRECT */
+#endif
+
+#include "MD5_io.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#if !defined( O_DIRECT )
+#define O_DIRECT                       ( 0 ) /* The direct backend reads like the plain one */
+#endif
+
+/* Small files sorted by size at a time by MD5_IO_HashFiles() */
+#define MD5_IO_MAX_SORTED_FILES        ( 64U )
+
+/* Pages whose residency MD5_IO_ReadDropping() checks per read */
+#define MD5_IO_RESIDENCY_PAGES         ( 256U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Small files read into the lanes of a worker's buffer, waiting to be hashed
+*/
+typedef struct MD5_IO_Lanes
+{
+   const UINT8* apbData[ MD5_MULTI_LANES ];
+   UINT32 adwLength[ MD5_MULTI_LANES ];
+   MD5_IO_FileType* apsFiles[ MD5_MULTI_LANES ];
+   UINT8 bNumLanes;
+} MD5_IO_LanesType;
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static ssize_t MD5_IO_ReadDropping( int iFd, UINT8* pbBuffer, size_t iSize, off_t lOffset );
+static ssize_t MD5_IO_Read( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer, size_t iSize );
+static ssize_t MD5_IO_ReadKnownSize( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer,
+                                     UINT32 dwSizeHint );
+static BOOL MD5_IO_DropDirect( const MD5_IO_WorkerType* psWorker, int iFd );
+static BOOL MD5_IO_UpdateFromFd( MD5_IO_WorkerType* psWorker, int iFd );
+static BOOL MD5_IO_UpdateFromSparseFd( MD5_IO_WorkerType* psWorker, int iFd );
+static void MD5_IO_FinalDigest( MD5_IO_WorkerType* psWorker, UINT8* pbDigest, UINT64* plSize );
+static void MD5_IO_FlushLanes( MD5_IO_WorkerType* psWorker, MD5_IO_LanesType* psLanes );
+static void MD5_IO_HashSmallFile( MD5_IO_WorkerType* psWorker, MD5_IO_LanesType* psLanes,
+                                  MD5_IO_FileType* psFile );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Reads a range like pread() and drops the pages it brought into the page
+** cache. Residency is taken from mincore() on a mapping of the range before
+** the read: it starts no I/O of its own (unlike a preadv2() RWF_NOWAIT probe,
+** which may trigger the readahead it is meant to detect). At most
+** MD5_IO_RESIDENCY_PAGES pages are read per call. Files that can't be mapped
+** are read without dropping anything.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iFd      - File descriptor to read
+**    pbBuffer - Receives the data
+**    iSize    - Bytes to read
+**    lOffset  - File offset to read from
+**
+** Returns:
+**    ssize_t - Bytes read, 0 at the end of the file, -1 on a read error
+**              (errno is set)
+**------------------------------------------------------------------------------
+*/
+static ssize_t MD5_IO_ReadDropping( int iFd, UINT8* pbBuffer, size_t iSize, off_t lOffset )
+{
+   unsigned char abResident[ MD5_IO_RESIDENCY_PAGES ];
+   off_t lPageSize = (off_t)sysconf( _SC_PAGESIZE );
+   off_t lMapStart = lOffset - lOffset % lPageSize;
+   size_t iMapSize;
+   size_t iPage;
+   size_t iNumPages;
+   ssize_t iBytesRead;
+   void* pxMap;
+
+   if( (size_t)( lOffset - lMapStart ) + iSize > MD5_IO_RESIDENCY_PAGES * (size_t)lPageSize )
+   {
+      iSize = MD5_IO_RESIDENCY_PAGES * (size_t)lPageSize - (size_t)( lOffset - lMapStart );
+   }
+
+   iMapSize = (size_t)( lOffset - lMapStart ) + iSize;
+   pxMap    = mmap( NULL, iMapSize, PROT_READ, MAP_SHARED, iFd, lMapStart );
+
+   if( pxMap == MAP_FAILED )
+   {
+      return pread( iFd, pbBuffer, iSize, lOffset );
+   }
+
+   /* Mapping the range faults nothing in; pages past the end read as absent */
+   iNumPages = ( iMapSize + (size_t)lPageSize - 1 ) / (size_t)lPageSize;
+
+   if( mincore( pxMap, iMapSize, abResident ) != 0 )
+   {
+      /* Unknown residency: treat everything as someone else's */
+      memset( abResident, 1, iNumPages );
+   }
+
+   munmap( pxMap, iMapSize );
+
+#if defined( POSIX_FADV_RANDOM )
+   /* Readahead would cache pages past the read that look like someone else's */
+   posix_fadvise( iFd, 0, 0, POSIX_FADV_RANDOM );
+#endif
+
+   iBytesRead = pread( iFd, pbBuffer, iSize, lOffset );
+
+#if defined( POSIX_FADV_DONTNEED )
+   if( iBytesRead > 0 )
+   {
+      size_t iRunStart = 0;
+
+      iNumPages = ( (size_t)( lOffset - lMapStart ) + (size_t)iBytesRead + (size_t)lPageSize - 1 ) /
+                  (size_t)lPageSize;
+
+      /* Drop every run of pages that were absent before the read */
+      for( iPage = 0; iPage <= iNumPages; iPage++ )
+      {
+         if( ( iPage < iNumPages ) && !( abResident[ iPage ] & 1 ) )
+         {
+            continue;
+         }
+
+         if( iPage > iRunStart )
+         {
+            posix_fadvise( iFd, lMapStart + (off_t)iRunStart * lPageSize,
+                           (off_t)( iPage - iRunStart ) * lPageSize, POSIX_FADV_DONTNEED );
+         }
+
+         iRunStart = iPage + 1;
+      }
+   }
+#endif
+
+   return iBytesRead;
+}
+
+/*------------------------------------------------------------------------------
+** Reads from the current position of a file descriptor, applying the
+** worker's I/O policy. Descriptors that can't seek (pipes) have no pages to
+** drop and are only throttled.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose I/O policy applies
+**    iFd      - File descriptor to read
+**    pbBuffer - Receives the data
+**    iSize    - Bytes to read
+**
+** Returns:
+**    ssize_t - Bytes read, 0 at the end of the file, -1 on a read error
+**              (errno is set)
+**------------------------------------------------------------------------------
+*/
+static ssize_t MD5_IO_Read( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer, size_t iSize )
+{
+   off_t lOffset = psWorker->fDropCache ? lseek( iFd, 0, SEEK_CUR ) : -1;
+   ssize_t iBytesRead;
+
+   if( lOffset < 0 )
+   {
+      iBytesRead = read( iFd, pbBuffer, iSize );
+
+      if( psWorker->psThrottle != NULL )
+      {
+         MD5_THROTTLE_Acquire( psWorker->psThrottle, ( iBytesRead > 0 ) ? (UINT64)iBytesRead : 0 );
+      }
+
+      return iBytesRead;
+   }
+
+   iBytesRead = MD5_IO_ReadAt( psWorker, iFd, pbBuffer, iSize, lOffset );
+
+   if( ( iBytesRead > 0 ) && ( lseek( iFd, lOffset + iBytesRead, SEEK_SET ) < 0 ) )
+   {
+      return -1;
+   }
+
+   return iBytesRead;
+}
+
+/*------------------------------------------------------------------------------
+** Reads a file of known size. One byte more than expected is requested, so a
+** file of the expected size takes a single read() call and a file that grew
+** is noticed without another one.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker   - Worker whose I/O policy applies
+**    iFd        - File descriptor to read
+**    pbBuffer   - Receives the data, room for dwSizeHint + 1 bytes
+**    dwSizeHint - Expected size
+**
+** Returns:
+**    ssize_t - Bytes read (dwSizeHint + 1 if the file is larger than
+**              expected), -1 on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+static ssize_t MD5_IO_ReadKnownSize( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer,
+                                     UINT32 dwSizeHint )
+{
+   size_t iTotal = 0;
+   ssize_t iBytesRead;
+
+   do
+   {
+      iBytesRead =
+         MD5_IO_Read( psWorker, iFd, &pbBuffer[ iTotal ], (size_t)dwSizeHint + 1 - iTotal );
+
+      if( iBytesRead > 0 )
+      {
+         iTotal += (size_t)iBytesRead;
+      }
+      else if( ( iBytesRead < 0 ) && ( errno != EINTR ) )
+      {
+         return -1;
+      }
+   } while( ( iBytesRead < 0 ) || ( ( iBytesRead != 0 ) && ( iTotal < dwSizeHint ) ) );
+
+   return (ssize_t)iTotal;
+}
+
+/*------------------------------------------------------------------------------
+** Falls back to plain reads after a direct read failed with EINVAL: some
+** file systems accept O_DIRECT on open but refuse the reads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose read failed
+**    iFd      - File descriptor of the failed read
+**
+** Returns:
+**    BOOL - TRUE if O_DIRECT was cleared and the read is worth retrying
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_IO_DropDirect( const MD5_IO_WorkerType* psWorker, int iFd )
+{
+   int iError = errno;
+   int iFlags;
+
+   if( ( psWorker->bBackend != MD5_IO_BACKEND_DIRECT ) || ( iError != EINVAL ) ||
+       ( ( iFlags = fcntl( iFd, F_GETFL ) ) < 0 ) || ( ( iFlags & O_DIRECT ) == 0 ) ||
+       ( fcntl( iFd, F_SETFL, iFlags & ~O_DIRECT ) != 0 ) )
+   {
+      errno = iError;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Feeds everything readable from a file descriptor to the worker's MD5
+** instance.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_IO_UpdateFromFd( MD5_IO_WorkerType* psWorker, int iFd )
+{
+   ssize_t iBytesRead;
+
+   do
+   {
+      iBytesRead = MD5_IO_Read( psWorker, iFd, psWorker->pbBuffer, psWorker->dwBufferSize );
+
+      if( iBytesRead > 0 )
+      {
+         MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+      }
+      else if( ( iBytesRead < 0 ) && ( errno != EINTR ) && !MD5_IO_DropDirect( psWorker, iFd ) )
+      {
+         return FALSE;
+      }
+   } while( iBytesRead != 0 );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Feeds a file to the worker's MD5 instance, reading only its data regions.
+** The holes in between (and a trailing hole) are hashed as zero runs, which
+** gives the same digest as reading them. Files that aren't sparse, and file
+** systems without SEEK_DATA support, are read like any other file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read, from its current position
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_IO_UpdateFromSparseFd( MD5_IO_WorkerType* psWorker, int iFd )
+{
+   off_t lOffset = lseek( iFd, 0, SEEK_CUR );
+   struct stat sStat;
+
+   /* Allocating fewer blocks than the size requires is what makes it sparse */
+   if( ( lOffset < 0 ) || ( fstat( iFd, &sStat ) != 0 ) || !S_ISREG( sStat.st_mode ) ||
+       ( (UINT64)sStat.st_blocks * 512 >= (UINT64)sStat.st_size ) )
+   {
+      return MD5_IO_UpdateFromFd( psWorker, iFd );
+   }
+
+   while( lOffset < sStat.st_size )
+   {
+      off_t lData = lseek( iFd, lOffset, SEEK_DATA );
+      off_t lHole;
+
+      if( lData < 0 )
+      {
+         if( errno != ENXIO )
+         {
+            /* SEEK_DATA isn't supported, read the rest */
+            return ( lseek( iFd, lOffset, SEEK_SET ) == lOffset ) &&
+                   MD5_IO_UpdateFromFd( psWorker, iFd );
+         }
+
+         /* No data beyond lOffset: the file ends with a hole */
+         lData = sStat.st_size;
+      }
+
+      if( lData > sStat.st_size )
+      {
+         lData = sStat.st_size;
+      }
+
+      MD5_UpdateByteRun( &psWorker->sInst, 0, (UINT64)( lData - lOffset ) );
+
+      if( lData == sStat.st_size )
+      {
+         break;
+      }
+
+      lHole = lseek( iFd, lData, SEEK_HOLE );
+
+      if( lHole < 0 )
+      {
+         return FALSE;
+      }
+
+      if( lHole > sStat.st_size )
+      {
+         lHole = sStat.st_size;
+      }
+
+      for( lOffset = lData; lOffset < lHole; )
+      {
+         size_t iChunk      = psWorker->dwBufferSize;
+         ssize_t iBytesRead;
+
+         if( (UINT64)( lHole - lOffset ) < iChunk )
+         {
+            iChunk = (size_t)( lHole - lOffset );
+         }
+
+         iBytesRead = MD5_IO_ReadAt( psWorker, iFd, psWorker->pbBuffer, iChunk, lOffset );
+
+         if( iBytesRead > 0 )
+         {
+            MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+            lOffset += iBytesRead;
+         }
+         else if( iBytesRead == 0 )
+         {
+            /* Truncated while being hashed */
+            return TRUE;
+         }
+         else if( errno != EINTR )
+         {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Finalizes the worker's MD5 instance.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize   - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_IO_FinalDigest( MD5_IO_WorkerType* psWorker, UINT8* pbDigest, UINT64* plSize )
+{
+   if( plSize != NULL )
+   {
+      *plSize = psWorker->sInst.lTotalByteSize;
+   }
+
+   MD5_Final( &psWorker->sInst );
+   memcpy( pbDigest, psWorker->sInst.adwDigest, MD5_DIGEST_SIZE );
+}
+
+/*------------------------------------------------------------------------------
+** Hashes the small files waiting in the lanes and empties the lanes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance
+**    psLanes  - Lanes to hash
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_IO_FlushLanes( MD5_IO_WorkerType* psWorker, MD5_IO_LanesType* psLanes )
+{
+   UINT8 aabDigest[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   UINT8 bLane;
+
+   if( psLanes->bNumLanes == 1 )
+   {
+      /* A single lane costs as much as all of them, the scalar code is cheaper */
+      MD5_Init( &psWorker->sInst );
+      MD5_UpdateLarge( &psWorker->sInst, psLanes->apbData[ 0 ], psLanes->adwLength[ 0 ] );
+      MD5_IO_FinalDigest( psWorker, psLanes->apsFiles[ 0 ]->abDigest, NULL );
+   }
+   else if( psLanes->bNumLanes > 1 )
+   {
+      MD5_MULTI_Compute( psLanes->apbData, psLanes->adwLength, aabDigest, psLanes->bNumLanes );
+
+      for( bLane = 0; bLane < psLanes->bNumLanes; bLane++ )
+      {
+         memcpy( psLanes->apsFiles[ bLane ]->abDigest, aabDigest[ bLane ], MD5_DIGEST_SIZE );
+      }
+   }
+
+   psLanes->bNumLanes = 0;
+}
+
+/*------------------------------------------------------------------------------
+** Reads a small file into the next free lane, hashing the lanes once all are
+** in use.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the read buffer
+**    psLanes  - Lanes of the read buffer
+**    psFile   - Small file to hash
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_IO_HashSmallFile( MD5_IO_WorkerType* psWorker, MD5_IO_LanesType* psLanes,
+                                  MD5_IO_FileType* psFile )
+{
+   UINT8* pbLane =
+      &psWorker->pbBuffer[ psLanes->bNumLanes * ( MD5_IO_GetSmallFileSize( psWorker ) + 1 ) ];
+   int iFd       = openat( psFile->iDirFd, psFile->pacName, O_RDONLY | O_CLOEXEC );
+   ssize_t iBytesRead;
+
+   if( iFd < 0 )
+   {
+      psFile->iError = errno;
+      return;
+   }
+
+   iBytesRead = MD5_IO_ReadKnownSize( psWorker, iFd, pbLane, (UINT32)psFile->lSizeHint );
+
+   if( iBytesRead < 0 )
+   {
+      psFile->iError = errno;
+   }
+   else if( (UINT64)iBytesRead > psFile->lSizeHint )
+   {
+      /* The file grew: hash it on its own, the other lanes go first */
+      MD5_IO_FlushLanes( psWorker, psLanes );
+      MD5_Init( &psWorker->sInst );
+      MD5_UpdateLarge( &psWorker->sInst, pbLane, (UINT32)iBytesRead );
+
+      if( MD5_IO_UpdateFromFd( psWorker, iFd ) )
+      {
+         MD5_IO_FinalDigest( psWorker, psFile->abDigest, NULL );
+      }
+      else
+      {
+         psFile->iError = errno;
+      }
+   }
+   else
+   {
+      psLanes->apbData[ psLanes->bNumLanes ]   = pbLane;
+      psLanes->adwLength[ psLanes->bNumLanes ] = (UINT32)iBytesRead;
+      psLanes->apsFiles[ psLanes->bNumLanes ]  = psFile;
+
+      if( ++psLanes->bNumLanes == MD5_MULTI_LANES )
+      {
+         MD5_IO_FlushLanes( psWorker, psLanes );
+      }
+   }
+
+   close( iFd );
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the per-worker read buffer size that keeps the buffers of all
+** workers within a total memory cap.
+**------------------------------------------------------------------------------
+** Arguments:
+**    dwPreferredSize - Desired buffer size in bytes
+**    iNumWorkers     - Number of workers that each own a buffer
+**    lMemCap         - Cap on the sum of all buffers in bytes (0: no cap)
+**
+** Returns:
+**    UINT32 - Buffer size, at least MD5_IO_MIN_BUFFER_SIZE
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_IO_GetBufferSize( UINT32 dwPreferredSize, UINT16 iNumWorkers, UINT64 lMemCap )
+{
+   UINT64 lSize = dwPreferredSize;
+
+   if( ( lMemCap != 0 ) && ( iNumWorkers != 0 ) && ( lSize * iNumWorkers > lMemCap ) )
+   {
+      lSize = lMemCap / iNumWorkers;
+   }
+
+   /* Whole pages keep the reads aligned with the page cache */
+   lSize &= ~(UINT64)( MD5_IO_MIN_BUFFER_SIZE - 1 );
+
+   if( lSize < MD5_IO_MIN_BUFFER_SIZE )
+   {
+      lSize = MD5_IO_MIN_BUFFER_SIZE;
+   }
+
+   return (UINT32)lSize;
+}
+
+/*------------------------------------------------------------------------------
+** Allocates the read buffer of a worker. The buffer is page aligned, as
+** direct I/O requires.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker     - Worker to initialize
+**    dwBufferSize - Read buffer size in bytes
+**
+** Returns:
+**    BOOL - TRUE on success
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_InitWorker( MD5_IO_WorkerType* psWorker, UINT32 dwBufferSize )
+{
+   void* pxBuffer = NULL;
+
+   memset( psWorker, 0, sizeof( *psWorker ) );
+
+   if( posix_memalign( &pxBuffer, MD5_IO_MIN_BUFFER_SIZE,
+                       (size_t)dwBufferSize + MD5_IO_SPARE_BYTES ) != 0 )
+   {
+      return FALSE;
+   }
+
+   psWorker->pbBuffer     = pxBuffer;
+   psWorker->dwBufferSize = dwBufferSize;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Frees the read buffer of a worker.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_FreeWorker( MD5_IO_WorkerType* psWorker )
+{
+   free( psWorker->pbBuffer );
+   psWorker->pbBuffer     = NULL;
+   psWorker->dwBufferSize = 0;
+}
+
+/*------------------------------------------------------------------------------
+** Prepares a file the worker opened for being read from its start with the
+** worker's backend. Best effort: a file system that doesn't support the
+** backend is read with plain read() calls.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose backend applies
+**    iFd      - File descriptor to prepare (not one shared with others: the
+**               direct backend changes its file status flags)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_ApplyBackend( const MD5_IO_WorkerType* psWorker, int iFd )
+{
+   int iFlags;
+
+   if( psWorker->bBackend == MD5_IO_BACKEND_SEQUENTIAL )
+   {
+      (void)posix_fadvise( iFd, 0, 0, POSIX_FADV_SEQUENTIAL );
+   }
+   else if( ( psWorker->bBackend == MD5_IO_BACKEND_DIRECT ) &&
+            ( ( iFlags = fcntl( iFd, F_GETFL ) ) >= 0 ) )
+   {
+      /* Refused by file systems without direct I/O, they are read as before */
+      (void)fcntl( iFd, F_SETFL, iFlags | O_DIRECT );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Reads from a file at an offset like pread(), applying the worker's I/O
+** policy (throttle and page cache hygiene). For hashing loops outside this
+** module that read through a worker's buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose I/O policy applies
+**    iFd      - File descriptor to read
+**    pbBuffer - Receives the data
+**    iSize    - Bytes to read
+**    lOffset  - File offset to read from
+**
+** Returns:
+**    ssize_t - Bytes read, 0 at the end of the file, -1 on a read error
+**              (errno is set)
+**------------------------------------------------------------------------------
+*/
+ssize_t MD5_IO_ReadAt( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer, size_t iSize,
+                       off_t lOffset )
+{
+   ssize_t iBytesRead;
+
+   if( psWorker->fDropCache )
+   {
+      iBytesRead = MD5_IO_ReadDropping( iFd, pbBuffer, iSize, lOffset );
+   }
+   else
+   {
+      iBytesRead = pread( iFd, pbBuffer, iSize, lOffset );
+   }
+
+   /* Charged after the fact: a short read at the end takes what it got */
+   if( psWorker->psThrottle != NULL )
+   {
+      MD5_THROTTLE_Acquire( psWorker->psThrottle, ( iBytesRead > 0 ) ? (UINT64)iBytesRead : 0 );
+   }
+
+   return iBytesRead;
+}
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of everything readable from a file descriptor, starting at
+** its current position. With fSparse set, the holes of a sparse file are
+** found with lseek( SEEK_DATA / SEEK_HOLE ) and hashed as zero runs without
+** being read.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize   - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashFd( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbDigest, UINT64* plSize )
+{
+   MD5_Init( &psWorker->sInst );
+
+   if( !MD5_IO_UpdateFd( psWorker, iFd ) )
+   {
+      return FALSE;
+   }
+
+   MD5_IO_FinalDigest( psWorker, pbDigest, plSize );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Continues the worker's MD5 instance with everything readable from a file
+** descriptor, starting at its current position. The instance is neither
+** initialized nor finalized, so a restored state (MD5_ImportState()) can be
+** carried on with the data appended to a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_UpdateFd( MD5_IO_WorkerType* psWorker, int iFd )
+{
+   return psWorker->fSparse ? MD5_IO_UpdateFromSparseFd( psWorker, iFd ) :
+                              MD5_IO_UpdateFromFd( psWorker, iFd );
+}
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    pacPath  - File to hash
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize   - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE if the file could not be opened or read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashPath( MD5_IO_WorkerType* psWorker, const char* pacPath, UINT8* pbDigest,
+                      UINT64* plSize )
+{
+   int iFd = open( pacPath, O_RDONLY | O_CLOEXEC );
+   BOOL fSuccess;
+   int iError;
+
+   if( iFd < 0 )
+   {
+      return FALSE;
+   }
+
+   if( !psWorker->fSparse )
+   {
+      MD5_IO_ApplyBackend( psWorker, iFd );
+   }
+
+   fSuccess = MD5_IO_HashFd( psWorker, iFd, pbDigest, plSize );
+   iError   = errno;
+   close( iFd );
+   errno = iError;
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of a file relative to a directory fd. A file that fits the
+** read buffer according to its expected size is read with a single read().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker  - Worker providing the MD5 instance and read buffer
+**    iDirFd    - Directory pacName is relative to, or AT_FDCWD
+**    pacName   - File to hash
+**    lSizeHint - Expected file size (a wrong hint costs speed, not accuracy)
+**    pbDigest  - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize    - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE if the file could not be opened or read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashAt( MD5_IO_WorkerType* psWorker, int iDirFd, const char* pacName, UINT64 lSizeHint,
+                    UINT8* pbDigest, UINT64* plSize )
+{
+   int iFd       = openat( iDirFd, pacName, O_RDONLY | O_CLOEXEC );
+   BOOL fSuccess = TRUE;
+   int iError;
+
+   if( iFd < 0 )
+   {
+      return FALSE;
+   }
+
+   MD5_Init( &psWorker->sInst );
+
+   if( lSizeHint <= psWorker->dwBufferSize )
+   {
+      ssize_t iBytesRead =
+         MD5_IO_ReadKnownSize( psWorker, iFd, psWorker->pbBuffer, (UINT32)lSizeHint );
+
+      if( iBytesRead < 0 )
+      {
+         fSuccess = FALSE;
+      }
+      else
+      {
+         MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+
+         if( (UINT64)iBytesRead > lSizeHint )
+         {
+            fSuccess = MD5_IO_UpdateFromFd( psWorker, iFd );
+         }
+      }
+   }
+   else if( psWorker->fSparse )
+   {
+      fSuccess = MD5_IO_UpdateFromSparseFd( psWorker, iFd );
+   }
+   else
+   {
+      MD5_IO_ApplyBackend( psWorker, iFd );
+      fSuccess = MD5_IO_UpdateFromFd( psWorker, iFd );
+   }
+
+   iError = errno;
+   close( iFd );
+   errno = iError;
+
+   if( fSuccess )
+   {
+      MD5_IO_FinalDigest( psWorker, pbDigest, plSize );
+   }
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Returns the largest file size that MD5_IO_HashFiles() hashes on the
+** multi-lane path: each lane gets an equal share of the read buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the read buffer
+**
+** Returns:
+**    UINT32 - Size limit in bytes
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_IO_GetSmallFileSize( const MD5_IO_WorkerType* psWorker )
+{
+   return psWorker->dwBufferSize / MD5_MULTI_LANES;
+}
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of several files. Small files are read with a single
+** read() each and hashed MD5_MULTI_LANES at a time, other files are hashed
+** with MD5_IO_HashAt().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker  - Worker providing the MD5 instance and read buffer
+**    asFiles   - Files to hash, receive the digest or error
+**    iNumFiles - Number of files
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_HashFiles( MD5_IO_WorkerType* psWorker, MD5_IO_FileType asFiles[], UINT16 iNumFiles )
+{
+   MD5_IO_FileType* apsSmall[ MD5_IO_MAX_SORTED_FILES ];
+   UINT32 dwSmallFileSize = MD5_IO_GetSmallFileSize( psWorker );
+   MD5_IO_LanesType sLanes;
+   UINT16 iNumSmall = 0;
+   UINT16 iFile;
+   UINT16 iSmall;
+
+   sLanes.bNumLanes = 0;
+
+   for( iFile = 0; iFile < iNumFiles; iFile++ )
+   {
+      MD5_IO_FileType* psFile = &asFiles[ iFile ];
+
+      psFile->iError = 0;
+
+      if( psFile->lSizeHint <= dwSmallFileSize )
+      {
+         /* Insertion sort by size, lanes of similar length waste the least */
+         for( iSmall = iNumSmall;
+              ( iSmall > 0 ) && ( apsSmall[ iSmall - 1 ]->lSizeHint > psFile->lSizeHint );
+              iSmall-- )
+         {
+            apsSmall[ iSmall ] = apsSmall[ iSmall - 1 ];
+         }
+
+         apsSmall[ iSmall ] = psFile;
+         iNumSmall++;
+      }
+
+      if( ( iNumSmall == MD5_IO_MAX_SORTED_FILES ) ||
+          ( ( iFile + 1 == iNumFiles ) && ( iNumSmall != 0 ) ) )
+      {
+         for( iSmall = 0; iSmall < iNumSmall; iSmall++ )
+         {
+            MD5_IO_HashSmallFile( psWorker, &sLanes, apsSmall[ iSmall ] );
+         }
+
+         MD5_IO_FlushLanes( psWorker, &sLanes );
+         iNumSmall = 0;
+      }
+   }
+
+   for( iFile = 0; iFile < iNumFiles; iFile++ )
+   {
+      MD5_IO_FileType* psFile = &asFiles[ iFile ];
+
+      if( ( psFile->lSizeHint > dwSmallFileSize ) &&
+          !MD5_IO_HashAt( psWorker, psFile->iDirFd, psFile->pacName, psFile->lSizeHint,
+                          psFile->abDigest, NULL ) )
+      {
+         psFile->iError = errno;
+      }
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Starts replacing a file: creates a temporary file next to it that the new
+** contents are written to. MD5_IO_CommitReplace() renames it over the file,
+** so readers and a crash see either the old or the new contents.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psReplace   - Replacement to start, psFile receives the temporary file
+**    pacFilename - File to replace (need not exist)
+**
+** Returns:
+**    BOOL - FALSE if the temporary file could not be created (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_BeginReplace( MD5_IO_ReplaceType* psReplace, const char* pacFilename )
+{
+   size_t iTempLen = strlen( pacFilename ) + 32;
+   int iError;
+   int iFd;
+
+   psReplace->psFile      = NULL;
+   psReplace->pacFilename = pacFilename;
+   psReplace->pacTemp     = malloc( iTempLen );
+
+   if( psReplace->pacTemp == NULL )
+   {
+      return FALSE;
+   }
+
+   snprintf( psReplace->pacTemp, iTempLen, "%s.tmp.%ld", pacFilename, (long)getpid() );
+
+   iFd = open( psReplace->pacTemp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+   if( ( iFd < 0 ) || ( ( psReplace->psFile = fdopen( iFd, "wb" ) ) == NULL ) )
+   {
+      iError = errno;
+
+      if( iFd >= 0 )
+      {
+         close( iFd );
+         unlink( psReplace->pacTemp );
+      }
+
+      free( psReplace->pacTemp );
+      psReplace->pacTemp = NULL;
+      errno              = iError;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Finishes replacing a file: syncs the temporary file and renames it over
+** the file. The temporary file is removed if anything failed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psReplace - Replacement started with MD5_IO_BeginReplace()
+**    fSuccess  - FALSE if writing the new contents failed (errno is set),
+**                the file is then left as it was
+**
+** Returns:
+**    BOOL - FALSE if the file was not replaced (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_CommitReplace( MD5_IO_ReplaceType* psReplace, BOOL fSuccess )
+{
+   int iError = errno;
+
+   if( fSuccess )
+   {
+      fSuccess =
+         ( fflush( psReplace->psFile ) == 0 ) && ( fsync( fileno( psReplace->psFile ) ) == 0 );
+      iError   = errno;
+   }
+
+   if( ( fclose( psReplace->psFile ) != 0 ) && fSuccess )
+   {
+      fSuccess = FALSE;
+      iError   = errno;
+   }
+
+   if( fSuccess && ( rename( psReplace->pacTemp, psReplace->pacFilename ) != 0 ) )
+   {
+      fSuccess = FALSE;
+      iError   = errno;
+   }
+
+   if( !fSuccess )
+   {
+      unlink( psReplace->pacTemp );
+   }
+
+   free( psReplace->pacTemp );
+   psReplace->psFile  = NULL;
+   psReplace->pacTemp = NULL;
+   errno              = iError;
+
+   return fSuccess;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,310 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_io.h
+**    Summary: POSIX file hashing helpers shared by the host applications.
+**             Every worker thread owns an MD5_IO_WorkerType holding its MD5
+**             instance and read buffer, so no state is shared between files
+**             hashed in parallel.
+**
+**             Every read goes through the worker's I/O policy: an optional
+**             throttle, and with fDropCache the pages a read brought into
+**             the page cache are dropped again once hashed. Pages that were
+**             cached before the read are left alone.
+**
+**             Files a worker opens itself are read with its backend: plain
+**             read(), read() with sequential readahead, or direct I/O that
+**             bypasses the page cache. Which one is fastest depends on the
+**             device, so the choice is left to the caller (see MD5_tune.h).
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_IO_H_
+#define HMS_SC_MD5_IO_H_
+
+#include "MD5.h"
+#include "MD5_multi.h"
+#include "MD5_throttle.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_IO_MIN_BUFFER_SIZE         ( 4096U )
+#define MD5_IO_DEFAULT_BUFFER_SIZE     ( 128U * 1024U )
+
+/*
+** Files are read with one byte more than their expected size, which tells
+** whether they grew without another read() call. Every lane of the read
+** buffer gets such a spare byte.
+*/
+#define MD5_IO_SPARE_BYTES             ( MD5_MULTI_LANES )
+
+/*
+** Read backends (MD5_IO_WorkerType.bBackend)
+*/
+#define MD5_IO_BACKEND_READ            ( 0U ) /* read() */
+#define MD5_IO_BACKEND_SEQUENTIAL      ( 1U ) /* read() with POSIX_FADV_SEQUENTIAL readahead */
+#define MD5_IO_BACKEND_DIRECT          ( 2U ) /* read() with O_DIRECT, no page cache */
+#define MD5_IO_NUM_BACKENDS            ( 3U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_IO_Worker
+{
+   MD5_InstType sInst;
+   UINT8* pbBuffer;
+   UINT32 dwBufferSize;
+   BOOL fSparse;                   /* Skip the holes of sparse files instead of reading them */
+   BOOL fDropCache;                /* Keep the page cache as it was before the read */
+   UINT8 bBackend;                 /* MD5_IO_BACKEND_..., for files the worker opens */
+   MD5_THROTTLE_Type* psThrottle;  /* Shared by the workers, NULL: no limits */
+} MD5_IO_WorkerType;
+
+/*
+** A file to hash with MD5_IO_HashFiles()
+*/
+typedef struct MD5_IO_File
+{
+   int iDirFd;          /* Directory pacName is relative to, or AT_FDCWD */
+   const char* pacName;
+   UINT64 lSizeHint;    /* Expected size (e.g. from stat) */
+   int iError;          /* errno of the failed operation, 0 on success */
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_IO_FileType;
+
+/*
+** A file being replaced atomically, see MD5_IO_BeginReplace()
+*/
+typedef struct MD5_IO_Replace
+{
+   FILE* psFile;            /* Temporary file the new contents are written to */
+   const char* pacFilename; /* File to replace */
+   char* pacTemp;           /* Name of the temporary file */
+} MD5_IO_ReplaceType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the per-worker read buffer size that keeps the buffers of all
+** workers within a total memory cap.
+**------------------------------------------------------------------------------
+** Arguments:
+**    dwPreferredSize - Desired buffer size in bytes
+**    iNumWorkers     - Number of workers that each own a buffer
+**    lMemCap         - Cap on the sum of all buffers in bytes (0: no cap)
+**
+** Returns:
+**    UINT32 - Buffer size, at least MD5_IO_MIN_BUFFER_SIZE
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_IO_GetBufferSize( UINT32 dwPreferredSize, UINT16 iNumWorkers, UINT64 lMemCap );
+
+/*------------------------------------------------------------------------------
+** Allocates the read buffer of a worker. The buffer is page aligned, as
+** direct I/O requires.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker     - Worker to initialize
+**    dwBufferSize - Read buffer size in bytes
+**
+** Returns:
+**    BOOL - TRUE on success
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_InitWorker( MD5_IO_WorkerType* psWorker, UINT32 dwBufferSize );
+
+/*------------------------------------------------------------------------------
+** Frees the read buffer of a worker.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_FreeWorker( MD5_IO_WorkerType* psWorker );
+
+/*------------------------------------------------------------------------------
+** Prepares a file the worker opened for being read from its start with the
+** worker's backend. Best effort: a file system that doesn't support the
+** backend is read with plain read() calls.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose backend applies
+**    iFd      - File descriptor to prepare (not one shared with others: the
+**               direct backend changes its file status flags)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_ApplyBackend( const MD5_IO_WorkerType* psWorker, int iFd );
+
+/*------------------------------------------------------------------------------
+** Reads from a file at an offset like pread(), applying the worker's I/O
+** policy (throttle and page cache hygiene). For hashing loops outside this
+** module that read through a worker's buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker whose I/O policy applies
+**    iFd      - File descriptor to read
+**    pbBuffer - Receives the data
+**    iSize    - Bytes to read
+**    lOffset  - File offset to read from
+**
+** Returns:
+**    ssize_t - Bytes read, 0 at the end of the file, -1 on a read error
+**              (errno is set)
+**------------------------------------------------------------------------------
+*/
+ssize_t MD5_IO_ReadAt( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbBuffer, size_t iSize,
+                       off_t lOffset );
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of everything readable from a file descriptor, starting at
+** its current position. With fSparse set, the holes of a sparse file are
+** found with lseek( SEEK_DATA / SEEK_HOLE ) and hashed as zero runs without
+** being read.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize   - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashFd( MD5_IO_WorkerType* psWorker, int iFd, UINT8* pbDigest, UINT64* plSize );
+
+/*------------------------------------------------------------------------------
+** Continues the worker's MD5 instance with everything readable from a file
+** descriptor, starting at its current position. The instance is neither
+** initialized nor finalized, so a restored state (MD5_ImportState()) can be
+** carried on with the data appended to a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    iFd      - File descriptor to read
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_UpdateFd( MD5_IO_WorkerType* psWorker, int iFd );
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    pacPath  - File to hash
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize   - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE if the file could not be opened or read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashPath( MD5_IO_WorkerType* psWorker, const char* pacPath, UINT8* pbDigest,
+                      UINT64* plSize );
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of a file relative to a directory fd. A file that fits the
+** read buffer according to its expected size is read with a single read().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker  - Worker providing the MD5 instance and read buffer
+**    iDirFd    - Directory pacName is relative to, or AT_FDCWD
+**    pacName   - File to hash
+**    lSizeHint - Expected file size (a wrong hint costs speed, not accuracy)
+**    pbDigest  - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    plSize    - Receives the number of bytes hashed (may be NULL)
+**
+** Returns:
+**    BOOL - FALSE if the file could not be opened or read (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_HashAt( MD5_IO_WorkerType* psWorker, int iDirFd, const char* pacName, UINT64 lSizeHint,
+                    UINT8* pbDigest, UINT64* plSize );
+
+/*------------------------------------------------------------------------------
+** Returns the largest file size that MD5_IO_HashFiles() hashes on the
+** multi-lane path: each lane gets an equal share of the read buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the read buffer
+**
+** Returns:
+**    UINT32 - Size limit in bytes
+**------------------------------------------------------------------------------
+*/
+UINT32 MD5_IO_GetSmallFileSize( const MD5_IO_WorkerType* psWorker );
+
+/*------------------------------------------------------------------------------
+** Computes the MD5 of several files. Small files are read with a single
+** read() each and hashed MD5_MULTI_LANES at a time, other files are hashed
+** with MD5_IO_HashAt().
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker  - Worker providing the MD5 instance and read buffer
+**    asFiles   - Files to hash, receive the digest or error
+**    iNumFiles - Number of files
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_IO_HashFiles( MD5_IO_WorkerType* psWorker, MD5_IO_FileType asFiles[], UINT16 iNumFiles );
+
+/*------------------------------------------------------------------------------
+** Starts replacing a file: creates a temporary file next to it that the new
+** contents are written to. MD5_IO_CommitReplace() renames it over the file,
+** so readers and a crash see either the old or the new contents.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psReplace   - Replacement to start, psFile receives the temporary file
+**    pacFilename - File to replace (need not exist)
+**
+** Returns:
+**    BOOL - FALSE if the temporary file could not be created (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_BeginReplace( MD5_IO_ReplaceType* psReplace, const char* pacFilename );
+
+/*------------------------------------------------------------------------------
+** Finishes replacing a file: syncs the temporary file and renames it over
+** the file. The temporary file is removed if anything failed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psReplace - Replacement started with MD5_IO_BeginReplace()
+**    fSuccess  - FALSE if writing the new contents failed (errno is set),
+**                the file is then left as it was
+**
+** Returns:
+**    BOOL - FALSE if the file was not replaced (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_IO_CommitReplace( MD5_IO_ReplaceType* psReplace, BOOL fSuccess );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_IO_H_ */
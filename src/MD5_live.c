@@ -0,0 +1,735 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_live.c
+**    Summary: Live md5sum manifest of a directory tree. The queued changes
+**             are sorted and merged into the sorted entries, so applying a
+**             burst costs one pass over the manifest.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_live.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static int MD5_LIVE_CompareEntries( const void* pxEntry1, const void* pxEntry2 );
+static int MD5_LIVE_CompareChanges( const void* pxChange1, const void* pxChange2 );
+static BOOL MD5_LIVE_IsSelf( const MD5_LIVE_Type* psLive, UINT64 lDevice, UINT64 lInode );
+static void MD5_LIVE_Emit( const MD5_WALK_FileType* psFile, void* pxCtx );
+static void MD5_LIVE_Job( void* pxArg, UINT16 iWorker );
+static UINT64 MD5_LIVE_RemoveTree( MD5_LIVE_Type* psLive, const char* pacPath );
+static BOOL MD5_LIVE_ApplyChanges( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool );
+static void MD5_LIVE_FreeChanges( MD5_LIVE_Type* psLive );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** qsort() routine, orders manifest entries by path.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxEntry1 - First entry
+**    pxEntry2 - Second entry
+**
+** Returns:
+**    int - Negative, zero or positive like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_LIVE_CompareEntries( const void* pxEntry1, const void* pxEntry2 )
+{
+   return strcmp( ( (const MD5_LIVE_EntryType*)pxEntry1 )->pacPath,
+                  ( (const MD5_LIVE_EntryType*)pxEntry2 )->pacPath );
+}
+
+/*------------------------------------------------------------------------------
+** qsort() routine, orders queued changes by path, a removal before a change.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxChange1 - First change
+**    pxChange2 - Second change
+**
+** Returns:
+**    int - Negative, zero or positive like strcmp()
+**------------------------------------------------------------------------------
+*/
+static int MD5_LIVE_CompareChanges( const void* pxChange1, const void* pxChange2 )
+{
+   const MD5_LIVE_ChangeType* psChange1 = (const MD5_LIVE_ChangeType*)pxChange1;
+   const MD5_LIVE_ChangeType* psChange2 = (const MD5_LIVE_ChangeType*)pxChange2;
+   int iOrder = strcmp( psChange1->pacPath, psChange2->pacPath );
+
+   if( iOrder != 0 )
+   {
+      return iOrder;
+   }
+
+   return (int)psChange2->fRemoved - (int)psChange1->fRemoved;
+}
+
+/*------------------------------------------------------------------------------
+** Tells whether a file is the manifest file itself (or the temporary file it
+** is written to).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    lDevice - Device of the file
+**    lInode  - Inode of the file
+**
+** Returns:
+**    BOOL - TRUE for the manifest file
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_LIVE_IsSelf( const MD5_LIVE_Type* psLive, UINT64 lDevice, UINT64 lInode )
+{
+   return psLive->fSelfKnown && ( lDevice == psLive->lSelfDevice ) &&
+          ( lInode == psLive->lSelfInode );
+}
+
+/*------------------------------------------------------------------------------
+** Walk emit routine, collects the entries of a full scan.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile - File visited by the walk
+**    pxCtx  - Manifest
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_LIVE_Emit( const MD5_WALK_FileType* psFile, void* pxCtx )
+{
+   MD5_LIVE_Type* psLive = (MD5_LIVE_Type*)pxCtx;
+   MD5_LIVE_EntryType* psEntry;
+
+   if( psFile->iError != 0 )
+   {
+      psLive->pnError( psFile->pacPath, psFile->iError, psLive->pxCtx );
+      return;
+   }
+
+   if( psLive->fOutOfMemory || MD5_LIVE_IsSelf( psLive, psFile->lDevice, psFile->lInode ) )
+   {
+      return;
+   }
+
+   if( psLive->lNumEntries == psLive->lAlloc )
+   {
+      UINT64 lAlloc = ( psLive->lAlloc == 0 ) ? 1024 : psLive->lAlloc * 2;
+      MD5_LIVE_EntryType* asEntries =
+         realloc( psLive->asEntries, lAlloc * sizeof( MD5_LIVE_EntryType ) );
+
+      if( asEntries == NULL )
+      {
+         psLive->fOutOfMemory = TRUE;
+         return;
+      }
+
+      psLive->asEntries = asEntries;
+      psLive->lAlloc    = lAlloc;
+   }
+
+   psEntry          = &psLive->asEntries[ psLive->lNumEntries ];
+   psEntry->pacPath = strdup( psFile->pacPath );
+
+   if( psEntry->pacPath == NULL )
+   {
+      psLive->fOutOfMemory = TRUE;
+      return;
+   }
+
+   memcpy( psEntry->abDigest, psFile->abDigest, MD5_DIGEST_SIZE );
+   psEntry->fGone = FALSE;
+   psLive->lNumEntries++;
+}
+
+/*------------------------------------------------------------------------------
+** Pool job, rehashes a changed path. A path that is gone again or is no
+** longer a regular file is left with fRegular unset.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Change (MD5_LIVE_ChangeType)
+**    iWorker - Index of the executing worker
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_LIVE_Job( void* pxArg, UINT16 iWorker )
+{
+   MD5_LIVE_ChangeType* psChange = (MD5_LIVE_ChangeType*)pxArg;
+   struct stat sStat;
+
+   psChange->fRegular = FALSE;
+   psChange->iError   = 0;
+
+   if( ( lstat( psChange->pacPath, &sStat ) != 0 ) || !S_ISREG( sStat.st_mode ) )
+   {
+      return;
+   }
+
+   psChange->lDevice = (UINT64)sStat.st_dev;
+   psChange->lInode  = (UINT64)sStat.st_ino;
+
+   if( MD5_IO_HashPath( psChange->apsWorkers[ iWorker ], psChange->pacPath, psChange->abDigest,
+                        NULL ) )
+   {
+      psChange->fRegular = TRUE;
+   }
+   else if( errno != ENOENT )
+   {
+      psChange->iError = errno;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Marks a removed path and everything below it as gone;
+** MD5_LIVE_ApplyChanges() drops the marked entries.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    pacPath - Removed path
+**
+** Returns:
+**    UINT64 - Number of entries marked
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_LIVE_RemoveTree( MD5_LIVE_Type* psLive, const char* pacPath )
+{
+   size_t iLen     = strlen( pacPath );
+   UINT64 lLow     = 0;
+   UINT64 lHigh    = psLive->lNumEntries;
+   UINT64 lRemoved = 0;
+
+   /* The paths starting with pacPath follow the first one not below it */
+   while( lLow < lHigh )
+   {
+      UINT64 lMiddle = lLow + ( lHigh - lLow ) / 2;
+
+      if( strcmp( psLive->asEntries[ lMiddle ].pacPath, pacPath ) < 0 )
+      {
+         lLow = lMiddle + 1;
+      }
+      else
+      {
+         lHigh = lMiddle;
+      }
+   }
+
+   for( ; lLow < psLive->lNumEntries; lLow++ )
+   {
+      MD5_LIVE_EntryType* psEntry = &psLive->asEntries[ lLow ];
+
+      if( strncmp( psEntry->pacPath, pacPath, iLen ) != 0 )
+      {
+         break;
+      }
+
+      if( !psEntry->fGone &&
+          ( ( psEntry->pacPath[ iLen ] == '\0' ) || ( psEntry->pacPath[ iLen ] == '/' ) ) )
+      {
+         psEntry->fGone = TRUE;
+         lRemoved++;
+      }
+   }
+
+   return lRemoved;
+}
+
+/*------------------------------------------------------------------------------
+** Applies the queued changes: rehashes the changed paths on the workers,
+** drops the removed ones and merges the results into the sorted entries.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**    psPool - Pool to run on
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_LIVE_ApplyChanges( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool )
+{
+   MD5_LIVE_ChangeType* asChanges = psLive->asChanges;
+   MD5_LIVE_EntryType* asMerged;
+   UINT64 lNumUnique = 0;
+   UINT64 lNumMerged = 0;
+   UINT64 lEntry;
+   UINT64 lChange;
+
+   psLive->lNumRehashed = 0;
+   psLive->lNumRemoved  = 0;
+
+   qsort( asChanges, psLive->lNumChanges, sizeof( MD5_LIVE_ChangeType ), MD5_LIVE_CompareChanges );
+
+   /* A path is looked at once, however often it changed */
+   for( lChange = 0; lChange < psLive->lNumChanges; lChange++ )
+   {
+      if( ( lNumUnique > 0 ) &&
+          ( MD5_LIVE_CompareChanges( &asChanges[ lNumUnique - 1 ], &asChanges[ lChange ] ) == 0 ) )
+      {
+         free( asChanges[ lChange ].pacPath );
+      }
+      else
+      {
+         asChanges[ lNumUnique++ ] = asChanges[ lChange ];
+      }
+   }
+
+   psLive->lNumChanges = lNumUnique;
+
+   for( lChange = 0; lChange < lNumUnique; lChange++ )
+   {
+      if( !asChanges[ lChange ].fRemoved )
+      {
+         MD5_POOL_Submit( psPool, MD5_LIVE_Job, &asChanges[ lChange ] );
+         psLive->lNumRehashed++;
+      }
+   }
+
+   MD5_POOL_Wait( psPool );
+
+   /* Removals first: a directory replaced within the burst is re-added below */
+   for( lChange = 0; lChange < lNumUnique; lChange++ )
+   {
+      if( asChanges[ lChange ].fRemoved )
+      {
+         psLive->lNumRemoved += MD5_LIVE_RemoveTree( psLive, asChanges[ lChange ].pacPath );
+      }
+   }
+
+   asMerged = malloc( ( psLive->lNumEntries + lNumUnique + 1 ) * sizeof( MD5_LIVE_EntryType ) );
+
+   if( asMerged == NULL )
+   {
+      psLive->fOutOfMemory = TRUE;
+      return FALSE;
+   }
+
+   lEntry  = 0;
+   lChange = 0;
+
+   while( ( lEntry < psLive->lNumEntries ) || ( lChange < lNumUnique ) )
+   {
+      MD5_LIVE_EntryType* psEntry   =
+         ( lEntry < psLive->lNumEntries ) ? &psLive->asEntries[ lEntry ] : NULL;
+      MD5_LIVE_ChangeType* psChange = ( lChange < lNumUnique ) ? &asChanges[ lChange ] : NULL;
+      int iOrder;
+
+      if( ( psEntry != NULL ) && psEntry->fGone )
+      {
+         free( psEntry->pacPath );
+         lEntry++;
+         continue;
+      }
+
+      if( ( psChange != NULL ) && psChange->fRemoved )
+      {
+         lChange++;
+         continue;
+      }
+
+      if( psEntry == NULL )
+      {
+         iOrder = 1;
+      }
+      else if( psChange == NULL )
+      {
+         iOrder = -1;
+      }
+      else
+      {
+         iOrder = strcmp( psEntry->pacPath, psChange->pacPath );
+      }
+
+      if( iOrder < 0 )
+      {
+         asMerged[ lNumMerged++ ] = *psEntry;
+         lEntry++;
+         continue;
+      }
+
+      if( psChange->iError != 0 )
+      {
+         psLive->pnError( psChange->pacPath, psChange->iError, psLive->pxCtx );
+      }
+
+      if( MD5_LIVE_IsSelf( psLive, psChange->lDevice, psChange->lInode ) )
+      {
+         psChange->fRegular = FALSE;
+      }
+
+      if( iOrder == 0 )
+      {
+         if( psChange->fRegular &&
+             ( memcmp( psEntry->abDigest, psChange->abDigest, MD5_DIGEST_SIZE ) == 0 ) )
+         {
+            /* Rewritten with the same content */
+            asMerged[ lNumMerged++ ] = *psEntry;
+            lEntry++;
+            lChange++;
+            continue;
+         }
+
+         free( psEntry->pacPath );
+         lEntry++;
+
+         if( !psChange->fRegular )
+         {
+            psLive->lNumRemoved++;
+         }
+      }
+
+      if( psChange->fRegular )
+      {
+         asMerged[ lNumMerged ].pacPath = psChange->pacPath;
+         asMerged[ lNumMerged ].fGone   = FALSE;
+         memcpy( asMerged[ lNumMerged ].abDigest, psChange->abDigest, MD5_DIGEST_SIZE );
+         lNumMerged++;
+
+         /* Owned by the manifest now */
+         psChange->pacPath = NULL;
+         psLive->fModified = TRUE;
+      }
+
+      lChange++;
+   }
+
+   if( psLive->lNumRemoved > 0 )
+   {
+      psLive->fModified = TRUE;
+   }
+
+   MD5_LIVE_FreeChanges( psLive );
+
+   free( psLive->asEntries );
+   psLive->asEntries   = asMerged;
+   psLive->lAlloc      = psLive->lNumEntries + lNumUnique + 1;
+   psLive->lNumEntries = lNumMerged;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Drops the queued changes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_LIVE_FreeChanges( MD5_LIVE_Type* psLive )
+{
+   UINT64 lChange;
+
+   for( lChange = 0; lChange < psLive->lNumChanges; lChange++ )
+   {
+      free( psLive->asChanges[ lChange ].pacPath );
+   }
+
+   psLive->lNumChanges = 0;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares an empty manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive      - Manifest to initialize
+**    pacFilename - Manifest file, kept by reference. An existing file is
+**                  not read, but left out of the manifest.
+**    apsWorkers  - Per-worker MD5 instance and read buffer of the pool that
+**                  the manifest is updated on
+**    psWalkCfg   - pnVisit, pnVisitBatch, lBatchFileSize and pnPickWorker of
+**                  the full scans (e.g. to answer from a digest cache); the
+**                  other fields are set by the manifest
+**    pnError     - Called for every file that could not be hashed
+**    pnLine      - Writes a line of the manifest file
+**    pxCtx       - Passed to pnError and pnLine
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Init( MD5_LIVE_Type* psLive, const char* pacFilename, MD5_IO_WorkerType* apsWorkers[],
+                    const MD5_WALK_ConfigType* psWalkCfg, MD5_LIVE_ErrorFunc pnError,
+                    MD5_LIVE_LineFunc pnLine, void* pxCtx )
+{
+   struct stat sStat;
+
+   memset( psLive, 0, sizeof( MD5_LIVE_Type ) );
+
+   psLive->pacFilename = pacFilename;
+   psLive->apsWorkers  = apsWorkers;
+   psLive->sWalkCfg    = *psWalkCfg;
+   psLive->pnError     = pnError;
+   psLive->pnLine      = pnLine;
+   psLive->pxCtx       = pxCtx;
+
+   psLive->sWalkCfg.pnEmit         = MD5_LIVE_Emit;
+   psLive->sWalkCfg.pxCtx          = psLive;
+   psLive->sWalkCfg.fSkipHardLinks = FALSE;
+
+   /* An existing manifest inside the tree is not listed */
+   if( stat( pacFilename, &sStat ) == 0 )
+   {
+      psLive->lSelfDevice = (UINT64)sStat.st_dev;
+      psLive->lSelfInode  = (UINT64)sStat.st_ino;
+      psLive->fSelfKnown  = TRUE;
+   }
+
+   psLive->pacBuffer = malloc( MD5_LIVE_BUFFER_SIZE );
+
+   return ( psLive->pacBuffer != NULL );
+}
+
+/*------------------------------------------------------------------------------
+** Builds the manifest from scratch with a parallel tree walk.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    psPool  - Pool to run on, not running other jobs
+**    pacRoot - Directory to list
+**
+** Returns:
+**    BOOL - FALSE if the walk failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Scan( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool, const char* pacRoot )
+{
+   UINT64 lEntry;
+
+   for( lEntry = 0; lEntry < psLive->lNumEntries; lEntry++ )
+   {
+      free( psLive->asEntries[ lEntry ].pacPath );
+   }
+
+   psLive->lNumEntries = 0;
+
+   if( !MD5_WALK_Run( psPool, pacRoot, &psLive->sWalkCfg ) )
+   {
+      return FALSE;
+   }
+
+   if( psLive->fOutOfMemory )
+   {
+      errno = ENOMEM;
+      return FALSE;
+   }
+
+   qsort( psLive->asEntries, psLive->lNumEntries, sizeof( MD5_LIVE_EntryType ),
+          MD5_LIVE_CompareEntries );
+   psLive->fModified = TRUE;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Change notification routine (MD5_WATCH_EventFunc), queues a change until
+** MD5_LIVE_Update(). Memory running out sets fOutOfMemory.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacPath - Changed path
+**    bEvent  - MD5_WATCH_...
+**    pxCtx   - Manifest
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_LIVE_Event( const char* pacPath, UINT8 bEvent, void* pxCtx )
+{
+   MD5_LIVE_Type* psLive = (MD5_LIVE_Type*)pxCtx;
+   MD5_LIVE_ChangeType* psChange;
+
+   if( bEvent == MD5_WATCH_OVERFLOW )
+   {
+      psLive->fRescan = TRUE;
+      return;
+   }
+
+   if( psLive->fOutOfMemory )
+   {
+      return;
+   }
+
+   if( psLive->lNumChanges == psLive->lChangeAlloc )
+   {
+      UINT64 lAlloc = ( psLive->lChangeAlloc == 0 ) ? 256 : psLive->lChangeAlloc * 2;
+      MD5_LIVE_ChangeType* asChanges =
+         realloc( psLive->asChanges, lAlloc * sizeof( MD5_LIVE_ChangeType ) );
+
+      if( asChanges == NULL )
+      {
+         psLive->fOutOfMemory = TRUE;
+         return;
+      }
+
+      psLive->asChanges    = asChanges;
+      psLive->lChangeAlloc = lAlloc;
+   }
+
+   psChange = &psLive->asChanges[ psLive->lNumChanges ];
+   memset( psChange, 0, sizeof( MD5_LIVE_ChangeType ) );
+   psChange->pacPath    = strdup( pacPath );
+   psChange->fRemoved   = ( bEvent == MD5_WATCH_REMOVED );
+   psChange->apsWorkers = psLive->apsWorkers;
+
+   if( psChange->pacPath == NULL )
+   {
+      psLive->fOutOfMemory = TRUE;
+      return;
+   }
+
+   psLive->lNumChanges++;
+}
+
+/*------------------------------------------------------------------------------
+** Tells whether changes are waiting to be applied.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**
+** Returns:
+**    BOOL - TRUE if MD5_LIVE_Update() has work to do
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_IsPending( const MD5_LIVE_Type* psLive )
+{
+   return ( psLive->lNumChanges > 0 ) || psLive->fRescan;
+}
+
+/*------------------------------------------------------------------------------
+** Applies the queued changes: the changed paths are rehashed on the pool
+** workers, the removed ones dropped. Lost events mean starting over with a
+** full scan, after watching the directories created meanwhile.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    psPool  - Pool to run on, not running other jobs
+**    psWatch - Change notification of the tree
+**    pacRoot - Directory listed by the manifest
+**
+** Returns:
+**    BOOL - FALSE if the rescan failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Update( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool, MD5_WATCH_Type* psWatch,
+                      const char* pacRoot )
+{
+   if( psLive->fRescan )
+   {
+      MD5_LIVE_FreeChanges( psLive );
+      psLive->fRescan = FALSE;
+
+      /* Directories created while events were lost aren't watched yet */
+      return MD5_WATCH_AddTree( psWatch, pacRoot, NULL, NULL ) &&
+             MD5_LIVE_Scan( psLive, psPool, pacRoot );
+   }
+
+   if( !MD5_LIVE_ApplyChanges( psLive, psPool ) )
+   {
+      errno = ENOMEM;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Replaces the manifest file atomically (MD5_IO_BeginReplace()), so readers
+** always see a complete manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Write( MD5_LIVE_Type* psLive )
+{
+   MD5_IO_ReplaceType sReplace;
+   MD5_FMT_WriterType sWriter;
+   struct stat sStat;
+   UINT64 lEntry;
+
+   if( !MD5_IO_BeginReplace( &sReplace, psLive->pacFilename ) )
+   {
+      return FALSE;
+   }
+
+   /* Known before the rename, so the events of the update are recognized */
+   if( fstat( fileno( sReplace.psFile ), &sStat ) == 0 )
+   {
+      psLive->lSelfDevice = (UINT64)sStat.st_dev;
+      psLive->lSelfInode  = (UINT64)sStat.st_ino;
+      psLive->fSelfKnown  = TRUE;
+   }
+
+   MD5_FMT_WriterInit( &sWriter, sReplace.psFile, psLive->pacBuffer, MD5_LIVE_BUFFER_SIZE, FALSE );
+
+   for( lEntry = 0; lEntry < psLive->lNumEntries; lEntry++ )
+   {
+      psLive->pnLine( &sWriter, psLive->asEntries[ lEntry ].abDigest,
+                      psLive->asEntries[ lEntry ].pacPath, psLive->pxCtx );
+   }
+
+   psLive->fModified = FALSE;
+
+   return MD5_IO_CommitReplace( &sReplace, MD5_FMT_Flush( &sWriter ) );
+}
+
+/*------------------------------------------------------------------------------
+** Releases the entries and queued changes of a manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_LIVE_Free( MD5_LIVE_Type* psLive )
+{
+   UINT64 lEntry;
+
+   for( lEntry = 0; lEntry < psLive->lNumEntries; lEntry++ )
+   {
+      free( psLive->asEntries[ lEntry ].pacPath );
+   }
+
+   MD5_LIVE_FreeChanges( psLive );
+
+   free( psLive->asEntries );
+   free( psLive->asChanges );
+   free( psLive->pacBuffer );
+
+   psLive->asEntries   = NULL;
+   psLive->lNumEntries = 0;
+   psLive->lAlloc      = 0;
+   psLive->asChanges   = NULL;
+   psLive->pacBuffer   = NULL;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
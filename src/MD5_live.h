@@ -0,0 +1,224 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_live.h
+**    Summary: Live md5sum manifest of a directory tree. The manifest is
+**             built once with a parallel tree walk; afterwards only the
+**             paths reported by the change notification (MD5_watch.h) are
+**             rehashed or dropped. Changes are queued as they arrive and
+**             applied in one go, so a burst of writes to a file costs a
+**             single rehash.
+**
+**             Every path is listed, hard links included, since changes
+**             arrive by path. The manifest file itself is never listed, or
+**             every update would cause the next one.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_LIVE_H_
+#define HMS_SC_MD5_LIVE_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include "MD5_fmt.h"
+#include "MD5_io.h"
+#include "MD5_pool.h"
+#include "MD5_walk.h"
+#include "MD5_watch.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_LIVE_BUFFER_SIZE           ( 1024U * 1024U ) /* Manifest output buffer */
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A file of the manifest
+*/
+typedef struct MD5_LIVE_Entry
+{
+   char* pacPath;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   BOOL fGone;    /* Removed, dropped by the next merge */
+} MD5_LIVE_EntryType;
+
+/*
+** A path reported by the change notification. A changed path is rehashed by
+** a job, a removed one takes everything below it along.
+*/
+typedef struct MD5_LIVE_Change
+{
+   char* pacPath;
+   BOOL fRemoved;
+   BOOL fRegular; /* After the job: a regular file, abDigest is valid */
+   UINT64 lDevice;
+   UINT64 lInode;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   int iError;
+   MD5_IO_WorkerType** apsWorkers; /* Workers of the manifest, for the job */
+} MD5_LIVE_ChangeType;
+
+/*
+** Called one at a time for every file that could not be hashed, with the
+** errno of the failed operation.
+*/
+typedef void ( *MD5_LIVE_ErrorFunc )( const char* pacPath, int iError, void* pxCtx );
+
+/*
+** Called for every line of the manifest file, in path order.
+*/
+typedef void ( *MD5_LIVE_LineFunc )( MD5_FMT_WriterType* psWriter, const UINT8* pbDigest,
+                                     const char* pacPath, void* pxCtx );
+
+typedef struct MD5_LIVE
+{
+   MD5_LIVE_EntryType* asEntries;   /* Sorted by path (strcmp) */
+   UINT64 lNumEntries;
+   UINT64 lAlloc;
+   MD5_LIVE_ChangeType* asChanges;  /* Changes waiting to be applied */
+   UINT64 lNumChanges;
+   UINT64 lChangeAlloc;
+   BOOL fRescan;                    /* Events were lost */
+   BOOL fModified;                  /* Differs from the manifest file */
+   BOOL fOutOfMemory;
+   const char* pacFilename;         /* Manifest file */
+   UINT64 lSelfDevice;              /* Identity of the manifest file */
+   UINT64 lSelfInode;
+   BOOL fSelfKnown;
+   char* pacBuffer;                 /* Output buffer, MD5_LIVE_BUFFER_SIZE bytes */
+   MD5_IO_WorkerType** apsWorkers;  /* Per-worker MD5 instance and read buffer */
+   MD5_WALK_ConfigType sWalkCfg;    /* Visit routines of the full scans */
+   MD5_LIVE_ErrorFunc pnError;
+   MD5_LIVE_LineFunc pnLine;
+   void* pxCtx;
+   UINT64 lNumRehashed;             /* Statistics of the last MD5_LIVE_Update() */
+   UINT64 lNumRemoved;
+} MD5_LIVE_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares an empty manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive      - Manifest to initialize
+**    pacFilename - Manifest file, kept by reference. An existing file is
+**                  not read, but left out of the manifest.
+**    apsWorkers  - Per-worker MD5 instance and read buffer of the pool that
+**                  the manifest is updated on
+**    psWalkCfg   - pnVisit, pnVisitBatch, lBatchFileSize and pnPickWorker of
+**                  the full scans (e.g. to answer from a digest cache); the
+**                  other fields are set by the manifest
+**    pnError     - Called for every file that could not be hashed
+**    pnLine      - Writes a line of the manifest file
+**    pxCtx       - Passed to pnError and pnLine
+**
+** Returns:
+**    BOOL - FALSE if memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Init( MD5_LIVE_Type* psLive, const char* pacFilename, MD5_IO_WorkerType* apsWorkers[],
+                    const MD5_WALK_ConfigType* psWalkCfg, MD5_LIVE_ErrorFunc pnError,
+                    MD5_LIVE_LineFunc pnLine, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Builds the manifest from scratch with a parallel tree walk.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    psPool  - Pool to run on, not running other jobs
+**    pacRoot - Directory to list
+**
+** Returns:
+**    BOOL - FALSE if the walk failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Scan( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool, const char* pacRoot );
+
+/*------------------------------------------------------------------------------
+** Change notification routine (MD5_WATCH_EventFunc), queues a change until
+** MD5_LIVE_Update(). Memory running out sets fOutOfMemory.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacPath - Changed path
+**    bEvent  - MD5_WATCH_...
+**    pxCtx   - Manifest
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_LIVE_Event( const char* pacPath, UINT8 bEvent, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Tells whether changes are waiting to be applied.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**
+** Returns:
+**    BOOL - TRUE if MD5_LIVE_Update() has work to do
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_IsPending( const MD5_LIVE_Type* psLive );
+
+/*------------------------------------------------------------------------------
+** Applies the queued changes: the changed paths are rehashed on the pool
+** workers, the removed ones dropped. Lost events mean starting over with a
+** full scan, after watching the directories created meanwhile.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive  - Manifest
+**    psPool  - Pool to run on, not running other jobs
+**    psWatch - Change notification of the tree
+**    pacRoot - Directory listed by the manifest
+**
+** Returns:
+**    BOOL - FALSE if the rescan failed or memory ran out (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Update( MD5_LIVE_Type* psLive, MD5_POOL_Type* psPool, MD5_WATCH_Type* psWatch,
+                      const char* pacRoot );
+
+/*------------------------------------------------------------------------------
+** Replaces the manifest file atomically (MD5_IO_BeginReplace()), so readers
+** always see a complete manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_LIVE_Write( MD5_LIVE_Type* psLive );
+
+/*------------------------------------------------------------------------------
+** Releases the entries and queued changes of a manifest.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psLive - Manifest to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_LIVE_Free( MD5_LIVE_Type* psLive );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_LIVE_H_ */
@@ -0,0 +1,291 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_manifest.c
+**    Summary: Parsing of digest manifests as written by md5sum.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_fmt.h"
+#include "MD5_manifest.h"
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+#define MD5_MANIFEST_TEST_LINE_SIZE    ( 96U )
+#endif
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** A manifest line and its expected name, NULL if the line must be rejected
+*/
+typedef struct MD5_MANIFEST_TestCase
+{
+   const char* pacDesc;
+   const char* pacLine;
+   const char* pacName;
+} MD5_MANIFEST_TestCaseType;
+#endif
+
+/*******************************************************************************
+** Private Globals
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*----------------------------------------------------------------------------
+** MD5( "abc" ), the digest of every test line
+**----------------------------------------------------------------------------
+*/
+static const UINT8 MD5_MANIFEST_abTestDigest[ MD5_DIGEST_SIZE ] =
+{
+   0x90, 0x01, 0x50, 0x98, 0x3C, 0xD2, 0x4F, 0xB0,
+   0xD6, 0x96, 0x3F, 0x7D, 0x28, 0xE1, 0x7F, 0x72
+};
+
+/*----------------------------------------------------------------------------
+** Manifest lines as md5sum writes them, and malformed ones
+**----------------------------------------------------------------------------
+*/
+static const MD5_MANIFEST_TestCaseType MD5_MANIFEST_asTestCases[] =
+{
+   { "TEXT MODE",          "900150983cd24fb0d6963f7d28e17f72  a b", "a b" },
+   { "BINARY MODE",        "900150983CD24FB0D6963F7D28E17F72 *a", "a" },
+   { "DIGEST ONLY",        "900150983cd24fb0d6963f7d28e17f72", "" },
+   { "TAGGED",             "MD5 (a) = b) = 900150983cd24fb0d6963f7d28e17f72", "a) = b" },
+   { "PLAIN BACKSLASH",    "900150983cd24fb0d6963f7d28e17f72  a\\nb", "a\\nb" },
+   { "ESCAPED",            "\\900150983cd24fb0d6963f7d28e17f72  a\\nb\\\\c", "a\nb\\c" },
+   { "ESCAPED TAGGED",     "\\MD5 (\\\\\\n) = 900150983cd24fb0d6963f7d28e17f72", "\\\n" },
+   { "INVALID ESCAPE",     "\\900150983cd24fb0d6963f7d28e17f72  a\\tb", NULL },
+   { "TRAILING BACKSLASH", "\\900150983cd24fb0d6963f7d28e17f72  a\\", NULL },
+   { "INVALID DIGEST",     "900150983cd24fb0d6963f7d28e17f7g  a", NULL },
+   { "ONE SPACE",          "900150983cd24fb0d6963f7d28e17f72 a", NULL }
+};
+#endif
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static BOOL MD5_MANIFEST_Unescape( char* pacName );
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static BOOL MD5_MANIFEST_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Reverts the md5sum name escaping ("\\" and "\n") in place.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacName - NUL terminated name to unescape
+**
+** Returns:
+**    BOOL - FALSE on an invalid escape sequence
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_MANIFEST_Unescape( char* pacName )
+{
+   char* pacOut = pacName;
+
+   for( ; *pacName != '\0'; pacName++ )
+   {
+      if( *pacName == '\\' )
+      {
+         pacName++;
+
+         if( *pacName == '\\' )
+         {
+            *pacOut++ = '\\';
+         }
+         else if( *pacName == 'n' )
+         {
+            *pacOut++ = '\n';
+         }
+         else
+         {
+            return FALSE;
+         }
+      }
+      else
+      {
+         *pacOut++ = *pacName;
+      }
+   }
+
+   *pacOut = '\0';
+
+   return TRUE;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Test number
+**    pacName    - Test name
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_MANIFEST_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "MANIFEST_TEST_%03d: %s\t: %s\n", bTestEntry, pacName,
+               fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Parses one manifest line in place. The line must not contain the line
+** terminator. Escaped names (line starting with a backslash) are unescaped.
+** A line holding nothing but a digest is accepted with an empty name.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacLine  - NUL terminated line, modified in place
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    ppacName - Receives a pointer to the file name within pacLine
+**
+** Returns:
+**    BOOL - FALSE if the line is improperly formatted
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MANIFEST_ParseLine( char* pacLine, UINT8* pbDigest, char** ppacName )
+{
+   BOOL fEscaped = FALSE;
+   size_t iLineLen;
+   char* pacName;
+
+   if( *pacLine == '\\' )
+   {
+      fEscaped = TRUE;
+      pacLine++;
+   }
+
+   iLineLen = strlen( pacLine );
+
+   if( strncmp( pacLine, "MD5 (", 5 ) == 0 )
+   {
+      /* BSD tagged format: MD5 (<name>) = <hex> */
+      const size_t iTrailerLen = 4 + MD5_FMT_HEX_LEN;
+
+      if( ( iLineLen < 5 + iTrailerLen ) ||
+          ( memcmp( &pacLine[ iLineLen - iTrailerLen ], ") = ", 4 ) != 0 ) ||
+          !MD5_FMT_DecodeHex( &pacLine[ iLineLen - MD5_FMT_HEX_LEN ], pbDigest ) )
+      {
+         return FALSE;
+      }
+
+      pacName                           = &pacLine[ 5 ];
+      pacLine[ iLineLen - iTrailerLen ] = '\0';
+   }
+   else
+   {
+      /* Default format: <hex>, a space, a space or '*' (binary), <name> */
+      if( ( iLineLen < MD5_FMT_HEX_LEN ) ||
+          !MD5_FMT_DecodeHex( pacLine, pbDigest ) )
+      {
+         return FALSE;
+      }
+
+      pacName = &pacLine[ MD5_FMT_HEX_LEN ];
+
+      if( *pacName != '\0' )
+      {
+         if( ( iLineLen < MD5_FMT_HEX_LEN + 3 ) || ( pacName[ 0 ] != ' ' ) ||
+             ( ( pacName[ 1 ] != ' ' ) && ( pacName[ 1 ] != '*' ) ) )
+         {
+            return FALSE;
+         }
+
+         pacName += 2;
+      }
+   }
+
+   if( fEscaped && !MD5_MANIFEST_Unescape( pacName ) )
+   {
+      return FALSE;
+   }
+
+   *ppacName = pacName;
+
+   return TRUE;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks MD5_MANIFEST_ParseLine() on lines in both formats, with and without
+** escaped names, and on lines it has to reject.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MANIFEST_RunTests( void )
+{
+   char acLine[ MD5_MANIFEST_TEST_LINE_SIZE ];
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+   BOOL fAllPassed = TRUE;
+   UINT8 bCase;
+
+   for( bCase = 0;
+        bCase < sizeof( MD5_MANIFEST_asTestCases ) / sizeof( MD5_MANIFEST_asTestCases[ 0 ] );
+        bCase++ )
+   {
+      const MD5_MANIFEST_TestCaseType* psCase = &MD5_MANIFEST_asTestCases[ bCase ];
+      char* pacName                           = NULL;
+      BOOL fParsed;
+      BOOL fPassed;
+
+      strcpy( acLine, psCase->pacLine );
+      fParsed = MD5_MANIFEST_ParseLine( acLine, abDigest, &pacName );
+
+      if( psCase->pacName == NULL )
+      {
+         fPassed = !fParsed;
+      }
+      else
+      {
+         fPassed = fParsed && ( strcmp( pacName, psCase->pacName ) == 0 ) &&
+                   ( memcmp( abDigest, MD5_MANIFEST_abTestDigest, MD5_DIGEST_SIZE ) == 0 );
+      }
+
+      fAllPassed = MD5_MANIFEST_ReportTest( bCase, psCase->pacDesc, fPassed ) && fAllPassed;
+   }
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
@@ -0,0 +1,55 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_manifest.h
+**    Summary: Parsing of digest manifests as written by md5sum, both in the
+**             default ("<hex>  <name>") and in the BSD tagged
+**             ("MD5 (<name>) = <hex>") format.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_MANIFEST_H_
+#define HMS_SC_MD5_MANIFEST_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Parses one manifest line in place. The line must not contain the line
+** terminator. Escaped names (line starting with a backslash) are unescaped.
+** A line holding nothing but a digest is accepted with an empty name.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacLine  - NUL terminated line, modified in place
+**    pbDigest - Receives the digest (MD5_DIGEST_SIZE bytes)
+**    ppacName - Receives a pointer to the file name within pacLine
+**
+** Returns:
+**    BOOL - FALSE if the line is improperly formatted
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MANIFEST_ParseLine( char* pacLine, UINT8* pbDigest, char** ppacName );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks MD5_MANIFEST_ParseLine() on lines in both formats, with and without
+** escaped names, and on lines it has to reject.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MANIFEST_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_MANIFEST_H_ */
@@ -0,0 +1,387 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_multi.c
+**    Summary: Multi-lane MD5. Every step of the RFC1321 algorithm is applied
+**             to all lanes in a fixed-length loop over plain arrays, a form
+**             that compilers vectorize without intrinsics. Lanes whose
+**             message is already complete keep running on a zero block and
+**             their result is masked out.
+**
+**             tools.ietf.org/html/rfc1321
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_multi.h"
+#include "MD5_port.h"
+
+#if( MD5_USE_BIG_ENDIAN == 1 )
+#error "This mode of operation is not yet supported!"
+#endif
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_MULTI_A                    ( 0 )
+#define MD5_MULTI_B                    ( 1 )
+#define MD5_MULTI_C                    ( 2 )
+#define MD5_MULTI_D                    ( 3 )
+
+/* Message words per block */
+#define MD5_MULTI_BLOCK_WORDS          ( MD5_BLOCK_SIZE >> 2 )
+
+/* Padding adds the 0x80 marker and the 64-bit message length */
+#define MD5_MULTI_PAD_OVERHEAD         ( 9U )
+
+#define MD5_MULTI_F( x, y, z )         ( ( (x) & (y) ) | ( ~(x) & (z) ) )
+#define MD5_MULTI_G( x, y, z )         ( ( (x) & (z) ) | ( (y) & ~(z) ) )
+#define MD5_MULTI_H( x, y, z )         ( (x) ^ (y) ^ (z) )
+#define MD5_MULTI_I( x, y, z )         ( (y) ^ ( (x) | ~(z) ) )
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/* Test message, long enough for three blocks at any lane offset */
+#define MD5_MULTI_TEST_MSG_SIZE        ( 3U * MD5_BLOCK_SIZE + MD5_MULTI_LANES )
+#endif
+
+/*------------------------------------------------------------------------------
+** One MD5 operation applied to all lanes.
+**
+** Reference: RFC1321 Section 3.4
+**------------------------------------------------------------------------------
+*/
+#define MD5_MULTI_STEP( f, a, b, c, d, k, s, t )                                    \
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )                               \
+   {                                                                                \
+      a[ bLane ] += f( b[ bLane ], c[ bLane ], d[ bLane ] ) + (UINT32)(t) +         \
+                    aadwX[ k ][ bLane ];                                            \
+      a[ bLane ] = ( ( a[ bLane ] << (s) ) | ( a[ bLane ] >> ( 32 - (s) ) ) ) +     \
+                   b[ bLane ];                                                      \
+   }
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+static void MD5_MULTI_ProcessBlock( UINT32 aadwState[][ MD5_MULTI_LANES ],
+                                    UINT32 aadwX[][ MD5_MULTI_LANES ],
+                                    const UINT32 adwMask[] );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Processes one (transposed) block per lane. Lanes with a zero mask are left
+** unchanged.
+**------------------------------------------------------------------------------
+** Arguments:
+**    aadwState - Registers A, B, C and D of every lane
+**    aadwX     - Block words, aadwX[ word ][ lane ]
+**    adwMask   - 0xFFFFFFFF for lanes to update, 0 for finished lanes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_MULTI_ProcessBlock( UINT32 aadwState[][ MD5_MULTI_LANES ],
+                                    UINT32 aadwX[][ MD5_MULTI_LANES ],
+                                    const UINT32 adwMask[] )
+{
+   UINT32 a[ MD5_MULTI_LANES ];
+   UINT32 b[ MD5_MULTI_LANES ];
+   UINT32 c[ MD5_MULTI_LANES ];
+   UINT32 d[ MD5_MULTI_LANES ];
+   UINT8 bLane;
+
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+   {
+      a[ bLane ] = aadwState[ MD5_MULTI_A ][ bLane ];
+      b[ bLane ] = aadwState[ MD5_MULTI_B ][ bLane ];
+      c[ bLane ] = aadwState[ MD5_MULTI_C ][ bLane ];
+      d[ bLane ] = aadwState[ MD5_MULTI_D ][ bLane ];
+   }
+
+   /* Round 1 */
+   MD5_MULTI_STEP( MD5_MULTI_F, a, b, c, d,  0,  7, 0xd76aa478 )
+   MD5_MULTI_STEP( MD5_MULTI_F, d, a, b, c,  1, 12, 0xe8c7b756 )
+   MD5_MULTI_STEP( MD5_MULTI_F, c, d, a, b,  2, 17, 0x242070db )
+   MD5_MULTI_STEP( MD5_MULTI_F, b, c, d, a,  3, 22, 0xc1bdceee )
+   MD5_MULTI_STEP( MD5_MULTI_F, a, b, c, d,  4,  7, 0xf57c0faf )
+   MD5_MULTI_STEP( MD5_MULTI_F, d, a, b, c,  5, 12, 0x4787c62a )
+   MD5_MULTI_STEP( MD5_MULTI_F, c, d, a, b,  6, 17, 0xa8304613 )
+   MD5_MULTI_STEP( MD5_MULTI_F, b, c, d, a,  7, 22, 0xfd469501 )
+   MD5_MULTI_STEP( MD5_MULTI_F, a, b, c, d,  8,  7, 0x698098d8 )
+   MD5_MULTI_STEP( MD5_MULTI_F, d, a, b, c,  9, 12, 0x8b44f7af )
+   MD5_MULTI_STEP( MD5_MULTI_F, c, d, a, b, 10, 17, 0xffff5bb1 )
+   MD5_MULTI_STEP( MD5_MULTI_F, b, c, d, a, 11, 22, 0x895cd7be )
+   MD5_MULTI_STEP( MD5_MULTI_F, a, b, c, d, 12,  7, 0x6b901122 )
+   MD5_MULTI_STEP( MD5_MULTI_F, d, a, b, c, 13, 12, 0xfd987193 )
+   MD5_MULTI_STEP( MD5_MULTI_F, c, d, a, b, 14, 17, 0xa679438e )
+   MD5_MULTI_STEP( MD5_MULTI_F, b, c, d, a, 15, 22, 0x49b40821 )
+
+   /* Round 2 */
+   MD5_MULTI_STEP( MD5_MULTI_G, a, b, c, d,  1,  5, 0xf61e2562 )
+   MD5_MULTI_STEP( MD5_MULTI_G, d, a, b, c,  6,  9, 0xc040b340 )
+   MD5_MULTI_STEP( MD5_MULTI_G, c, d, a, b, 11, 14, 0x265e5a51 )
+   MD5_MULTI_STEP( MD5_MULTI_G, b, c, d, a,  0, 20, 0xe9b6c7aa )
+   MD5_MULTI_STEP( MD5_MULTI_G, a, b, c, d,  5,  5, 0xd62f105d )
+   MD5_MULTI_STEP( MD5_MULTI_G, d, a, b, c, 10,  9, 0x02441453 )
+   MD5_MULTI_STEP( MD5_MULTI_G, c, d, a, b, 15, 14, 0xd8a1e681 )
+   MD5_MULTI_STEP( MD5_MULTI_G, b, c, d, a,  4, 20, 0xe7d3fbc8 )
+   MD5_MULTI_STEP( MD5_MULTI_G, a, b, c, d,  9,  5, 0x21e1cde6 )
+   MD5_MULTI_STEP( MD5_MULTI_G, d, a, b, c, 14,  9, 0xc33707d6 )
+   MD5_MULTI_STEP( MD5_MULTI_G, c, d, a, b,  3, 14, 0xf4d50d87 )
+   MD5_MULTI_STEP( MD5_MULTI_G, b, c, d, a,  8, 20, 0x455a14ed )
+   MD5_MULTI_STEP( MD5_MULTI_G, a, b, c, d, 13,  5, 0xa9e3e905 )
+   MD5_MULTI_STEP( MD5_MULTI_G, d, a, b, c,  2,  9, 0xfcefa3f8 )
+   MD5_MULTI_STEP( MD5_MULTI_G, c, d, a, b,  7, 14, 0x676f02d9 )
+   MD5_MULTI_STEP( MD5_MULTI_G, b, c, d, a, 12, 20, 0x8d2a4c8a )
+
+   /* Round 3 */
+   MD5_MULTI_STEP( MD5_MULTI_H, a, b, c, d,  5,  4, 0xfffa3942 )
+   MD5_MULTI_STEP( MD5_MULTI_H, d, a, b, c,  8, 11, 0x8771f681 )
+   MD5_MULTI_STEP( MD5_MULTI_H, c, d, a, b, 11, 16, 0x6d9d6122 )
+   MD5_MULTI_STEP( MD5_MULTI_H, b, c, d, a, 14, 23, 0xfde5380c )
+   MD5_MULTI_STEP( MD5_MULTI_H, a, b, c, d,  1,  4, 0xa4beea44 )
+   MD5_MULTI_STEP( MD5_MULTI_H, d, a, b, c,  4, 11, 0x4bdecfa9 )
+   MD5_MULTI_STEP( MD5_MULTI_H, c, d, a, b,  7, 16, 0xf6bb4b60 )
+   MD5_MULTI_STEP( MD5_MULTI_H, b, c, d, a, 10, 23, 0xbebfbc70 )
+   MD5_MULTI_STEP( MD5_MULTI_H, a, b, c, d, 13,  4, 0x289b7ec6 )
+   MD5_MULTI_STEP( MD5_MULTI_H, d, a, b, c,  0, 11, 0xeaa127fa )
+   MD5_MULTI_STEP( MD5_MULTI_H, c, d, a, b,  3, 16, 0xd4ef3085 )
+   MD5_MULTI_STEP( MD5_MULTI_H, b, c, d, a,  6, 23, 0x04881d05 )
+   MD5_MULTI_STEP( MD5_MULTI_H, a, b, c, d,  9,  4, 0xd9d4d039 )
+   MD5_MULTI_STEP( MD5_MULTI_H, d, a, b, c, 12, 11, 0xe6db99e5 )
+   MD5_MULTI_STEP( MD5_MULTI_H, c, d, a, b, 15, 16, 0x1fa27cf8 )
+   MD5_MULTI_STEP( MD5_MULTI_H, b, c, d, a,  2, 23, 0xc4ac5665 )
+
+   /* Round 4 */
+   MD5_MULTI_STEP( MD5_MULTI_I, a, b, c, d,  0,  6, 0xf4292244 )
+   MD5_MULTI_STEP( MD5_MULTI_I, d, a, b, c,  7, 10, 0x432aff97 )
+   MD5_MULTI_STEP( MD5_MULTI_I, c, d, a, b, 14, 15, 0xab9423a7 )
+   MD5_MULTI_STEP( MD5_MULTI_I, b, c, d, a,  5, 21, 0xfc93a039 )
+   MD5_MULTI_STEP( MD5_MULTI_I, a, b, c, d, 12,  6, 0x655b59c3 )
+   MD5_MULTI_STEP( MD5_MULTI_I, d, a, b, c,  3, 10, 0x8f0ccc92 )
+   MD5_MULTI_STEP( MD5_MULTI_I, c, d, a, b, 10, 15, 0xffeff47d )
+   MD5_MULTI_STEP( MD5_MULTI_I, b, c, d, a,  1, 21, 0x85845dd1 )
+   MD5_MULTI_STEP( MD5_MULTI_I, a, b, c, d,  8,  6, 0x6fa87e4f )
+   MD5_MULTI_STEP( MD5_MULTI_I, d, a, b, c, 15, 10, 0xfe2ce6e0 )
+   MD5_MULTI_STEP( MD5_MULTI_I, c, d, a, b,  6, 15, 0xa3014314 )
+   MD5_MULTI_STEP( MD5_MULTI_I, b, c, d, a, 13, 21, 0x4e0811a1 )
+   MD5_MULTI_STEP( MD5_MULTI_I, a, b, c, d,  4,  6, 0xf7537e82 )
+   MD5_MULTI_STEP( MD5_MULTI_I, d, a, b, c, 11, 10, 0xbd3af235 )
+   MD5_MULTI_STEP( MD5_MULTI_I, c, d, a, b,  2, 15, 0x2ad7d2bb )
+   MD5_MULTI_STEP( MD5_MULTI_I, b, c, d, a,  9, 21, 0xeb86d391 )
+
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+   {
+      aadwState[ MD5_MULTI_A ][ bLane ] += a[ bLane ] & adwMask[ bLane ];
+      aadwState[ MD5_MULTI_B ][ bLane ] += b[ bLane ] & adwMask[ bLane ];
+      aadwState[ MD5_MULTI_C ][ bLane ] += c[ bLane ] & adwMask[ bLane ];
+      aadwState[ MD5_MULTI_D ][ bLane ] += d[ bLane ] & adwMask[ bLane ];
+   }
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the digests of up to MD5_MULTI_LANES complete messages. Lanes are
+** kept in lockstep until the longest message is done, so the messages should
+** have similar lengths for best throughput.
+**------------------------------------------------------------------------------
+** Arguments:
+**    apbMsg    - Messages to hash
+**    adwMsgLen - Length of each message in bytes
+**    aabDigest - Receives the digest of each message
+**    bNumMsgs  - Number of messages (1..MD5_MULTI_LANES)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_MULTI_Compute( const UINT8* const apbMsg[], const UINT32 adwMsgLen[],
+                        UINT8 aabDigest[][ MD5_DIGEST_SIZE ], UINT8 bNumMsgs )
+{
+   static const UINT8 abZeroBlock[ MD5_BLOCK_SIZE ] = { 0 };
+
+   UINT32 aadwState[ MD5_DIGEST_SIZE_DWORDS ][ MD5_MULTI_LANES ];
+   UINT32 aadwX[ MD5_MULTI_BLOCK_WORDS ][ MD5_MULTI_LANES ];
+   UINT32 adwMask[ MD5_MULTI_LANES ];
+   UINT32 adwFullBlocks[ MD5_MULTI_LANES ];
+   UINT32 adwNumBlocks[ MD5_MULTI_LANES ];
+   UINT8 aabTail[ MD5_MULTI_LANES ][ 2 * MD5_BLOCK_SIZE ];
+   UINT32 dwMaxBlocks = 0;
+   UINT32 dwBlock;
+   UINT8 bLane;
+   UINT8 bWord;
+
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+   {
+      aadwState[ MD5_MULTI_A ][ bLane ] = 0x67452301;
+      aadwState[ MD5_MULTI_B ][ bLane ] = 0xEFCDAB89;
+      aadwState[ MD5_MULTI_C ][ bLane ] = 0x98BADCFE;
+      aadwState[ MD5_MULTI_D ][ bLane ] = 0x10325476;
+
+      adwFullBlocks[ bLane ] = 0;
+      adwNumBlocks[ bLane ]  = 0;
+
+      if( bLane < bNumMsgs )
+      {
+         UINT32 dwTailLen = adwMsgLen[ bLane ] % MD5_BLOCK_SIZE;
+         UINT64 lBitLen   = (UINT64)adwMsgLen[ bLane ] << 3;
+         UINT32 dwTailEnd;
+         UINT8 bByte;
+
+         adwFullBlocks[ bLane ] = adwMsgLen[ bLane ] / MD5_BLOCK_SIZE;
+         adwNumBlocks[ bLane ]  =
+            ( adwMsgLen[ bLane ] + MD5_MULTI_PAD_OVERHEAD + MD5_BLOCK_SIZE - 1 ) / MD5_BLOCK_SIZE;
+         dwTailEnd = ( adwNumBlocks[ bLane ] - adwFullBlocks[ bLane ] ) * MD5_BLOCK_SIZE;
+
+         /* The partial last block, the 0x80 marker, zero padding and the bit length */
+         memset( aabTail[ bLane ], 0, sizeof( aabTail[ bLane ] ) );
+         memcpy( aabTail[ bLane ], &apbMsg[ bLane ][ adwFullBlocks[ bLane ] * MD5_BLOCK_SIZE ],
+                 dwTailLen );
+         aabTail[ bLane ][ dwTailLen ] = 0x80;
+
+         for( bByte = 0; bByte < 8; bByte++ )
+         {
+            aabTail[ bLane ][ dwTailEnd - 8 + bByte ] = (UINT8)( lBitLen >> ( 8 * bByte ) );
+         }
+
+         if( adwNumBlocks[ bLane ] > dwMaxBlocks )
+         {
+            dwMaxBlocks = adwNumBlocks[ bLane ];
+         }
+      }
+   }
+
+   for( dwBlock = 0; dwBlock < dwMaxBlocks; dwBlock++ )
+   {
+      for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+      {
+         const UINT8* pbBlock = abZeroBlock;
+
+         if( dwBlock < adwFullBlocks[ bLane ] )
+         {
+            pbBlock = &apbMsg[ bLane ][ dwBlock * MD5_BLOCK_SIZE ];
+         }
+         else if( dwBlock < adwNumBlocks[ bLane ] )
+         {
+            pbBlock = &aabTail[ bLane ][ ( dwBlock - adwFullBlocks[ bLane ] ) * MD5_BLOCK_SIZE ];
+         }
+
+         adwMask[ bLane ] = ( dwBlock < adwNumBlocks[ bLane ] ) ? 0xFFFFFFFF : 0;
+
+         for( bWord = 0; bWord < MD5_MULTI_BLOCK_WORDS; bWord++ )
+         {
+            memcpy( &aadwX[ bWord ][ bLane ], &pbBlock[ bWord << 2 ], sizeof( UINT32 ) );
+         }
+      }
+
+      MD5_MULTI_ProcessBlock( aadwState, aadwX, adwMask );
+   }
+
+   for( bLane = 0; bLane < bNumMsgs; bLane++ )
+   {
+      for( bWord = 0; bWord < MD5_DIGEST_SIZE_DWORDS; bWord++ )
+      {
+         memcpy( &aabDigest[ bLane ][ bWord << 2 ], &aadwState[ bWord ][ bLane ],
+                 sizeof( UINT32 ) );
+      }
+   }
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks MD5_MULTI_Compute() against MD5_Init(), MD5_Update() and
+** MD5_Final() for messages of odd lengths, lengths around the block size and
+** the padding limit, unaligned message addresses and partly used lanes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MULTI_RunTests( void )
+{
+   /* Message lengths per test, one row of lanes each */
+   static const UINT32 aadwLengths[][ MD5_MULTI_LANES ] =
+   {
+      { 0, 1, 3, 55, 56, 57, 63, 64 },
+      { 65, 119, 120, 127, 128, 129, 191, 192 },
+      { 193, 7, 130, 64, 0, 100, 3 * MD5_BLOCK_SIZE, 1 }
+   };
+   /* Lanes used by each test */
+   static const UINT8 abNumMsgs[] = { MD5_MULTI_LANES, MD5_MULTI_LANES, 3 };
+
+   UINT8 abMsg[ MD5_MULTI_TEST_MSG_SIZE ];
+   UINT8 aabDigest[ MD5_MULTI_LANES ][ MD5_DIGEST_SIZE ];
+   const UINT8* apbMsg[ MD5_MULTI_LANES ];
+   BOOL fAllPassed = TRUE;
+   MD5_InstType sInst;
+   UINT16 iByte;
+   UINT8 bTest;
+   UINT8 bLane;
+
+   for( iByte = 0; iByte < MD5_MULTI_TEST_MSG_SIZE; iByte++ )
+   {
+      abMsg[ iByte ] = (UINT8)( iByte * 7 + 1 );
+   }
+
+   /* Every lane starts at its own, mostly unaligned, offset */
+   for( bLane = 0; bLane < MD5_MULTI_LANES; bLane++ )
+   {
+      apbMsg[ bLane ] = &abMsg[ bLane ];
+   }
+
+   for( bTest = 0; bTest < sizeof( abNumMsgs ); bTest++ )
+   {
+      BOOL fMismatch = FALSE;
+
+      MD5_PRINTF( "MULTI_TEST_%03d: LANES = %u\t: ", bTest, (unsigned)abNumMsgs[ bTest ] );
+
+      MD5_MULTI_Compute( apbMsg, aadwLengths[ bTest ], aabDigest, abNumMsgs[ bTest ] );
+
+      for( bLane = 0; bLane < abNumMsgs[ bTest ]; bLane++ )
+      {
+         MD5_Init( &sInst );
+         MD5_Update( &sInst, apbMsg[ bLane ], (UINT16)aadwLengths[ bTest ][ bLane ] );
+         MD5_Final( &sInst );
+
+         if( MD5_MEMCMP( aabDigest[ bLane ], sInst.adwDigest, MD5_DIGEST_SIZE ) != 0 )
+         {
+            fMismatch = TRUE;
+         }
+      }
+
+      if( fMismatch )
+      {
+         fAllPassed = FALSE;
+         MD5_PRINTF( "FAILED\n" );
+      }
+      else
+      {
+         MD5_PRINTF( "PASSED\n" );
+      }
+   }
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
@@ -0,0 +1,66 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_multi.h
+**    Summary: Multi-lane MD5 that computes the digests of several independent
+**             messages at once. The lanes are processed in lockstep so the
+**             compiler can map them onto SIMD registers, which keeps the
+**             cores busy when many small messages (files) have to be hashed.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_MULTI_H_
+#define HMS_SC_MD5_MULTI_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_MULTI_LANES                ( 8U )
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the digests of up to MD5_MULTI_LANES complete messages. Lanes are
+** kept in lockstep until the longest message is done, so the messages should
+** have similar lengths for best throughput.
+**------------------------------------------------------------------------------
+** Arguments:
+**    apbMsg    - Messages to hash
+**    adwMsgLen - Length of each message in bytes
+**    aabDigest - Receives the digest of each message
+**    bNumMsgs  - Number of messages (1..MD5_MULTI_LANES)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_MULTI_Compute( const UINT8* const apbMsg[], const UINT32 adwMsgLen[],
+                        UINT8 aabDigest[][ MD5_DIGEST_SIZE ], UINT8 bNumMsgs );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks MD5_MULTI_Compute() against MD5_Init(), MD5_Update() and
+** MD5_Final() for messages of odd lengths, lengths around the block size and
+** the padding limit, unaligned message addresses and partly used lanes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_MULTI_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_MULTI_H_ */
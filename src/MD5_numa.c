@@ -0,0 +1,483 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_numa.c
+**    Summary: CPU and NUMA node topology from sysfs, thread pinning and
+**             node-local memory.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* pthread_setaffinity_np(), CPU_SET(), syscall() */
+#endif
+
+#include "MD5_numa.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined( __linux__ )
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+/*
+** mbind() arguments (linux/mempolicy.h, which glibc doesn't wrap)
+*/
+#define MD5_NUMA_MPOL_PREFERRED        ( 1 )
+#define MD5_NUMA_MPOL_MF_MOVE          ( 1U << 1 )
+
+#define MD5_NUMA_BITS_PER_LONG         ( 8U * sizeof( unsigned long ) )
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+#if defined( __linux__ )
+static BOOL MD5_NUMA_ReadFile( const char* pacPath, char* pacText, size_t iSize );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+#if defined( __linux__ )
+/*------------------------------------------------------------------------------
+** Reads a small sysfs file as a string without its trailing newline.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacPath - File to read
+**    pacText - Receives the content
+**    iSize   - Room in pacText
+**
+** Returns:
+**    BOOL - FALSE if the file could not be read (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_NUMA_ReadFile( const char* pacPath, char* pacText, size_t iSize )
+{
+   int iFd = open( pacPath, O_RDONLY | O_CLOEXEC );
+   ssize_t iLength;
+
+   if( iFd < 0 )
+   {
+      return FALSE;
+   }
+
+   iLength = read( iFd, pacText, iSize - 1 );
+   close( iFd );
+
+   if( iLength < 0 )
+   {
+      return FALSE;
+   }
+
+   while( ( iLength > 0 ) && isspace( (unsigned char)pacText[ iLength - 1 ] ) )
+   {
+      iLength--;
+   }
+
+   pacText[ iLength ] = '\0';
+
+   return TRUE;
+}
+#endif
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Parses a list of numbers and ranges in the sysfs and taskset format, such
+** as "0-3,8,10-11". The numbers are returned in list order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacList - List to parse
+**    dwLimit - Every number must be below this
+**    aiItems - Receives the numbers
+**    iMax    - Room in aiItems
+**    piNum   - Receives the number of items
+**
+** Returns:
+**    BOOL - FALSE if the list is malformed, empty, has a number out of range
+**           or more than iMax items
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_ParseList( const char* pacList, UINT32 dwLimit, UINT16* aiItems, UINT16 iMax,
+                         UINT16* piNum )
+{
+   const char* pacPos = pacList;
+
+   *piNum = 0;
+
+   while( TRUE )
+   {
+      unsigned long dwFirst;
+      unsigned long dwLast;
+      char* pacEnd;
+
+      if( !isdigit( (unsigned char)*pacPos ) )
+      {
+         return FALSE;
+      }
+
+      dwFirst = strtoul( pacPos, &pacEnd, 10 );
+      dwLast  = dwFirst;
+
+      if( *pacEnd == '-' )
+      {
+         pacPos = pacEnd + 1;
+
+         if( !isdigit( (unsigned char)*pacPos ) )
+         {
+            return FALSE;
+         }
+
+         dwLast = strtoul( pacPos, &pacEnd, 10 );
+      }
+
+      if( ( dwFirst > dwLast ) || ( dwLast >= dwLimit ) )
+      {
+         return FALSE;
+      }
+
+      for( ; dwFirst <= dwLast; dwFirst++ )
+      {
+         if( *piNum == iMax )
+         {
+            return FALSE;
+         }
+
+         aiItems[ ( *piNum )++ ] = (UINT16)dwFirst;
+      }
+
+      if( *pacEnd != ',' )
+      {
+         return ( *pacEnd == '\0' );
+      }
+
+      pacPos = pacEnd + 1;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Gets the CPUs of a node.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iNode  - Node number
+**    psCpus - Receives the CPUs of the node
+**
+** Returns:
+**    BOOL - FALSE if the node doesn't exist or has no CPUs (errno is set,
+**           ENOSYS on hosts other than Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_GetNodeCpus( UINT16 iNode, MD5_NUMA_CpuSetType* psCpus )
+{
+#if defined( __linux__ )
+   UINT16 aiCpus[ MD5_NUMA_MAX_CPUS ];
+   char acPath[ 64 ];
+   char acList[ 4096 ];
+   UINT16 iNumCpus;
+   UINT16 iCpu;
+
+   memset( psCpus, 0, sizeof( *psCpus ) );
+   snprintf( acPath, sizeof( acPath ), "/sys/devices/system/node/node%u/cpulist", iNode );
+
+   if( !MD5_NUMA_ReadFile( acPath, acList, sizeof( acList ) ) )
+   {
+      return FALSE;
+   }
+
+   /* A node with memory only has an empty list */
+   if( !MD5_NUMA_ParseList( acList, MD5_NUMA_MAX_CPUS, aiCpus, MD5_NUMA_MAX_CPUS, &iNumCpus ) )
+   {
+      errno = ENOENT;
+      return FALSE;
+   }
+
+   for( iCpu = 0; iCpu < iNumCpus; iCpu++ )
+   {
+      MD5_NUMA_SET_CPU( psCpus, aiCpus[ iCpu ] );
+   }
+
+   return TRUE;
+#else
+   (void)iNode;
+   memset( psCpus, 0, sizeof( *psCpus ) );
+   errno = ENOSYS;
+   return FALSE;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+** Returns the node a CPU belongs to.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iCpu - CPU number
+**
+** Returns:
+**    int - Node number, -1 if unknown
+**------------------------------------------------------------------------------
+*/
+int MD5_NUMA_GetCpuNode( UINT16 iCpu )
+{
+#if defined( __linux__ )
+   char acPath[ 64 ];
+   struct dirent* psEntry;
+   int iNode = -1;
+   DIR* psDir;
+
+   /* The CPU directory has a nodeN link to its node */
+   snprintf( acPath, sizeof( acPath ), "/sys/devices/system/cpu/cpu%u", iCpu );
+   psDir = opendir( acPath );
+
+   if( psDir == NULL )
+   {
+      return -1;
+   }
+
+   while( ( iNode < 0 ) && ( ( psEntry = readdir( psDir ) ) != NULL ) )
+   {
+      if( ( strncmp( psEntry->d_name, "node", 4 ) == 0 ) &&
+          isdigit( (unsigned char)psEntry->d_name[ 4 ] ) )
+      {
+         iNode = atoi( &psEntry->d_name[ 4 ] );
+      }
+   }
+
+   closedir( psDir );
+
+   return iNode;
+#else
+   (void)iCpu;
+   return -1;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+** Returns the node the controller of a block device is attached to. The
+** device path in sysfs is followed up to the first ancestor (the PCI
+** function of an NVMe drive or HBA) that knows its node.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lDevice - Device number (st_dev of a file on it)
+**
+** Returns:
+**    int - Node number, -1 if unknown (no block device, as for tmpfs or
+**          network file systems, or a virtual one such as device-mapper)
+**------------------------------------------------------------------------------
+*/
+int MD5_NUMA_GetDeviceNode( UINT64 lDevice )
+{
+#if defined( __linux__ )
+   char acLink[ 64 ];
+   char acPath[ PATH_MAX + 16 ];
+   char acNode[ 16 ];
+   size_t iLength;
+
+   if( major( (dev_t)lDevice ) == 0 )
+   {
+      return -1;
+   }
+
+   snprintf( acLink, sizeof( acLink ), "/sys/dev/block/%u:%u", major( (dev_t)lDevice ),
+             minor( (dev_t)lDevice ) );
+
+   if( realpath( acLink, acPath ) == NULL )
+   {
+      return -1;
+   }
+
+   /* Partitions, disks and controllers are nested below their PCI device */
+   for( iLength = strlen( acPath ); iLength > sizeof( "/sys/devices" ); )
+   {
+      strcpy( &acPath[ iLength ], "/numa_node" );
+
+      if( MD5_NUMA_ReadFile( acPath, acNode, sizeof( acNode ) ) )
+      {
+         return atoi( acNode );
+      }
+
+      while( ( iLength > 0 ) && ( acPath[ --iLength ] != '/' ) )
+      {
+      }
+   }
+
+   return -1;
+#else
+   (void)lDevice;
+   return -1;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+** Restricts a thread to a set of CPUs.
+**------------------------------------------------------------------------------
+** Arguments:
+**    sThread - Thread to pin
+**    psCpus  - CPUs the thread may run on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts other than
+**           Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_PinThread( pthread_t sThread, const MD5_NUMA_CpuSetType* psCpus )
+{
+#if defined( __linux__ )
+   cpu_set_t sSet;
+   UINT32 dwCpu;
+   int iError;
+
+   CPU_ZERO( &sSet );
+
+   for( dwCpu = 0; ( dwCpu < MD5_NUMA_MAX_CPUS ) && ( dwCpu < CPU_SETSIZE ); dwCpu++ )
+   {
+      if( MD5_NUMA_HAS_CPU( psCpus, dwCpu ) )
+      {
+         CPU_SET( dwCpu, &sSet );
+      }
+   }
+
+   iError = pthread_setaffinity_np( sThread, sizeof( sSet ), &sSet );
+
+   if( iError != 0 )
+   {
+      errno = iError;
+      return FALSE;
+   }
+
+   return TRUE;
+#else
+   (void)sThread;
+   (void)psCpus;
+   errno = ENOSYS;
+   return FALSE;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+** Allocates zeroed memory whose pages are placed on a node when they are
+** first touched. The node is a preference: when it runs out of memory, the
+** pages come from another one.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSize - Bytes to allocate
+**    iNode - Node to place the pages on, -1 for the default placement
+**
+** Returns:
+**    void* - Allocated memory (free with MD5_NUMA_Free()), NULL if out of
+**            memory
+**------------------------------------------------------------------------------
+*/
+void* MD5_NUMA_Alloc( size_t iSize, int iNode )
+{
+   void* pxMem = mmap( NULL, iSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+   if( pxMem == MAP_FAILED )
+   {
+      return NULL;
+   }
+
+   if( iNode >= 0 )
+   {
+      /* Unplaced memory still works */
+      (void)MD5_NUMA_Bind( pxMem, iSize, iNode );
+   }
+
+   return pxMem;
+}
+
+/*------------------------------------------------------------------------------
+** Frees memory allocated with MD5_NUMA_Alloc().
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxMem - Memory to free, or NULL
+**    iSize - Size it was allocated with
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_NUMA_Free( void* pxMem, size_t iSize )
+{
+   if( pxMem != NULL )
+   {
+      munmap( pxMem, iSize );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Prefers a node for the whole pages of an existing allocation (such as a
+** malloc()ed buffer) and moves those already touched there.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxMem - Start of the memory
+**    iSize - Bytes of memory
+**    iNode - Node to place the pages on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts other than
+**           Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_Bind( void* pxMem, size_t iSize, int iNode )
+{
+#if defined( __linux__ )
+   unsigned long alNodes[ MD5_NUMA_MAX_NODES / MD5_NUMA_BITS_PER_LONG ];
+   uintptr_t iPageSize = (uintptr_t)sysconf( _SC_PAGESIZE );
+   uintptr_t iStart    = ( (uintptr_t)pxMem + iPageSize - 1 ) & ~( iPageSize - 1 );
+   uintptr_t iEnd      = ( (uintptr_t)pxMem + iSize ) & ~( iPageSize - 1 );
+
+   if( ( iNode < 0 ) || ( (UINT32)iNode >= MD5_NUMA_MAX_NODES ) )
+   {
+      errno = EINVAL;
+      return FALSE;
+   }
+
+   /* Pages shared with neighbouring allocations are left where they are */
+   if( iEnd <= iStart )
+   {
+      return TRUE;
+   }
+
+   memset( alNodes, 0, sizeof( alNodes ) );
+   alNodes[ iNode / MD5_NUMA_BITS_PER_LONG ] = 1UL << ( iNode % MD5_NUMA_BITS_PER_LONG );
+
+   /* The kernel drops the last bit of maxnode */
+   return ( syscall( SYS_mbind, iStart, iEnd - iStart, MD5_NUMA_MPOL_PREFERRED, alNodes,
+                     MD5_NUMA_MAX_NODES + 1, MD5_NUMA_MPOL_MF_MOVE ) == 0 );
+#else
+   (void)pxMem;
+   (void)iSize;
+   (void)iNode;
+   errno = ENOSYS;
+   return FALSE;
+#endif
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
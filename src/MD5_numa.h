@@ -0,0 +1,182 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_numa.h
+**    Summary: CPU and NUMA node topology for placing the workers of the
+**             parallel modes: which CPUs belong to a node, which node a CPU
+**             or the controller of a block device is attached to, pinning a
+**             thread to CPUs and allocating memory on a node.
+**
+**             The topology is read from sysfs and memory is placed with the
+**             mbind() system call, so no NUMA library is needed. Other hosts
+**             report every node as unknown (-1) and pinning and binding fail
+**             with ENOSYS; memory is still allocated, just not placed.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_NUMA_H_
+#define HMS_SC_MD5_NUMA_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_NUMA_MAX_CPUS              ( 1024U )
+#define MD5_NUMA_MAX_NODES             ( 64U )
+
+/*
+** CPU set operations
+*/
+#define MD5_NUMA_SET_CPU( psSet, iCpu ) \
+   ( ( psSet )->alMask[ ( iCpu ) / 64U ] |= (UINT64)1 << ( ( iCpu ) % 64U ) )
+#define MD5_NUMA_HAS_CPU( psSet, iCpu ) \
+   ( ( ( psSet )->alMask[ ( iCpu ) / 64U ] >> ( ( iCpu ) % 64U ) ) & 1U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_NUMA_CpuSet
+{
+   UINT64 alMask[ MD5_NUMA_MAX_CPUS / 64U ];
+} MD5_NUMA_CpuSetType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Parses a list of numbers and ranges in the sysfs and taskset format, such
+** as "0-3,8,10-11". The numbers are returned in list order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacList - List to parse
+**    dwLimit - Every number must be below this
+**    aiItems - Receives the numbers
+**    iMax    - Room in aiItems
+**    piNum   - Receives the number of items
+**
+** Returns:
+**    BOOL - FALSE if the list is malformed, empty, has a number out of range
+**           or more than iMax items
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_ParseList( const char* pacList, UINT32 dwLimit, UINT16* aiItems, UINT16 iMax,
+                         UINT16* piNum );
+
+/*------------------------------------------------------------------------------
+** Gets the CPUs of a node.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iNode  - Node number
+**    psCpus - Receives the CPUs of the node
+**
+** Returns:
+**    BOOL - FALSE if the node doesn't exist or has no CPUs (errno is set,
+**           ENOSYS on hosts other than Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_GetNodeCpus( UINT16 iNode, MD5_NUMA_CpuSetType* psCpus );
+
+/*------------------------------------------------------------------------------
+** Returns the node a CPU belongs to.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iCpu - CPU number
+**
+** Returns:
+**    int - Node number, -1 if unknown
+**------------------------------------------------------------------------------
+*/
+int MD5_NUMA_GetCpuNode( UINT16 iCpu );
+
+/*------------------------------------------------------------------------------
+** Returns the node the controller of a block device is attached to. The
+** device path in sysfs is followed up to the first ancestor (the PCI
+** function of an NVMe drive or HBA) that knows its node.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lDevice - Device number (st_dev of a file on it)
+**
+** Returns:
+**    int - Node number, -1 if unknown (no block device, as for tmpfs or
+**          network file systems, or a virtual one such as device-mapper)
+**------------------------------------------------------------------------------
+*/
+int MD5_NUMA_GetDeviceNode( UINT64 lDevice );
+
+/*------------------------------------------------------------------------------
+** Restricts a thread to a set of CPUs.
+**------------------------------------------------------------------------------
+** Arguments:
+**    sThread - Thread to pin
+**    psCpus  - CPUs the thread may run on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts other than
+**           Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_PinThread( pthread_t sThread, const MD5_NUMA_CpuSetType* psCpus );
+
+/*------------------------------------------------------------------------------
+** Allocates zeroed memory whose pages are placed on a node when they are
+** first touched. The node is a preference: when it runs out of memory, the
+** pages come from another one.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSize - Bytes to allocate
+**    iNode - Node to place the pages on, -1 for the default placement
+**
+** Returns:
+**    void* - Allocated memory (free with MD5_NUMA_Free()), NULL if out of
+**            memory
+**------------------------------------------------------------------------------
+*/
+void* MD5_NUMA_Alloc( size_t iSize, int iNode );
+
+/*------------------------------------------------------------------------------
+** Frees memory allocated with MD5_NUMA_Alloc().
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxMem - Memory to free, or NULL
+**    iSize - Size it was allocated with
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_NUMA_Free( void* pxMem, size_t iSize );
+
+/*------------------------------------------------------------------------------
+** Prefers a node for the whole pages of an existing allocation (such as a
+** malloc()ed buffer) and moves those already touched there.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxMem - Start of the memory
+**    iSize - Bytes of memory
+**    iNode - Node to place the pages on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts other than
+**           Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_NUMA_Bind( void* pxMem, size_t iSize, int iNode );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_NUMA_H_ */
@@ -0,0 +1,336 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_piece.c
+**    Summary: Parallel piece hashing. One job per worker claims pieces from
+**             a shared cursor until none are left and reads each piece with
+**             pread(), so no file position is shared between the workers.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_piece.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_PIECE_Ctx
+{
+   MD5_IO_WorkerType** apsWorkers;
+   MD5_PIECE_ResultType* asResults;
+   int iFd;
+   UINT64 lSize;
+   UINT32 dwPieceSize;
+   int iLeadByte;     /* MD5_PIECE_NO_LEAD_BYTE if none */
+   UINT64 lNumPieces;
+   UINT64 lNextPiece; /* Next piece to claim, protected by sLock */
+   pthread_mutex_t sLock;
+} MD5_PIECE_CtxType;
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static BOOL MD5_PIECE_Claim( MD5_PIECE_CtxType* psCtx, UINT64* plPiece );
+static void MD5_PIECE_HashPiece( MD5_PIECE_CtxType* psCtx, MD5_IO_WorkerType* psWorker,
+                                 UINT64 lPiece );
+static void MD5_PIECE_Job( void* pxArg, UINT16 iWorker );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Claims the next piece to hash.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCtx   - Hashing context
+**    plPiece - Receives the piece index
+**
+** Returns:
+**    BOOL - FALSE once all pieces are claimed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_PIECE_Claim( MD5_PIECE_CtxType* psCtx, UINT64* plPiece )
+{
+   BOOL fClaimed;
+
+   pthread_mutex_lock( &psCtx->sLock );
+
+   fClaimed = ( psCtx->lNextPiece < psCtx->lNumPieces );
+
+   if( fClaimed )
+   {
+      *plPiece = psCtx->lNextPiece++;
+   }
+
+   pthread_mutex_unlock( &psCtx->sLock );
+
+   return fClaimed;
+}
+
+/*------------------------------------------------------------------------------
+** Hashes one piece with the worker's MD5 instance.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psCtx    - Hashing context
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    lPiece   - Index of the piece
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_PIECE_HashPiece( MD5_PIECE_CtxType* psCtx, MD5_IO_WorkerType* psWorker,
+                                 UINT64 lPiece )
+{
+   MD5_PIECE_ResultType* psResult = &psCtx->asResults[ lPiece ];
+   UINT64 lOffset                 = lPiece * psCtx->dwPieceSize;
+   UINT64 lRemaining              = psCtx->lSize - lOffset;
+
+   if( lRemaining > psCtx->dwPieceSize )
+   {
+      lRemaining = psCtx->dwPieceSize;
+   }
+
+   psResult->iError = 0;
+
+   MD5_Init( &psWorker->sInst );
+
+   if( psCtx->iLeadByte != MD5_PIECE_NO_LEAD_BYTE )
+   {
+      MD5_UpdateByte( &psWorker->sInst, (UINT8)psCtx->iLeadByte, 1 );
+   }
+
+   while( lRemaining > 0 )
+   {
+      size_t iChunk      =
+         ( lRemaining < psWorker->dwBufferSize ) ? (size_t)lRemaining : psWorker->dwBufferSize;
+      ssize_t iBytesRead = pread( psCtx->iFd, psWorker->pbBuffer, iChunk, (off_t)lOffset );
+
+      if( iBytesRead > 0 )
+      {
+         MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+         lOffset += (UINT64)iBytesRead;
+         lRemaining -= (UINT64)iBytesRead;
+      }
+      else if( iBytesRead == 0 )
+      {
+         /* The file shrank while it was being hashed */
+         psResult->iError = EIO;
+         return;
+      }
+      else if( errno != EINTR )
+      {
+         psResult->iError = errno;
+         return;
+      }
+   }
+
+   MD5_Final( &psWorker->sInst );
+   memcpy( psResult->abDigest, psWorker->sInst.adwDigest, MD5_DIGEST_SIZE );
+}
+
+/*------------------------------------------------------------------------------
+** Pool job, hashes pieces until all of them are claimed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Hashing context
+**    iWorker - Index of the executing worker
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_PIECE_Job( void* pxArg, UINT16 iWorker )
+{
+   MD5_PIECE_CtxType* psCtx = (MD5_PIECE_CtxType*)pxArg;
+   UINT64 lPiece;
+
+   while( MD5_PIECE_Claim( psCtx, &lPiece ) )
+   {
+      MD5_PIECE_HashPiece( psCtx, psCtx->apsWorkers[ iWorker ], lPiece );
+   }
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of pieces a file is split into. The last piece may be
+** shorter than the others.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lSize       - File size in bytes
+**    dwPieceSize - Piece size in bytes
+**
+** Returns:
+**    UINT64 - Number of pieces (0 for an empty file)
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_PIECE_GetNumPieces( UINT64 lSize, UINT32 dwPieceSize )
+{
+   return ( lSize + dwPieceSize - 1 ) / dwPieceSize;
+}
+
+/*------------------------------------------------------------------------------
+** Returns the size of a regular file or block device.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iFd    - Open file descriptor
+**    plSize - Receives the size in bytes
+**
+** Returns:
+**    BOOL - FALSE if the size could not be determined (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_PIECE_GetSize( int iFd, UINT64* plSize )
+{
+   struct stat sStat;
+   off_t lEnd;
+
+   if( fstat( iFd, &sStat ) != 0 )
+   {
+      return FALSE;
+   }
+
+   if( S_ISREG( sStat.st_mode ) )
+   {
+      *plSize = (UINT64)sStat.st_size;
+      return TRUE;
+   }
+
+   /* Block devices report a size of 0, but can seek to their end */
+   lEnd = lseek( iFd, 0, SEEK_END );
+
+   if( lEnd < 0 )
+   {
+      return FALSE;
+   }
+
+   *plSize = (UINT64)lEnd;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Hashes the first lSize bytes of a file piece by piece on all pool workers.
+** Pieces are handed out in ascending order, which keeps the reads close to
+** sequential. Returns once every piece is done.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool      - Pool to run on, not running other jobs
+**    apsWorkers  - Per-worker MD5 instance and read buffer
+**    iFd         - File to read with pread()
+**    lSize       - Number of bytes to hash
+**    dwPieceSize - Piece size in bytes
+**    iLeadByte   - Byte hashed ahead of the data of every piece (e.g. the
+**                  leaf marker of a tree hash), MD5_PIECE_NO_LEAD_BYTE for
+**                  the plain MD5 of the piece
+**    asResults   - Receive the digest or error of every piece, room for
+**                  MD5_PIECE_GetNumPieces( lSize, dwPieceSize ) entries
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_PIECE_HashAll( MD5_POOL_Type* psPool, MD5_IO_WorkerType* apsWorkers[], int iFd,
+                        UINT64 lSize, UINT32 dwPieceSize, int iLeadByte,
+                        MD5_PIECE_ResultType asResults[] )
+{
+   MD5_PIECE_CtxType sCtx;
+   UINT16 iWorker;
+
+   sCtx.apsWorkers  = apsWorkers;
+   sCtx.asResults   = asResults;
+   sCtx.iFd         = iFd;
+   sCtx.lSize       = lSize;
+   sCtx.dwPieceSize = dwPieceSize;
+   sCtx.iLeadByte   = iLeadByte;
+   sCtx.lNumPieces  = MD5_PIECE_GetNumPieces( lSize, dwPieceSize );
+   sCtx.lNextPiece  = 0;
+   pthread_mutex_init( &sCtx.sLock, NULL );
+
+   for( iWorker = 0; ( iWorker < psPool->iNumWorkers ) && ( iWorker < sCtx.lNumPieces ); iWorker++ )
+   {
+      MD5_POOL_Submit( psPool, MD5_PIECE_Job, &sCtx );
+   }
+
+   MD5_POOL_Wait( psPool );
+
+   pthread_mutex_destroy( &sCtx.sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Writes the header line of a piece list.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile      - Stream to write to
+**    lSize       - File size in bytes
+**    dwPieceSize - Piece size in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_PIECE_WriteHeader( FILE* psFile, UINT64 lSize, UINT32 dwPieceSize )
+{
+   fprintf( psFile, "%s %u %llu\n", MD5_PIECE_LIST_TAG, (unsigned int)dwPieceSize,
+            (unsigned long long)lSize );
+}
+
+/*------------------------------------------------------------------------------
+** Parses the header line of a piece list.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacLine       - NUL terminated line, without the line terminator
+**    plSize        - Receives the file size in bytes
+**    pdwPieceSize  - Receives the piece size in bytes
+**
+** Returns:
+**    BOOL - FALSE if the line isn't a valid header
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_PIECE_ParseHeader( const char* pacLine, UINT64* plSize, UINT32* pdwPieceSize )
+{
+   const size_t iTagLen = strlen( MD5_PIECE_LIST_TAG );
+   unsigned long long lPieceSize;
+   char* pacEnd;
+
+   if( ( strncmp( pacLine, MD5_PIECE_LIST_TAG, iTagLen ) != 0 ) || ( pacLine[ iTagLen ] != ' ' ) )
+   {
+      return FALSE;
+   }
+
+   errno      = 0;
+   lPieceSize = strtoull( &pacLine[ iTagLen + 1 ], &pacEnd, 10 );
+
+   if( ( *pacEnd != ' ' ) || ( lPieceSize < MD5_PIECE_MIN_SIZE ) || ( lPieceSize > 0xFFFFFFFFULL ) )
+   {
+      return FALSE;
+   }
+
+   *pdwPieceSize = (UINT32)lPieceSize;
+   *plSize       = (UINT64)strtoull( pacEnd + 1, &pacEnd, 10 );
+
+   return ( *pacEnd == '\0' ) && ( errno == 0 );
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,138 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_piece.h
+**    Summary: Piece lists. A large file or block device is split into fixed
+**             size pieces that are hashed in parallel, each with an MD5
+**             instance of its own. Comparing two piece lists locates the
+**             corrupt byte ranges of an image instead of just flagging it.
+**
+**             List format (text): a header line
+**                "md5-pieces <piece size> <total size>"
+**             followed by one hexadecimal digest line per piece.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_PIECE_H_
+#define HMS_SC_MD5_PIECE_H_
+
+#include "MD5.h"
+#include "MD5_io.h"
+#include "MD5_pool.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_PIECE_DEFAULT_SIZE         ( 4U * 1024U * 1024U )
+#define MD5_PIECE_MIN_SIZE             ( 1024U )
+#define MD5_PIECE_LIST_TAG             "md5-pieces"
+#define MD5_PIECE_NO_LEAD_BYTE         ( -1 )
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <stdio.h>
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_PIECE_Result
+{
+   int iError; /* errno of the failed read, 0 on success */
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_PIECE_ResultType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of pieces a file is split into. The last piece may be
+** shorter than the others.
+**------------------------------------------------------------------------------
+** Arguments:
+**    lSize       - File size in bytes
+**    dwPieceSize - Piece size in bytes
+**
+** Returns:
+**    UINT64 - Number of pieces (0 for an empty file)
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_PIECE_GetNumPieces( UINT64 lSize, UINT32 dwPieceSize );
+
+/*------------------------------------------------------------------------------
+** Returns the size of a regular file or block device.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iFd    - Open file descriptor
+**    plSize - Receives the size in bytes
+**
+** Returns:
+**    BOOL - FALSE if the size could not be determined (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_PIECE_GetSize( int iFd, UINT64* plSize );
+
+/*------------------------------------------------------------------------------
+** Hashes the first lSize bytes of a file piece by piece on all pool workers.
+** Pieces are handed out in ascending order, which keeps the reads close to
+** sequential. Returns once every piece is done.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool      - Pool to run on, not running other jobs
+**    apsWorkers  - Per-worker MD5 instance and read buffer
+**    iFd         - File to read with pread()
+**    lSize       - Number of bytes to hash
+**    dwPieceSize - Piece size in bytes
+**    iLeadByte   - Byte hashed ahead of the data of every piece (e.g. the
+**                  leaf marker of a tree hash), MD5_PIECE_NO_LEAD_BYTE for
+**                  the plain MD5 of the piece
+**    asResults   - Receive the digest or error of every piece, room for
+**                  MD5_PIECE_GetNumPieces( lSize, dwPieceSize ) entries
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_PIECE_HashAll( MD5_POOL_Type* psPool, MD5_IO_WorkerType* apsWorkers[], int iFd,
+                        UINT64 lSize, UINT32 dwPieceSize, int iLeadByte,
+                        MD5_PIECE_ResultType asResults[] );
+
+/*------------------------------------------------------------------------------
+** Writes the header line of a piece list.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile      - Stream to write to
+**    lSize       - File size in bytes
+**    dwPieceSize - Piece size in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_PIECE_WriteHeader( FILE* psFile, UINT64 lSize, UINT32 dwPieceSize );
+
+/*------------------------------------------------------------------------------
+** Parses the header line of a piece list.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacLine       - NUL terminated line, without the line terminator
+**    plSize        - Receives the file size in bytes
+**    pdwPieceSize  - Receives the piece size in bytes
+**
+** Returns:
+**    BOOL - FALSE if the line isn't a valid header
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_PIECE_ParseHeader( const char* pacLine, UINT64* plSize, UINT32* pdwPieceSize );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_PIECE_H_ */
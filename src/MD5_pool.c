@@ -0,0 +1,609 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_pool.c
+**    Summary: Work-stealing thread pool used by the host applications to run
+**             MD5 computations on all available cores.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_pool.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Private Globals
+********************************************************************************
+*/
+
+/*
+** Worker executing on the calling thread (NULL for non-pool threads). Used to
+** push jobs submitted from within a job onto the local deque.
+*/
+static __thread MD5_POOL_WorkerType* MD5_POOL_psCurrentWorker = NULL;
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static BOOL MD5_POOL_DequeInit( MD5_POOL_DequeType* psDeque );
+static void MD5_POOL_DequeFree( MD5_POOL_DequeType* psDeque );
+static BOOL MD5_POOL_DequePush( MD5_POOL_DequeType* psDeque, const MD5_POOL_JobType* psJob );
+static BOOL MD5_POOL_DequePop( MD5_POOL_DequeType* psDeque, MD5_POOL_JobType* psJob );
+static BOOL MD5_POOL_DequeSteal( MD5_POOL_DequeType* psDeque, MD5_POOL_JobType* psJob );
+static BOOL MD5_POOL_TakeJob( MD5_POOL_Type* psPool, MD5_POOL_WorkerType* psWorker,
+                              MD5_POOL_JobType* psJob );
+static void MD5_POOL_JobDone( MD5_POOL_Type* psPool );
+static void MD5_POOL_Push( MD5_POOL_Type* psPool, MD5_POOL_WorkerType* psWorker,
+                           MD5_POOL_JobFunc pnJob, void* pxArg );
+static void* MD5_POOL_WorkerMain( void* pxArg );
+static void MD5_POOL_Shutdown( MD5_POOL_Type* psPool, UINT16 iNumThreads, UINT16 iNumDeques );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes an empty job deque.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDeque - Deque to initialize
+**
+** Returns:
+**    BOOL - TRUE on success
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_POOL_DequeInit( MD5_POOL_DequeType* psDeque )
+{
+   psDeque->dwCapacity = MD5_POOL_INITIAL_DEQUE_SIZE;
+   psDeque->dwHead     = 0;
+   psDeque->dwTail     = 0;
+   psDeque->asJobs     = malloc( psDeque->dwCapacity * sizeof( MD5_POOL_JobType ) );
+
+   if( psDeque->asJobs == NULL )
+   {
+      return FALSE;
+   }
+
+   pthread_mutex_init( &psDeque->sLock, NULL );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Releases the resources of a job deque.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDeque - Deque to free
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_POOL_DequeFree( MD5_POOL_DequeType* psDeque )
+{
+   pthread_mutex_destroy( &psDeque->sLock );
+   free( psDeque->asJobs );
+   psDeque->asJobs = NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Pushes a job onto the owner end of the deque, growing it when full.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDeque - Deque to push to
+**    psJob   - Job to copy into the deque
+**
+** Returns:
+**    BOOL - FALSE if the deque was full and could not be grown
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_POOL_DequePush( MD5_POOL_DequeType* psDeque, const MD5_POOL_JobType* psJob )
+{
+   BOOL fPushed = TRUE;
+
+   pthread_mutex_lock( &psDeque->sLock );
+
+   if( ( psDeque->dwTail - psDeque->dwHead ) == psDeque->dwCapacity )
+   {
+      UINT32 dwNewCapacity    = psDeque->dwCapacity << 1;
+      MD5_POOL_JobType* asNew = malloc( dwNewCapacity * sizeof( MD5_POOL_JobType ) );
+      UINT32 dwIndex;
+
+      if( asNew == NULL )
+      {
+         fPushed = FALSE;
+      }
+      else
+      {
+         for( dwIndex = psDeque->dwHead; dwIndex != psDeque->dwTail; dwIndex++ )
+         {
+            asNew[ dwIndex & ( dwNewCapacity - 1 ) ] =
+               psDeque->asJobs[ dwIndex & ( psDeque->dwCapacity - 1 ) ];
+         }
+
+         free( psDeque->asJobs );
+         psDeque->asJobs     = asNew;
+         psDeque->dwCapacity = dwNewCapacity;
+      }
+   }
+
+   if( fPushed )
+   {
+      psDeque->asJobs[ psDeque->dwTail & ( psDeque->dwCapacity - 1 ) ] = *psJob;
+      MD5_PORT_AtomicStore( &psDeque->dwTail, psDeque->dwTail + 1 );
+   }
+
+   pthread_mutex_unlock( &psDeque->sLock );
+
+   return fPushed;
+}
+
+/*------------------------------------------------------------------------------
+** Pops the newest job from the owner end of the deque.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDeque - Deque to pop from
+**    psJob   - Receives the job
+**
+** Returns:
+**    BOOL - TRUE if a job was returned
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_POOL_DequePop( MD5_POOL_DequeType* psDeque, MD5_POOL_JobType* psJob )
+{
+   BOOL fFound = FALSE;
+
+   pthread_mutex_lock( &psDeque->sLock );
+
+   if( psDeque->dwTail != psDeque->dwHead )
+   {
+      MD5_PORT_AtomicStore( &psDeque->dwTail, psDeque->dwTail - 1 );
+      *psJob = psDeque->asJobs[ psDeque->dwTail & ( psDeque->dwCapacity - 1 ) ];
+      fFound = TRUE;
+   }
+
+   pthread_mutex_unlock( &psDeque->sLock );
+
+   return fFound;
+}
+
+/*------------------------------------------------------------------------------
+** Steals the oldest job from the thief end of the deque.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDeque - Deque to steal from
+**    psJob   - Receives the job
+**
+** Returns:
+**    BOOL - TRUE if a job was returned
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_POOL_DequeSteal( MD5_POOL_DequeType* psDeque, MD5_POOL_JobType* psJob )
+{
+   BOOL fFound = FALSE;
+
+   /* Avoid contending on the lock of deques that are empty anyway */
+   if( MD5_PORT_AtomicLoad( &psDeque->dwTail ) == MD5_PORT_AtomicLoad( &psDeque->dwHead ) )
+   {
+      return FALSE;
+   }
+
+   pthread_mutex_lock( &psDeque->sLock );
+
+   if( psDeque->dwTail != psDeque->dwHead )
+   {
+      *psJob = psDeque->asJobs[ psDeque->dwHead & ( psDeque->dwCapacity - 1 ) ];
+      MD5_PORT_AtomicStore( &psDeque->dwHead, psDeque->dwHead + 1 );
+      fFound = TRUE;
+   }
+
+   pthread_mutex_unlock( &psDeque->sLock );
+
+   return fFound;
+}
+
+/*------------------------------------------------------------------------------
+** Takes the next job for a worker: its own newest job first, else the oldest
+** job of another worker.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool   - Pool the worker belongs to
+**    psWorker - Worker looking for work
+**    psJob    - Receives the job
+**
+** Returns:
+**    BOOL - TRUE if a job was returned
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_POOL_TakeJob( MD5_POOL_Type* psPool, MD5_POOL_WorkerType* psWorker,
+                              MD5_POOL_JobType* psJob )
+{
+   BOOL fFound = MD5_POOL_DequePop( &psWorker->sDeque, psJob );
+   UINT16 iVictim;
+
+   for( iVictim = 1; !fFound && ( iVictim < psPool->iNumWorkers ); iVictim++ )
+   {
+      UINT16 iIndex = ( psWorker->iIndex + iVictim ) % psPool->iNumWorkers;
+      fFound = MD5_POOL_DequeSteal( &psPool->asWorkers[ iIndex ].sDeque, psJob );
+   }
+
+   if( fFound )
+   {
+      MD5_PORT_AtomicSub( &psPool->dwQueued, 1 );
+   }
+
+   return fFound;
+}
+
+/*------------------------------------------------------------------------------
+** Accounts for a finished job and wakes up MD5_POOL_Wait() on the last one.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool the job belonged to
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_POOL_JobDone( MD5_POOL_Type* psPool )
+{
+   if( MD5_PORT_AtomicSub( &psPool->dwOutstanding, 1 ) == 0 )
+   {
+      pthread_mutex_lock( &psPool->sLock );
+      pthread_cond_broadcast( &psPool->sDoneCond );
+      pthread_mutex_unlock( &psPool->sLock );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Worker thread main loop.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg - Pointer to the worker's MD5_POOL_WorkerType
+**
+** Returns:
+**    void* - Always NULL
+**------------------------------------------------------------------------------
+*/
+static void* MD5_POOL_WorkerMain( void* pxArg )
+{
+   MD5_POOL_WorkerType* psWorker = (MD5_POOL_WorkerType*)pxArg;
+   MD5_POOL_Type* psPool         = psWorker->psPool;
+   MD5_POOL_JobType sJob;
+
+   MD5_POOL_psCurrentWorker = psWorker;
+
+   while( TRUE )
+   {
+      BOOL fStop;
+
+      if( MD5_POOL_TakeJob( psPool, psWorker, &sJob ) )
+      {
+         sJob.pnJob( sJob.pxArg, psWorker->iIndex );
+         MD5_POOL_JobDone( psPool );
+         continue;
+      }
+
+      /*
+      ** Announce the sleeper before re-checking the queue; a submitter either
+      ** sees the sleeper (and signals under the lock) or we see its job.
+      */
+      pthread_mutex_lock( &psPool->sLock );
+      MD5_PORT_AtomicAdd( &psPool->dwSleepers, 1 );
+
+      while( ( MD5_PORT_AtomicLoad( &psPool->dwQueued ) == 0 ) && !psPool->fStop )
+      {
+         pthread_cond_wait( &psPool->sWorkCond, &psPool->sLock );
+      }
+
+      MD5_PORT_AtomicSub( &psPool->dwSleepers, 1 );
+      fStop = psPool->fStop && ( MD5_PORT_AtomicLoad( &psPool->dwQueued ) == 0 );
+      pthread_mutex_unlock( &psPool->sLock );
+
+      if( fStop )
+      {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Queues a job on a worker's deque and wakes a sleeping worker.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool   - Pool to run the job on
+**    psWorker - Worker whose deque takes the job
+**    pnJob    - Job routine
+**    pxArg    - Argument handed to the job routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_POOL_Push( MD5_POOL_Type* psPool, MD5_POOL_WorkerType* psWorker,
+                           MD5_POOL_JobFunc pnJob, void* pxArg )
+{
+   MD5_POOL_JobType sJob;
+
+   sJob.pnJob = pnJob;
+   sJob.pxArg = pxArg;
+
+   /* Count the job before it becomes visible so MD5_POOL_Wait() can't miss it */
+   MD5_PORT_AtomicAdd( &psPool->dwOutstanding, 1 );
+
+   if( !MD5_POOL_DequePush( &psWorker->sDeque, &sJob ) )
+   {
+      /* Out of memory, run the job on the calling thread instead of dropping it */
+      pnJob( pxArg, ( MD5_POOL_psCurrentWorker == psWorker ) ? psWorker->iIndex : 0 );
+      MD5_POOL_JobDone( psPool );
+      return;
+   }
+
+   MD5_PORT_AtomicAdd( &psPool->dwQueued, 1 );
+
+   if( MD5_PORT_AtomicLoad( &psPool->dwSleepers ) != 0 )
+   {
+      pthread_mutex_lock( &psPool->sLock );
+      pthread_cond_signal( &psPool->sWorkCond );
+      pthread_mutex_unlock( &psPool->sLock );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Stops the worker threads and releases all pool resources.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool      - Pool to shut down
+**    iNumThreads - Number of worker threads that were started
+**    iNumDeques  - Number of worker deques that were initialized
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_POOL_Shutdown( MD5_POOL_Type* psPool, UINT16 iNumThreads, UINT16 iNumDeques )
+{
+   UINT16 iWorker;
+
+   pthread_mutex_lock( &psPool->sLock );
+   psPool->fStop = TRUE;
+   pthread_cond_broadcast( &psPool->sWorkCond );
+   pthread_mutex_unlock( &psPool->sLock );
+
+   for( iWorker = 0; iWorker < iNumThreads; iWorker++ )
+   {
+      pthread_join( psPool->asWorkers[ iWorker ].sThread, NULL );
+   }
+
+   for( iWorker = 0; iWorker < iNumDeques; iWorker++ )
+   {
+      MD5_POOL_DequeFree( &psPool->asWorkers[ iWorker ].sDeque );
+   }
+
+   pthread_cond_destroy( &psPool->sDoneCond );
+   pthread_cond_destroy( &psPool->sWorkCond );
+   pthread_mutex_destroy( &psPool->sLock );
+
+   free( psPool->asWorkers );
+   psPool->asWorkers   = NULL;
+   psPool->iNumWorkers = 0;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of online processors, used as the default worker count.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    UINT16 - Number of online processors (at least 1)
+**------------------------------------------------------------------------------
+*/
+UINT16 MD5_POOL_GetDefaultNumWorkers( void )
+{
+   long lNumCpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+   if( lNumCpus < 1 )
+   {
+      lNumCpus = 1;
+   }
+   else if( lNumCpus > (long)MD5_POOL_MAX_WORKERS )
+   {
+      lNumCpus = MD5_POOL_MAX_WORKERS;
+   }
+
+   return (UINT16)lNumCpus;
+}
+
+/*------------------------------------------------------------------------------
+** Creates the pool and starts its worker threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool      - Pool to initialize
+**    iNumWorkers - Number of worker threads (1..MD5_POOL_MAX_WORKERS)
+**
+** Returns:
+**    BOOL - TRUE if all workers were started
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_POOL_Create( MD5_POOL_Type* psPool, UINT16 iNumWorkers )
+{
+   UINT16 iWorker;
+
+   memset( psPool, 0, sizeof( *psPool ) );
+
+   if( ( iNumWorkers == 0 ) || ( iNumWorkers > MD5_POOL_MAX_WORKERS ) )
+   {
+      return FALSE;
+   }
+
+   psPool->asWorkers = calloc( iNumWorkers, sizeof( MD5_POOL_WorkerType ) );
+
+   if( psPool->asWorkers == NULL )
+   {
+      return FALSE;
+   }
+
+   pthread_mutex_init( &psPool->sLock, NULL );
+   pthread_cond_init( &psPool->sWorkCond, NULL );
+   pthread_cond_init( &psPool->sDoneCond, NULL );
+
+   for( iWorker = 0; iWorker < iNumWorkers; iWorker++ )
+   {
+      MD5_POOL_WorkerType* psWorker = &psPool->asWorkers[ iWorker ];
+
+      psWorker->psPool = psPool;
+      psWorker->iIndex = iWorker;
+
+      if( !MD5_POOL_DequeInit( &psWorker->sDeque ) )
+      {
+         break;
+      }
+   }
+
+   /* Deques are set up before any thread may try to steal from them */
+   psPool->iNumWorkers = iWorker;
+
+   for( iWorker = 0; iWorker < psPool->iNumWorkers; iWorker++ )
+   {
+      MD5_POOL_WorkerType* psWorker = &psPool->asWorkers[ iWorker ];
+
+      if( pthread_create( &psWorker->sThread, NULL, MD5_POOL_WorkerMain, psWorker ) != 0 )
+      {
+         break;
+      }
+   }
+
+   if( iWorker != iNumWorkers )
+   {
+      MD5_POOL_Shutdown( psPool, iWorker, psPool->iNumWorkers );
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Queues a job. May be called from any thread, including from within a job.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to run the job on
+**    pnJob  - Job routine
+**    pxArg  - Argument handed to the job routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Submit( MD5_POOL_Type* psPool, MD5_POOL_JobFunc pnJob, void* pxArg )
+{
+   MD5_POOL_WorkerType* psWorker = MD5_POOL_psCurrentWorker;
+
+   if( ( psWorker == NULL ) || ( psWorker->psPool != psPool ) )
+   {
+      UINT32 dwTarget = MD5_PORT_AtomicAdd( &psPool->dwNextWorker, 1 );
+      psWorker        = &psPool->asWorkers[ dwTarget % psPool->iNumWorkers ];
+   }
+
+   MD5_POOL_Push( psPool, psWorker, pnJob, pxArg );
+}
+
+/*------------------------------------------------------------------------------
+** Queues a job on the deque of a given worker, such as one close to the
+** job's data. Other workers still steal it when they run out of work, so
+** this is a preference, not a binding.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool to run the job on
+**    iWorker - Worker whose deque takes the job
+**    pnJob   - Job routine
+**    pxArg   - Argument handed to the job routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_SubmitTo( MD5_POOL_Type* psPool, UINT16 iWorker, MD5_POOL_JobFunc pnJob, void* pxArg )
+{
+   MD5_POOL_Push( psPool, &psPool->asWorkers[ iWorker % psPool->iNumWorkers ], pnJob, pxArg );
+}
+
+/*------------------------------------------------------------------------------
+** Restricts a worker thread to a set of CPUs.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool the worker belongs to
+**    iWorker - Worker to pin
+**    psCpus  - CPUs the worker may run on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, see MD5_NUMA_PinThread())
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_POOL_PinWorker( MD5_POOL_Type* psPool, UINT16 iWorker, const MD5_NUMA_CpuSetType* psCpus )
+{
+   return MD5_NUMA_PinThread( psPool->asWorkers[ iWorker ].sThread, psCpus );
+}
+
+/*------------------------------------------------------------------------------
+** Blocks until all submitted jobs (including jobs submitted by jobs) are done.
+** Must not be called from within a job.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to wait for
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Wait( MD5_POOL_Type* psPool )
+{
+   pthread_mutex_lock( &psPool->sLock );
+
+   while( MD5_PORT_AtomicLoad( &psPool->dwOutstanding ) != 0 )
+   {
+      pthread_cond_wait( &psPool->sDoneCond, &psPool->sLock );
+   }
+
+   pthread_mutex_unlock( &psPool->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Waits for all outstanding jobs, stops the workers and frees the pool.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to destroy
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Destroy( MD5_POOL_Type* psPool )
+{
+   if( psPool->asWorkers != NULL )
+   {
+      MD5_POOL_Wait( psPool );
+      MD5_POOL_Shutdown( psPool, psPool->iNumWorkers, psPool->iNumWorkers );
+   }
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,186 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_pool.h
+**    Summary: Work-stealing thread pool used by the host applications to run
+**             MD5 computations on all available cores. Every worker owns a
+**             job deque; jobs submitted from within a worker are pushed onto
+**             its own deque (LIFO, cache friendly) while idle workers steal
+**             the oldest jobs of other workers (FIFO).
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_POOL_H_
+#define HMS_SC_MD5_POOL_H_
+
+#include "MD5_cfg.h"
+#include "MD5_int.h"
+#include "MD5_numa.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <pthread.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_POOL_MAX_WORKERS           ( 1024U )
+#define MD5_POOL_INITIAL_DEQUE_SIZE    ( 64U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Job routine. 'iWorker' is the index (0..n-1) of the worker executing the job
+** which allows jobs to use per-worker resources (MD5 instances, buffers).
+*/
+typedef void ( *MD5_POOL_JobFunc )( void* pxArg, UINT16 iWorker );
+
+typedef struct MD5_POOL_Job
+{
+   MD5_POOL_JobFunc pnJob;
+   void* pxArg;
+} MD5_POOL_JobType;
+
+typedef struct MD5_POOL_Deque
+{
+   pthread_mutex_t sLock;
+   MD5_POOL_JobType* asJobs;
+   UINT32 dwCapacity; /* Always a power of two */
+   UINT32 dwHead;     /* Steal end (oldest job) */
+   UINT32 dwTail;     /* Owner end (newest job) */
+} MD5_POOL_DequeType;
+
+typedef struct MD5_POOL_Worker
+{
+   struct MD5_Pool* psPool;
+   pthread_t sThread;
+   UINT16 iIndex;
+   MD5_POOL_DequeType sDeque;
+} MD5_POOL_WorkerType;
+
+typedef struct MD5_Pool
+{
+   MD5_POOL_WorkerType* asWorkers;
+   UINT16 iNumWorkers;
+   UINT32 dwNextWorker;  /* Round-robin target for external submissions */
+   UINT32 dwQueued;      /* Jobs waiting in any deque */
+   UINT32 dwOutstanding; /* Jobs queued or running */
+   UINT32 dwSleepers;    /* Workers blocked waiting for work */
+   BOOL fStop;
+   pthread_mutex_t sLock;
+   pthread_cond_t sWorkCond;
+   pthread_cond_t sDoneCond;
+} MD5_POOL_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the number of online processors, used as the default worker count.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    UINT16 - Number of online processors (at least 1)
+**------------------------------------------------------------------------------
+*/
+UINT16 MD5_POOL_GetDefaultNumWorkers( void );
+
+/*------------------------------------------------------------------------------
+** Creates the pool and starts its worker threads.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool      - Pool to initialize
+**    iNumWorkers - Number of worker threads (1..MD5_POOL_MAX_WORKERS)
+**
+** Returns:
+**    BOOL - TRUE if all workers were started
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_POOL_Create( MD5_POOL_Type* psPool, UINT16 iNumWorkers );
+
+/*------------------------------------------------------------------------------
+** Queues a job. May be called from any thread, including from within a job.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to run the job on
+**    pnJob  - Job routine
+**    pxArg  - Argument handed to the job routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Submit( MD5_POOL_Type* psPool, MD5_POOL_JobFunc pnJob, void* pxArg );
+
+/*------------------------------------------------------------------------------
+** Queues a job on the deque of a given worker, such as one close to the
+** job's data. Other workers still steal it when they run out of work, so
+** this is a preference, not a binding.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool to run the job on
+**    iWorker - Worker whose deque takes the job
+**    pnJob   - Job routine
+**    pxArg   - Argument handed to the job routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_SubmitTo( MD5_POOL_Type* psPool, UINT16 iWorker, MD5_POOL_JobFunc pnJob,
+                        void* pxArg );
+
+/*------------------------------------------------------------------------------
+** Restricts a worker thread to a set of CPUs.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool the worker belongs to
+**    iWorker - Worker to pin
+**    psCpus  - CPUs the worker may run on
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, see MD5_NUMA_PinThread())
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_POOL_PinWorker( MD5_POOL_Type* psPool, UINT16 iWorker, const MD5_NUMA_CpuSetType* psCpus );
+
+/*------------------------------------------------------------------------------
+** Blocks until all submitted jobs (including jobs submitted by jobs) are done.
+** Must not be called from within a job.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to wait for
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Wait( MD5_POOL_Type* psPool );
+
+/*------------------------------------------------------------------------------
+** Waits for all outstanding jobs, stops the workers and frees the pool.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool - Pool to destroy
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_POOL_Destroy( MD5_POOL_Type* psPool );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_POOL_H_ */
@@ -57,6 +57,22 @@
 #define MD5_MEMSET( dst, val, size )    memset( dst, val, size )
 #endif
 
+#if( MD5_USE_POSIX_HOST == 1 )
+/*
+** Atomic operations used by the POSIX host services. Mapped onto the
+** GCC/Clang built-ins, adapt as needed for other tool chains.
+*/
+#define MD5_PORT_AtomicAdd( pxVal, xAdd )    __atomic_add_fetch( pxVal, xAdd, __ATOMIC_SEQ_CST )
+#define MD5_PORT_AtomicSub( pxVal, xSub )    __atomic_sub_fetch( pxVal, xSub, __ATOMIC_SEQ_CST )
+#define MD5_PORT_AtomicLoad( pxVal )         __atomic_load_n( pxVal, __ATOMIC_SEQ_CST )
+#define MD5_PORT_AtomicStore( pxVal, xVal )  __atomic_store_n( pxVal, xVal, __ATOMIC_SEQ_CST )
+
+/*
+** Cache prefetch hint, may be defined empty
+*/
+#define MD5_PORT_Prefetch( pxAddr )          __builtin_prefetch( pxAddr )
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
 /*******************************************************************************
 ** Public Services
 ********************************************************************************
@@ -0,0 +1,501 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_rpc.c
+**    Summary: Message transport of the local hashing service protocol over
+**             SOCK_SEQPACKET Unix domain sockets, with fd passing.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_rpc.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_RPC_LISTEN_BACKLOG         ( 64 )
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+static int MD5_RPC_Socket( const char* pacSocket, struct sockaddr_un* psAddress );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Creates a SOCK_SEQPACKET socket and the address of a socket path.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSocket - Path of the service socket
+**    psAddress - Receives the address
+**
+** Returns:
+**    int - Socket, -1 on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+static int MD5_RPC_Socket( const char* pacSocket, struct sockaddr_un* psAddress )
+{
+   if( strlen( pacSocket ) >= sizeof( psAddress->sun_path ) )
+   {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+
+   memset( psAddress, 0, sizeof( *psAddress ) );
+   psAddress->sun_family = AF_UNIX;
+   strcpy( psAddress->sun_path, pacSocket );
+
+   return socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Connects to a service.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSocket - Path of the service socket
+**
+** Returns:
+**    int - Connected socket, -1 on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+int MD5_RPC_Connect( const char* pacSocket )
+{
+   struct sockaddr_un sAddress;
+   int iSocket = MD5_RPC_Socket( pacSocket, &sAddress );
+   int iError;
+
+   if( iSocket < 0 )
+   {
+      return -1;
+   }
+
+   if( connect( iSocket, (struct sockaddr*)&sAddress, sizeof( sAddress ) ) != 0 )
+   {
+      iError = errno;
+      close( iSocket );
+      errno = iError;
+      return -1;
+   }
+
+   return iSocket;
+}
+
+/*------------------------------------------------------------------------------
+** Creates the listening socket of a service. A stale socket file left by a
+** service that is no longer running is replaced. The socket file is made
+** accessible to the owner only (0600), as the service hashes any file its
+** user can read.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSocket - Path of the service socket
+**
+** Returns:
+**    int - Listening socket, -1 on failure (errno is set, EADDRINUSE if a
+**          service is running on the socket)
+**------------------------------------------------------------------------------
+*/
+int MD5_RPC_Listen( const char* pacSocket )
+{
+   struct sockaddr_un sAddress;
+   int iSocket = MD5_RPC_Socket( pacSocket, &sAddress );
+   int iError;
+
+   if( iSocket < 0 )
+   {
+      return -1;
+   }
+
+   if( bind( iSocket, (struct sockaddr*)&sAddress, sizeof( sAddress ) ) != 0 )
+   {
+      iError = errno;
+
+      if( iError == EADDRINUSE )
+      {
+         int iProbe = MD5_RPC_Connect( pacSocket );
+
+         if( iProbe >= 0 )
+         {
+            /* A service is running */
+            close( iProbe );
+         }
+         else if( errno == ECONNREFUSED )
+         {
+            /* Nobody is listening: left behind by a service that is gone */
+            unlink( pacSocket );
+            iError = 0;
+
+            if( bind( iSocket, (struct sockaddr*)&sAddress, sizeof( sAddress ) ) != 0 )
+            {
+               iError = errno;
+            }
+         }
+      }
+
+      if( iError != 0 )
+      {
+         close( iSocket );
+         errno = iError;
+         return -1;
+      }
+   }
+
+   /*
+   ** The service opens paths with the rights of its user: only that user may
+   ** connect. Nobody can connect before listen(), so there is no window.
+   */
+   if( chmod( pacSocket, S_IRUSR | S_IWUSR ) != 0 )
+   {
+      iError = errno;
+      close( iSocket );
+      unlink( pacSocket );
+      errno = iError;
+      return -1;
+   }
+
+   if( listen( iSocket, MD5_RPC_LISTEN_BACKLOG ) != 0 )
+   {
+      iError = errno;
+      close( iSocket );
+      errno = iError;
+      return -1;
+   }
+
+   return iSocket;
+}
+
+/*------------------------------------------------------------------------------
+** Appends a request to a message. The message starts out empty (all zero).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psMessage - Message to add the request to
+**    psRequest - Request header; dwLength is the payload length
+**    pxPayload - Payload (path or data), dwLength bytes
+**    iFd       - HASH_FD: fd of the data, kept open by the caller until the
+**                message is sent
+**
+** Returns:
+**    BOOL - FALSE if the message is full (send it and start a new one)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_AddRequest( MD5_RPC_MessageType* psMessage, const MD5_RPC_RequestType* psRequest,
+                         const void* pxPayload, int iFd )
+{
+   UINT32 dwFree = MD5_RPC_MAX_MESSAGE - psMessage->dwLength;
+
+   if( ( dwFree < sizeof( MD5_RPC_RequestType ) ) ||
+       ( psRequest->dwLength > dwFree - sizeof( MD5_RPC_RequestType ) ) )
+   {
+      return FALSE;
+   }
+
+   if( psRequest->bOp == MD5_RPC_OP_HASH_FD )
+   {
+      if( psMessage->iNumFds == MD5_RPC_MAX_FDS )
+      {
+         return FALSE;
+      }
+
+      psMessage->aiFds[ psMessage->iNumFds++ ] = iFd;
+   }
+
+   memcpy( &psMessage->abData[ psMessage->dwLength ], psRequest, sizeof( MD5_RPC_RequestType ) );
+   psMessage->dwLength += sizeof( MD5_RPC_RequestType );
+
+   if( psRequest->dwLength > 0 )
+   {
+      memcpy( &psMessage->abData[ psMessage->dwLength ], pxPayload, psRequest->dwLength );
+      psMessage->dwLength += psRequest->dwLength;
+   }
+
+   psMessage->iNumRequests++;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Sends a request message and empties it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket   - Connected socket
+**    psMessage - Message to send
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_SendMessage( int iSocket, MD5_RPC_MessageType* psMessage )
+{
+   union
+   {
+      struct cmsghdr sHeader;
+      char acSpace[ CMSG_SPACE( sizeof( int ) * MD5_RPC_MAX_FDS ) ];
+   } uControl;
+   struct msghdr sMsg;
+   struct iovec sIov;
+   ssize_t iSent;
+
+   memset( &sMsg, 0, sizeof( sMsg ) );
+   sIov.iov_base   = psMessage->abData;
+   sIov.iov_len    = psMessage->dwLength;
+   sMsg.msg_iov    = &sIov;
+   sMsg.msg_iovlen = 1;
+
+   if( psMessage->iNumFds > 0 )
+   {
+      struct cmsghdr* psHeader;
+
+      memset( &uControl, 0, sizeof( uControl ) );
+      sMsg.msg_control    = uControl.acSpace;
+      sMsg.msg_controllen = CMSG_SPACE( sizeof( int ) * psMessage->iNumFds );
+
+      psHeader             = CMSG_FIRSTHDR( &sMsg );
+      psHeader->cmsg_level = SOL_SOCKET;
+      psHeader->cmsg_type  = SCM_RIGHTS;
+      psHeader->cmsg_len   = CMSG_LEN( sizeof( int ) * psMessage->iNumFds );
+      memcpy( CMSG_DATA( psHeader ), psMessage->aiFds, sizeof( int ) * psMessage->iNumFds );
+   }
+
+   do
+   {
+      iSent = sendmsg( iSocket, &sMsg, MSG_NOSIGNAL );
+   }
+   while( ( iSent < 0 ) && ( errno == EINTR ) );
+
+   psMessage->dwLength     = 0;
+   psMessage->iNumFds      = 0;
+   psMessage->iNumRequests = 0;
+
+   return ( iSent >= 0 );
+}
+
+/*------------------------------------------------------------------------------
+** Receives a request message. fds beyond MD5_RPC_MAX_FDS are closed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket   - Connected socket
+**    psMessage - Receives the message and its fds (the caller closes them)
+**
+** Returns:
+**    BOOL - FALSE at the end of the connection (errno 0) or on failure
+**           (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_ReceiveMessage( int iSocket, MD5_RPC_MessageType* psMessage )
+{
+   union
+   {
+      struct cmsghdr sHeader;
+      char acSpace[ CMSG_SPACE( sizeof( int ) * MD5_RPC_MAX_FDS ) ];
+   } uControl;
+   struct cmsghdr* psHeader;
+   struct msghdr sMsg;
+   struct iovec sIov;
+   ssize_t iReceived;
+
+   memset( &sMsg, 0, sizeof( sMsg ) );
+   sIov.iov_base       = psMessage->abData;
+   sIov.iov_len        = MD5_RPC_MAX_MESSAGE;
+   sMsg.msg_iov        = &sIov;
+   sMsg.msg_iovlen     = 1;
+   sMsg.msg_control    = uControl.acSpace;
+   sMsg.msg_controllen = sizeof( uControl.acSpace );
+
+   psMessage->dwLength     = 0;
+   psMessage->iNumFds      = 0;
+   psMessage->iNumRequests = 0;
+
+   do
+   {
+      iReceived = recvmsg( iSocket, &sMsg, MSG_CMSG_CLOEXEC );
+   }
+   while( ( iReceived < 0 ) && ( errno == EINTR ) );
+
+   if( iReceived <= 0 )
+   {
+      if( iReceived == 0 )
+      {
+         errno = 0;
+      }
+
+      return FALSE;
+   }
+
+   for( psHeader = CMSG_FIRSTHDR( &sMsg ); psHeader != NULL;
+        psHeader = CMSG_NXTHDR( &sMsg, psHeader ) )
+   {
+      const UINT8* pbFds;
+      size_t iNumFds;
+      size_t iFd;
+
+      if( ( psHeader->cmsg_level != SOL_SOCKET ) || ( psHeader->cmsg_type != SCM_RIGHTS ) )
+      {
+         continue;
+      }
+
+      pbFds   = CMSG_DATA( psHeader );
+      iNumFds = ( psHeader->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+
+      for( iFd = 0; iFd < iNumFds; iFd++ )
+      {
+         int iReceivedFd;
+
+         memcpy( &iReceivedFd, pbFds + iFd * sizeof( int ), sizeof( int ) );
+
+         if( psMessage->iNumFds < MD5_RPC_MAX_FDS )
+         {
+            psMessage->aiFds[ psMessage->iNumFds++ ] = iReceivedFd;
+         }
+         else
+         {
+            close( iReceivedFd );
+         }
+      }
+   }
+
+   if( sMsg.msg_flags & MSG_TRUNC )
+   {
+      while( psMessage->iNumFds > 0 )
+      {
+         close( psMessage->aiFds[ --psMessage->iNumFds ] );
+      }
+
+      errno = EMSGSIZE;
+      return FALSE;
+   }
+
+   psMessage->dwLength = (UINT32)iReceived;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Gets the next request of a received message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psMessage  - Received message
+**    pdwOffset  - Position in the message, 0 for the first request; advanced
+**                 past the request
+**    psRequest  - Receives the request header
+**    ppbPayload - Receives a pointer to the payload within the message
+**
+** Returns:
+**    BOOL - FALSE at the end of the message or if the rest of it is not a
+**           complete request
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_NextRequest( const MD5_RPC_MessageType* psMessage, UINT32* pdwOffset,
+                          MD5_RPC_RequestType* psRequest, const UINT8** ppbPayload )
+{
+   UINT32 dwLeft = psMessage->dwLength - *pdwOffset;
+
+   if( dwLeft < sizeof( MD5_RPC_RequestType ) )
+   {
+      return FALSE;
+   }
+
+   memcpy( psRequest, &psMessage->abData[ *pdwOffset ], sizeof( MD5_RPC_RequestType ) );
+
+   if( psRequest->dwLength > dwLeft - sizeof( MD5_RPC_RequestType ) )
+   {
+      return FALSE;
+   }
+
+   *ppbPayload  = &psMessage->abData[ *pdwOffset + sizeof( MD5_RPC_RequestType ) ];
+   *pdwOffset  += sizeof( MD5_RPC_RequestType ) + psRequest->dwLength;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Sends the responses to a request message as one message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket       - Connected socket
+**    asResponses   - Responses in request order
+**    iNumResponses - Number of responses, at most MD5_RPC_MAX_REQUESTS
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_SendResponses( int iSocket, const MD5_RPC_ResponseType* asResponses,
+                            UINT16 iNumResponses )
+{
+   ssize_t iSent;
+
+   do
+   {
+      iSent =
+         send( iSocket, asResponses, iNumResponses * sizeof( MD5_RPC_ResponseType ), MSG_NOSIGNAL );
+   }
+   while( ( iSent < 0 ) && ( errno == EINTR ) );
+
+   return ( iSent >= 0 );
+}
+
+/*------------------------------------------------------------------------------
+** Receives the responses to one request message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket     - Connected socket
+**    asResponses - Receives the responses, room for MD5_RPC_MAX_REQUESTS
+**
+** Returns:
+**    long - Number of responses, -1 on failure or at the end of the
+**           connection (errno is set, 0 at the end)
+**------------------------------------------------------------------------------
+*/
+long MD5_RPC_ReceiveResponses( int iSocket, MD5_RPC_ResponseType* asResponses )
+{
+   ssize_t iReceived;
+
+   do
+   {
+      iReceived =
+         recv( iSocket, asResponses, MD5_RPC_MAX_REQUESTS * sizeof( MD5_RPC_ResponseType ), 0 );
+   }
+   while( ( iReceived < 0 ) && ( errno == EINTR ) );
+
+   if( iReceived <= 0 )
+   {
+      if( iReceived == 0 )
+      {
+         errno = 0;
+      }
+
+      return -1;
+   }
+
+   if( ( iReceived % sizeof( MD5_RPC_ResponseType ) ) != 0 )
+   {
+      errno = EPROTO;
+      return -1;
+   }
+
+   return (long)( iReceived / sizeof( MD5_RPC_ResponseType ) );
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
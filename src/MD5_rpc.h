@@ -0,0 +1,217 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_rpc.h
+**    Summary: Binary protocol of the local hashing service (md5 --serve).
+**             Clients talk to the service over a Unix domain socket of type
+**             SOCK_SEQPACKET, so every message arrives whole.
+**
+**             A request message carries one or more requests (batching),
+**             each a fixed header followed by its payload. A client may send
+**             further messages before the responses arrive (pipelining).
+**             The service answers every request message with one message
+**             holding the responses of its requests, in request order.
+**
+**             Requests:
+**                HASH_PATH - the payload is a path, opened by the service
+**                HASH_FD   - an fd passed with the message (SCM_RIGHTS), such
+**                            as a memfd or shared memory object, is mapped
+**                            and hashed in place; the payload is empty
+**                HASH_DATA - the payload is the data itself
+**             The fds of a message belong to its HASH_FD requests in order.
+**
+**             All fields are in host byte order: both ends are on one host.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_RPC_H_
+#define HMS_SC_MD5_RPC_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_RPC_OP_HASH_PATH           ( 1U )
+#define MD5_RPC_OP_HASH_FD             ( 2U )
+#define MD5_RPC_OP_HASH_DATA           ( 3U )
+
+#define MD5_RPC_MAX_MESSAGE            ( 64U * 1024U ) /* Bytes of a request message */
+#define MD5_RPC_MAX_FDS                ( 64U )         /* fds of a request message */
+#define MD5_RPC_MAX_REQUESTS           ( MD5_RPC_MAX_MESSAGE / sizeof( MD5_RPC_RequestType ) )
+
+/*
+** HASH_FD length that extends the range to the end of the file
+*/
+#define MD5_RPC_TO_END                 ( ~(UINT64)0 )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_RPC_Request
+{
+   UINT32 dwId;             /* Chosen by the client, echoed in the response */
+   UINT8 bOp;               /* MD5_RPC_OP_... */
+   UINT8 abReserved[ 3 ];
+   UINT32 dwLength;         /* Payload bytes following the header */
+   UINT32 dwReserved;
+   UINT64 lOffset;          /* HASH_FD: start of the range */
+   UINT64 lSize;            /* HASH_FD: length of the range, or MD5_RPC_TO_END */
+} MD5_RPC_RequestType;
+
+typedef struct MD5_RPC_Response
+{
+   UINT32 dwId;
+   UINT32 dwError;          /* errno of the failed request, 0 on success */
+   UINT64 lSize;            /* Bytes hashed */
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_RPC_ResponseType;
+
+/*
+** A request message being built by a client, or received by the service
+*/
+typedef struct MD5_RPC_Message
+{
+   UINT8 abData[ MD5_RPC_MAX_MESSAGE ];
+   UINT32 dwLength;
+   int aiFds[ MD5_RPC_MAX_FDS ];
+   UINT16 iNumFds;
+   UINT16 iNumRequests;
+} MD5_RPC_MessageType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Connects to a service.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSocket - Path of the service socket
+**
+** Returns:
+**    int - Connected socket, -1 on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+int MD5_RPC_Connect( const char* pacSocket );
+
+/*------------------------------------------------------------------------------
+** Creates the listening socket of a service. A stale socket file left by a
+** service that is no longer running is replaced. The socket file is made
+** accessible to the owner only (0600), as the service hashes any file its
+** user can read.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSocket - Path of the service socket
+**
+** Returns:
+**    int - Listening socket, -1 on failure (errno is set, EADDRINUSE if a
+**          service is running on the socket)
+**------------------------------------------------------------------------------
+*/
+int MD5_RPC_Listen( const char* pacSocket );
+
+/*------------------------------------------------------------------------------
+** Appends a request to a message. The message starts out empty (all zero).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psMessage - Message to add the request to
+**    psRequest - Request header; dwLength is the payload length
+**    pxPayload - Payload (path or data), dwLength bytes
+**    iFd       - HASH_FD: fd of the data, kept open by the caller until the
+**                message is sent
+**
+** Returns:
+**    BOOL - FALSE if the message is full (send it and start a new one)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_AddRequest( MD5_RPC_MessageType* psMessage, const MD5_RPC_RequestType* psRequest,
+                         const void* pxPayload, int iFd );
+
+/*------------------------------------------------------------------------------
+** Sends a request message and empties it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket   - Connected socket
+**    psMessage - Message to send
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_SendMessage( int iSocket, MD5_RPC_MessageType* psMessage );
+
+/*------------------------------------------------------------------------------
+** Receives a request message. fds beyond MD5_RPC_MAX_FDS are closed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket   - Connected socket
+**    psMessage - Receives the message and its fds (the caller closes them)
+**
+** Returns:
+**    BOOL - FALSE at the end of the connection (errno 0) or on failure
+**           (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_ReceiveMessage( int iSocket, MD5_RPC_MessageType* psMessage );
+
+/*------------------------------------------------------------------------------
+** Gets the next request of a received message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psMessage  - Received message
+**    pdwOffset  - Position in the message, 0 for the first request; advanced
+**                 past the request
+**    psRequest  - Receives the request header
+**    ppbPayload - Receives a pointer to the payload within the message
+**
+** Returns:
+**    BOOL - FALSE at the end of the message or if the rest of it is not a
+**           complete request
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_NextRequest( const MD5_RPC_MessageType* psMessage, UINT32* pdwOffset,
+                          MD5_RPC_RequestType* psRequest, const UINT8** ppbPayload );
+
+/*------------------------------------------------------------------------------
+** Sends the responses to a request message as one message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket       - Connected socket
+**    asResponses   - Responses in request order
+**    iNumResponses - Number of responses, at most MD5_RPC_MAX_REQUESTS
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_RPC_SendResponses( int iSocket, const MD5_RPC_ResponseType* asResponses,
+                            UINT16 iNumResponses );
+
+/*------------------------------------------------------------------------------
+** Receives the responses to one request message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iSocket     - Connected socket
+**    asResponses - Receives the responses, room for MD5_RPC_MAX_REQUESTS
+**
+** Returns:
+**    long - Number of responses, -1 on failure or at the end of the
+**           connection (errno is set, 0 at the end)
+**------------------------------------------------------------------------------
+*/
+long MD5_RPC_ReceiveResponses( int iSocket, MD5_RPC_ResponseType* asResponses );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_RPC_H_ */
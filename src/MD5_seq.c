@@ -0,0 +1,144 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_seq.c
+**    Summary: Bounded reorder buffer emitting results in sequence order.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_seq.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <stdlib.h>
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a reorder buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq    - Reorder buffer to initialize
+**    dwWindow - Maximum number of items reserved but not yet emitted
+**    pnEmit   - Emit routine
+**    pxCtx    - Context handed to the emit routine
+**
+** Returns:
+**    BOOL - TRUE on success
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SEQ_Init( MD5_SEQ_Type* psSeq, UINT32 dwWindow, MD5_SEQ_EmitFunc pnEmit, void* pxCtx )
+{
+   psSeq->apxSlots  = calloc( dwWindow, sizeof( void* ) );
+   psSeq->dwWindow  = dwWindow;
+   psSeq->lNextSeq  = 0;
+   psSeq->lNextEmit = 0;
+   psSeq->pnEmit    = pnEmit;
+   psSeq->pxCtx     = pxCtx;
+
+   if( ( dwWindow == 0 ) || ( psSeq->apxSlots == NULL ) )
+   {
+      free( psSeq->apxSlots );
+      psSeq->apxSlots = NULL;
+      return FALSE;
+   }
+
+   pthread_mutex_init( &psSeq->sLock, NULL );
+   pthread_cond_init( &psSeq->sSpaceCond, NULL );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Reserves the next sequence number, blocking while the window is full.
+** Sequence numbers must be reserved by a single producer thread.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq - Reorder buffer
+**
+** Returns:
+**    UINT64 - Reserved sequence number
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_SEQ_Reserve( MD5_SEQ_Type* psSeq )
+{
+   UINT64 lSeq;
+
+   pthread_mutex_lock( &psSeq->sLock );
+
+   while( psSeq->lNextSeq - psSeq->lNextEmit >= psSeq->dwWindow )
+   {
+      pthread_cond_wait( &psSeq->sSpaceCond, &psSeq->sLock );
+   }
+
+   lSeq = psSeq->lNextSeq++;
+
+   pthread_mutex_unlock( &psSeq->sLock );
+
+   return lSeq;
+}
+
+/*------------------------------------------------------------------------------
+** Completes a reserved sequence number and emits every item that is now next
+** in line.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq  - Reorder buffer
+**    lSeq   - Sequence number returned by MD5_SEQ_Reserve()
+**    pxItem - Completed item (must not be NULL)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SEQ_Complete( MD5_SEQ_Type* psSeq, UINT64 lSeq, void* pxItem )
+{
+   BOOL fEmitted = FALSE;
+
+   pthread_mutex_lock( &psSeq->sLock );
+
+   psSeq->apxSlots[ lSeq % psSeq->dwWindow ] = pxItem;
+
+   while( psSeq->apxSlots[ psSeq->lNextEmit % psSeq->dwWindow ] != NULL )
+   {
+      void** ppxSlot = &psSeq->apxSlots[ psSeq->lNextEmit % psSeq->dwWindow ];
+
+      psSeq->pnEmit( *ppxSlot, psSeq->pxCtx );
+      *ppxSlot = NULL;
+      psSeq->lNextEmit++;
+      fEmitted = TRUE;
+   }
+
+   if( fEmitted )
+   {
+      pthread_cond_signal( &psSeq->sSpaceCond );
+   }
+
+   pthread_mutex_unlock( &psSeq->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Frees a reorder buffer. All reserved items must have been completed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq - Reorder buffer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SEQ_Free( MD5_SEQ_Type* psSeq )
+{
+   pthread_cond_destroy( &psSeq->sSpaceCond );
+   pthread_mutex_destroy( &psSeq->sLock );
+   free( psSeq->apxSlots );
+   psSeq->apxSlots = NULL;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
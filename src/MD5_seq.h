@@ -0,0 +1,109 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_seq.h
+**    Summary: Bounded reorder buffer. Producers reserve consecutive sequence
+**             numbers, results complete in any order on the worker threads
+**             and are emitted strictly in sequence order. Reserving blocks
+**             while the window is full, which bounds the work in flight.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_SEQ_H_
+#define HMS_SC_MD5_SEQ_H_
+
+#include "MD5_cfg.h"
+#include "MD5_int.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <pthread.h>
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Called for every completed item in sequence order, one call at a time.
+*/
+typedef void ( *MD5_SEQ_EmitFunc )( void* pxItem, void* pxCtx );
+
+typedef struct MD5_SEQ
+{
+   void** apxSlots;   /* Completed items, NULL while pending */
+   UINT32 dwWindow;   /* Maximum number of reserved, unemitted items */
+   UINT64 lNextSeq;   /* Next sequence number to reserve */
+   UINT64 lNextEmit;  /* Next sequence number to emit */
+   MD5_SEQ_EmitFunc pnEmit;
+   void* pxCtx;
+   pthread_mutex_t sLock;
+   pthread_cond_t sSpaceCond;
+} MD5_SEQ_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a reorder buffer.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq    - Reorder buffer to initialize
+**    dwWindow - Maximum number of items reserved but not yet emitted
+**    pnEmit   - Emit routine
+**    pxCtx    - Context handed to the emit routine
+**
+** Returns:
+**    BOOL - TRUE on success
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SEQ_Init( MD5_SEQ_Type* psSeq, UINT32 dwWindow, MD5_SEQ_EmitFunc pnEmit, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Reserves the next sequence number, blocking while the window is full.
+** Sequence numbers must be reserved by a single producer thread.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq - Reorder buffer
+**
+** Returns:
+**    UINT64 - Reserved sequence number
+**------------------------------------------------------------------------------
+*/
+UINT64 MD5_SEQ_Reserve( MD5_SEQ_Type* psSeq );
+
+/*------------------------------------------------------------------------------
+** Completes a reserved sequence number and emits every item that is now next
+** in line.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq  - Reorder buffer
+**    lSeq   - Sequence number returned by MD5_SEQ_Reserve()
+**    pxItem - Completed item (must not be NULL)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SEQ_Complete( MD5_SEQ_Type* psSeq, UINT64 lSeq, void* pxItem );
+
+/*------------------------------------------------------------------------------
+** Frees a reorder buffer. All reserved items must have been completed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psSeq - Reorder buffer
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SEQ_Free( MD5_SEQ_Type* psSeq );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_SEQ_H_ */
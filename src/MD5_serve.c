@@ -0,0 +1,853 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_serve.c
+**    Summary: Local hashing service and its client. The requests of a
+**             message are hashed on the workers in parallel, the messages of
+**             a connection one after the other.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* F_GET_SEALS */
+#endif
+
+#include "MD5_serve.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+struct MD5_SERVE_Connection;
+
+/*
+** A HASH_PATH or HASH_FD request, hashed on a worker
+*/
+typedef struct MD5_SERVE_Call
+{
+   struct MD5_SERVE_Connection* psConn;
+   MD5_RPC_RequestType sRequest;
+   const UINT8* pbPayload;
+   int iFd;                             /* HASH_FD: fd passed for the request, or -1 */
+   MD5_RPC_ResponseType* psResponse;
+} MD5_SERVE_CallType;
+
+/*
+** A client connection, served by a thread of its own
+*/
+typedef struct MD5_SERVE_Connection
+{
+   MD5_SERVE_Type* psServer;
+   struct MD5_SERVE_Connection* psNext;
+   int iSocket;
+   pthread_mutex_t sLock;
+   pthread_cond_t sDone;                /* Signalled when the last call is done */
+   UINT32 dwPending;                    /* Calls of the message still running */
+   MD5_InstType sInst;                  /* HASH_DATA requests, hashed in place */
+   MD5_RPC_MessageType sMessage;
+   MD5_SERVE_CallType asCalls[ MD5_RPC_MAX_REQUESTS ];
+   MD5_RPC_ResponseType asResponses[ MD5_RPC_MAX_REQUESTS ];
+} MD5_SERVE_ConnectionType;
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static int MD5_SERVE_HashPath( MD5_IO_WorkerType* psWorker, const MD5_SERVE_CallType* psCall );
+static int MD5_SERVE_HashFd( MD5_IO_WorkerType* psWorker, const MD5_SERVE_CallType* psCall );
+static void MD5_SERVE_Job( void* pxArg, UINT16 iWorker );
+static BOOL MD5_SERVE_Message( MD5_SERVE_ConnectionType* psConn );
+static void MD5_SERVE_RemoveConnection( MD5_SERVE_Type* psServer,
+                                        MD5_SERVE_ConnectionType* psConn );
+static void MD5_SERVE_FreeConnection( MD5_SERVE_ConnectionType* psConn );
+static void* MD5_SERVE_ConnectionMain( void* pxArg );
+static BOOL MD5_SERVE_Receive( MD5_SERVE_ClientType* psClient );
+static BOOL MD5_SERVE_Send( MD5_SERVE_ClientType* psClient );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Hashes the file named by a HASH_PATH request.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    psCall   - Request, receives the response
+**
+** Returns:
+**    int - 0 or the errno of the failed operation
+**------------------------------------------------------------------------------
+*/
+static int MD5_SERVE_HashPath( MD5_IO_WorkerType* psWorker, const MD5_SERVE_CallType* psCall )
+{
+   UINT32 dwLength = psCall->sRequest.dwLength;
+   char* pacPath;
+   int iError = 0;
+
+   if( ( dwLength == 0 ) || ( memchr( psCall->pbPayload, '\0', dwLength ) != NULL ) )
+   {
+      return EINVAL;
+   }
+
+   pacPath = malloc( dwLength + 1 );
+
+   if( pacPath == NULL )
+   {
+      return ENOMEM;
+   }
+
+   memcpy( pacPath, psCall->pbPayload, dwLength );
+   pacPath[ dwLength ] = '\0';
+
+   if( !MD5_IO_HashPath( psWorker, pacPath, psCall->psResponse->abDigest,
+                         &psCall->psResponse->lSize ) )
+   {
+      iError = errno;
+   }
+
+   free( pacPath );
+
+   return iError;
+}
+
+/*------------------------------------------------------------------------------
+** Hashes the range of a HASH_FD request. A memfd sealed against shrinking is
+** mapped and hashed in place: the client can't truncate it under the
+** mapping. Other regular files are read with pread(), anything else (pipes,
+** sockets) to its end.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWorker - Worker providing the MD5 instance and read buffer
+**    psCall   - Request, receives the response
+**
+** Returns:
+**    int - 0 or the errno of the failed operation
+**------------------------------------------------------------------------------
+*/
+static int MD5_SERVE_HashFd( MD5_IO_WorkerType* psWorker, const MD5_SERVE_CallType* psCall )
+{
+   MD5_RPC_ResponseType* psResponse = psCall->psResponse;
+   UINT64 lOffset                   = psCall->sRequest.lOffset;
+   UINT64 lSize                     = psCall->sRequest.lSize;
+   UINT64 lHashed                   = 0;
+   struct stat sStat;
+
+   if( psCall->iFd < 0 )
+   {
+      return EBADF;
+   }
+
+   if( fstat( psCall->iFd, &sStat ) != 0 )
+   {
+      return errno;
+   }
+
+   if( !S_ISREG( sStat.st_mode ) )
+   {
+      if( ( lOffset != 0 ) || ( lSize != MD5_RPC_TO_END ) )
+      {
+         return ESPIPE;
+      }
+
+      if( !MD5_IO_HashFd( psWorker, psCall->iFd, psResponse->abDigest, &psResponse->lSize ) )
+      {
+         return errno;
+      }
+
+      return 0;
+   }
+
+   if( lOffset > (UINT64)sStat.st_size )
+   {
+      return EINVAL;
+   }
+
+   if( lSize == MD5_RPC_TO_END )
+   {
+      lSize = (UINT64)sStat.st_size - lOffset;
+   }
+   else if( lSize > (UINT64)sStat.st_size - lOffset )
+   {
+      return EINVAL;
+   }
+
+   MD5_Init( &psWorker->sInst );
+
+#if defined( F_GET_SEALS )
+   {
+      int iSeals       = fcntl( psCall->iFd, F_GET_SEALS );
+      UINT64 lStart    = lOffset & ~( (UINT64)sysconf( _SC_PAGESIZE ) - 1 );
+      UINT64 lMapSize  = lOffset + lSize - lStart;
+      UINT8* pbMapping = MAP_FAILED;
+
+      if( ( iSeals >= 0 ) && ( ( iSeals & F_SEAL_SHRINK ) != 0 ) && ( lSize > 0 ) &&
+          ( lMapSize == (size_t)lMapSize ) )
+      {
+         pbMapping =
+            mmap( NULL, (size_t)lMapSize, PROT_READ, MAP_SHARED, psCall->iFd, (off_t)lStart );
+      }
+
+      if( pbMapping != MAP_FAILED )
+      {
+         const UINT8* pbData = pbMapping + ( lOffset - lStart );
+
+         while( lHashed < lSize )
+         {
+            UINT32 dwPart =
+               ( lSize - lHashed > 0x40000000U ) ? 0x40000000U : (UINT32)( lSize - lHashed );
+
+            MD5_UpdateLarge( &psWorker->sInst, &pbData[ lHashed ], dwPart );
+            lHashed += dwPart;
+         }
+
+         munmap( pbMapping, (size_t)lMapSize );
+      }
+   }
+#endif
+
+   /* A file that shrank yields the digest of the bytes that were left */
+   while( lHashed < lSize )
+   {
+      UINT64 lLeft       = lSize - lHashed;
+      UINT32 dwChunk     =
+         ( lLeft < psWorker->dwBufferSize ) ? (UINT32)lLeft : psWorker->dwBufferSize;
+      ssize_t iBytesRead = MD5_IO_ReadAt( psWorker, psCall->iFd, psWorker->pbBuffer, dwChunk,
+                                         (off_t)( lOffset + lHashed ) );
+
+      if( iBytesRead < 0 )
+      {
+         if( errno == EINTR )
+         {
+            continue;
+         }
+
+         return errno;
+      }
+
+      if( iBytesRead == 0 )
+      {
+         break;
+      }
+
+      MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+      lHashed += (UINT64)iBytesRead;
+   }
+
+   MD5_Peek( &psWorker->sInst, psResponse->abDigest );
+   psResponse->lSize = lHashed;
+
+   return 0;
+}
+
+/*------------------------------------------------------------------------------
+** Pool job, hashes one request of a message.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Call to hash
+**    iWorker - Worker running the job
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_SERVE_Job( void* pxArg, UINT16 iWorker )
+{
+   MD5_SERVE_CallType* psCall       = (MD5_SERVE_CallType*)pxArg;
+   MD5_SERVE_ConnectionType* psConn = psCall->psConn;
+   MD5_IO_WorkerType* psWorker      = psConn->psServer->apsWorkers[ iWorker ];
+   int iError;
+
+   if( psCall->sRequest.bOp == MD5_RPC_OP_HASH_PATH )
+   {
+      iError = MD5_SERVE_HashPath( psWorker, psCall );
+   }
+   else
+   {
+      iError = MD5_SERVE_HashFd( psWorker, psCall );
+   }
+
+   psCall->psResponse->dwError = (UINT32)iError;
+
+   pthread_mutex_lock( &psConn->sLock );
+
+   if( --psConn->dwPending == 0 )
+   {
+      pthread_cond_signal( &psConn->sDone );
+   }
+
+   pthread_mutex_unlock( &psConn->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Answers the request message received on a connection. Paths and fds are
+** hashed on the workers, data in place while they run.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psConn - Connection holding the message
+**
+** Returns:
+**    BOOL - FALSE if the message is malformed or the responses could not be
+**           sent (errno is set), which ends the connection
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_SERVE_Message( MD5_SERVE_ConnectionType* psConn )
+{
+   MD5_RPC_MessageType* psMessage = &psConn->sMessage;
+   const UINT8* pbPayload;
+   MD5_RPC_RequestType sRequest;
+   UINT32 dwOffset  = 0;
+   UINT16 iNumCalls = 0;
+   UINT16 iNumFds   = 0;
+   UINT32 dwNumJobs = 0;
+   BOOL fSuccess;
+   UINT16 iCall;
+
+   while( MD5_RPC_NextRequest( psMessage, &dwOffset, &sRequest, &pbPayload ) )
+   {
+      MD5_SERVE_CallType* psCall = &psConn->asCalls[ iNumCalls ];
+
+      psCall->psConn     = psConn;
+      psCall->sRequest   = sRequest;
+      psCall->pbPayload  = pbPayload;
+      psCall->iFd        = -1;
+      psCall->psResponse = &psConn->asResponses[ iNumCalls ];
+
+      memset( psCall->psResponse, 0, sizeof( MD5_RPC_ResponseType ) );
+      psCall->psResponse->dwId = sRequest.dwId;
+
+      /* The fds of a message belong to its HASH_FD requests in order */
+      if( ( sRequest.bOp == MD5_RPC_OP_HASH_FD ) && ( iNumFds < psMessage->iNumFds ) )
+      {
+         psCall->iFd = psMessage->aiFds[ iNumFds++ ];
+      }
+
+      if( ( sRequest.bOp == MD5_RPC_OP_HASH_PATH ) || ( sRequest.bOp == MD5_RPC_OP_HASH_FD ) )
+      {
+         dwNumJobs++;
+      }
+      else if( sRequest.bOp != MD5_RPC_OP_HASH_DATA )
+      {
+         psCall->psResponse->dwError = EINVAL;
+      }
+
+      iNumCalls++;
+   }
+
+   fSuccess = ( dwOffset == psMessage->dwLength );
+
+   if( fSuccess )
+   {
+      /* Counted up front, so the count can't reach zero before all jobs are queued */
+      psConn->dwPending = dwNumJobs;
+
+      for( iCall = 0; iCall < iNumCalls; iCall++ )
+      {
+         MD5_SERVE_CallType* psCall = &psConn->asCalls[ iCall ];
+
+         if( ( psCall->sRequest.bOp == MD5_RPC_OP_HASH_PATH ) ||
+             ( psCall->sRequest.bOp == MD5_RPC_OP_HASH_FD ) )
+         {
+            MD5_POOL_Submit( psConn->psServer->psPool, MD5_SERVE_Job, psCall );
+         }
+      }
+
+      for( iCall = 0; iCall < iNumCalls; iCall++ )
+      {
+         MD5_SERVE_CallType* psCall = &psConn->asCalls[ iCall ];
+
+         if( psCall->sRequest.bOp == MD5_RPC_OP_HASH_DATA )
+         {
+            MD5_Init( &psConn->sInst );
+            MD5_UpdateLarge( &psConn->sInst, psCall->pbPayload, psCall->sRequest.dwLength );
+            MD5_Peek( &psConn->sInst, psCall->psResponse->abDigest );
+            psCall->psResponse->lSize = psCall->sRequest.dwLength;
+         }
+      }
+
+      pthread_mutex_lock( &psConn->sLock );
+
+      while( psConn->dwPending > 0 )
+      {
+         pthread_cond_wait( &psConn->sDone, &psConn->sLock );
+      }
+
+      pthread_mutex_unlock( &psConn->sLock );
+   }
+
+   for( iCall = 0; iCall < psMessage->iNumFds; iCall++ )
+   {
+      close( psMessage->aiFds[ iCall ] );
+   }
+
+   if( !fSuccess )
+   {
+      errno = EPROTO;
+      return FALSE;
+   }
+
+   return MD5_RPC_SendResponses( psConn->iSocket, psConn->asResponses, iNumCalls );
+}
+
+/*------------------------------------------------------------------------------
+** Takes a connection off the service's list; the last one wakes up a
+** stopping service.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer - Service
+**    psConn   - Connection that ends
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_SERVE_RemoveConnection( MD5_SERVE_Type* psServer, MD5_SERVE_ConnectionType* psConn )
+{
+   MD5_SERVE_ConnectionType** ppsLink;
+
+   pthread_mutex_lock( &psServer->sLock );
+
+   for( ppsLink = &psServer->psConnections; *ppsLink != psConn; ppsLink = &( *ppsLink )->psNext )
+   {
+   }
+
+   *ppsLink = psConn->psNext;
+
+   if( --psServer->dwNumConnections == 0 )
+   {
+      pthread_cond_signal( &psServer->sIdle );
+   }
+
+   pthread_mutex_unlock( &psServer->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Closes the socket of a connection taken off the list and frees it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psConn - Connection to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_SERVE_FreeConnection( MD5_SERVE_ConnectionType* psConn )
+{
+   close( psConn->iSocket );
+   pthread_cond_destroy( &psConn->sDone );
+   pthread_mutex_destroy( &psConn->sLock );
+   free( psConn );
+}
+
+/*------------------------------------------------------------------------------
+** Thread of a connection, answers its messages until the client closes the
+** connection or breaks the protocol.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg - Connection
+**
+** Returns:
+**    void* - NULL
+**------------------------------------------------------------------------------
+*/
+static void* MD5_SERVE_ConnectionMain( void* pxArg )
+{
+   MD5_SERVE_ConnectionType* psConn = (MD5_SERVE_ConnectionType*)pxArg;
+   MD5_SERVE_Type* psServer         = psConn->psServer;
+
+   while( MD5_RPC_ReceiveMessage( psConn->iSocket, &psConn->sMessage ) &&
+          MD5_SERVE_Message( psConn ) )
+   {
+   }
+
+   if( ( errno != 0 ) && ( psServer->pnError != NULL ) )
+   {
+      psServer->pnError( errno, psServer->pxCtx );
+   }
+
+   MD5_SERVE_RemoveConnection( psServer, psConn );
+   MD5_SERVE_FreeConnection( psConn );
+
+   return NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Receives the responses to the oldest message in flight and reports them
+** in submission order.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client with a message in flight
+**
+** Returns:
+**    BOOL - FALSE if the service went away or answered something else
+**           (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_SERVE_Receive( MD5_SERVE_ClientType* psClient )
+{
+   MD5_SERVE_BatchType* psBatch = &psClient->asBatches[ psClient->iFirst ];
+   long lNumResponses           =
+      MD5_RPC_ReceiveResponses( psClient->iSocket, psClient->asResponses );
+   BOOL fSuccess                = ( lNumResponses == (long)psBatch->iNumNames );
+   UINT16 iName;
+
+   if( fSuccess )
+   {
+      for( iName = 0; iName < psBatch->iNumNames; iName++ )
+      {
+         if( psClient->asResponses[ iName ].dwId != psBatch->dwFirstId + iName )
+         {
+            fSuccess = FALSE;
+         }
+      }
+   }
+
+   /* The service went away (errno 0) or answered something else */
+   if( !fSuccess && ( ( lNumResponses >= 0 ) || ( errno == 0 ) ) )
+   {
+      errno = ( lNumResponses >= 0 ) ? EPROTO : ECONNRESET;
+   }
+
+   for( iName = 0; fSuccess && ( iName < psBatch->iNumNames ); iName++ )
+   {
+      const MD5_RPC_ResponseType* psResponse = &psClient->asResponses[ iName ];
+
+      if( psResponse->dwError != 0 )
+      {
+         psClient->pnResult( psBatch->apacNames[ iName ], NULL, (int)psResponse->dwError,
+                             psClient->pxCtx );
+      }
+      else
+      {
+         psClient->pnResult( psBatch->apacNames[ iName ], psResponse->abDigest, 0,
+                             psClient->pxCtx );
+      }
+   }
+
+   for( iName = 0; iName < psBatch->iNumNames; iName++ )
+   {
+      free( psBatch->apacNames[ iName ] );
+   }
+
+   psBatch->iNumNames = 0;
+   psClient->iFirst   = ( psClient->iFirst + 1 ) % MD5_SERVE_PIPELINE_DEPTH;
+   psClient->iNumSent--;
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Sends the message being built. Once MD5_SERVE_PIPELINE_DEPTH messages are
+** in flight, the responses to the oldest are received.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client
+**
+** Returns:
+**    BOOL - FALSE if the service failed or went away (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_SERVE_Send( MD5_SERVE_ClientType* psClient )
+{
+   if( !MD5_RPC_SendMessage( psClient->iSocket, &psClient->sMessage ) )
+   {
+      return FALSE;
+   }
+
+   psClient->iNumSent++;
+
+   if( psClient->iNumSent == MD5_SERVE_PIPELINE_DEPTH )
+   {
+      return MD5_SERVE_Receive( psClient );
+   }
+
+   return TRUE;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares a service without connections.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer   - Service to initialize
+**    psPool     - Pool the requests are hashed on
+**    apsWorkers - Per-worker MD5 instance and read buffer of the pool
+**    pnError    - Called when a connection breaks off (may be NULL)
+**    pxCtx      - Passed to pnError
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Init( MD5_SERVE_Type* psServer, MD5_POOL_Type* psPool,
+                     MD5_IO_WorkerType* apsWorkers[], MD5_SERVE_ErrorFunc pnError, void* pxCtx )
+{
+   memset( psServer, 0, sizeof( MD5_SERVE_Type ) );
+
+   psServer->psPool     = psPool;
+   psServer->apsWorkers = apsWorkers;
+   psServer->pnError    = pnError;
+   psServer->pxCtx      = pxCtx;
+
+   pthread_mutex_init( &psServer->sLock, NULL );
+   pthread_cond_init( &psServer->sIdle, NULL );
+   pthread_attr_init( &psServer->sAttributes );
+   pthread_attr_setdetachstate( &psServer->sAttributes, PTHREAD_CREATE_DETACHED );
+}
+
+/*------------------------------------------------------------------------------
+** Serves an accepted connection on a thread of its own until the client
+** closes it or breaks the protocol.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer - Service
+**    iSocket  - Accepted socket, taken over (closed if refused)
+**
+** Returns:
+**    BOOL - FALSE if the connection was refused: MD5_SERVE_MAX_CONNECTIONS
+**           are served already, or memory or threads ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Accept( MD5_SERVE_Type* psServer, int iSocket )
+{
+   MD5_SERVE_ConnectionType* psConn = NULL;
+   pthread_t sThread;
+
+   pthread_mutex_lock( &psServer->sLock );
+
+   if( psServer->dwNumConnections < MD5_SERVE_MAX_CONNECTIONS )
+   {
+      psConn = malloc( sizeof( MD5_SERVE_ConnectionType ) );
+   }
+
+   if( psConn != NULL )
+   {
+      psConn->psServer          = psServer;
+      psConn->iSocket           = iSocket;
+      psConn->dwPending         = 0;
+      psConn->sMessage.dwLength = 0;
+      psConn->psNext            = psServer->psConnections;
+      pthread_mutex_init( &psConn->sLock, NULL );
+      pthread_cond_init( &psConn->sDone, NULL );
+
+      psServer->psConnections = psConn;
+      psServer->dwNumConnections++;
+   }
+
+   pthread_mutex_unlock( &psServer->sLock );
+
+   if( psConn == NULL )
+   {
+      /* The client sees the connection end */
+      close( iSocket );
+      return FALSE;
+   }
+
+   if( pthread_create( &sThread, &psServer->sAttributes, MD5_SERVE_ConnectionMain, psConn ) != 0 )
+   {
+      MD5_SERVE_RemoveConnection( psServer, psConn );
+      MD5_SERVE_FreeConnection( psConn );
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Ends all connections once their current message is answered and releases
+** the service. The pool is left running.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer - Service to stop
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Stop( MD5_SERVE_Type* psServer )
+{
+   MD5_SERVE_ConnectionType* psConn;
+
+   pthread_mutex_lock( &psServer->sLock );
+
+   for( psConn = psServer->psConnections; psConn != NULL; psConn = psConn->psNext )
+   {
+      shutdown( psConn->iSocket, SHUT_RDWR );
+   }
+
+   while( psServer->dwNumConnections > 0 )
+   {
+      pthread_cond_wait( &psServer->sIdle, &psServer->sLock );
+   }
+
+   pthread_mutex_unlock( &psServer->sLock );
+
+   pthread_attr_destroy( &psServer->sAttributes );
+   pthread_cond_destroy( &psServer->sIdle );
+   pthread_mutex_destroy( &psServer->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Connects a client to a service.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient  - Client to initialize
+**    pacSocket - Path of the service socket
+**    pnResult  - Called for every submitted name
+**    pxCtx     - Passed to pnResult
+**
+** Returns:
+**    BOOL - FALSE if the service could not be reached (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Connect( MD5_SERVE_ClientType* psClient, const char* pacSocket,
+                        MD5_SERVE_ResultFunc pnResult, void* pxCtx )
+{
+   memset( psClient, 0, sizeof( MD5_SERVE_ClientType ) );
+
+   psClient->pnResult = pnResult;
+   psClient->pxCtx    = pxCtx;
+   psClient->iSocket  = MD5_RPC_Connect( pacSocket );
+
+   return ( psClient->iSocket >= 0 );
+}
+
+/*------------------------------------------------------------------------------
+** Queues a file to be hashed by the service. A full message is sent; once
+** MD5_SERVE_PIPELINE_DEPTH messages are in flight, the responses to the
+** oldest are received first, which bounds the data queued in either
+** direction.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client
+**    pacName  - Name reported to pnResult, allocated with malloc() and
+**               taken over in any case
+**    pacPath  - Path the service opens; relative paths are resolved in the
+**               service's working directory
+**
+** Returns:
+**    BOOL - FALSE if the service failed or went away (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Submit( MD5_SERVE_ClientType* psClient, char* pacName, const char* pacPath )
+{
+   MD5_SERVE_BatchType* psBatch;
+   MD5_RPC_RequestType sRequest;
+
+   memset( &sRequest, 0, sizeof( sRequest ) );
+   sRequest.dwId     = psClient->dwNextId;
+   sRequest.bOp      = MD5_RPC_OP_HASH_PATH;
+   sRequest.dwLength = (UINT32)strlen( pacPath );
+
+   if( !MD5_RPC_AddRequest( &psClient->sMessage, &sRequest, pacPath, -1 ) )
+   {
+      /* Full: send it and start the next one */
+      if( ( psClient->sMessage.iNumRequests > 0 ) && !MD5_SERVE_Send( psClient ) )
+      {
+         free( pacName );
+         return FALSE;
+      }
+
+      if( !MD5_RPC_AddRequest( &psClient->sMessage, &sRequest, pacPath, -1 ) )
+      {
+         psClient->pnResult( pacName, NULL, ENAMETOOLONG, psClient->pxCtx );
+         free( pacName );
+         return TRUE;
+      }
+   }
+
+   psBatch =
+      &psClient->asBatches[ ( psClient->iFirst + psClient->iNumSent ) % MD5_SERVE_PIPELINE_DEPTH ];
+
+   if( psBatch->iNumNames == 0 )
+   {
+      psBatch->dwFirstId = psClient->dwNextId;
+   }
+
+   psBatch->apacNames[ psBatch->iNumNames++ ] = pacName;
+   psClient->dwNextId++;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Sends the message being built and waits for all responses.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client
+**
+** Returns:
+**    BOOL - FALSE if the service failed or went away (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Finish( MD5_SERVE_ClientType* psClient )
+{
+   BOOL fSuccess = TRUE;
+
+   if( psClient->sMessage.iNumRequests > 0 )
+   {
+      fSuccess = MD5_SERVE_Send( psClient );
+   }
+
+   while( fSuccess && ( psClient->iNumSent > 0 ) )
+   {
+      fSuccess = MD5_SERVE_Receive( psClient );
+   }
+
+   return fSuccess;
+}
+
+/*------------------------------------------------------------------------------
+** Closes the connection of a client. Names left unanswered after a failure
+** are dropped without a result.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Disconnect( MD5_SERVE_ClientType* psClient )
+{
+   UINT16 iBatch;
+
+   for( iBatch = 0; iBatch < MD5_SERVE_PIPELINE_DEPTH; iBatch++ )
+   {
+      MD5_SERVE_BatchType* psBatch = &psClient->asBatches[ iBatch ];
+
+      while( psBatch->iNumNames > 0 )
+      {
+         free( psBatch->apacNames[ --psBatch->iNumNames ] );
+      }
+   }
+
+   if( psClient->iSocket >= 0 )
+   {
+      close( psClient->iSocket );
+      psClient->iSocket = -1;
+   }
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,214 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_serve.h
+**    Summary: Local hashing service and its client, on top of the protocol
+**             of MD5_rpc.h.
+**
+**             The service hashes on the workers of a pool that is set up
+**             once and shared by all connections, so a client pays for
+**             neither thread start-up nor buffer allocation. Every
+**             connection has a thread of its own that hands the requests of
+**             its messages to the workers. Accepting connections is left to
+**             the caller, who knows how it wants to be stopped.
+**
+**             The client batches HASH_PATH requests into messages and keeps
+**             up to MD5_SERVE_PIPELINE_DEPTH messages in flight. Results are
+**             reported in submission order.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_SERVE_H_
+#define HMS_SC_MD5_SERVE_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include "MD5_io.h"
+#include "MD5_pool.h"
+#include "MD5_rpc.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_SERVE_MAX_CONNECTIONS      ( 64U ) /* Further clients see their connection end */
+#define MD5_SERVE_PIPELINE_DEPTH       ( 2U )  /* Messages a client keeps in flight */
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Called by a connection thread when its connection breaks off, with the
+** errno of the failed operation. A client that closes its end is no error.
+*/
+typedef void ( *MD5_SERVE_ErrorFunc )( int iError, void* pxCtx );
+
+typedef struct MD5_SERVE
+{
+   MD5_POOL_Type* psPool;
+   MD5_IO_WorkerType** apsWorkers;       /* Per-worker MD5 instance and read buffer */
+   pthread_mutex_t sLock;
+   pthread_cond_t sIdle;                 /* Signalled when the last connection ends */
+   pthread_attr_t sAttributes;           /* Detached connection threads */
+   struct MD5_SERVE_Connection* psConnections;
+   UINT32 dwNumConnections;
+   MD5_SERVE_ErrorFunc pnError;
+   void* pxCtx;
+} MD5_SERVE_Type;
+
+/*
+** Called one at a time for every name submitted to the client, in
+** submission order. pbDigest is NULL if the file could not be hashed.
+*/
+typedef void ( *MD5_SERVE_ResultFunc )( const char* pacName, const UINT8* pbDigest, int iError,
+                                        void* pxCtx );
+
+/*
+** A request message of the client: the names it hashes, in request order.
+** Request ids are consecutive from dwFirstId.
+*/
+typedef struct MD5_SERVE_Batch
+{
+   char* apacNames[ MD5_RPC_MAX_REQUESTS ];
+   UINT16 iNumNames;
+   UINT32 dwFirstId;
+} MD5_SERVE_BatchType;
+
+/*
+** The batches form a ring: the messages that wait for their responses,
+** oldest first, followed by the one being built.
+*/
+typedef struct MD5_SERVE_Client
+{
+   int iSocket;
+   UINT32 dwNextId;
+   UINT16 iFirst;
+   UINT16 iNumSent;
+   MD5_SERVE_BatchType asBatches[ MD5_SERVE_PIPELINE_DEPTH ];
+   MD5_RPC_MessageType sMessage;
+   MD5_RPC_ResponseType asResponses[ MD5_RPC_MAX_REQUESTS ];
+   MD5_SERVE_ResultFunc pnResult;
+   void* pxCtx;
+} MD5_SERVE_ClientType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Prepares a service without connections.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer   - Service to initialize
+**    psPool     - Pool the requests are hashed on
+**    apsWorkers - Per-worker MD5 instance and read buffer of the pool
+**    pnError    - Called when a connection breaks off (may be NULL)
+**    pxCtx      - Passed to pnError
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Init( MD5_SERVE_Type* psServer, MD5_POOL_Type* psPool,
+                     MD5_IO_WorkerType* apsWorkers[], MD5_SERVE_ErrorFunc pnError, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Serves an accepted connection on a thread of its own until the client
+** closes it or breaks the protocol.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer - Service
+**    iSocket  - Accepted socket, taken over (closed if refused)
+**
+** Returns:
+**    BOOL - FALSE if the connection was refused: MD5_SERVE_MAX_CONNECTIONS
+**           are served already, or memory or threads ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Accept( MD5_SERVE_Type* psServer, int iSocket );
+
+/*------------------------------------------------------------------------------
+** Ends all connections once their current message is answered and releases
+** the service. The pool is left running.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psServer - Service to stop
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Stop( MD5_SERVE_Type* psServer );
+
+/*------------------------------------------------------------------------------
+** Connects a client to a service.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient  - Client to initialize
+**    pacSocket - Path of the service socket
+**    pnResult  - Called for every submitted name
+**    pxCtx     - Passed to pnResult
+**
+** Returns:
+**    BOOL - FALSE if the service could not be reached (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Connect( MD5_SERVE_ClientType* psClient, const char* pacSocket,
+                        MD5_SERVE_ResultFunc pnResult, void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Queues a file to be hashed by the service. A full message is sent; once
+** MD5_SERVE_PIPELINE_DEPTH messages are in flight, the responses to the
+** oldest are received first, which bounds the data queued in either
+** direction.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client
+**    pacName  - Name reported to pnResult, allocated with malloc() and
+**               taken over in any case
+**    pacPath  - Path the service opens; relative paths are resolved in the
+**               service's working directory
+**
+** Returns:
+**    BOOL - FALSE if the service failed or went away (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Submit( MD5_SERVE_ClientType* psClient, char* pacName, const char* pacPath );
+
+/*------------------------------------------------------------------------------
+** Sends the message being built and waits for all responses.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client
+**
+** Returns:
+**    BOOL - FALSE if the service failed or went away (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_SERVE_Finish( MD5_SERVE_ClientType* psClient );
+
+/*------------------------------------------------------------------------------
+** Closes the connection of a client. Names left unanswered after a failure
+** are dropped without a result.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psClient - Client to release
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_SERVE_Disconnect( MD5_SERVE_ClientType* psClient );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_SERVE_H_ */
@@ -0,0 +1,385 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_state.c
+**    Summary: Saved hashing state of a file, see MD5_state.h.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_state.h"
+#include "MD5_io.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+/* Tag, seven numbers, the sample digest and the state, with separators */
+#define MD5_STATE_MAX_LINE_LEN         ( 192U + 2U * ( MD5_DIGEST_SIZE + MD5_STATE_SIZE ) )
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static void MD5_STATE_WriteHex( FILE* psFile, const UINT8* pbData, UINT16 iLen );
+static const char* MD5_STATE_ParseHex( const char* pacHex, UINT8* pbData, UINT16 iLen );
+static const char* MD5_STATE_ParseNumber( const char* pacText, UINT64* plValue );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Writes data as lower case hexadecimal characters.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psFile - Stream to write to
+**    pbData - Data to write
+**    iLen   - Length of the data in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_STATE_WriteHex( FILE* psFile, const UINT8* pbData, UINT16 iLen )
+{
+   UINT16 iIndex;
+
+   for( iIndex = 0; iIndex < iLen; iIndex++ )
+   {
+      fprintf( psFile, "%02x", pbData[ iIndex ] );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Parses iLen bytes of hexadecimal data.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacHex - Hexadecimal characters
+**    pbData - Receives the data
+**    iLen   - Number of bytes to parse
+**
+** Returns:
+**    const char* - Character following the data, NULL on an invalid character
+**------------------------------------------------------------------------------
+*/
+static const char* MD5_STATE_ParseHex( const char* pacHex, UINT8* pbData, UINT16 iLen )
+{
+   char acByte[ 3 ] = { 0 };
+   UINT16 iIndex;
+
+   for( iIndex = 0; iIndex < iLen; iIndex++ )
+   {
+      if( !isxdigit( (unsigned char)pacHex[ 0 ] ) || !isxdigit( (unsigned char)pacHex[ 1 ] ) )
+      {
+         return NULL;
+      }
+
+      acByte[ 0 ]      = *pacHex++;
+      acByte[ 1 ]      = *pacHex++;
+      pbData[ iIndex ] = (UINT8)strtoul( acByte, NULL, 16 );
+   }
+
+   return pacHex;
+}
+
+/*------------------------------------------------------------------------------
+** Parses a decimal number followed by a space.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacText - Text to parse
+**    plValue - Receives the value
+**
+** Returns:
+**    const char* - Character following the space, NULL if there is no number
+**------------------------------------------------------------------------------
+*/
+static const char* MD5_STATE_ParseNumber( const char* pacText, UINT64* plValue )
+{
+   char* pacEnd;
+
+   if( !isdigit( (unsigned char)*pacText ) )
+   {
+      return NULL;
+   }
+
+   errno    = 0;
+   *plValue = (UINT64)strtoull( pacText, &pacEnd, 10 );
+
+   return ( ( errno == 0 ) && ( *pacEnd == ' ' ) ) ? pacEnd + 1 : NULL;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the tail sample of a prefix: the MD5 of its last dwSampleSize
+** bytes (or of the whole prefix, if it is shorter).
+**------------------------------------------------------------------------------
+** Arguments:
+**    iFd          - File to read with pread()
+**    lOffset      - Length of the prefix
+**    dwSampleSize - Sample length
+**    pbBuffer     - Read buffer
+**    dwBufferSize - Size of the read buffer in bytes
+**    pbDigest     - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_SampleTail( int iFd, UINT64 lOffset, UINT32 dwSampleSize, UINT8* pbBuffer,
+                           UINT32 dwBufferSize, UINT8* pbDigest )
+{
+   MD5_InstType sInst;
+   UINT64 lRemaining = ( lOffset < dwSampleSize ) ? lOffset : dwSampleSize;
+   UINT64 lPosition  = lOffset - lRemaining;
+
+   MD5_Init( &sInst );
+
+   while( lRemaining > 0 )
+   {
+      size_t iChunk      = ( lRemaining < dwBufferSize ) ? (size_t)lRemaining : dwBufferSize;
+      ssize_t iBytesRead = pread( iFd, pbBuffer, iChunk, (off_t)lPosition );
+
+      if( iBytesRead > 0 )
+      {
+         MD5_UpdateLarge( &sInst, pbBuffer, (UINT32)iBytesRead );
+         lPosition += (UINT64)iBytesRead;
+         lRemaining -= (UINT64)iBytesRead;
+      }
+      else if( iBytesRead == 0 )
+      {
+         /* The file shrank below the prefix */
+         errno = EIO;
+         return FALSE;
+      }
+      else if( errno != EINTR )
+      {
+         return FALSE;
+      }
+   }
+
+   MD5_Final( &sInst );
+   memcpy( pbDigest, sInst.adwDigest, MD5_DIGEST_SIZE );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Fills in the identity, size and times of the file a record describes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psRecord - Record to fill in
+**    psStat   - Status of the file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_STATE_SetFile( MD5_STATE_RecordType* psRecord, const struct stat* psStat )
+{
+   psRecord->lDevice  = (UINT64)psStat->st_dev;
+   psRecord->lInode   = (UINT64)psStat->st_ino;
+   psRecord->lSize    = (UINT64)psStat->st_size;
+   psRecord->lMtimeNs =
+      (UINT64)psStat->st_mtim.tv_sec * 1000000000ULL + (UINT64)psStat->st_mtim.tv_nsec;
+   psRecord->lCtimeNs =
+      (UINT64)psStat->st_ctim.tv_sec * 1000000000ULL + (UINT64)psStat->st_ctim.tv_nsec;
+}
+
+/*------------------------------------------------------------------------------
+** Checks whether the prefix a record describes is still the start of a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psRecord     - Saved state
+**    iFd          - The file, open for reading
+**    fGrowing     - TRUE if the file may have grown since the state was saved,
+**                   FALSE if its size and times must be unchanged as well
+**    pbBuffer     - Read buffer for the tail sample
+**    dwBufferSize - Size of the read buffer in bytes
+**
+** Returns:
+**    const char* - NULL if the prefix is unchanged, otherwise the reason why
+**                  the state can't be used
+**------------------------------------------------------------------------------
+*/
+const char* MD5_STATE_CheckPrefix( const MD5_STATE_RecordType* psRecord, int iFd, BOOL fGrowing,
+                                   UINT8* pbBuffer, UINT32 dwBufferSize )
+{
+   UINT8 abSample[ MD5_DIGEST_SIZE ];
+   MD5_STATE_RecordType sNow;
+   struct stat sStat;
+
+   if( fstat( iFd, &sStat ) != 0 )
+   {
+      return strerror( errno );
+   }
+
+   MD5_STATE_SetFile( &sNow, &sStat );
+
+   if( ( sNow.lDevice != psRecord->lDevice ) || ( sNow.lInode != psRecord->lInode ) )
+   {
+      return "not the same file (replaced or rotated)";
+   }
+
+   if( sNow.lSize < psRecord->lOffset )
+   {
+      return "file is shorter than the hashed prefix (truncated)";
+   }
+
+   if( !fGrowing &&
+       ( ( sNow.lSize != psRecord->lSize ) || ( sNow.lMtimeNs != psRecord->lMtimeNs ) ||
+         ( sNow.lCtimeNs != psRecord->lCtimeNs ) ) )
+   {
+      return "file was modified since the state was saved (size or times differ)";
+   }
+
+   if( psRecord->dwSampleSize == 0 )
+   {
+      return NULL;
+   }
+
+   if( !MD5_STATE_SampleTail( iFd, psRecord->lOffset, psRecord->dwSampleSize, pbBuffer,
+                              dwBufferSize, abSample ) )
+   {
+      return strerror( errno );
+   }
+
+   if( memcmp( abSample, psRecord->abSample, MD5_DIGEST_SIZE ) != 0 )
+   {
+      return "end of the hashed prefix was modified";
+   }
+
+   return NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Reads a state file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - State file
+**    psRecord    - Receives the saved state
+**
+** Returns:
+**    BOOL - FALSE if the file could not be read (errno is set) or is not a
+**           valid state file, e.g. one whose state doesn't hold as many
+**           bytes as its offset (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_Read( const char* pacFilename, MD5_STATE_RecordType* psRecord )
+{
+   char acLine[ MD5_STATE_MAX_LINE_LEN ];
+   const size_t iTagLen = strlen( MD5_STATE_TAG );
+   const char* pacText  = acLine;
+   FILE* psFile         = fopen( pacFilename, "rb" );
+   UINT64 lSampleSize   = 0;
+   UINT64 lStateBytes   = 0;
+   BOOL fValid;
+   UINT8 bIndex;
+
+   if( psFile == NULL )
+   {
+      return FALSE;
+   }
+
+   fValid = ( fgets( acLine, sizeof( acLine ), psFile ) != NULL );
+   fclose( psFile );
+
+   fValid = fValid && ( strncmp( pacText, MD5_STATE_TAG, iTagLen ) == 0 ) &&
+            ( pacText[ iTagLen ] == ' ' );
+   pacText += iTagLen + 1;
+
+   fValid =
+      fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lDevice ) ) != NULL );
+   fValid = fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lInode ) ) != NULL );
+   fValid = fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lSize ) ) != NULL );
+   fValid =
+      fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lMtimeNs ) ) != NULL );
+   fValid =
+      fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lCtimeNs ) ) != NULL );
+   fValid =
+      fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &psRecord->lOffset ) ) != NULL );
+   fValid = fValid && ( ( pacText = MD5_STATE_ParseNumber( pacText, &lSampleSize ) ) != NULL ) &&
+            ( lSampleSize <= 0xFFFFFFFFULL );
+   fValid = fValid &&
+            ( ( pacText = MD5_STATE_ParseHex( pacText, psRecord->abSample,
+                                              MD5_DIGEST_SIZE ) ) != NULL ) &&
+            ( *pacText++ == ' ' );
+   fValid = fValid &&
+            ( ( pacText = MD5_STATE_ParseHex( pacText, psRecord->abState,
+                                              MD5_STATE_SIZE ) ) != NULL ) &&
+            ( ( *pacText == '\n' ) || ( *pacText == '\0' ) );
+
+   /* The state starts with its byte count, which must be the hashed prefix */
+   for( bIndex = 0; fValid && ( bIndex < 8 ); bIndex++ )
+   {
+      lStateBytes |= (UINT64)psRecord->abState[ bIndex ] << ( 8 * bIndex );
+   }
+
+   fValid =
+      fValid && ( lStateBytes == psRecord->lOffset ) && ( psRecord->lOffset <= psRecord->lSize );
+
+   if( !fValid )
+   {
+      errno = EINVAL;
+      return FALSE;
+   }
+
+   psRecord->dwSampleSize = (UINT32)lSampleSize;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Writes a state file. The state is written to a temporary file that is
+** synced and renamed over the old one, so a crash leaves either state intact.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - State file
+**    psRecord    - State to save
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_Write( const char* pacFilename, const MD5_STATE_RecordType* psRecord )
+{
+   MD5_IO_ReplaceType sReplace;
+
+   if( !MD5_IO_BeginReplace( &sReplace, pacFilename ) )
+   {
+      return FALSE;
+   }
+
+   fprintf( sReplace.psFile, "%s %llu %llu %llu %llu %llu %llu %u ", MD5_STATE_TAG,
+            (unsigned long long)psRecord->lDevice, (unsigned long long)psRecord->lInode,
+            (unsigned long long)psRecord->lSize, (unsigned long long)psRecord->lMtimeNs,
+            (unsigned long long)psRecord->lCtimeNs, (unsigned long long)psRecord->lOffset,
+            (unsigned int)psRecord->dwSampleSize );
+   MD5_STATE_WriteHex( sReplace.psFile, psRecord->abSample, MD5_DIGEST_SIZE );
+   fputc( ' ', sReplace.psFile );
+   MD5_STATE_WriteHex( sReplace.psFile, psRecord->abState, MD5_STATE_SIZE );
+   fputc( '\n', sReplace.psFile );
+
+   return MD5_IO_CommitReplace( &sReplace, TRUE );
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,152 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_state.h
+**    Summary: Saved hashing state of a file. A state file (sidecar) holds the
+**             MD5 midstate after a prefix of a file together with the length
+**             and identity of that prefix, so a later run can continue with
+**             the bytes that follow it instead of starting over.
+**
+**             The prefix is trusted if the file is the same (device and
+**             inode), is at least as long, and the last bytes of the prefix
+**             (the tail sample) still have the same MD5. A file that must
+**             not have changed at all (a resumed job) must also have kept
+**             its size, modification and status change time. Bytes before
+**             the tail sample are not re-read, so a file that only grows
+**             (append mode) and was rewritten in place with the same tail
+**             sample is not detected.
+**
+**             File format (text): a single line
+**                "md5-state <device> <inode> <size> <mtime> <ctime>
+**                 <offset> <sample size> <sample digest> <state>"
+**             with the times in ns since the epoch and the digest and the
+**             MD5_ExportState() state in hex.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_STATE_H_
+#define HMS_SC_MD5_STATE_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_STATE_TAG                  "md5-state"
+#define MD5_STATE_DEFAULT_SAMPLE_SIZE  ( 64U * 1024U )
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <sys/stat.h>
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_STATE_Record
+{
+   UINT64 lDevice;
+   UINT64 lInode;
+   UINT64 lSize;                       /* File size when the state was saved */
+   UINT64 lMtimeNs;                    /* Modification time, ns since the epoch */
+   UINT64 lCtimeNs;                    /* Status change time, ns since the epoch */
+   UINT64 lOffset;                     /* Length of the hashed prefix */
+   UINT32 dwSampleSize;                /* Tail sample length, 0: none */
+   UINT8 abSample[ MD5_DIGEST_SIZE ];  /* MD5 of the last dwSampleSize bytes */
+   UINT8 abState[ MD5_STATE_SIZE ];    /* MD5_ExportState() after lOffset bytes */
+} MD5_STATE_RecordType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the tail sample of a prefix: the MD5 of its last dwSampleSize
+** bytes (or of the whole prefix, if it is shorter).
+**------------------------------------------------------------------------------
+** Arguments:
+**    iFd          - File to read with pread()
+**    lOffset      - Length of the prefix
+**    dwSampleSize - Sample length
+**    pbBuffer     - Read buffer
+**    dwBufferSize - Size of the read buffer in bytes
+**    pbDigest     - Receives the digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    BOOL - FALSE on a read error (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_SampleTail( int iFd, UINT64 lOffset, UINT32 dwSampleSize, UINT8* pbBuffer,
+                           UINT32 dwBufferSize, UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Fills in the identity, size and times of the file a record describes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psRecord - Record to fill in
+**    psStat   - Status of the file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_STATE_SetFile( MD5_STATE_RecordType* psRecord, const struct stat* psStat );
+
+/*------------------------------------------------------------------------------
+** Checks whether the prefix a record describes is still the start of a file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psRecord     - Saved state
+**    iFd          - The file, open for reading
+**    fGrowing     - TRUE if the file may have grown since the state was saved,
+**                   FALSE if its size and times must be unchanged as well
+**    pbBuffer     - Read buffer for the tail sample
+**    dwBufferSize - Size of the read buffer in bytes
+**
+** Returns:
+**    const char* - NULL if the prefix is unchanged, otherwise the reason why
+**                  the state can't be used
+**------------------------------------------------------------------------------
+*/
+const char* MD5_STATE_CheckPrefix( const MD5_STATE_RecordType* psRecord, int iFd, BOOL fGrowing,
+                                   UINT8* pbBuffer, UINT32 dwBufferSize );
+
+/*------------------------------------------------------------------------------
+** Reads a state file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - State file
+**    psRecord    - Receives the saved state
+**
+** Returns:
+**    BOOL - FALSE if the file could not be read (errno is set) or is not a
+**           valid state file, e.g. one whose state doesn't hold as many
+**           bytes as its offset (errno is EINVAL)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_Read( const char* pacFilename, MD5_STATE_RecordType* psRecord );
+
+/*------------------------------------------------------------------------------
+** Writes a state file. The state is written to a temporary file that is
+** synced and renamed over the old one, so a crash leaves either state intact.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - State file
+**    psRecord    - State to save
+**
+** Returns:
+**    BOOL - FALSE if the file could not be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_STATE_Write( const char* pacFilename, const MD5_STATE_RecordType* psRecord );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_STATE_H_ */
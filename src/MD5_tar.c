@@ -0,0 +1,1150 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tar.c
+**    Summary: Streaming tar archive parser with per-member MD5.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_port.h"
+#include "MD5_tar.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_TAR_STATE_HEADER           ( 0U )
+#define MD5_TAR_STATE_DATA             ( 1U ) /* Data of a regular file member */
+#define MD5_TAR_STATE_EXT              ( 2U ) /* Data of an extended header */
+#define MD5_TAR_STATE_END              ( 3U ) /* End-of-archive block seen */
+#define MD5_TAR_STATE_ERROR            ( 4U )
+
+/*
+** Header fields: offset and length
+*/
+#define MD5_TAR_NAME_OFFSET            ( 0U )
+#define MD5_TAR_NAME_LEN               ( 100U )
+#define MD5_TAR_SIZE_OFFSET            ( 124U )
+#define MD5_TAR_SIZE_LEN               ( 12U )
+#define MD5_TAR_CHKSUM_OFFSET          ( 148U )
+#define MD5_TAR_CHKSUM_LEN             ( 8U )
+#define MD5_TAR_TYPE_OFFSET            ( 156U )
+#define MD5_TAR_MAGIC_OFFSET           ( 257U )
+#define MD5_TAR_PREFIX_OFFSET          ( 345U )
+#define MD5_TAR_PREFIX_LEN             ( 155U )
+
+#define MD5_TAR_USTAR_MAGIC            "ustar" /* Followed by a NUL in POSIX archives */
+
+/*
+** Padding that follows lSize bytes of data up to the next block
+*/
+#define MD5_TAR_PADDING( lSize ) \
+   ( ( MD5_TAR_BLOCK_SIZE - ( (lSize) % MD5_TAR_BLOCK_SIZE ) ) % MD5_TAR_BLOCK_SIZE )
+
+/*
+** What a pax extended header record does (MD5_TAR_PaxKeyType.bAction)
+*/
+#define MD5_TAR_PAX_IGNORE             ( 0U ) /* Metadata that doesn't change the member data */
+#define MD5_TAR_PAX_PATH               ( 1U )
+#define MD5_TAR_PAX_SIZE               ( 2U )
+#define MD5_TAR_PAX_LINKPATH           ( 3U )
+#define MD5_TAR_PAX_SPARSE             ( 4U ) /* Member data is a sparse map and the data blocks */
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** Archive of the tests: a pax header and its records, a member named by
+** them and its data block, a ustar member with a name prefix and the two
+** end-of-archive blocks
+*/
+#define MD5_TAR_TEST_NUM_BLOCKS        ( 7U )
+#define MD5_TAR_TEST_MAX_MEMBERS       ( 2U )
+#define MD5_TAR_TEST_NAME_SIZE         ( 16U )
+#define MD5_TAR_TEST_PAX_RECORDS       "22 path=dir/long-name\n" \
+                                       "10 size=3\n" \
+                                       "25 SCHILY.xattr.user.a=b\n" \
+                                       "13 mtime=1.5\n"
+#define MD5_TAR_TEST_SPARSE_RECORD     "22 GNU.sparse.major=1\n"
+#endif
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A pax extended header key. With fPrefix set, every key starting with
+** pacKey matches.
+*/
+typedef struct MD5_TAR_PaxKey
+{
+   const char* pacKey;
+   BOOL fPrefix;
+   UINT8 bAction;
+} MD5_TAR_PaxKeyType;
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*
+** Members reported to MD5_TAR_TestEnd()
+*/
+typedef struct MD5_TAR_TestMembers
+{
+   UINT8 bNumMembers;
+   BOOL fError;                         /* Too many members, or a name too long */
+   char aacName[ MD5_TAR_TEST_MAX_MEMBERS ][ MD5_TAR_TEST_NAME_SIZE ];
+   UINT64 alSize[ MD5_TAR_TEST_MAX_MEMBERS ];
+   UINT8 aabDigest[ MD5_TAR_TEST_MAX_MEMBERS ][ MD5_DIGEST_SIZE ];
+} MD5_TAR_TestMembersType;
+
+/*
+** A numeric header field and its value
+*/
+typedef struct MD5_TAR_TestNumber
+{
+   UINT8 abField[ MD5_TAR_SIZE_LEN ];
+   UINT64 lValue;
+} MD5_TAR_TestNumberType;
+#endif
+
+/*******************************************************************************
+** Private Globals
+********************************************************************************
+*/
+
+/*----------------------------------------------------------------------------
+** The keys defined by POSIX and the vendor keys the parser knows about. Other
+** vendor keys (those containing a period) are ignored; other keys without a
+** period are reserved for POSIX and reject the archive.
+**----------------------------------------------------------------------------
+*/
+static const MD5_TAR_PaxKeyType MD5_TAR_asPaxKeys[] =
+{
+   { "path",        FALSE, MD5_TAR_PAX_PATH },
+   { "size",        FALSE, MD5_TAR_PAX_SIZE },
+   { "linkpath",    FALSE, MD5_TAR_PAX_LINKPATH },
+   { "atime",       FALSE, MD5_TAR_PAX_IGNORE },
+   { "mtime",       FALSE, MD5_TAR_PAX_IGNORE },
+   { "ctime",       FALSE, MD5_TAR_PAX_IGNORE },
+   { "uid",         FALSE, MD5_TAR_PAX_IGNORE },
+   { "gid",         FALSE, MD5_TAR_PAX_IGNORE },
+   { "uname",       FALSE, MD5_TAR_PAX_IGNORE },
+   { "gname",       FALSE, MD5_TAR_PAX_IGNORE },
+   { "charset",     FALSE, MD5_TAR_PAX_IGNORE },
+   { "hdrcharset",  FALSE, MD5_TAR_PAX_IGNORE },
+   { "comment",     FALSE, MD5_TAR_PAX_IGNORE },
+   { "GNU.sparse.", TRUE,  MD5_TAR_PAX_SPARSE },
+};
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*----------------------------------------------------------------------------
+** MD5( "abc" ) and MD5( "" ), the data of the test members
+**----------------------------------------------------------------------------
+*/
+static const UINT8 MD5_TAR_aabTestDigests[ MD5_TAR_TEST_MAX_MEMBERS ][ MD5_DIGEST_SIZE ] =
+{
+   { 0x90, 0x01, 0x50, 0x98, 0x3C, 0xD2, 0x4F, 0xB0,
+     0xD6, 0x96, 0x3F, 0x7D, 0x28, 0xE1, 0x7F, 0x72 },
+   { 0xD4, 0x1D, 0x8C, 0xD9, 0x8F, 0x00, 0xB2, 0x04,
+     0xE9, 0x80, 0x09, 0x98, 0xEC, 0xF8, 0x42, 0x7E }
+};
+#endif
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static BOOL MD5_TAR_Fail( MD5_TAR_Type* psTar, const char* pacError );
+static BOOL MD5_TAR_ParseNumber( const UINT8* pbField, UINT8 bLen, UINT64* plValue );
+static BOOL MD5_TAR_CheckSum( const UINT8* pbHeader );
+static UINT16 MD5_TAR_CopyField( char* pacDest, const UINT8* pbField, UINT16 iLen );
+static BOOL MD5_TAR_FindPaxKey( const char* pacKey, UINT32 dwKeyLen, UINT8* pbAction );
+static BOOL MD5_TAR_ParsePax( MD5_TAR_Type* psTar );
+static BOOL MD5_TAR_EndExtended( MD5_TAR_Type* psTar );
+static BOOL MD5_TAR_ParseHeader( MD5_TAR_Type* psTar, const UINT8* pbHeader,
+                                 const MD5_TAR_OutputType* psOutput );
+static void MD5_TAR_EndMember( MD5_TAR_Type* psTar, const MD5_TAR_OutputType* psOutput );
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static void MD5_TAR_TestOctal( UINT8* pbField, UINT8 bNumDigits, UINT32 dwValue );
+static void MD5_TAR_TestHeader( UINT8* pbHeader, const char* pacPrefix, const char* pacName,
+                                char cType, UINT32 dwSize );
+static void MD5_TAR_TestEnd( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest,
+                             void* pxCtx );
+static BOOL MD5_TAR_TestParse( MD5_TAR_Type* psTar, const UINT8* pbArchive, UINT32 dwSize,
+                               UINT32 dwPieceSize, MD5_TAR_TestMembersType* psMembers );
+static BOOL MD5_TAR_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Rejects the archive.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar    - Parser
+**    pacError - Reason
+**
+** Returns:
+**    BOOL - FALSE
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_Fail( MD5_TAR_Type* psTar, const char* pacError )
+{
+   psTar->bState   = MD5_TAR_STATE_ERROR;
+   psTar->pacError = pacError;
+
+   return FALSE;
+}
+
+/*------------------------------------------------------------------------------
+** Parses a numeric header field: octal digits (optionally preceded by spaces
+** and followed by a space or NUL), or a GNU base-256 number (high bit of the
+** first byte set).
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbField - Field
+**    bLen    - Length of the field
+**    plValue - Receives the value
+**
+** Returns:
+**    BOOL - FALSE if the field is malformed, negative or too large
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_ParseNumber( const UINT8* pbField, UINT8 bLen, UINT64* plValue )
+{
+   UINT64 lValue = 0;
+   UINT8 bIndex  = 0;
+   UINT8 bStart;
+
+   if( pbField[ 0 ] & 0x80 )
+   {
+      /* Base-256, big endian; 0xFF starts a negative number */
+      if( pbField[ 0 ] != 0x80 )
+      {
+         return FALSE;
+      }
+
+      for( bIndex = 1; bIndex < bLen; bIndex++ )
+      {
+         if( ( lValue >> 56 ) != 0 )
+         {
+            return FALSE;
+         }
+
+         lValue = ( lValue << 8 ) | pbField[ bIndex ];
+      }
+
+      *plValue = lValue;
+      return TRUE;
+   }
+
+   while( ( bIndex < bLen ) && ( pbField[ bIndex ] == ' ' ) )
+   {
+      bIndex++;
+   }
+
+   for( bStart = bIndex; ( bIndex < bLen ) && ( pbField[ bIndex ] >= '0' ) &&
+        ( pbField[ bIndex ] <= '7' ); bIndex++ )
+   {
+      if( ( lValue >> 61 ) != 0 )
+      {
+         return FALSE;
+      }
+
+      lValue = ( lValue << 3 ) | (UINT64)( pbField[ bIndex ] - '0' );
+   }
+
+   if( ( bIndex == bStart ) ||
+       ( ( bIndex < bLen ) && ( pbField[ bIndex ] != ' ' ) && ( pbField[ bIndex ] != '\0' ) ) )
+   {
+      return FALSE;
+   }
+
+   *plValue = lValue;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Verifies the header checksum: the sum of all header bytes with the
+** checksum field taken as spaces. Old archivers summed signed bytes, either
+** sum is accepted.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbHeader - Header block
+**
+** Returns:
+**    BOOL - TRUE if the checksum matches
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_CheckSum( const UINT8* pbHeader )
+{
+   UINT64 lStored;
+   UINT32 dwUnsigned = 0;
+   long lSigned      = 0;
+   UINT16 iIndex;
+
+   if( !MD5_TAR_ParseNumber( &pbHeader[ MD5_TAR_CHKSUM_OFFSET ], MD5_TAR_CHKSUM_LEN, &lStored ) )
+   {
+      return FALSE;
+   }
+
+   for( iIndex = 0; iIndex < MD5_TAR_BLOCK_SIZE; iIndex++ )
+   {
+      UINT8 bByte = pbHeader[ iIndex ];
+
+      if( ( iIndex >= MD5_TAR_CHKSUM_OFFSET ) &&
+          ( iIndex < MD5_TAR_CHKSUM_OFFSET + MD5_TAR_CHKSUM_LEN ) )
+      {
+         bByte = ' ';
+      }
+
+      dwUnsigned += bByte;
+      lSigned += (signed char)bByte;
+   }
+
+   return ( lStored == dwUnsigned ) || ( ( lSigned >= 0 ) && ( lStored == (UINT64)lSigned ) );
+}
+
+/*------------------------------------------------------------------------------
+** Copies a string header field, which is NUL terminated only if it is
+** shorter than the field.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacDest - Receives the string (at least iLen + 1 bytes), NUL terminated
+**    pbField - Field
+**    iLen    - Length of the field
+**
+** Returns:
+**    UINT16 - Length of the string
+**------------------------------------------------------------------------------
+*/
+static UINT16 MD5_TAR_CopyField( char* pacDest, const UINT8* pbField, UINT16 iLen )
+{
+   UINT16 iIndex;
+
+   for( iIndex = 0; ( iIndex < iLen ) && ( pbField[ iIndex ] != '\0' ); iIndex++ )
+   {
+      pacDest[ iIndex ] = (char)pbField[ iIndex ];
+   }
+
+   pacDest[ iIndex ] = '\0';
+
+   return iIndex;
+}
+
+/*------------------------------------------------------------------------------
+** Looks up a pax extended header key.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacKey   - Key, not NUL terminated
+**    dwKeyLen - Length of the key
+**    pbAction - Receives what the record does (MD5_TAR_PAX_...)
+**
+** Returns:
+**    BOOL - FALSE if the key is unknown and reserved for POSIX
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_FindPaxKey( const char* pacKey, UINT32 dwKeyLen, UINT8* pbAction )
+{
+   UINT16 iIndex;
+
+   for( iIndex = 0; iIndex < sizeof( MD5_TAR_asPaxKeys ) / sizeof( MD5_TAR_asPaxKeys[ 0 ] );
+        iIndex++ )
+   {
+      const MD5_TAR_PaxKeyType* psKey = &MD5_TAR_asPaxKeys[ iIndex ];
+      size_t iLen                     = strlen( psKey->pacKey );
+
+      if( ( ( dwKeyLen == iLen ) || ( psKey->fPrefix && ( dwKeyLen > iLen ) ) ) &&
+          ( memcmp( pacKey, psKey->pacKey, iLen ) == 0 ) )
+      {
+         *pbAction = psKey->bAction;
+         return TRUE;
+      }
+   }
+
+   /* Vendor extensions, e.g. SCHILY.xattr.*, only carry metadata */
+   *pbAction = MD5_TAR_PAX_IGNORE;
+
+   return ( memchr( pacKey, '.', dwKeyLen ) != NULL );
+}
+
+/*------------------------------------------------------------------------------
+** Parses the records ("<length> <key>=<value>\n") of a pax extended header
+** and keeps the path and size for the next member. A record with an empty
+** value cancels an earlier record with the same key. The link target is
+** only checked: link members have no data to hash.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser, with the header data in acExt
+**
+** Returns:
+**    BOOL - FALSE if a record is malformed or describes a member that can't
+**           be hashed (psTar->pacError tells why)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_ParsePax( MD5_TAR_Type* psTar )
+{
+   UINT32 dwPos = 0;
+
+   while( dwPos < psTar->dwExtLen )
+   {
+      const char* pacRecord = &psTar->acExt[ dwPos ];
+      UINT32 dwRecordLen    = 0;
+      UINT32 dwIndex        = 0;
+      UINT32 dwKey;
+      UINT32 dwValue;
+      UINT32 dwValueLen;
+      UINT32 dwDigit;
+      UINT64 lSize = 0;
+      UINT8 bAction;
+
+      while( ( dwPos + dwIndex < psTar->dwExtLen ) && ( pacRecord[ dwIndex ] >= '0' ) &&
+             ( pacRecord[ dwIndex ] <= '9' ) && ( dwRecordLen <= MD5_TAR_MAX_PAX_SIZE ) )
+      {
+         dwRecordLen = ( dwRecordLen * 10 ) + (UINT32)( pacRecord[ dwIndex++ ] - '0' );
+      }
+
+      if( ( dwIndex == 0 ) || ( dwPos + dwIndex >= psTar->dwExtLen ) ||
+          ( pacRecord[ dwIndex ] != ' ' ) || ( dwRecordLen <= dwIndex + 2 ) ||
+          ( dwRecordLen > psTar->dwExtLen - dwPos ) || ( pacRecord[ dwRecordLen - 1 ] != '\n' ) )
+      {
+         return MD5_TAR_Fail( psTar, "malformed pax extended header" );
+      }
+
+      dwKey = dwIndex + 1;
+
+      for( dwValue = dwKey; ( dwValue < dwRecordLen - 1 ) && ( pacRecord[ dwValue ] != '=' );
+           dwValue++ )
+      {
+      }
+
+      if( ( dwValue == dwKey ) || ( dwValue == dwRecordLen - 1 ) )
+      {
+         return MD5_TAR_Fail( psTar, "malformed pax extended header" );
+      }
+
+      if( !MD5_TAR_FindPaxKey( &pacRecord[ dwKey ], dwValue - dwKey, &bAction ) )
+      {
+         return MD5_TAR_Fail( psTar, "unsupported member (unknown pax record)" );
+      }
+
+      dwValueLen = dwRecordLen - 1 - ( dwValue + 1 );
+      dwValue++;
+
+      switch( bAction )
+      {
+      case MD5_TAR_PAX_PATH:
+      case MD5_TAR_PAX_LINKPATH:
+         if( ( dwValueLen > MD5_TAR_MAX_NAME_LEN ) ||
+             ( memchr( &pacRecord[ dwValue ], '\0', dwValueLen ) != NULL ) )
+         {
+            return MD5_TAR_Fail( psTar, "malformed pax extended header" );
+         }
+
+         if( bAction == MD5_TAR_PAX_PATH )
+         {
+            memcpy( psTar->acNextName, &pacRecord[ dwValue ], dwValueLen );
+            psTar->acNextName[ dwValueLen ] = '\0';
+            psTar->fNextName                = ( dwValueLen > 0 );
+         }
+         break;
+
+      case MD5_TAR_PAX_SIZE:
+         for( dwDigit = dwValue; dwDigit < dwValue + dwValueLen; dwDigit++ )
+         {
+            if( ( pacRecord[ dwDigit ] < '0' ) || ( pacRecord[ dwDigit ] > '9' ) ||
+                ( lSize > ( ~(UINT64)0 - 9 ) / 10 ) )
+            {
+               return MD5_TAR_Fail( psTar, "malformed pax extended header" );
+            }
+
+            lSize = ( lSize * 10 ) + (UINT64)( pacRecord[ dwDigit ] - '0' );
+         }
+
+         psTar->lNextSize = lSize;
+         psTar->fNextSize = ( dwValueLen > 0 );
+         break;
+
+      case MD5_TAR_PAX_SPARSE:
+         /*
+         ** The data of a pax sparse member starts with the sparse map, and
+         ** its name is a placeholder: hashing it would give a wrong digest
+         ** for a wrong name.
+         */
+         return MD5_TAR_Fail( psTar, "unsupported member (sparse file)" );
+
+      default:
+         break;
+      }
+
+      dwPos += dwRecordLen;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Applies a completely read extended header (pax or GNU long name) to the
+** next member.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser
+**
+** Returns:
+**    BOOL - FALSE if the extended header is malformed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_EndExtended( MD5_TAR_Type* psTar )
+{
+   if( psTar->bExtType == 'x' )
+   {
+      if( !MD5_TAR_ParsePax( psTar ) )
+      {
+         return FALSE;
+      }
+   }
+   else
+   {
+      /* GNU long name: the name, NUL terminated */
+      UINT16 iNameLen = MD5_TAR_CopyField( psTar->acNextName, (const UINT8*)psTar->acExt,
+                                           (UINT16)( ( psTar->dwExtLen < MD5_TAR_MAX_NAME_LEN ) ?
+                                                     psTar->dwExtLen : MD5_TAR_MAX_NAME_LEN ) );
+
+      if( ( iNameLen == MD5_TAR_MAX_NAME_LEN ) && ( psTar->dwExtLen > MD5_TAR_MAX_NAME_LEN ) &&
+          ( psTar->acExt[ MD5_TAR_MAX_NAME_LEN ] != '\0' ) )
+      {
+         return MD5_TAR_Fail( psTar, "member name too long" );
+      }
+
+      psTar->fNextName = TRUE;
+   }
+
+   psTar->lSkip  = MD5_TAR_PADDING( psTar->dwExtLen );
+   psTar->bState = MD5_TAR_STATE_HEADER;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Parses a header block and sets up the parser for the data that follows.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar    - Parser
+**    pbHeader - Header block
+**    psOutput - Member routines
+**
+** Returns:
+**    BOOL - FALSE if the header is malformed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_ParseHeader( MD5_TAR_Type* psTar, const UINT8* pbHeader,
+                                 const MD5_TAR_OutputType* psOutput )
+{
+   UINT64 lSize;
+   UINT16 iIndex;
+   char cType;
+
+   for( iIndex = 0; ( iIndex < MD5_TAR_BLOCK_SIZE ) && ( pbHeader[ iIndex ] == 0 ); iIndex++ )
+   {
+   }
+
+   if( iIndex == MD5_TAR_BLOCK_SIZE )
+   {
+      psTar->bState = MD5_TAR_STATE_END;
+      return TRUE;
+   }
+
+   if( !MD5_TAR_CheckSum( pbHeader ) )
+   {
+      return MD5_TAR_Fail( psTar, "header checksum mismatch" );
+   }
+
+   if( !MD5_TAR_ParseNumber( &pbHeader[ MD5_TAR_SIZE_OFFSET ], MD5_TAR_SIZE_LEN, &lSize ) )
+   {
+      return MD5_TAR_Fail( psTar, "invalid member size" );
+   }
+
+   cType = (char)pbHeader[ MD5_TAR_TYPE_OFFSET ];
+
+   switch( cType )
+   {
+   case 'x': /* pax extended header of the next member */
+   case 'L': /* GNU long name of the next member */
+      if( lSize > MD5_TAR_MAX_PAX_SIZE )
+      {
+         return MD5_TAR_Fail( psTar, "extended header too large" );
+      }
+
+      psTar->bExtType   = (UINT8)cType;
+      psTar->dwExtLen   = 0;
+      psTar->lRemaining = lSize;
+      psTar->bState     = MD5_TAR_STATE_EXT;
+      return TRUE;
+
+   case 'g': /* pax global header and GNU long link name, not needed */
+   case 'K':
+      psTar->lSkip = lSize + MD5_TAR_PADDING( lSize );
+      return TRUE;
+
+   case 'S': /* GNU sparse file, its data is only the non-zero parts */
+      return MD5_TAR_Fail( psTar, "unsupported member (GNU sparse file)" );
+
+   case 'M': /* GNU multi-volume continuation, the start is in another volume */
+      return MD5_TAR_Fail( psTar, "unsupported member (multi-volume continuation)" );
+
+   default:
+      break;
+   }
+
+   if( psTar->fNextSize )
+   {
+      lSize = psTar->lNextSize;
+   }
+
+   if( ( cType == '0' ) || ( cType == '\0' ) || ( cType == '7' ) )
+   {
+      MD5_TAR_MemberType* psMember = &psTar->sMember;
+
+      if( psTar->fNextName )
+      {
+         strcpy( psMember->acName, psTar->acNextName );
+      }
+      else
+      {
+         UINT16 iLen = 0;
+
+         /* POSIX ustar: the name is the prefix, a slash and the name field */
+         if( ( memcmp( &pbHeader[ MD5_TAR_MAGIC_OFFSET ], MD5_TAR_USTAR_MAGIC, 6 ) == 0 ) &&
+             ( pbHeader[ MD5_TAR_PREFIX_OFFSET ] != '\0' ) )
+         {
+            iLen = MD5_TAR_CopyField( psMember->acName, &pbHeader[ MD5_TAR_PREFIX_OFFSET ],
+                                      MD5_TAR_PREFIX_LEN );
+            psMember->acName[ iLen++ ] = '/';
+         }
+
+         MD5_TAR_CopyField( &psMember->acName[ iLen ], &pbHeader[ MD5_TAR_NAME_OFFSET ],
+                            MD5_TAR_NAME_LEN );
+      }
+
+      psMember->lSize   = lSize;
+      psMember->lOffset = psTar->lHeaderOffset + MD5_TAR_BLOCK_SIZE;
+
+      if( psOutput->pnBegin != NULL )
+      {
+         psOutput->pnBegin( psMember, psOutput->pxCtx );
+      }
+
+      if( psOutput->pnData == NULL )
+      {
+         MD5_Init( &psTar->sInst );
+      }
+
+      psTar->lRemaining = lSize;
+      psTar->bState     = MD5_TAR_STATE_DATA;
+   }
+   else if( ( cType >= '1' ) && ( cType <= '6' ) )
+   {
+      /* Links, devices, directories and FIFOs have no data */
+   }
+   else
+   {
+      /* Other members (GNU volume labels and dumpdirs, vendor extensions) are skipped */
+      psTar->lSkip = lSize + MD5_TAR_PADDING( lSize );
+   }
+
+   psTar->fNextName = FALSE;
+   psTar->fNextSize = FALSE;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Reports a member whose data has been supplied in full.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar    - Parser
+**    psOutput - Member routines
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TAR_EndMember( MD5_TAR_Type* psTar, const MD5_TAR_OutputType* psOutput )
+{
+   if( psOutput->pnData == NULL )
+   {
+      MD5_Final( &psTar->sInst );
+      psOutput->pnEnd( &psTar->sMember, (const UINT8*)psTar->sInst.adwDigest, psOutput->pxCtx );
+   }
+   else
+   {
+      psOutput->pnEnd( &psTar->sMember, NULL, psOutput->pxCtx );
+   }
+
+   psTar->lSkip  = MD5_TAR_PADDING( psTar->sMember.lSize );
+   psTar->bState = MD5_TAR_STATE_HEADER;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Writes a number as octal digits with leading zeros.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbField    - Field
+**    bNumDigits - Number of digits to write
+**    dwValue    - Number
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TAR_TestOctal( UINT8* pbField, UINT8 bNumDigits, UINT32 dwValue )
+{
+   while( bNumDigits-- > 0 )
+   {
+      pbField[ bNumDigits ] = (UINT8)( '0' + ( dwValue & 7 ) );
+      dwValue >>= 3;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Builds a ustar header block with a valid checksum.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pbHeader  - Receives the header block
+**    pacPrefix - Name prefix (empty for none)
+**    pacName   - Name
+**    cType     - Member type
+**    dwSize    - Member size in bytes
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TAR_TestHeader( UINT8* pbHeader, const char* pacPrefix, const char* pacName,
+                                char cType, UINT32 dwSize )
+{
+   UINT32 dwSum = 0;
+   UINT16 iIndex;
+
+   memset( pbHeader, 0, MD5_TAR_BLOCK_SIZE );
+   memcpy( &pbHeader[ MD5_TAR_NAME_OFFSET ], pacName, strlen( pacName ) );
+   MD5_TAR_TestOctal( &pbHeader[ MD5_TAR_SIZE_OFFSET ], MD5_TAR_SIZE_LEN - 1, dwSize );
+   pbHeader[ MD5_TAR_TYPE_OFFSET ] = (UINT8)cType;
+   memcpy( &pbHeader[ MD5_TAR_MAGIC_OFFSET ], MD5_TAR_USTAR_MAGIC "\0" "00", 8 );
+   memcpy( &pbHeader[ MD5_TAR_PREFIX_OFFSET ], pacPrefix, strlen( pacPrefix ) );
+
+   /* Summed with the checksum field as spaces, stored as six digits, a NUL and a space */
+   memset( &pbHeader[ MD5_TAR_CHKSUM_OFFSET ], ' ', MD5_TAR_CHKSUM_LEN );
+
+   for( iIndex = 0; iIndex < MD5_TAR_BLOCK_SIZE; iIndex++ )
+   {
+      dwSum += pbHeader[ iIndex ];
+   }
+
+   MD5_TAR_TestOctal( &pbHeader[ MD5_TAR_CHKSUM_OFFSET ], 6, dwSum );
+   pbHeader[ MD5_TAR_CHKSUM_OFFSET + 6 ] = '\0';
+}
+
+/*------------------------------------------------------------------------------
+** Records a member of the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psMember - Member
+**    pbDigest - Digest of the member data
+**    pxCtx    - MD5_TAR_TestMembersType receiving the member
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TAR_TestEnd( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest,
+                             void* pxCtx )
+{
+   MD5_TAR_TestMembersType* psMembers = (MD5_TAR_TestMembersType*)pxCtx;
+   UINT8 bMember                      = psMembers->bNumMembers;
+
+   if( ( bMember == MD5_TAR_TEST_MAX_MEMBERS ) ||
+       ( strlen( psMember->acName ) >= MD5_TAR_TEST_NAME_SIZE ) )
+   {
+      psMembers->fError = TRUE;
+      return;
+   }
+
+   strcpy( psMembers->aacName[ bMember ], psMember->acName );
+   psMembers->alSize[ bMember ] = psMember->lSize;
+   memcpy( psMembers->aabDigest[ bMember ], pbDigest, MD5_DIGEST_SIZE );
+   psMembers->bNumMembers++;
+}
+
+/*------------------------------------------------------------------------------
+** Parses an archive of the tests, supplied in pieces of a given size.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar       - Parser
+**    pbArchive   - Archive
+**    dwSize      - Size of the archive in bytes
+**    dwPieceSize - Size of the pieces in bytes
+**    psMembers   - Receives the members
+**
+** Returns:
+**    BOOL - FALSE if the archive was rejected
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_TestParse( MD5_TAR_Type* psTar, const UINT8* pbArchive, UINT32 dwSize,
+                               UINT32 dwPieceSize, MD5_TAR_TestMembersType* psMembers )
+{
+   MD5_TAR_OutputType sOutput;
+   BOOL fValid = TRUE;
+   UINT32 dwDone;
+
+   /* Cleared in full, as the tests compare whole member records */
+   memset( psMembers, 0, sizeof( MD5_TAR_TestMembersType ) );
+
+   sOutput.pnBegin = NULL;
+   sOutput.pnData  = NULL;
+   sOutput.pnEnd   = MD5_TAR_TestEnd;
+   sOutput.pxCtx   = psMembers;
+
+   MD5_TAR_Init( psTar );
+
+   for( dwDone = 0; fValid && ( dwDone < dwSize ); dwDone += dwPieceSize )
+   {
+      UINT32 dwLength = dwSize - dwDone;
+
+      if( dwLength > dwPieceSize )
+      {
+         dwLength = dwPieceSize;
+      }
+
+      fValid = MD5_TAR_Update( psTar, &pbArchive[ dwDone ], dwLength, &sOutput );
+   }
+
+   return fValid && MD5_TAR_Final( psTar ) && !psMembers->fError;
+}
+
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Test number
+**    pacName    - Test name
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TAR_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "TAR_TEST_%03d: %s\t: %s\n", bTestEntry, pacName, fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a parser for a new archive.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser to initialize
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TAR_Init( MD5_TAR_Type* psTar )
+{
+   psTar->bState        = MD5_TAR_STATE_HEADER;
+   psTar->iHeaderLen    = 0;
+   psTar->lOffset       = 0;
+   psTar->lHeaderOffset = 0;
+   psTar->lRemaining    = 0;
+   psTar->lSkip         = 0;
+   psTar->dwExtLen      = 0;
+   psTar->fNextName     = FALSE;
+   psTar->fNextSize     = FALSE;
+   psTar->pacError      = NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Parses the next piece of the archive. Data following the end-of-archive
+** block is ignored.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar     - Parser
+**    pbData    - Data following the previously supplied data
+**    dwDataLen - Length of the data in bytes
+**    psOutput  - Member routines
+**
+** Returns:
+**    BOOL - FALSE if the archive is malformed (psTar->pacError tells why,
+**           psTar->lHeaderOffset where)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_Update( MD5_TAR_Type* psTar, const UINT8* pbData, UINT32 dwDataLen,
+                     const MD5_TAR_OutputType* psOutput )
+{
+   while( ( dwDataLen > 0 ) && ( psTar->bState != MD5_TAR_STATE_END ) &&
+          ( psTar->bState != MD5_TAR_STATE_ERROR ) )
+   {
+      UINT32 dwUsed;
+
+      if( psTar->lSkip > 0 )
+      {
+         /* Padding and unwanted data are skipped in place */
+         dwUsed = ( psTar->lSkip < dwDataLen ) ? (UINT32)psTar->lSkip : dwDataLen;
+         psTar->lSkip -= dwUsed;
+      }
+      else if( psTar->bState == MD5_TAR_STATE_HEADER )
+      {
+         const UINT8* pbHeader = NULL;
+
+         if( ( psTar->iHeaderLen == 0 ) && ( dwDataLen >= MD5_TAR_BLOCK_SIZE ) )
+         {
+            /* The usual case, the header is parsed in place */
+            pbHeader = pbData;
+            dwUsed   = MD5_TAR_BLOCK_SIZE;
+         }
+         else
+         {
+            dwUsed = MD5_TAR_BLOCK_SIZE - psTar->iHeaderLen;
+            dwUsed = ( dwUsed < dwDataLen ) ? dwUsed : dwDataLen;
+
+            memcpy( &psTar->abHeader[ psTar->iHeaderLen ], pbData, dwUsed );
+            psTar->iHeaderLen += (UINT16)dwUsed;
+
+            if( psTar->iHeaderLen == MD5_TAR_BLOCK_SIZE )
+            {
+               pbHeader          = psTar->abHeader;
+               psTar->iHeaderLen = 0;
+            }
+         }
+
+         if( pbHeader != NULL )
+         {
+            psTar->lHeaderOffset = psTar->lOffset + dwUsed - MD5_TAR_BLOCK_SIZE;
+            MD5_TAR_ParseHeader( psTar, pbHeader, psOutput );
+         }
+      }
+      else
+      {
+         dwUsed = ( psTar->lRemaining < dwDataLen ) ? (UINT32)psTar->lRemaining : dwDataLen;
+
+         if( psTar->bState == MD5_TAR_STATE_EXT )
+         {
+            memcpy( &psTar->acExt[ psTar->dwExtLen ], pbData, dwUsed );
+            psTar->dwExtLen += dwUsed;
+         }
+         else if( psOutput->pnData != NULL )
+         {
+            psOutput->pnData( pbData, dwUsed, psOutput->pxCtx );
+         }
+         else
+         {
+            MD5_UpdateLarge( &psTar->sInst, pbData, dwUsed );
+         }
+
+         psTar->lRemaining -= dwUsed;
+      }
+
+      pbData += dwUsed;
+      dwDataLen -= dwUsed;
+      psTar->lOffset += dwUsed;
+
+      if( psTar->lRemaining == 0 )
+      {
+         if( psTar->bState == MD5_TAR_STATE_DATA )
+         {
+            MD5_TAR_EndMember( psTar, psOutput );
+         }
+         else if( psTar->bState == MD5_TAR_STATE_EXT )
+         {
+            MD5_TAR_EndExtended( psTar );
+         }
+      }
+   }
+
+   return ( psTar->bState != MD5_TAR_STATE_ERROR );
+}
+
+/*------------------------------------------------------------------------------
+** Ends the archive. An archive that ends at a header boundary without the
+** end-of-archive blocks is accepted.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser
+**
+** Returns:
+**    BOOL - FALSE if the archive is malformed or ends within a header or a
+**           member (psTar->pacError tells why)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_Final( MD5_TAR_Type* psTar )
+{
+   if( psTar->bState == MD5_TAR_STATE_ERROR )
+   {
+      return FALSE;
+   }
+
+   if( ( psTar->bState != MD5_TAR_STATE_END ) &&
+       ( ( psTar->bState != MD5_TAR_STATE_HEADER ) || ( psTar->iHeaderLen != 0 ) ||
+         ( psTar->lSkip != 0 ) ) )
+   {
+      return MD5_TAR_Fail( psTar, "unexpected end of archive" );
+   }
+
+   return TRUE;
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the header checksum (unsigned and signed sums), numeric fields in
+** octal and base-256, the names and sizes set by pax records and by the
+** ustar name prefix with the digests of the member data, parsing in small
+** pieces, and that sparse members reject the archive.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_RunTests( void )
+{
+   /* Numeric fields and their values, ~0 if the field must be rejected */
+   static const MD5_TAR_TestNumberType asNumbers[] =
+   {
+      { "00000000003", 3 },
+      { "   17 ", 15 },
+      { { 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x00 }, 256 },
+      { "12x", ~(UINT64)0 },
+      { "", ~(UINT64)0 },
+      { { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }, ~(UINT64)0 }
+   };
+
+   static MD5_TAR_Type sTar; /* Too large for the stack of small targets */
+   UINT8 abArchive[ MD5_TAR_TEST_NUM_BLOCKS * MD5_TAR_BLOCK_SIZE ];
+   UINT8* pbHeader = &abArchive[ 2 * MD5_TAR_BLOCK_SIZE ];
+   MD5_TAR_TestMembersType sMembers;
+   MD5_TAR_TestMembersType sSplit;
+   BOOL fAllPassed = TRUE;
+   BOOL fPassed    = TRUE;
+   long lSigned    = 0;
+   UINT64 lValue;
+   UINT16 iIndex;
+   UINT8 bNumber;
+
+   memset( abArchive, 0, sizeof( abArchive ) );
+   MD5_TAR_TestHeader( abArchive, "", "PaxHeader", 'x',
+                       sizeof( MD5_TAR_TEST_PAX_RECORDS ) - 1 );
+   memcpy( &abArchive[ MD5_TAR_BLOCK_SIZE ], MD5_TAR_TEST_PAX_RECORDS,
+           sizeof( MD5_TAR_TEST_PAX_RECORDS ) - 1 );
+   MD5_TAR_TestHeader( pbHeader, "", "placeholder", '0', 0 );
+   memcpy( &abArchive[ 3 * MD5_TAR_BLOCK_SIZE ], "abc", 3 );
+   MD5_TAR_TestHeader( &abArchive[ 4 * MD5_TAR_BLOCK_SIZE ], "pre", "fix", '0', 0 );
+
+   /* The checksum of the member header, then summed as signed bytes */
+   fPassed = MD5_TAR_CheckSum( pbHeader );
+   pbHeader[ MD5_TAR_NAME_OFFSET ] = 0xE9;
+   fPassed = fPassed && !MD5_TAR_CheckSum( pbHeader );
+
+   for( iIndex = 0; iIndex < MD5_TAR_BLOCK_SIZE; iIndex++ )
+   {
+      UINT8 bByte = pbHeader[ iIndex ];
+
+      if( ( iIndex >= MD5_TAR_CHKSUM_OFFSET ) &&
+          ( iIndex < MD5_TAR_CHKSUM_OFFSET + MD5_TAR_CHKSUM_LEN ) )
+      {
+         bByte = ' ';
+      }
+
+      lSigned += (signed char)bByte;
+   }
+
+   MD5_TAR_TestOctal( &pbHeader[ MD5_TAR_CHKSUM_OFFSET ], 6, (UINT32)lSigned );
+   fPassed = fPassed && MD5_TAR_CheckSum( pbHeader );
+
+   fAllPassed = MD5_TAR_ReportTest( 0, "CHECKSUM", fPassed ) && fAllPassed;
+
+   MD5_TAR_TestHeader( pbHeader, "", "placeholder", '0', 0 );
+   fPassed = TRUE;
+
+   for( bNumber = 0; bNumber < sizeof( asNumbers ) / sizeof( asNumbers[ 0 ] ); bNumber++ )
+   {
+      if( MD5_TAR_ParseNumber( asNumbers[ bNumber ].abField, MD5_TAR_SIZE_LEN, &lValue ) )
+      {
+         fPassed = fPassed && ( lValue == asNumbers[ bNumber ].lValue );
+      }
+      else
+      {
+         fPassed = fPassed && ( asNumbers[ bNumber ].lValue == ~(UINT64)0 );
+      }
+   }
+
+   fAllPassed = MD5_TAR_ReportTest( 1, "NUMBER", fPassed ) && fAllPassed;
+
+   /* The pax size overrides the size of 0 in the member header */
+   fPassed = MD5_TAR_TestParse( &sTar, abArchive, sizeof( abArchive ), sizeof( abArchive ),
+                                &sMembers ) &&
+             ( sMembers.bNumMembers == MD5_TAR_TEST_MAX_MEMBERS ) &&
+             ( strcmp( sMembers.aacName[ 0 ], "dir/long-name" ) == 0 ) &&
+             ( sMembers.alSize[ 0 ] == 3 ) &&
+             ( memcmp( sMembers.aabDigest[ 0 ], MD5_TAR_aabTestDigests[ 0 ],
+                       MD5_DIGEST_SIZE ) == 0 );
+
+   fAllPassed = MD5_TAR_ReportTest( 2, "PAX", fPassed ) && fAllPassed;
+
+   /* The pax records only apply to the member that follows them */
+   fPassed = ( sMembers.bNumMembers == MD5_TAR_TEST_MAX_MEMBERS ) &&
+             ( strcmp( sMembers.aacName[ 1 ], "pre/fix" ) == 0 ) && ( sMembers.alSize[ 1 ] == 0 ) &&
+             ( memcmp( sMembers.aabDigest[ 1 ], MD5_TAR_aabTestDigests[ 1 ],
+                       MD5_DIGEST_SIZE ) == 0 );
+
+   fAllPassed = MD5_TAR_ReportTest( 3, "USTAR PREFIX", fPassed ) && fAllPassed;
+
+   /* Headers and records split across pieces */
+   fPassed = MD5_TAR_TestParse( &sTar, abArchive, sizeof( abArchive ), 100, &sSplit ) &&
+             ( memcmp( &sSplit, &sMembers, sizeof( sMembers ) ) == 0 );
+
+   fAllPassed = MD5_TAR_ReportTest( 4, "SPLIT ARCHIVE", fPassed ) && fAllPassed;
+
+   /* A pax sparse record and a GNU sparse member */
+   MD5_TAR_TestHeader( abArchive, "", "PaxHeader", 'x', sizeof( MD5_TAR_TEST_SPARSE_RECORD ) - 1 );
+   memset( &abArchive[ MD5_TAR_BLOCK_SIZE ], 0, MD5_TAR_BLOCK_SIZE );
+   memcpy( &abArchive[ MD5_TAR_BLOCK_SIZE ], MD5_TAR_TEST_SPARSE_RECORD,
+           sizeof( MD5_TAR_TEST_SPARSE_RECORD ) - 1 );
+   fPassed = !MD5_TAR_TestParse( &sTar, abArchive, sizeof( abArchive ), sizeof( abArchive ),
+                                 &sMembers ) &&
+             ( strstr( sTar.pacError, "sparse" ) != NULL ) && ( sMembers.bNumMembers == 0 );
+
+   MD5_TAR_TestHeader( abArchive, "", "sparse", 'S', 0 );
+   fPassed = fPassed &&
+             !MD5_TAR_TestParse( &sTar, abArchive, sizeof( abArchive ), sizeof( abArchive ),
+                                 &sMembers ) &&
+             ( strstr( sTar.pacError, "sparse" ) != NULL );
+
+   fAllPassed = MD5_TAR_ReportTest( 5, "SPARSE", fPassed ) && fAllPassed;
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
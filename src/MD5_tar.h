@@ -0,0 +1,167 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tar.h
+**    Summary: Streaming tar archive parser that hashes the members without
+**             extracting them. The archive is supplied in pieces of any
+**             size; header and padding blocks are skipped in place and the
+**             data of every regular file member is fed straight from the
+**             caller's buffer into a per-member MD5 (or handed to the
+**             caller, who hashes it elsewhere).
+**
+**             Understands ustar headers (with the name prefix), pax
+**             extended headers (path and size records; link targets,
+**             times, owners and vendor records carry no data and are
+**             ignored), GNU long names and GNU base-256 sizes. Members
+**             other than regular files are skipped. Sparse members (GNU
+**             or pax), multi-volume continuations and pax records reserved
+**             for future POSIX versions reject the archive, as their data
+**             can't be hashed as it is stored.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_TAR_H_
+#define HMS_SC_MD5_TAR_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_TAR_BLOCK_SIZE             ( 512U )
+#define MD5_TAR_MAX_NAME_LEN           ( 4096U )
+#define MD5_TAR_MAX_PAX_SIZE           ( 64U * 1024U ) /* Extended header limit */
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A regular file member of the archive
+*/
+typedef struct MD5_TAR_Member
+{
+   char acName[ MD5_TAR_MAX_NAME_LEN + 1 ];
+   UINT64 lSize;
+   UINT64 lOffset; /* Archive offset of the member data */
+} MD5_TAR_MemberType;
+
+/*
+** Called when the header of a regular file member has been parsed.
+*/
+typedef void ( *MD5_TAR_BeginFunc )( const MD5_TAR_MemberType* psMember, void* pxCtx );
+
+/*
+** Called with consecutive pieces of the member data (only if set, see
+** MD5_TAR_OutputType).
+*/
+typedef void ( *MD5_TAR_DataFunc )( const UINT8* pbData, UINT32 dwLength, void* pxCtx );
+
+/*
+** Called when all data of a regular file member has been supplied.
+*/
+typedef void ( *MD5_TAR_EndFunc )( const MD5_TAR_MemberType* psMember, const UINT8* pbDigest,
+                                   void* pxCtx );
+
+typedef struct MD5_TAR_Output
+{
+   MD5_TAR_BeginFunc pnBegin; /* Optional */
+   MD5_TAR_DataFunc pnData;   /* NULL: the parser hashes the member data */
+   MD5_TAR_EndFunc pnEnd;     /* pbDigest is NULL if pnData is set */
+   void* pxCtx;
+} MD5_TAR_OutputType;
+
+typedef struct MD5_TAR
+{
+   UINT8 bState;
+   UINT8 abHeader[ MD5_TAR_BLOCK_SIZE ]; /* Header split across two pieces */
+   UINT16 iHeaderLen;
+   UINT64 lOffset;                       /* Archive bytes consumed */
+   UINT64 lHeaderOffset;                 /* Archive offset of the last header */
+   UINT64 lRemaining;                    /* Member or extended header data left */
+   UINT64 lSkip;                         /* Bytes to skip before the next block */
+   UINT8 bExtType;                       /* Type of the extended header being read */
+   UINT32 dwExtLen;
+   char acExt[ MD5_TAR_MAX_PAX_SIZE ];   /* Extended header data */
+   char acNextName[ MD5_TAR_MAX_NAME_LEN + 1 ]; /* pax or GNU long name */
+   BOOL fNextName;                       /* acNextName applies to the next member */
+   UINT64 lNextSize;                     /* pax size ... */
+   BOOL fNextSize;                       /* ... that applies to the next member */
+   MD5_TAR_MemberType sMember;
+   MD5_InstType sInst;
+   const char* pacError;                 /* Why the archive was rejected */
+} MD5_TAR_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a parser for a new archive.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser to initialize
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TAR_Init( MD5_TAR_Type* psTar );
+
+/*------------------------------------------------------------------------------
+** Parses the next piece of the archive. Data following the end-of-archive
+** block is ignored.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar     - Parser
+**    pbData    - Data following the previously supplied data
+**    dwDataLen - Length of the data in bytes
+**    psOutput  - Member routines
+**
+** Returns:
+**    BOOL - FALSE if the archive is malformed (psTar->pacError tells why,
+**           psTar->lHeaderOffset where)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_Update( MD5_TAR_Type* psTar, const UINT8* pbData, UINT32 dwDataLen,
+                     const MD5_TAR_OutputType* psOutput );
+
+/*------------------------------------------------------------------------------
+** Ends the archive. An archive that ends at a header boundary without the
+** end-of-archive blocks is accepted.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psTar - Parser
+**
+** Returns:
+**    BOOL - FALSE if the archive is malformed or ends within a header or a
+**           member (psTar->pacError tells why)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_Final( MD5_TAR_Type* psTar );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks the header checksum (unsigned and signed sums), numeric fields in
+** octal and base-256, the names and sizes set by pax records and by the
+** ustar name prefix with the digests of the member data, parsing in small
+** pieces, and that sparse members reject the archive.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TAR_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_TAR_H_ */
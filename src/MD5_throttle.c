@@ -0,0 +1,270 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_throttle.c
+**    Summary: Resource limits of the background mode. The buckets hold
+**             fractional tokens (doubles), so low limits such as a few read
+**             calls per second need no special casing.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* SCHED_IDLE, syscall() */
+#endif
+
+#include "MD5_throttle.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#if defined( __linux__ )
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_THROTTLE_NS_PER_SEC        ( 1000000000.0 )
+
+/*
+** ioprio_set() arguments (linux/ioprio.h, which glibc doesn't wrap)
+*/
+#define MD5_THROTTLE_IOPRIO_WHO_PROCESS ( 1 )
+#define MD5_THROTTLE_IOPRIO_IDLE       ( 3 << 13 ) /* IOPRIO_CLASS_IDLE, level 0 */
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+static UINT64 MD5_THROTTLE_GetTime( clockid_t iClock );
+static double MD5_THROTTLE_Refill( double rTokens, double rPerSec, UINT64 lElapsedNs );
+static double MD5_THROTTLE_GetWait( double rTokens, double rPerSec, double rWaitNs );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Reads a clock.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iClock - CLOCK_MONOTONIC or CLOCK_PROCESS_CPUTIME_ID
+**
+** Returns:
+**    UINT64 - Time in ns
+**------------------------------------------------------------------------------
+*/
+static UINT64 MD5_THROTTLE_GetTime( clockid_t iClock )
+{
+   struct timespec sNow;
+
+   clock_gettime( iClock, &sNow );
+
+   return (UINT64)sNow.tv_sec * 1000000000U + (UINT64)sNow.tv_nsec;
+}
+
+/*------------------------------------------------------------------------------
+** Adds the tokens earned in the elapsed time to a bucket.
+**------------------------------------------------------------------------------
+** Arguments:
+**    rTokens    - Tokens in the bucket
+**    rPerSec    - Tokens earned per second
+**    lElapsedNs - Time since the last refill
+**
+** Returns:
+**    double - Tokens in the bucket, at most MD5_THROTTLE_BURST_MS worth
+**------------------------------------------------------------------------------
+*/
+static double MD5_THROTTLE_Refill( double rTokens, double rPerSec, UINT64 lElapsedNs )
+{
+   double rCapacity = rPerSec * MD5_THROTTLE_BURST_MS / 1000.0;
+
+   rTokens += rPerSec * (double)lElapsedNs / MD5_THROTTLE_NS_PER_SEC;
+
+   return ( rTokens > rCapacity ) ? rCapacity : rTokens;
+}
+
+/*------------------------------------------------------------------------------
+** Returns the time it takes to pay off the debt of a bucket, or the longer
+** wait already required by another bucket.
+**------------------------------------------------------------------------------
+** Arguments:
+**    rTokens - Tokens in the bucket, negative while in debt
+**    rPerSec - Tokens earned per second
+**    rWaitNs - Wait required by the buckets checked before
+**
+** Returns:
+**    double - Wait in ns
+**------------------------------------------------------------------------------
+*/
+static double MD5_THROTTLE_GetWait( double rTokens, double rPerSec, double rWaitNs )
+{
+   double rDebtNs = -rTokens * MD5_THROTTLE_NS_PER_SEC / rPerSec;
+
+   return ( rDebtNs > rWaitNs ) ? rDebtNs : rWaitNs;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a throttle with full buckets.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle   - Throttle to initialize
+**    lBytesPerSec - Read rate limit, 0 for none
+**    dwOpsPerSec  - Read call limit, 0 for none
+**    dwCpuPercent - CPU time limit in percent of one CPU, 0 for none
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Init( MD5_THROTTLE_Type* psThrottle, UINT64 lBytesPerSec, UINT32 dwOpsPerSec,
+                        UINT32 dwCpuPercent )
+{
+   memset( psThrottle, 0, sizeof( *psThrottle ) );
+   pthread_mutex_init( &psThrottle->sLock, NULL );
+
+   psThrottle->lBytesPerSec = lBytesPerSec;
+   psThrottle->dwOpsPerSec  = dwOpsPerSec;
+   psThrottle->dwCpuPercent = dwCpuPercent;
+   psThrottle->rByteTokens  = (double)lBytesPerSec * MD5_THROTTLE_BURST_MS / 1000.0;
+   psThrottle->rOpTokens    = (double)dwOpsPerSec * MD5_THROTTLE_BURST_MS / 1000.0;
+   psThrottle->rCpuTokens   = (double)dwCpuPercent * 10000000.0 * MD5_THROTTLE_BURST_MS / 1000.0;
+   psThrottle->lLastNs      = MD5_THROTTLE_GetTime( CLOCK_MONOTONIC );
+   psThrottle->lLastCpuNs   = MD5_THROTTLE_GetTime( CLOCK_PROCESS_CPUTIME_ID );
+}
+
+/*------------------------------------------------------------------------------
+** Frees the resources of a throttle.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle - Throttle to free
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Free( MD5_THROTTLE_Type* psThrottle )
+{
+   pthread_mutex_destroy( &psThrottle->sLock );
+}
+
+/*------------------------------------------------------------------------------
+** Takes the tokens of a completed read call and the CPU time used since the
+** last call, and sleeps as long as the limits require, delaying the next
+** read of the caller. May be called from any thread.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle - Throttle to take the tokens from
+**    lBytes     - Bytes read
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Acquire( MD5_THROTTLE_Type* psThrottle, UINT64 lBytes )
+{
+   double rWaitNs = 0.0;
+   struct timespec sWait;
+   UINT64 lElapsedNs;
+   UINT64 lNowNs;
+
+   pthread_mutex_lock( &psThrottle->sLock );
+
+   lNowNs              = MD5_THROTTLE_GetTime( CLOCK_MONOTONIC );
+   lElapsedNs          = lNowNs - psThrottle->lLastNs;
+   psThrottle->lLastNs = lNowNs;
+
+   if( psThrottle->lBytesPerSec != 0 )
+   {
+      double rPerSec = (double)psThrottle->lBytesPerSec;
+
+      psThrottle->rByteTokens =
+         MD5_THROTTLE_Refill( psThrottle->rByteTokens, rPerSec, lElapsedNs ) - (double)lBytes;
+      rWaitNs                 = MD5_THROTTLE_GetWait( psThrottle->rByteTokens, rPerSec, rWaitNs );
+   }
+
+   if( psThrottle->dwOpsPerSec != 0 )
+   {
+      double rPerSec = (double)psThrottle->dwOpsPerSec;
+
+      psThrottle->rOpTokens =
+         MD5_THROTTLE_Refill( psThrottle->rOpTokens, rPerSec, lElapsedNs ) - 1.0;
+      rWaitNs               = MD5_THROTTLE_GetWait( psThrottle->rOpTokens, rPerSec, rWaitNs );
+   }
+
+   if( psThrottle->dwCpuPercent != 0 )
+   {
+      /* All threads of the process count, the throttled and the others */
+      double rPerSec = (double)psThrottle->dwCpuPercent * 10000000.0;
+      UINT64 lCpuNs  = MD5_THROTTLE_GetTime( CLOCK_PROCESS_CPUTIME_ID );
+
+      psThrottle->rCpuTokens = MD5_THROTTLE_Refill( psThrottle->rCpuTokens, rPerSec, lElapsedNs ) -
+                               (double)( lCpuNs - psThrottle->lLastCpuNs );
+      psThrottle->lLastCpuNs = lCpuNs;
+      rWaitNs                = MD5_THROTTLE_GetWait( psThrottle->rCpuTokens, rPerSec, rWaitNs );
+   }
+
+   pthread_mutex_unlock( &psThrottle->sLock );
+
+   if( rWaitNs >= 1000.0 )
+   {
+      sWait.tv_sec  = (time_t)( rWaitNs / MD5_THROTTLE_NS_PER_SEC );
+      sWait.tv_nsec = (long)( rWaitNs - (double)sWait.tv_sec * MD5_THROTTLE_NS_PER_SEC );
+
+      while( ( nanosleep( &sWait, &sWait ) != 0 ) && ( errno == EINTR ) )
+      {
+      }
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Moves the calling thread into the idle CPU scheduling class (SCHED_IDLE)
+** and the idle I/O priority class. Threads it creates afterwards inherit
+** both, so call it before the workers are started.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - FALSE if either class could not be set (errno is set, ENOSYS
+**           on hosts other than Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_THROTTLE_SetIdlePriority( void )
+{
+#if defined( __linux__ )
+   struct sched_param sParam;
+
+   memset( &sParam, 0, sizeof( sParam ) );
+
+   if( sched_setscheduler( 0, SCHED_IDLE, &sParam ) != 0 )
+   {
+      return FALSE;
+   }
+
+   return ( syscall( SYS_ioprio_set, MD5_THROTTLE_IOPRIO_WHO_PROCESS, 0,
+                     MD5_THROTTLE_IOPRIO_IDLE ) == 0 );
+#else
+   errno = ENOSYS;
+   return FALSE;
+#endif
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,123 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_throttle.h
+**    Summary: Resource limits of the background mode. A token bucket shared
+**             by all workers limits the read rate in bytes and in read
+**             calls per second, and the CPU time of the process as a share
+**             of one CPU. Every read takes its tokens first; a reader that
+**             runs into debt sleeps until the debt is paid off.
+**
+**             MD5_THROTTLE_SetIdlePriority() moves the process into the
+**             idle CPU and I/O scheduling classes (Linux), so it only uses
+**             what other processes leave.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_THROTTLE_H_
+#define HMS_SC_MD5_THROTTLE_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <pthread.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+/*
+** Burst allowance of every limit: tokens saved up while idle are capped at
+** this much time worth of the rate
+*/
+#define MD5_THROTTLE_BURST_MS          ( 100U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_THROTTLE
+{
+   pthread_mutex_t sLock;
+   UINT64 lBytesPerSec;  /* 0: no limit */
+   UINT32 dwOpsPerSec;   /* 0: no limit */
+   UINT32 dwCpuPercent;  /* 0: no limit, 100: one CPU */
+   double rByteTokens;   /* Negative while in debt */
+   double rOpTokens;
+   double rCpuTokens;    /* ns of CPU time */
+   UINT64 lLastNs;       /* Last refill, CLOCK_MONOTONIC */
+   UINT64 lLastCpuNs;    /* Process CPU time at the last refill */
+} MD5_THROTTLE_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Initializes a throttle with full buckets.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle   - Throttle to initialize
+**    lBytesPerSec - Read rate limit, 0 for none
+**    dwOpsPerSec  - Read call limit, 0 for none
+**    dwCpuPercent - CPU time limit in percent of one CPU, 0 for none
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Init( MD5_THROTTLE_Type* psThrottle, UINT64 lBytesPerSec, UINT32 dwOpsPerSec,
+                        UINT32 dwCpuPercent );
+
+/*------------------------------------------------------------------------------
+** Frees the resources of a throttle.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle - Throttle to free
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Free( MD5_THROTTLE_Type* psThrottle );
+
+/*------------------------------------------------------------------------------
+** Takes the tokens of a completed read call and the CPU time used since the
+** last call, and sleeps as long as the limits require, delaying the next
+** read of the caller. May be called from any thread.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psThrottle - Throttle to take the tokens from
+**    lBytes     - Bytes read
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_THROTTLE_Acquire( MD5_THROTTLE_Type* psThrottle, UINT64 lBytes );
+
+/*------------------------------------------------------------------------------
+** Moves the calling thread into the idle CPU scheduling class (SCHED_IDLE)
+** and the idle I/O priority class. Threads it creates afterwards inherit
+** both, so call it before the workers are started.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - FALSE if either class could not be set (errno is set, ENOSYS
+**           on hosts other than Linux)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_THROTTLE_SetIdlePriority( void );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_THROTTLE_H_ */
@@ -0,0 +1,268 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tree.c
+**    Summary: MD5 tree hash, interior levels and root. Leaves of a file are
+**             hashed by the caller (e.g. in parallel with
+**             MD5_PIECE_HashAll()).
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include <string.h>
+#if( MD5_USE_PRINTF == 1 )
+#include <stdio.h>
+#endif
+
+#include "MD5_tree.h"
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/* Tree of the tests: three leaves, the last one partial, under one node */
+#define MD5_TREE_TEST_LEAF_SIZE        ( 64U )
+#define MD5_TREE_TEST_FAN_OUT          ( 4U )
+#define MD5_TREE_TEST_INPUT_SIZE       ( 2U * MD5_TREE_TEST_LEAF_SIZE + 22U )
+#define MD5_TREE_TEST_NUM_LEAVES       ( 3U )
+#endif
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+static void MD5_TREE_HashMemory( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwSize,
+                                 UINT8* pbRoot );
+static BOOL MD5_TREE_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed );
+#endif
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Computes the tree hash of an input held in memory, with the leaf size and
+** fan-out of the tests.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst - MD5 instance to use
+**    pbData - Input
+**    dwSize - Length of the input, at most MD5_TREE_TEST_INPUT_SIZE bytes
+**    pbRoot - Receives the root digest
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TREE_HashMemory( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwSize,
+                                 UINT8* pbRoot )
+{
+   UINT8 aabLeaves[ MD5_TREE_TEST_NUM_LEAVES ][ MD5_DIGEST_SIZE ];
+   UINT32 dwOffset  = 0;
+   UINT8 bNumLeaves = 0;
+
+   do
+   {
+      UINT32 dwLength = dwSize - dwOffset;
+
+      if( dwLength > MD5_TREE_TEST_LEAF_SIZE )
+      {
+         dwLength = MD5_TREE_TEST_LEAF_SIZE;
+      }
+
+      MD5_TREE_HashLeaf( psInst, &pbData[ dwOffset ], dwLength, aabLeaves[ bNumLeaves++ ] );
+      dwOffset += dwLength;
+   }
+   while( dwOffset < dwSize );
+
+   MD5_TREE_Reduce( psInst, aabLeaves, bNumLeaves, MD5_TREE_TEST_FAN_OUT, dwSize, pbRoot );
+}
+
+/*------------------------------------------------------------------------------
+** Prints the result of a test.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bTestEntry - Number of the test
+**    pacName    - What was tested
+**    fPassed    - TRUE if the test has passed
+**
+** Returns:
+**    BOOL - fPassed
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TREE_ReportTest( UINT8 bTestEntry, const char* pacName, BOOL fPassed )
+{
+   MD5_PRINTF( "TREE_TEST_%03d: %s\t: %s\n", bTestEntry, pacName, fPassed ? "PASSED" : "FAILED" );
+
+   return fPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the digest of a leaf held in memory. Leaves read from a file are
+** hashed the same way by MD5_PIECE_HashAll() with MD5_TREE_LEAF_MARKER as
+** the lead byte.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst   - MD5 instance used to hash the leaf
+**    pbData   - Leaf data
+**    dwLength - Length of the leaf in bytes
+**    pbDigest - Receives the leaf digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TREE_HashLeaf( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwLength,
+                        UINT8* pbDigest )
+{
+   MD5_Init( psInst );
+   MD5_UpdateByte( psInst, MD5_TREE_LEAF_MARKER, 1 );
+   MD5_UpdateLarge( psInst, pbData, dwLength );
+   MD5_Final( psInst );
+   memcpy( pbDigest, psInst->adwDigest, MD5_DIGEST_SIZE );
+}
+
+/*------------------------------------------------------------------------------
+** Computes the root of a tree from its leaf digests, level by level. The
+** leaf digests are overwritten with the interior nodes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst     - MD5 instance used to hash the interior nodes
+**    aabDigests - Leaf digests in input order, modified
+**    lNumLeaves - Number of leaves (at least 1)
+**    iFanOut    - Children per interior node (MD5_TREE_MIN_FAN_OUT ..
+**                 MD5_TREE_MAX_FAN_OUT)
+**    lSize      - Length of the input in bytes
+**    pbRoot     - Receives the root digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TREE_Reduce( MD5_InstType* psInst, UINT8 aabDigests[][ MD5_DIGEST_SIZE ],
+                      UINT64 lNumLeaves, UINT16 iFanOut, UINT64 lSize, UINT8* pbRoot )
+{
+   UINT64 lNumNodes = lNumLeaves;
+   UINT8 abLength[ 8 ];
+   UINT8 bByte;
+
+   while( lNumNodes > 1 )
+   {
+      UINT64 lParent;
+      UINT64 lNumParents = ( lNumNodes + iFanOut - 1 ) / iFanOut;
+
+      /* Parent i only reads children i * fan-out and up, so it can be stored in place */
+      for( lParent = 0; lParent < lNumParents; lParent++ )
+      {
+         UINT64 lFirstChild  = lParent * iFanOut;
+         UINT64 lNumChildren = lNumNodes - lFirstChild;
+
+         if( lNumChildren > iFanOut )
+         {
+            lNumChildren = iFanOut;
+         }
+
+         MD5_Init( psInst );
+         MD5_UpdateByte( psInst, MD5_TREE_NODE_MARKER, 1 );
+         MD5_UpdateLarge( psInst, aabDigests[ lFirstChild ],
+                          (UINT32)( lNumChildren * MD5_DIGEST_SIZE ) );
+         MD5_Final( psInst );
+         memcpy( aabDigests[ lParent ], psInst->adwDigest, MD5_DIGEST_SIZE );
+      }
+
+      lNumNodes = lNumParents;
+   }
+
+   for( bByte = 0; bByte < sizeof( abLength ); bByte++ )
+   {
+      abLength[ bByte ] = (UINT8)( lSize >> ( 8 * bByte ) );
+   }
+
+   MD5_Init( psInst );
+   MD5_UpdateByte( psInst, MD5_TREE_ROOT_MARKER, 1 );
+   MD5_Update( psInst, aabDigests[ 0 ], MD5_DIGEST_SIZE );
+   MD5_Update( psInst, abLength, sizeof( abLength ) );
+   MD5_Final( psInst );
+   memcpy( pbRoot, psInst->adwDigest, MD5_DIGEST_SIZE );
+}
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks that the tree hash of an input differs from that of a forged input
+** made of the node marker and its leaf digests, and that the root of a
+** single leaf input is not the plain MD5 of the input.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TREE_RunTests( void )
+{
+   UINT8 abInput[ MD5_TREE_TEST_INPUT_SIZE ];
+   UINT8 abForged[ 1 + MD5_TREE_TEST_NUM_LEAVES * MD5_DIGEST_SIZE ];
+   UINT8 abRoot[ MD5_DIGEST_SIZE ];
+   UINT8 abForgedRoot[ MD5_DIGEST_SIZE ];
+   BOOL fAllPassed = TRUE;
+   MD5_InstType sInst;
+   UINT16 iByte;
+   UINT8 bLeaf;
+
+   for( iByte = 0; iByte < sizeof( abInput ); iByte++ )
+   {
+      abInput[ iByte ] = (UINT8)( iByte * 7 + 1 );
+   }
+
+   /* A single leaf input that is the node marker followed by the leaf digests of abInput */
+   abForged[ 0 ] = MD5_TREE_NODE_MARKER;
+
+   for( bLeaf = 0; bLeaf < MD5_TREE_TEST_NUM_LEAVES; bLeaf++ )
+   {
+      UINT32 dwOffset = bLeaf * MD5_TREE_TEST_LEAF_SIZE;
+      UINT32 dwLength = sizeof( abInput ) - dwOffset;
+
+      if( dwLength > MD5_TREE_TEST_LEAF_SIZE )
+      {
+         dwLength = MD5_TREE_TEST_LEAF_SIZE;
+      }
+
+      MD5_TREE_HashLeaf( &sInst, &abInput[ dwOffset ], dwLength,
+                         &abForged[ 1 + bLeaf * MD5_DIGEST_SIZE ] );
+   }
+
+   MD5_TREE_HashMemory( &sInst, abInput, sizeof( abInput ), abRoot );
+   MD5_TREE_HashMemory( &sInst, abForged, sizeof( abForged ), abForgedRoot );
+
+   fAllPassed = MD5_TREE_ReportTest( 0, "NODE AS LEAF",
+                                     ( memcmp( abRoot, abForgedRoot, MD5_DIGEST_SIZE ) != 0 ) ) &&
+                fAllPassed;
+
+   /* A single leaf input */
+   MD5_TREE_HashMemory( &sInst, abInput, MD5_TREE_TEST_LEAF_SIZE, abRoot );
+   MD5_Compute( &sInst, abInput, MD5_TREE_TEST_LEAF_SIZE );
+
+   fAllPassed =
+      MD5_TREE_ReportTest( 1, "SINGLE LEAF",
+                           ( memcmp( abRoot, sInst.adwDigest, MD5_DIGEST_SIZE ) != 0 ) ) &&
+      fAllPassed;
+
+   return fAllPassed;
+}
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
@@ -0,0 +1,105 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tree.h
+**    Summary: MD5 tree hash. NOT the MD5 of the input: the input is split
+**             into fixed size leaves whose MD5s can be computed in parallel,
+**             and every interior node is the MD5 of a marker byte followed
+**             by the digests of up to 'fan-out' children. The root depends
+**             on the leaf size and fan-out, which must therefore be stored
+**             with it; both sides of a check have to use this scheme.
+**
+**                leaf     = MD5( MD5_TREE_LEAF_MARKER || leaf data )
+**                interior = MD5( MD5_TREE_NODE_MARKER || child digests )
+**                root     = MD5( MD5_TREE_ROOT_MARKER || top digest ||
+**                              input length, 64 bit little endian )
+**
+**             The top digest is that of the single top node, a leaf for an
+**             input no larger than the leaf size. An empty input has one
+**             empty leaf. The markers keep leaves, interior nodes and the
+**             root apart, so no input can pose as the children of a node,
+**             and the length ties the root to the size of the input.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_TREE_H_
+#define HMS_SC_MD5_TREE_H_
+
+#include "MD5.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_TREE_DEFAULT_LEAF_SIZE     ( 4U * 1024U * 1024U )
+#define MD5_TREE_DEFAULT_FAN_OUT       ( 16U )
+#define MD5_TREE_MIN_FAN_OUT           ( 2U )
+#define MD5_TREE_MAX_FAN_OUT           ( 256U )
+#define MD5_TREE_LEAF_MARKER           ( 0x00U )
+#define MD5_TREE_NODE_MARKER           ( 0x01U )
+#define MD5_TREE_ROOT_MARKER           ( 0x02U )
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Computes the digest of a leaf held in memory. Leaves read from a file are
+** hashed the same way by MD5_PIECE_HashAll() with MD5_TREE_LEAF_MARKER as
+** the lead byte.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst   - MD5 instance used to hash the leaf
+**    pbData   - Leaf data
+**    dwLength - Length of the leaf in bytes
+**    pbDigest - Receives the leaf digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TREE_HashLeaf( MD5_InstType* psInst, const UINT8* pbData, UINT32 dwLength,
+                        UINT8* pbDigest );
+
+/*------------------------------------------------------------------------------
+** Computes the root of a tree from its leaf digests, level by level. The
+** leaf digests are overwritten with the interior nodes.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psInst     - MD5 instance used to hash the interior nodes
+**    aabDigests - Leaf digests in input order, modified
+**    lNumLeaves - Number of leaves (at least 1)
+**    iFanOut    - Children per interior node (MD5_TREE_MIN_FAN_OUT ..
+**                 MD5_TREE_MAX_FAN_OUT)
+**    lSize      - Length of the input in bytes
+**    pbRoot     - Receives the root digest (MD5_DIGEST_SIZE bytes)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_TREE_Reduce( MD5_InstType* psInst, UINT8 aabDigests[][ MD5_DIGEST_SIZE ],
+                      UINT64 lNumLeaves, UINT16 iFanOut, UINT64 lSize, UINT8* pbRoot );
+
+#if( MD5_USE_TEST_ROUTINE == 1 )
+/*------------------------------------------------------------------------------
+** Checks that the tree hash of an input differs from that of a forged input
+** made of the node marker and its leaf digests, and that the root of a
+** single leaf input is not the plain MD5 of the input.
+**------------------------------------------------------------------------------
+** Arguments:
+**    None
+**
+** Returns:
+**    BOOL - TRUE if all tests have passed.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TREE_RunTests( void );
+#endif /* ( MD5_USE_TEST_ROUTINE == 1 ) */
+
+#endif /* HMS_SC_MD5_TREE_H_ */
@@ -0,0 +1,605 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tune.c
+**    Summary: Read settings tuned to a device: the trials of the autotune
+**             mode and the settings file.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_tune.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined( __linux__ )
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#endif
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_TUNE_MAX_LINE              ( 256U )
+#define MD5_TUNE_MAX_READ_SIZE         ( 64U * 1024U * 1024U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A worker of a trial, hashing its part of the sample
+*/
+typedef struct MD5_TUNE_Reader
+{
+   pthread_t sThread;
+   const char* pacSample;
+   MD5_IO_WorkerType sWorker;
+   UINT64 lOffset;
+   UINT64 lLength;
+   int iError; /* errno of the failed operation, 0 on success */
+} MD5_TUNE_ReaderType;
+
+/*******************************************************************************
+** Private Globals
+********************************************************************************
+*/
+
+/*
+** Read sizes tried, smallest first: on a tie the smaller one is kept
+*/
+static const UINT32 adwTuneReadSizes[] =
+   { 4096U, 16384U, 65536U, 131072U, 262144U, 1048576U, 4194304U };
+
+static const char* const apacBackendNames[ MD5_IO_NUM_BACKENDS ] =
+   { "read", "sequential", "direct" };
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+static BOOL MD5_TUNE_ParseLine( const char* pacLine, char* pacKey,
+                                MD5_TUNE_SettingsType* psSettings );
+static void* MD5_TUNE_ReadRange( void* pxReader );
+static void MD5_TUNE_Measure( const char* pacSample, UINT64 lSize, MD5_TUNE_SettingsType* psTrial );
+static void MD5_TUNE_Try( const char* pacSample, UINT64 lSize, MD5_TUNE_SettingsType* psTrial,
+                          MD5_TUNE_TrialFunc pnTrial, void* pxCtx, MD5_TUNE_SettingsType* psBest );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Parses a line of the settings file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacLine    - Line to parse
+**    pacKey     - Receives the key, MD5_TUNE_KEY_SIZE bytes
+**    psSettings - Receives the settings
+**
+** Returns:
+**    BOOL - FALSE if the line isn't a valid entry
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_TUNE_ParseLine( const char* pacLine, char* pacKey,
+                                MD5_TUNE_SettingsType* psSettings )
+{
+   unsigned long long lBytesPerSec;
+   unsigned long dwReadSize;
+   unsigned int iNumWorkers;
+   char acBackend[ 16 ];
+   UINT8 bBackend;
+
+   if( sscanf( pacLine, "%47s %lu %u %15s %llu", pacKey, &dwReadSize, &iNumWorkers, acBackend,
+               &lBytesPerSec ) != 5 )
+   {
+      return FALSE;
+   }
+
+   for( bBackend = 0; bBackend < MD5_IO_NUM_BACKENDS; bBackend++ )
+   {
+      if( strcmp( acBackend, apacBackendNames[ bBackend ] ) == 0 )
+      {
+         break;
+      }
+   }
+
+   if( ( bBackend == MD5_IO_NUM_BACKENDS ) || ( dwReadSize < MD5_IO_MIN_BUFFER_SIZE ) ||
+       ( dwReadSize > MD5_TUNE_MAX_READ_SIZE ) ||
+       ( ( dwReadSize % MD5_IO_MIN_BUFFER_SIZE ) != 0 ) || ( iNumWorkers == 0 ) ||
+       ( iNumWorkers > 0xFFFFU ) )
+   {
+      return FALSE;
+   }
+
+   psSettings->dwReadSize   = (UINT32)dwReadSize;
+   psSettings->iNumWorkers  = (UINT16)iNumWorkers;
+   psSettings->bBackend     = bBackend;
+   psSettings->lBytesPerSec = (UINT64)lBytesPerSec;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Thread of a trial worker: hashes its part of the sample through its own
+** file descriptor, read with the trial's backend.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxReader - MD5_TUNE_ReaderType of the worker
+**
+** Returns:
+**    void* - NULL
+**------------------------------------------------------------------------------
+*/
+static void* MD5_TUNE_ReadRange( void* pxReader )
+{
+   MD5_TUNE_ReaderType* psReader = pxReader;
+   MD5_IO_WorkerType* psWorker   = &psReader->sWorker;
+   UINT64 lDone                  = 0;
+   int iFd                       = open( psReader->pacSample, O_RDONLY | O_CLOEXEC );
+
+   if( iFd < 0 )
+   {
+      psReader->iError = errno;
+      return NULL;
+   }
+
+   MD5_IO_ApplyBackend( psWorker, iFd );
+   MD5_Init( &psWorker->sInst );
+
+   while( lDone < psReader->lLength )
+   {
+      size_t iChunk = psWorker->dwBufferSize;
+      ssize_t iBytesRead;
+
+      if( psReader->lLength - lDone < iChunk )
+      {
+         iChunk = (size_t)( psReader->lLength - lDone );
+      }
+
+      iBytesRead = MD5_IO_ReadAt( psWorker, iFd, psWorker->pbBuffer, iChunk,
+                                  (off_t)( psReader->lOffset + lDone ) );
+
+      if( iBytesRead > 0 )
+      {
+         MD5_UpdateLarge( &psWorker->sInst, psWorker->pbBuffer, (UINT32)iBytesRead );
+         lDone += (UINT64)iBytesRead;
+      }
+      else if( iBytesRead == 0 )
+      {
+         /* The sample shrank, the trial doesn't measure what it should */
+         psReader->iError = EIO;
+         break;
+      }
+      else if( errno != EINTR )
+      {
+         psReader->iError = errno;
+         break;
+      }
+   }
+
+   MD5_Final( &psWorker->sInst );
+   close( iFd );
+
+   return NULL;
+}
+
+/*------------------------------------------------------------------------------
+** Runs a trial: drops the sample from the page cache and hashes it with the
+** workers of the trial, each reading an equal part.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSample - Sample file
+**    lSize     - Bytes of the sample to read
+**    psTrial   - Settings to measure, receives the throughput (0 if the
+**                trial failed, errno is set)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TUNE_Measure( const char* pacSample, UINT64 lSize, MD5_TUNE_SettingsType* psTrial )
+{
+   MD5_TUNE_ReaderType* asReaders = calloc( psTrial->iNumWorkers, sizeof( MD5_TUNE_ReaderType ) );
+   UINT64 lPart                   =
+      ( lSize / psTrial->iNumWorkers ) & ~(UINT64)( MD5_IO_MIN_BUFFER_SIZE - 1 );
+   UINT16 iNumStarted             = 0;
+   int iError                     = 0;
+   struct timespec sStart;
+   struct timespec sEnd;
+   UINT64 lElapsedNs;
+   UINT16 iReader;
+   int iFd;
+
+   psTrial->lBytesPerSec = 0;
+
+   if( asReaders == NULL )
+   {
+      return;
+   }
+
+   if( lPart == 0 )
+   {
+      free( asReaders );
+      errno = EINVAL;
+      return;
+   }
+
+   /* Clean pages only; the sample is expected to be on disk already */
+   iFd = open( pacSample, O_RDONLY | O_CLOEXEC );
+
+   if( iFd >= 0 )
+   {
+      (void)posix_fadvise( iFd, 0, (off_t)lSize, POSIX_FADV_DONTNEED );
+      close( iFd );
+   }
+
+   for( iReader = 0; iReader < psTrial->iNumWorkers; iReader++ )
+   {
+      if( !MD5_IO_InitWorker( &asReaders[ iReader ].sWorker, psTrial->dwReadSize ) )
+      {
+         iError = ENOMEM;
+         break;
+      }
+
+      asReaders[ iReader ].sWorker.bBackend = psTrial->bBackend;
+      asReaders[ iReader ].pacSample        = pacSample;
+      asReaders[ iReader ].lOffset          = lPart * iReader;
+      asReaders[ iReader ].lLength          = lPart;
+   }
+
+   clock_gettime( CLOCK_MONOTONIC, &sStart );
+
+   for( ; ( iError == 0 ) && ( iNumStarted < psTrial->iNumWorkers ); iNumStarted++ )
+   {
+      iError = pthread_create( &asReaders[ iNumStarted ].sThread, NULL, MD5_TUNE_ReadRange,
+                               &asReaders[ iNumStarted ] );
+
+      if( iError != 0 )
+      {
+         break;
+      }
+   }
+
+   for( iReader = 0; iReader < iNumStarted; iReader++ )
+   {
+      pthread_join( asReaders[ iReader ].sThread, NULL );
+
+      if( iError == 0 )
+      {
+         iError = asReaders[ iReader ].iError;
+      }
+   }
+
+   clock_gettime( CLOCK_MONOTONIC, &sEnd );
+
+   for( iReader = 0; iReader < psTrial->iNumWorkers; iReader++ )
+   {
+      MD5_IO_FreeWorker( &asReaders[ iReader ].sWorker );
+   }
+
+   free( asReaders );
+
+   lElapsedNs = (UINT64)( sEnd.tv_sec - sStart.tv_sec ) * 1000000000U + (UINT64)sEnd.tv_nsec -
+                (UINT64)sStart.tv_nsec;
+
+   if( iError != 0 )
+   {
+      errno = iError;
+      return;
+   }
+
+   psTrial->lBytesPerSec = (UINT64)( (double)( lPart * psTrial->iNumWorkers ) * 1e9 /
+                                     (double)( ( lElapsedNs != 0 ) ? lElapsedNs : 1 ) );
+}
+
+/*------------------------------------------------------------------------------
+** Runs a trial, reports it and keeps it if it beats the best so far by
+** MD5_TUNE_MIN_GAIN_PERCENT.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSample - Sample file
+**    lSize     - Bytes of the sample to read
+**    psTrial   - Settings to measure, receives the throughput
+**    pnTrial   - Receives the trial, or NULL
+**    pxCtx     - Passed to pnTrial
+**    psBest    - Best settings so far (lBytesPerSec 0 if none)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_TUNE_Try( const char* pacSample, UINT64 lSize, MD5_TUNE_SettingsType* psTrial,
+                          MD5_TUNE_TrialFunc pnTrial, void* pxCtx, MD5_TUNE_SettingsType* psBest )
+{
+   MD5_TUNE_Measure( pacSample, lSize, psTrial );
+
+   if( pnTrial != NULL )
+   {
+      pnTrial( psTrial, pxCtx );
+   }
+
+   if( (double)psTrial->lBytesPerSec >
+       (double)psBest->lBytesPerSec * ( 100.0 + MD5_TUNE_MIN_GAIN_PERCENT ) / 100.0 )
+   {
+      *psBest = *psTrial;
+   }
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the name of a read backend, as used in the settings file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bBackend - MD5_IO_BACKEND_...
+**
+** Returns:
+**    const char* - Name ("read", "sequential" or "direct")
+**------------------------------------------------------------------------------
+*/
+const char* MD5_TUNE_GetBackendName( UINT8 bBackend )
+{
+   return apacBackendNames[ ( bBackend < MD5_IO_NUM_BACKENDS ) ? bBackend : MD5_IO_BACKEND_READ ];
+}
+
+/*------------------------------------------------------------------------------
+** Builds the settings key of the device a path is stored on: the device
+** number and the file system type ("8:1/ef53"). For a block device, the key
+** is that of the device itself ("259:0/blk").
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacPath - File, directory or block device
+**    pacKey  - Receives the key, MD5_TUNE_KEY_SIZE bytes
+**
+** Returns:
+**    BOOL - FALSE if the path can't be examined (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_GetKey( const char* pacPath, char* pacKey )
+{
+   struct stat sStat;
+
+   if( stat( pacPath, &sStat ) != 0 )
+   {
+      return FALSE;
+   }
+
+#if defined( __linux__ )
+   if( S_ISBLK( sStat.st_mode ) )
+   {
+      snprintf( pacKey, MD5_TUNE_KEY_SIZE, "%u:%u/blk", major( sStat.st_rdev ),
+                minor( sStat.st_rdev ) );
+   }
+   else
+   {
+      struct statfs sFs;
+
+      if( statfs( pacPath, &sFs ) != 0 )
+      {
+         return FALSE;
+      }
+
+      snprintf( pacKey, MD5_TUNE_KEY_SIZE, "%u:%u/%lx", major( sStat.st_dev ),
+                minor( sStat.st_dev ), (unsigned long)sFs.f_type );
+   }
+#else
+   snprintf( pacKey, MD5_TUNE_KEY_SIZE, "%llx/%s",
+             (unsigned long long)( S_ISBLK( sStat.st_mode ) ? sStat.st_rdev : sStat.st_dev ),
+             S_ISBLK( sStat.st_mode ) ? "blk" : "fs" );
+#endif
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Looks up the settings of a device.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - Settings file
+**    pacKey      - Key of the device (MD5_TUNE_GetKey())
+**    psSettings  - Receives the settings
+**
+** Returns:
+**    BOOL - FALSE if the device has no valid entry or the file can't be read
+**           (errno is set, ENOENT if there is no entry)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Load( const char* pacFilename, const char* pacKey, MD5_TUNE_SettingsType* psSettings )
+{
+   FILE* psFile = fopen( pacFilename, "r" );
+   BOOL fFound  = FALSE;
+   char acLine[ MD5_TUNE_MAX_LINE ];
+   char acKey[ MD5_TUNE_KEY_SIZE ];
+
+   if( psFile == NULL )
+   {
+      return FALSE;
+   }
+
+   /* The last entry wins, should a hand edit have left two */
+   while( fgets( acLine, sizeof( acLine ), psFile ) != NULL )
+   {
+      MD5_TUNE_SettingsType sEntry;
+
+      if( MD5_TUNE_ParseLine( acLine, acKey, &sEntry ) && ( strcmp( acKey, pacKey ) == 0 ) )
+      {
+         *psSettings = sEntry;
+         fFound      = TRUE;
+      }
+   }
+
+   fclose( psFile );
+
+   if( !fFound )
+   {
+      errno = ENOENT;
+   }
+
+   return fFound;
+}
+
+/*------------------------------------------------------------------------------
+** Records the settings of a device, replacing its previous entry. The file is
+** replaced atomically (MD5_IO_BeginReplace()), so concurrent readers see
+** either the old or the new settings.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - Settings file, created if missing
+**    pacKey      - Key of the device (MD5_TUNE_GetKey())
+**    psSettings  - Settings to record
+**
+** Returns:
+**    BOOL - FALSE if the file can't be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Store( const char* pacFilename, const char* pacKey,
+                     const MD5_TUNE_SettingsType* psSettings )
+{
+   MD5_IO_ReplaceType sReplace;
+   FILE* psOld;
+   BOOL fSuccess = TRUE;
+   char acLine[ MD5_TUNE_MAX_LINE ];
+   char acKey[ MD5_TUNE_KEY_SIZE ];
+
+   if( !MD5_IO_BeginReplace( &sReplace, pacFilename ) )
+   {
+      return FALSE;
+   }
+
+   psOld = fopen( pacFilename, "r" );
+
+   /* Valid entries of other devices are kept, everything else is dropped */
+   while( fSuccess && ( psOld != NULL ) && ( fgets( acLine, sizeof( acLine ), psOld ) != NULL ) )
+   {
+      MD5_TUNE_SettingsType sEntry;
+
+      if( MD5_TUNE_ParseLine( acLine, acKey, &sEntry ) && ( strcmp( acKey, pacKey ) != 0 ) )
+      {
+         fSuccess = ( fprintf( sReplace.psFile, "%s %lu %u %s %llu\n", acKey,
+                               (unsigned long)sEntry.dwReadSize, (unsigned int)sEntry.iNumWorkers,
+                               MD5_TUNE_GetBackendName( sEntry.bBackend ),
+                               (unsigned long long)sEntry.lBytesPerSec ) > 0 );
+      }
+   }
+
+   if( psOld != NULL )
+   {
+      fclose( psOld );
+   }
+
+   fSuccess = fSuccess &&
+              ( fprintf( sReplace.psFile, "%s %lu %u %s %llu\n", pacKey,
+                         (unsigned long)psSettings->dwReadSize,
+                         (unsigned int)psSettings->iNumWorkers,
+                         MD5_TUNE_GetBackendName( psSettings->bBackend ),
+                         (unsigned long long)psSettings->lBytesPerSec ) > 0 );
+
+   return MD5_IO_CommitReplace( &sReplace, fSuccess );
+}
+
+/*------------------------------------------------------------------------------
+** Finds the fastest read settings for a sample file. Every trial drops the
+** sample from the page cache and hashes it with a set of workers, each
+** reading its own part of the sample. The search goes one dimension at a
+** time: read sizes with one plain reader, then the backends at the best
+** size, then doubling numbers of workers with the best of both. Data that
+** can't be dropped from the page cache (dirty pages, tmpfs) is measured
+** from memory.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSample   - Sample file (or block device) on the device to tune for
+**    lSize       - Bytes of the sample to read per trial
+**    iMaxWorkers - Most workers to try
+**    lMemCap     - Cap on the buffers of all workers in bytes (0: no cap)
+**    pnTrial     - Receives every trial, or NULL
+**    pxCtx       - Passed to pnTrial
+**    psBest      - Receives the fastest settings
+**
+** Returns:
+**    BOOL - FALSE if no trial succeeded (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Run( const char* pacSample, UINT64 lSize, UINT16 iMaxWorkers, UINT64 lMemCap,
+                   MD5_TUNE_TrialFunc pnTrial, void* pxCtx, MD5_TUNE_SettingsType* psBest )
+{
+   MD5_TUNE_SettingsType sTrial;
+   UINT16 iNumWorkers;
+   UINT8 bBackend;
+   UINT16 iSize;
+
+   memset( psBest, 0, sizeof( *psBest ) );
+   memset( &sTrial, 0, sizeof( sTrial ) );
+
+   sTrial.iNumWorkers = 1;
+   sTrial.bBackend    = MD5_IO_BACKEND_READ;
+
+   for( iSize = 0; iSize < sizeof( adwTuneReadSizes ) / sizeof( adwTuneReadSizes[ 0 ] ); iSize++ )
+   {
+      /* A read larger than the sample measures nothing new */
+      if( ( adwTuneReadSizes[ iSize ] > lSize ) ||
+          ( ( lMemCap != 0 ) && ( adwTuneReadSizes[ iSize ] > lMemCap ) ) )
+      {
+         break;
+      }
+
+      sTrial.dwReadSize = adwTuneReadSizes[ iSize ];
+      MD5_TUNE_Try( pacSample, lSize, &sTrial, pnTrial, pxCtx, psBest );
+   }
+
+   if( psBest->lBytesPerSec == 0 )
+   {
+      if( iSize == 0 )
+      {
+         errno = EINVAL;
+      }
+
+      return FALSE;
+   }
+
+   for( bBackend = MD5_IO_BACKEND_READ + 1; bBackend < MD5_IO_NUM_BACKENDS; bBackend++ )
+   {
+      sTrial.dwReadSize = psBest->dwReadSize;
+      sTrial.bBackend   = bBackend;
+      MD5_TUNE_Try( pacSample, lSize, &sTrial, pnTrial, pxCtx, psBest );
+   }
+
+   for( iNumWorkers = 2; ( iNumWorkers / 2 ) < iMaxWorkers; iNumWorkers *= 2 )
+   {
+      sTrial.dwReadSize  = psBest->dwReadSize;
+      sTrial.bBackend    = psBest->bBackend;
+      sTrial.iNumWorkers = ( iNumWorkers < iMaxWorkers ) ? iNumWorkers : iMaxWorkers;
+
+      if( ( ( lMemCap != 0 ) && ( (UINT64)sTrial.dwReadSize * sTrial.iNumWorkers > lMemCap ) ) ||
+          ( lSize / sTrial.iNumWorkers < sTrial.dwReadSize ) )
+      {
+         break;
+      }
+
+      MD5_TUNE_Try( pacSample, lSize, &sTrial, pnTrial, pxCtx, psBest );
+   }
+
+   return TRUE;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,158 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_tune.h
+**    Summary: Read settings tuned to a device. MD5_TUNE_Run() hashes a
+**             sample file on the device with different read sizes, read
+**             backends (MD5_IO_BACKEND_...) and numbers of reads in flight
+**             (workers, each with one buffer), and picks the fastest
+**             settings. They are kept per device and file system in a small
+**             text file, so later runs on the same device start with them.
+**
+**             File format: one line per device,
+**             "<key> <read size> <workers> <backend> <bytes/s>", the key as
+**             built by MD5_TUNE_GetKey(). Lines that don't parse are
+**             dropped by the next update.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_TUNE_H_
+#define HMS_SC_MD5_TUNE_H_
+
+#include "MD5.h"
+#include "MD5_io.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_TUNE_KEY_SIZE              ( 48U )
+
+/*
+** Bytes of the sample read by every trial, split evenly between its workers
+*/
+#define MD5_TUNE_SAMPLE_SIZE           ( 32U * 1024U * 1024U )
+
+/*
+** A trial must be this much faster than the best so far to replace it, so
+** measurement noise doesn't trade small reads and few workers for nothing
+*/
+#define MD5_TUNE_MIN_GAIN_PERCENT      ( 5U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_TUNE_Settings
+{
+   UINT32 dwReadSize;   /* Bytes per read call, the buffer size of a worker */
+   UINT16 iNumWorkers;  /* Reads in flight */
+   UINT8 bBackend;      /* MD5_IO_BACKEND_... */
+   UINT64 lBytesPerSec; /* Measured with these settings, 0 if the trial failed */
+} MD5_TUNE_SettingsType;
+
+/*
+** Called after every trial of MD5_TUNE_Run()
+*/
+typedef void ( *MD5_TUNE_TrialFunc )( const MD5_TUNE_SettingsType* psTrial, void* pxCtx );
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Returns the name of a read backend, as used in the settings file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    bBackend - MD5_IO_BACKEND_...
+**
+** Returns:
+**    const char* - Name ("read", "sequential" or "direct")
+**------------------------------------------------------------------------------
+*/
+const char* MD5_TUNE_GetBackendName( UINT8 bBackend );
+
+/*------------------------------------------------------------------------------
+** Builds the settings key of the device a path is stored on: the device
+** number and the file system type ("8:1/ef53"). For a block device, the key
+** is that of the device itself ("259:0/blk").
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacPath - File, directory or block device
+**    pacKey  - Receives the key, MD5_TUNE_KEY_SIZE bytes
+**
+** Returns:
+**    BOOL - FALSE if the path can't be examined (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_GetKey( const char* pacPath, char* pacKey );
+
+/*------------------------------------------------------------------------------
+** Looks up the settings of a device.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - Settings file
+**    pacKey      - Key of the device (MD5_TUNE_GetKey())
+**    psSettings  - Receives the settings
+**
+** Returns:
+**    BOOL - FALSE if the device has no valid entry or the file can't be read
+**           (errno is set, ENOENT if there is no entry)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Load( const char* pacFilename, const char* pacKey,
+                    MD5_TUNE_SettingsType* psSettings );
+
+/*------------------------------------------------------------------------------
+** Records the settings of a device, replacing its previous entry. The file is
+** replaced atomically (MD5_IO_BeginReplace()), so concurrent readers see
+** either the old or the new settings.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacFilename - Settings file, created if missing
+**    pacKey      - Key of the device (MD5_TUNE_GetKey())
+**    psSettings  - Settings to record
+**
+** Returns:
+**    BOOL - FALSE if the file can't be written (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Store( const char* pacFilename, const char* pacKey,
+                     const MD5_TUNE_SettingsType* psSettings );
+
+/*------------------------------------------------------------------------------
+** Finds the fastest read settings for a sample file. Every trial drops the
+** sample from the page cache and hashes it with a set of workers, each
+** reading its own part of the sample. The search goes one dimension at a
+** time: read sizes with one plain reader, then the backends at the best
+** size, then doubling numbers of workers with the best of both. Data that
+** can't be dropped from the page cache (dirty pages, tmpfs) is measured
+** from memory.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacSample   - Sample file (or block device) on the device to tune for
+**    lSize       - Bytes of the sample to read per trial
+**    iMaxWorkers - Most workers to try
+**    lMemCap     - Cap on the buffers of all workers in bytes (0: no cap)
+**    pnTrial     - Receives every trial, or NULL
+**    pxCtx       - Passed to pnTrial
+**    psBest      - Receives the fastest settings
+**
+** Returns:
+**    BOOL - FALSE if no trial succeeded (errno is set)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_TUNE_Run( const char* pacSample, UINT64 lSize, UINT16 iMaxWorkers, UINT64 lMemCap,
+                   MD5_TUNE_TrialFunc pnTrial, void* pxCtx, MD5_TUNE_SettingsType* psBest );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_TUNE_H_ */
@@ -0,0 +1,1110 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_walk.c
+**    Summary: Parallel directory-tree walker. Every directory scan and every
+**             file visit is a pool job. The discovered tree doubles as the
+**             reorder buffer: an emit cursor walks it depth-first in sorted
+**             order and hands out results as soon as the next one in line is
+**             ready, freeing nodes as it goes.
+**
+**             A directory keeps its fd open while jobs for its children are
+**             pending, so files and sub-directories are opened with a short
+**             relative lookup. Files are identified and visited in batches,
+**             which spreads the job overhead over many small files.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE /* statx() */
+#endif
+
+#include "MD5_walk.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined( __linux__ )
+#include <sys/sysmacros.h>
+#endif
+
+#include "MD5_port.h"
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_WALK_INITIAL_ENTRIES       ( 32U )
+#define MD5_WALK_INITIAL_LINKS         ( 256U )
+
+/*
+** Directory fds kept open at the same time (at most a quarter of the fd
+** limit), beyond that full paths are used
+*/
+#define MD5_WALK_MAX_DIR_FDS           ( 256U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+typedef struct MD5_WALK_Node
+{
+   MD5_WALK_FileType sFile;
+   struct MD5_WALK_Ctx* psWalk;
+   struct MD5_WALK_Node* psParent;
+   struct MD5_WALK_Node** apsChildren; /* Sorted by name */
+   UINT32 dwNumChildren;
+   UINT32 dwNextChild;                 /* Next child to emit */
+   int iDirFd;                         /* Directory kept open for its children, else -1 */
+   UINT32 dwDirFdRefs;                 /* Pending child jobs using iDirFd */
+   BOOL fDirectory;
+   BOOL fLinked;                       /* Regular file with more than one link */
+   BOOL fLinkOwner;                    /* Linked file visited through this node */
+   BOOL fReady;                        /* Scanned (directory) or visited (file) */
+} MD5_WALK_NodeType;
+
+/*
+** Files of one directory that are identified (and visited) by one job
+*/
+typedef struct MD5_WALK_Batch
+{
+   MD5_WALK_NodeType* psDir;
+   UINT16 iNumFiles;
+   MD5_WALK_NodeType* apsFiles[ MD5_WALK_BATCH_SIZE ];
+} MD5_WALK_BatchType;
+
+typedef struct MD5_WALK_Entry
+{
+   char* pacName;
+   BOOL fDirectory;
+} MD5_WALK_EntryType;
+
+/*
+** Multiply linked inode. The first link to be visited hashes the file, the
+** first link in emit order reports it; all other links are skipped.
+*/
+typedef struct MD5_WALK_Link
+{
+   UINT64 lDevice;
+   UINT64 lInode; /* 0 marks an empty slot */
+   int iError;
+   BOOL fVisited;
+   BOOL fEmitted;
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_WALK_LinkType;
+
+typedef struct MD5_WALK_Ctx
+{
+   MD5_POOL_Type* psPool;
+   const MD5_WALK_ConfigType* psCfg;
+   MD5_WALK_NodeType* psCursor;
+   UINT32 dwOpenDirFds;
+   UINT32 dwMaxDirFds;
+   BOOL fOutOfMemory;
+   pthread_mutex_t sEmitLock;
+   pthread_mutex_t sLinkLock;
+   MD5_WALK_LinkType* asLinks;
+   UINT32 dwLinkCapacity; /* Always a power of two */
+   UINT32 dwNumLinks;
+} MD5_WALK_CtxType;
+
+/*------------------------------------------------------------------------------
+** Forward declarations
+**------------------------------------------------------------------------------
+*/
+
+static MD5_WALK_NodeType* MD5_WALK_NewNode( MD5_WALK_CtxType* psWalk, MD5_WALK_NodeType* psParent,
+                                            const char* pacName, BOOL fDirectory );
+static void MD5_WALK_FreeNode( MD5_WALK_NodeType* psNode );
+static MD5_WALK_LinkType* MD5_WALK_FindLink( MD5_WALK_CtxType* psWalk, UINT64 lDevice,
+                                             UINT64 lInode );
+static BOOL MD5_WALK_ClaimInode( MD5_WALK_CtxType* psWalk, UINT64 lDevice, UINT64 lInode,
+                                 BOOL* pfFirst );
+static void MD5_WALK_StoreLinkResult( MD5_WALK_CtxType* psWalk, const MD5_WALK_FileType* psFile );
+static BOOL MD5_WALK_ResolveLink( MD5_WALK_CtxType* psWalk, MD5_WALK_FileType* psFile );
+static int MD5_WALK_CompareEntries( const void* pxEntry1, const void* pxEntry2 );
+static int MD5_WALK_ReadEntries( int iDirFd, MD5_WALK_EntryType** pasEntries,
+                                 UINT32* pdwNumEntries );
+static void MD5_WALK_ReleaseDirFd( MD5_WALK_NodeType* psDir );
+static BOOL MD5_WALK_IdentifyFile( MD5_WALK_NodeType* psNode );
+static void MD5_WALK_SubmitFiles( MD5_WALK_NodeType* psDir, MD5_WALK_NodeType* apsFiles[],
+                                  UINT16 iNumFiles );
+static void MD5_WALK_ScanJob( void* pxArg, UINT16 iWorker );
+static void MD5_WALK_BatchJob( void* pxArg, UINT16 iWorker );
+static void MD5_WALK_VisitJob( void* pxArg, UINT16 iWorker );
+static void MD5_WALK_Emit( MD5_WALK_CtxType* psWalk );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Allocates a tree node. The path is the parent's path joined with pacName
+** (or pacName itself for the root). Until the parent decides to keep its fd
+** open, the node is addressed by its full path.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk     - Walk the node belongs to
+**    psParent   - Parent directory node, NULL for the root
+**    pacName    - Entry name (root: path as given by the user)
+**    fDirectory - TRUE for directories
+**
+** Returns:
+**    MD5_WALK_NodeType* - New node, NULL when out of memory
+**------------------------------------------------------------------------------
+*/
+static MD5_WALK_NodeType* MD5_WALK_NewNode( MD5_WALK_CtxType* psWalk, MD5_WALK_NodeType* psParent,
+                                            const char* pacName, BOOL fDirectory )
+{
+   MD5_WALK_NodeType* psNode = calloc( 1, sizeof( MD5_WALK_NodeType ) );
+   size_t iNameLen           = strlen( pacName );
+   size_t iParentLen         = 0;
+
+   if( psNode == NULL )
+   {
+      return NULL;
+   }
+
+   if( ( psParent != NULL ) && ( psParent->sFile.pacPath != NULL ) )
+   {
+      iParentLen = strlen( psParent->sFile.pacPath );
+   }
+
+   psNode->sFile.pacPath = malloc( iParentLen + 1 + iNameLen + 1 );
+
+   if( psNode->sFile.pacPath == NULL )
+   {
+      free( psNode );
+      return NULL;
+   }
+
+   if( iParentLen != 0 )
+   {
+      memcpy( psNode->sFile.pacPath, psParent->sFile.pacPath, iParentLen );
+
+      if( psNode->sFile.pacPath[ iParentLen - 1 ] != '/' )
+      {
+         psNode->sFile.pacPath[ iParentLen++ ] = '/';
+      }
+   }
+
+   memcpy( &psNode->sFile.pacPath[ iParentLen ], pacName, iNameLen + 1 );
+
+   psNode->sFile.iDirFd  = AT_FDCWD;
+   psNode->sFile.pacName = &psNode->sFile.pacPath[ iParentLen ];
+   psNode->iDirFd        = -1;
+   psNode->psWalk        = psWalk;
+   psNode->psParent   = psParent;
+   psNode->fDirectory = fDirectory;
+
+   return psNode;
+}
+
+/*------------------------------------------------------------------------------
+** Frees a node (its children must have been freed already).
+**------------------------------------------------------------------------------
+** Arguments:
+**    psNode - Node to free
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_FreeNode( MD5_WALK_NodeType* psNode )
+{
+   free( psNode->apsChildren );
+   free( psNode->sFile.pacPath );
+   free( psNode );
+}
+
+/*------------------------------------------------------------------------------
+** Looks up the slot of a (device, inode) pair. Caller holds the link lock.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk  - Walk context holding the set of linked inodes
+**    lDevice - Device the file resides on
+**    lInode  - Inode number of the file
+**
+** Returns:
+**    MD5_WALK_LinkType* - Matching slot, or the empty slot to insert it into
+**------------------------------------------------------------------------------
+*/
+static MD5_WALK_LinkType* MD5_WALK_FindLink( MD5_WALK_CtxType* psWalk, UINT64 lDevice,
+                                             UINT64 lInode )
+{
+   UINT32 dwSlot = (UINT32)( ( lInode * 0x9E3779B97F4A7C15ULL ) ^ lDevice );
+
+   while( TRUE )
+   {
+      MD5_WALK_LinkType* psLink = &psWalk->asLinks[ dwSlot & ( psWalk->dwLinkCapacity - 1 ) ];
+
+      if( ( psLink->lInode == 0 ) ||
+          ( ( psLink->lInode == lInode ) && ( psLink->lDevice == lDevice ) ) )
+      {
+         return psLink;
+      }
+
+      dwSlot++;
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Records a (device, inode) pair of a multiply linked file.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk  - Walk context holding the set of linked inodes
+**    lDevice - Device the file resides on
+**    lInode  - Inode number of the file
+**    pfFirst - Set to TRUE if this is the first time the inode is seen (the
+**              caller is to visit the file), FALSE if another link claimed it
+**
+** Returns:
+**    BOOL - FALSE if the inode could not be recorded (out of memory)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_WALK_ClaimInode( MD5_WALK_CtxType* psWalk, UINT64 lDevice, UINT64 lInode,
+                                 BOOL* pfFirst )
+{
+   MD5_WALK_LinkType* psLink;
+
+   pthread_mutex_lock( &psWalk->sLinkLock );
+
+   /* Keep the load factor at or below 1/2 */
+   if( ( psWalk->dwNumLinks + 1 ) * 2 > psWalk->dwLinkCapacity )
+   {
+      UINT32 dwOldCapacity        = psWalk->dwLinkCapacity;
+      MD5_WALK_LinkType* asOld    = psWalk->asLinks;
+      UINT32 dwNewCapacity        =
+         ( dwOldCapacity == 0 ) ? MD5_WALK_INITIAL_LINKS : dwOldCapacity << 1;
+      MD5_WALK_LinkType* asNew    = calloc( dwNewCapacity, sizeof( MD5_WALK_LinkType ) );
+      UINT32 dwIndex;
+
+      if( asNew == NULL )
+      {
+         pthread_mutex_unlock( &psWalk->sLinkLock );
+         return FALSE;
+      }
+
+      psWalk->asLinks        = asNew;
+      psWalk->dwLinkCapacity = dwNewCapacity;
+
+      for( dwIndex = 0; dwIndex < dwOldCapacity; dwIndex++ )
+      {
+         if( asOld[ dwIndex ].lInode != 0 )
+         {
+            *MD5_WALK_FindLink( psWalk, asOld[ dwIndex ].lDevice, asOld[ dwIndex ].lInode ) =
+               asOld[ dwIndex ];
+         }
+      }
+
+      free( asOld );
+   }
+
+   psLink   = MD5_WALK_FindLink( psWalk, lDevice, lInode );
+   *pfFirst = ( psLink->lInode == 0 );
+
+   if( *pfFirst )
+   {
+      psLink->lDevice = lDevice;
+      psLink->lInode  = lInode;
+      psWalk->dwNumLinks++;
+   }
+
+   pthread_mutex_unlock( &psWalk->sLinkLock );
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Stores the visit result of a multiply linked file for its other links.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk - Walk context holding the set of linked inodes
+**    psFile - Visited file
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_StoreLinkResult( MD5_WALK_CtxType* psWalk, const MD5_WALK_FileType* psFile )
+{
+   MD5_WALK_LinkType* psLink;
+
+   pthread_mutex_lock( &psWalk->sLinkLock );
+
+   psLink           = MD5_WALK_FindLink( psWalk, psFile->lDevice, psFile->lInode );
+   psLink->iError   = psFile->iError;
+   psLink->fVisited = TRUE;
+   memcpy( psLink->abDigest, psFile->abDigest, MD5_DIGEST_SIZE );
+
+   pthread_mutex_unlock( &psWalk->sLinkLock );
+}
+
+/*------------------------------------------------------------------------------
+** Decides whether a multiply linked file about to be emitted is reported (it
+** is the first link in emit order) or skipped.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk - Walk context holding the set of linked inodes
+**    psFile - File about to be emitted, receives the result of the link
+**             that was visited
+**
+** Returns:
+**    BOOL - FALSE if the link that visits the inode isn't done yet
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_WALK_ResolveLink( MD5_WALK_CtxType* psWalk, MD5_WALK_FileType* psFile )
+{
+   BOOL fResolved = TRUE;
+   MD5_WALK_LinkType* psLink;
+
+   pthread_mutex_lock( &psWalk->sLinkLock );
+
+   psLink = MD5_WALK_FindLink( psWalk, psFile->lDevice, psFile->lInode );
+
+   if( psLink->fEmitted )
+   {
+      psFile->fSkipped = TRUE;
+   }
+   else if( !psLink->fVisited )
+   {
+      fResolved = FALSE;
+   }
+   else
+   {
+      psLink->fEmitted = TRUE;
+      psFile->iError   = psLink->iError;
+      memcpy( psFile->abDigest, psLink->abDigest, MD5_DIGEST_SIZE );
+   }
+
+   pthread_mutex_unlock( &psWalk->sLinkLock );
+
+   return fResolved;
+}
+
+/*------------------------------------------------------------------------------
+** qsort() callback ordering directory entries bytewise by name.
+**------------------------------------------------------------------------------
+*/
+static int MD5_WALK_CompareEntries( const void* pxEntry1, const void* pxEntry2 )
+{
+   return strcmp( ( (const MD5_WALK_EntryType*)pxEntry1 )->pacName,
+                  ( (const MD5_WALK_EntryType*)pxEntry2 )->pacName );
+}
+
+/*------------------------------------------------------------------------------
+** Reads the regular files and sub-directories of a directory, sorted by name.
+**------------------------------------------------------------------------------
+** Arguments:
+**    iDirFd        - Open directory to read (stays open)
+**    pasEntries    - Receives the allocated entry array
+**    pdwNumEntries - Receives the number of entries
+**
+** Returns:
+**    int - 0 on success, else an errno value
+**------------------------------------------------------------------------------
+*/
+static int MD5_WALK_ReadEntries( int iDirFd, MD5_WALK_EntryType** pasEntries,
+                                 UINT32* pdwNumEntries )
+{
+   int iReadFd                    = dup( iDirFd );
+   DIR* psDir                     = ( iReadFd < 0 ) ? NULL : fdopendir( iReadFd );
+   MD5_WALK_EntryType* asEntries  = NULL;
+   UINT32 dwCapacity              = 0;
+   UINT32 dwNumEntries            = 0;
+   int iError                     = 0;
+   struct dirent* psEntry;
+
+   if( psDir == NULL )
+   {
+      iError = errno;
+
+      if( iReadFd >= 0 )
+      {
+         close( iReadFd );
+      }
+
+      return iError;
+   }
+
+   while( ( psEntry = readdir( psDir ) ) != NULL )
+   {
+      unsigned char bType = psEntry->d_type;
+
+      if( ( strcmp( psEntry->d_name, "." ) == 0 ) || ( strcmp( psEntry->d_name, ".." ) == 0 ) )
+      {
+         continue;
+      }
+
+      if( bType == DT_UNKNOWN )
+      {
+         struct stat sStat;
+
+         /* File systems without d_type support */
+         if( fstatat( dirfd( psDir ), psEntry->d_name, &sStat, AT_SYMLINK_NOFOLLOW ) == 0 )
+         {
+            bType = S_ISDIR( sStat.st_mode ) ? DT_DIR :
+                                               ( S_ISREG( sStat.st_mode ) ? DT_REG : DT_UNKNOWN );
+         }
+      }
+
+      if( ( bType != DT_DIR ) && ( bType != DT_REG ) )
+      {
+         continue;
+      }
+
+      if( dwNumEntries == dwCapacity )
+      {
+         UINT32 dwNewCapacity         =
+            ( dwCapacity == 0 ) ? MD5_WALK_INITIAL_ENTRIES : dwCapacity << 1;
+         MD5_WALK_EntryType* asNew    =
+            realloc( asEntries, dwNewCapacity * sizeof( MD5_WALK_EntryType ) );
+
+         if( asNew == NULL )
+         {
+            iError = ENOMEM;
+            break;
+         }
+
+         asEntries  = asNew;
+         dwCapacity = dwNewCapacity;
+      }
+
+      asEntries[ dwNumEntries ].pacName    = strdup( psEntry->d_name );
+      asEntries[ dwNumEntries ].fDirectory = ( bType == DT_DIR );
+
+      if( asEntries[ dwNumEntries ].pacName == NULL )
+      {
+         iError = ENOMEM;
+         break;
+      }
+
+      dwNumEntries++;
+   }
+
+   closedir( psDir );
+
+   if( iError != 0 )
+   {
+      while( dwNumEntries != 0 )
+      {
+         free( asEntries[ --dwNumEntries ].pacName );
+      }
+
+      free( asEntries );
+      return iError;
+   }
+
+   if( dwNumEntries > 1 )
+   {
+      qsort( asEntries, dwNumEntries, sizeof( MD5_WALK_EntryType ), MD5_WALK_CompareEntries );
+   }
+
+   *pasEntries    = asEntries;
+   *pdwNumEntries = dwNumEntries;
+
+   return 0;
+}
+
+/*------------------------------------------------------------------------------
+** Drops the reference of a finished child job on the fd of its directory and
+** closes the fd once no pending job needs it anymore. Must be called before
+** the child is marked ready, as the emit cursor may free the directory after.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDir - Directory node of the child
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_ReleaseDirFd( MD5_WALK_NodeType* psDir )
+{
+   if( ( psDir->iDirFd >= 0 ) && ( MD5_PORT_AtomicSub( &psDir->dwDirFdRefs, 1 ) == 0 ) )
+   {
+      close( psDir->iDirFd );
+      MD5_PORT_AtomicSub( &psDir->psWalk->dwOpenDirFds, 1 );
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Fills in the identity of a file and claims it if it is multiply linked.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psNode - File node to identify
+**
+** Returns:
+**    BOOL - TRUE if the file is to be visited through this node, FALSE if it
+**           could not be identified (iError is set) or another link visits it
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_WALK_IdentifyFile( MD5_WALK_NodeType* psNode )
+{
+   MD5_WALK_CtxType* psWalk  = psNode->psWalk;
+   MD5_WALK_FileType* psFile = &psNode->sFile;
+   BOOL fFirst               = TRUE;
+   UINT64 lNumLinks;
+#if defined( STATX_BASIC_STATS )
+   struct statx sStat;
+
+   /* Only the fields that are needed, which spares some file systems work */
+   if( statx( psFile->iDirFd, psFile->pacName, AT_SYMLINK_NOFOLLOW,
+              STATX_SIZE | STATX_INO | STATX_NLINK | STATX_MTIME | STATX_CTIME, &sStat ) != 0 )
+   {
+      psFile->iError = errno;
+      return FALSE;
+   }
+
+   psFile->lSize    = (UINT64)sStat.stx_size;
+   psFile->lDevice  = (UINT64)makedev( sStat.stx_dev_major, sStat.stx_dev_minor );
+   psFile->lInode   = (UINT64)sStat.stx_ino;
+   psFile->lMtimeNs = (UINT64)sStat.stx_mtime.tv_sec * 1000000000ULL + sStat.stx_mtime.tv_nsec;
+   psFile->lCtimeNs = (UINT64)sStat.stx_ctime.tv_sec * 1000000000ULL + sStat.stx_ctime.tv_nsec;
+   lNumLinks        = (UINT64)sStat.stx_nlink;
+#else
+   struct stat sStat;
+
+   if( fstatat( psFile->iDirFd, psFile->pacName, &sStat, AT_SYMLINK_NOFOLLOW ) != 0 )
+   {
+      psFile->iError = errno;
+      return FALSE;
+   }
+
+   psFile->lSize    = (UINT64)sStat.st_size;
+   psFile->lDevice  = (UINT64)sStat.st_dev;
+   psFile->lInode   = (UINT64)sStat.st_ino;
+   psFile->lMtimeNs = (UINT64)sStat.st_mtim.tv_sec * 1000000000ULL + (UINT64)sStat.st_mtim.tv_nsec;
+   psFile->lCtimeNs = (UINT64)sStat.st_ctim.tv_sec * 1000000000ULL + (UINT64)sStat.st_ctim.tv_nsec;
+   lNumLinks        = (UINT64)sStat.st_nlink;
+#endif
+
+   /* Links that can't be tracked are visited like any other file */
+   if( psWalk->psCfg->fSkipHardLinks && ( lNumLinks > 1 ) &&
+       MD5_WALK_ClaimInode( psWalk, psFile->lDevice, psFile->lInode, &fFirst ) )
+   {
+      psNode->fLinked    = TRUE;
+      psNode->fLinkOwner = fFirst;
+   }
+
+   return fFirst;
+}
+
+/*------------------------------------------------------------------------------
+** Submits a batch job for files of a directory. The batch takes over one
+** reference on the directory fd.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psDir     - Directory node the files belong to
+**    apsFiles  - File nodes
+**    iNumFiles - Number of files (1..MD5_WALK_BATCH_SIZE)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_SubmitFiles( MD5_WALK_NodeType* psDir, MD5_WALK_NodeType* apsFiles[],
+                                  UINT16 iNumFiles )
+{
+   MD5_WALK_BatchType* psBatch = malloc( sizeof( MD5_WALK_BatchType ) );
+   UINT16 iFile;
+
+   if( psBatch == NULL )
+   {
+      MD5_PORT_AtomicStore( &psDir->psWalk->fOutOfMemory, TRUE );
+      MD5_WALK_ReleaseDirFd( psDir );
+
+      for( iFile = 0; iFile < iNumFiles; iFile++ )
+      {
+         apsFiles[ iFile ]->sFile.iError = ENOMEM;
+         MD5_PORT_AtomicStore( &apsFiles[ iFile ]->fReady, TRUE );
+      }
+
+      return;
+   }
+
+   psBatch->psDir     = psDir;
+   psBatch->iNumFiles = iNumFiles;
+   memcpy( psBatch->apsFiles, apsFiles, iNumFiles * sizeof( MD5_WALK_NodeType* ) );
+
+   MD5_POOL_Submit( psDir->psWalk->psPool, MD5_WALK_BatchJob, psBatch );
+}
+
+/*------------------------------------------------------------------------------
+** Pool job scanning a directory node and submitting jobs for its children.
+** Sub-directories get a scan job each, files are grouped into batches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Directory node to scan
+**    iWorker - Executing worker (unused)
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_ScanJob( void* pxArg, UINT16 iWorker )
+{
+   MD5_WALK_NodeType* psNode     = (MD5_WALK_NodeType*)pxArg;
+   MD5_WALK_CtxType* psWalk      = psNode->psWalk;
+   MD5_WALK_EntryType* asEntries = NULL;
+   UINT32 dwNumEntries           = 0;
+   UINT32 dwNumJobs              = 0;
+   UINT32 dwNumFiles             = 0;
+   UINT32 dwEntry;
+   int iFlags                    = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+   int iFd;
+
+   (void)iWorker;
+
+   /* Symbolic links are only followed for the root given by the user */
+   if( psNode->psParent != NULL )
+   {
+      iFlags |= O_NOFOLLOW;
+   }
+
+   iFd = openat( psNode->sFile.iDirFd, psNode->sFile.pacName, iFlags );
+
+   if( psNode->psParent != NULL )
+   {
+      MD5_WALK_ReleaseDirFd( psNode->psParent );
+   }
+
+   if( iFd < 0 )
+   {
+      psNode->sFile.iError = errno;
+   }
+   else
+   {
+      psNode->sFile.iError = MD5_WALK_ReadEntries( iFd, &asEntries, &dwNumEntries );
+   }
+
+   if( ( psNode->sFile.iError == 0 ) && ( dwNumEntries != 0 ) )
+   {
+      psNode->apsChildren = malloc( dwNumEntries * sizeof( MD5_WALK_NodeType* ) );
+
+      if( psNode->apsChildren == NULL )
+      {
+         psNode->sFile.iError = ENOMEM;
+      }
+
+      for( dwEntry = 0; dwEntry < dwNumEntries; dwEntry++ )
+      {
+         if( psNode->sFile.iError == 0 )
+         {
+            MD5_WALK_NodeType* psChild = MD5_WALK_NewNode(
+               psWalk, psNode, asEntries[ dwEntry ].pacName, asEntries[ dwEntry ].fDirectory );
+
+            if( psChild == NULL )
+            {
+               psNode->sFile.iError = ENOMEM;
+            }
+            else
+            {
+               psNode->apsChildren[ psNode->dwNumChildren++ ] = psChild;
+            }
+         }
+
+         free( asEntries[ dwEntry ].pacName );
+      }
+
+      free( asEntries );
+
+      if( psNode->sFile.iError == ENOMEM )
+      {
+         MD5_PORT_AtomicStore( &psWalk->fOutOfMemory, TRUE );
+      }
+   }
+
+   /* Keep the directory open for the children, as long as the budget allows */
+   if( ( iFd >= 0 ) && ( psNode->dwNumChildren != 0 ) )
+   {
+      if( MD5_PORT_AtomicAdd( &psWalk->dwOpenDirFds, 1 ) <= psWalk->dwMaxDirFds )
+      {
+         psNode->iDirFd = iFd;
+         iFd            = -1;
+      }
+      else
+      {
+         MD5_PORT_AtomicSub( &psWalk->dwOpenDirFds, 1 );
+      }
+   }
+
+   if( iFd >= 0 )
+   {
+      close( iFd );
+   }
+
+   /* Children created so far are still walked, even if some failed */
+   for( dwEntry = 0; dwEntry < psNode->dwNumChildren; dwEntry++ )
+   {
+      MD5_WALK_NodeType* psChild = psNode->apsChildren[ dwEntry ];
+
+      if( psNode->iDirFd >= 0 )
+      {
+         psChild->sFile.iDirFd = psNode->iDirFd;
+      }
+      else
+      {
+         psChild->sFile.pacName = psChild->sFile.pacPath;
+      }
+
+      if( psChild->fDirectory )
+      {
+         dwNumJobs++;
+      }
+      else
+      {
+         dwNumFiles++;
+      }
+   }
+
+   /* All references are taken before the first child job can drop one */
+   psNode->dwDirFdRefs = dwNumJobs + ( dwNumFiles + MD5_WALK_BATCH_SIZE - 1 ) / MD5_WALK_BATCH_SIZE;
+
+   if( psNode->dwNumChildren != 0 )
+   {
+      MD5_WALK_NodeType* apsFiles[ MD5_WALK_BATCH_SIZE ];
+      UINT16 iNumFiles = 0;
+
+      for( dwEntry = 0; dwEntry < psNode->dwNumChildren; dwEntry++ )
+      {
+         MD5_WALK_NodeType* psChild = psNode->apsChildren[ dwEntry ];
+
+         if( psChild->fDirectory )
+         {
+            MD5_POOL_Submit( psWalk->psPool, MD5_WALK_ScanJob, psChild );
+         }
+         else
+         {
+            apsFiles[ iNumFiles++ ] = psChild;
+
+            if( iNumFiles == MD5_WALK_BATCH_SIZE )
+            {
+               MD5_WALK_SubmitFiles( psNode, apsFiles, iNumFiles );
+               iNumFiles = 0;
+            }
+         }
+      }
+
+      if( iNumFiles != 0 )
+      {
+         MD5_WALK_SubmitFiles( psNode, apsFiles, iNumFiles );
+      }
+   }
+
+   /* From here on the node belongs to the emit cursor */
+   MD5_PORT_AtomicStore( &psNode->fReady, TRUE );
+   MD5_WALK_Emit( psWalk );
+}
+
+/*------------------------------------------------------------------------------
+** Pool job identifying a batch of files of one directory. Files up to the
+** configured size are visited right here, larger files get a job of their
+** own so they are spread over the workers.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - Batch of file nodes
+**    iWorker - Executing worker, handed to the visit routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_BatchJob( void* pxArg, UINT16 iWorker )
+{
+   MD5_WALK_BatchType* psBatch      = (MD5_WALK_BatchType*)pxArg;
+   MD5_WALK_CtxType* psWalk         = psBatch->psDir->psWalk;
+   const MD5_WALK_ConfigType* psCfg = psWalk->psCfg;
+   MD5_WALK_FileType* apsVisit[ MD5_WALK_BATCH_SIZE ];
+   UINT16 iNumVisit                 = 0;
+   UINT16 iFile;
+   int iTarget;
+
+   for( iFile = 0; iFile < psBatch->iNumFiles; iFile++ )
+   {
+      MD5_WALK_NodeType* psNode = psBatch->apsFiles[ iFile ];
+
+      if( !MD5_WALK_IdentifyFile( psNode ) )
+      {
+         continue;
+      }
+
+      if( psNode->sFile.lSize <= psCfg->lBatchFileSize )
+      {
+         apsVisit[ iNumVisit++ ] = &psNode->sFile;
+      }
+      else
+      {
+         /* The batch still holds its reference, so the fd is open */
+         if( psBatch->psDir->iDirFd >= 0 )
+         {
+            MD5_PORT_AtomicAdd( &psBatch->psDir->dwDirFdRefs, 1 );
+         }
+
+         psBatch->apsFiles[ iFile ] = NULL;
+         iTarget                    = ( psCfg->pnPickWorker != NULL ) ?
+                                      psCfg->pnPickWorker( psNode->sFile.lDevice, psCfg->pxCtx ) :
+                                      -1;
+
+         if( iTarget >= 0 )
+         {
+            MD5_POOL_SubmitTo( psWalk->psPool, (UINT16)iTarget, MD5_WALK_VisitJob, psNode );
+         }
+         else
+         {
+            MD5_POOL_Submit( psWalk->psPool, MD5_WALK_VisitJob, psNode );
+         }
+      }
+   }
+
+   if( ( iNumVisit != 0 ) && ( psCfg->pnVisitBatch != NULL ) )
+   {
+      psCfg->pnVisitBatch( apsVisit, iNumVisit, iWorker, psCfg->pxCtx );
+   }
+   else
+   {
+      for( iFile = 0; iFile < iNumVisit; iFile++ )
+      {
+         psCfg->pnVisit( apsVisit[ iFile ], iWorker, psCfg->pxCtx );
+      }
+   }
+
+   for( iFile = 0; iFile < psBatch->iNumFiles; iFile++ )
+   {
+      if( ( psBatch->apsFiles[ iFile ] != NULL ) && psBatch->apsFiles[ iFile ]->fLinkOwner )
+      {
+         MD5_WALK_StoreLinkResult( psWalk, &psBatch->apsFiles[ iFile ]->sFile );
+      }
+   }
+
+   MD5_WALK_ReleaseDirFd( psBatch->psDir );
+
+   for( iFile = 0; iFile < psBatch->iNumFiles; iFile++ )
+   {
+      if( psBatch->apsFiles[ iFile ] != NULL )
+      {
+         MD5_PORT_AtomicStore( &psBatch->apsFiles[ iFile ]->fReady, TRUE );
+      }
+   }
+
+   free( psBatch );
+   MD5_WALK_Emit( psWalk );
+}
+
+/*------------------------------------------------------------------------------
+** Pool job visiting a single (large) file that was identified by a batch.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pxArg   - File node to visit
+**    iWorker - Executing worker, handed to the visit routine
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_VisitJob( void* pxArg, UINT16 iWorker )
+{
+   MD5_WALK_NodeType* psNode = (MD5_WALK_NodeType*)pxArg;
+   MD5_WALK_CtxType* psWalk  = psNode->psWalk;
+
+   psWalk->psCfg->pnVisit( &psNode->sFile, iWorker, psWalk->psCfg->pxCtx );
+
+   if( psNode->fLinkOwner )
+   {
+      MD5_WALK_StoreLinkResult( psWalk, &psNode->sFile );
+   }
+
+   MD5_WALK_ReleaseDirFd( psNode->psParent );
+   MD5_PORT_AtomicStore( &psNode->fReady, TRUE );
+   MD5_WALK_Emit( psWalk );
+}
+
+/*------------------------------------------------------------------------------
+** Advances the emit cursor as far as the tree is ready, handing results to
+** the emit routine and freeing everything that has been emitted.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWalk - Walk context
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WALK_Emit( MD5_WALK_CtxType* psWalk )
+{
+   MD5_WALK_NodeType* psCursor;
+
+   pthread_mutex_lock( &psWalk->sEmitLock );
+
+   psCursor = psWalk->psCursor;
+
+   while( ( psCursor != NULL ) && MD5_PORT_AtomicLoad( &psCursor->fReady ) )
+   {
+      if( psCursor->dwNextChild < psCursor->dwNumChildren )
+      {
+         MD5_WALK_NodeType* psChild = psCursor->apsChildren[ psCursor->dwNextChild ];
+
+         if( !MD5_PORT_AtomicLoad( &psChild->fReady ) ||
+             ( psChild->fLinked && !MD5_WALK_ResolveLink( psWalk, &psChild->sFile ) ) )
+         {
+            break;
+         }
+
+         if( psChild->fDirectory )
+         {
+            psCursor = psChild;
+         }
+         else
+         {
+            psWalk->psCfg->pnEmit( &psChild->sFile, psWalk->psCfg->pxCtx );
+            MD5_WALK_FreeNode( psChild );
+            psCursor->dwNextChild++;
+         }
+      }
+      else
+      {
+         MD5_WALK_NodeType* psParent = psCursor->psParent;
+
+         /* Directories are only reported when (part of) their scan failed */
+         if( psCursor->sFile.iError != 0 )
+         {
+            psWalk->psCfg->pnEmit( &psCursor->sFile, psWalk->psCfg->pxCtx );
+         }
+
+         MD5_WALK_FreeNode( psCursor );
+
+         if( psParent != NULL )
+         {
+            psParent->dwNextChild++;
+         }
+
+         psCursor = psParent;
+      }
+   }
+
+   psWalk->psCursor = psCursor;
+
+   pthread_mutex_unlock( &psWalk->sEmitLock );
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Walks the tree below pacRoot (or the single file pacRoot) and returns once
+** every file has been visited and emitted. Symbolic links are not followed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool to run the directory scans and file visits on. The pool
+**              must not be running other jobs while the walk is active.
+**    pacRoot - Directory (or file) to walk
+**    psCfg   - Visit/emit routines and options
+**
+** Returns:
+**    BOOL - FALSE if the walk could not be started or memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WALK_Run( MD5_POOL_Type* psPool, const char* pacRoot, const MD5_WALK_ConfigType* psCfg )
+{
+   MD5_WALK_CtxType sWalk;
+   MD5_WALK_NodeType* psRoot;
+   struct rlimit sFdLimit;
+   struct stat sStat;
+
+   if( stat( pacRoot, &sStat ) != 0 )
+   {
+      return FALSE;
+   }
+
+   memset( &sWalk, 0, sizeof( sWalk ) );
+   sWalk.psPool      = psPool;
+   sWalk.psCfg       = psCfg;
+   sWalk.dwMaxDirFds = MD5_WALK_MAX_DIR_FDS;
+
+   if( ( getrlimit( RLIMIT_NOFILE, &sFdLimit ) == 0 ) &&
+       ( sFdLimit.rlim_cur / 4 < sWalk.dwMaxDirFds ) )
+   {
+      sWalk.dwMaxDirFds = (UINT32)( sFdLimit.rlim_cur / 4 );
+   }
+   pthread_mutex_init( &sWalk.sEmitLock, NULL );
+   pthread_mutex_init( &sWalk.sLinkLock, NULL );
+
+   if( S_ISDIR( sStat.st_mode ) )
+   {
+      psRoot = MD5_WALK_NewNode( &sWalk, NULL, pacRoot, TRUE );
+   }
+   else
+   {
+      /* A single file: wrap it in an already scanned, anonymous directory */
+      psRoot = calloc( 1, sizeof( MD5_WALK_NodeType ) );
+
+      if( psRoot != NULL )
+      {
+         psRoot->psWalk      = &sWalk;
+         psRoot->iDirFd      = -1;
+         psRoot->fDirectory  = TRUE;
+         psRoot->fReady      = TRUE;
+         psRoot->apsChildren = malloc( sizeof( MD5_WALK_NodeType* ) );
+
+         if( psRoot->apsChildren != NULL )
+         {
+            psRoot->apsChildren[ 0 ] = MD5_WALK_NewNode( &sWalk, psRoot, pacRoot, FALSE );
+         }
+
+         if( ( psRoot->apsChildren == NULL ) || ( psRoot->apsChildren[ 0 ] == NULL ) )
+         {
+            MD5_WALK_FreeNode( psRoot );
+            psRoot = NULL;
+         }
+         else
+         {
+            psRoot->dwNumChildren = 1;
+         }
+      }
+   }
+
+   if( psRoot != NULL )
+   {
+      sWalk.psCursor = psRoot;
+
+      if( psRoot->fReady )
+      {
+         MD5_WALK_SubmitFiles( psRoot, psRoot->apsChildren, 1 );
+      }
+      else
+      {
+         MD5_POOL_Submit( psPool, MD5_WALK_ScanJob, psRoot );
+      }
+
+      MD5_POOL_Wait( psPool );
+
+      /* Picks up files that failed without a job of their own */
+      MD5_WALK_Emit( &sWalk );
+   }
+   else
+   {
+      sWalk.fOutOfMemory = TRUE;
+   }
+
+   pthread_mutex_destroy( &sWalk.sLinkLock );
+   pthread_mutex_destroy( &sWalk.sEmitLock );
+   free( sWalk.asLinks );
+
+   return !sWalk.fOutOfMemory;
+}
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
@@ -0,0 +1,114 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_walk.h
+**    Summary: Parallel directory-tree walker. Directories are scanned and
+**             files are visited as jobs on an MD5_pool, while the results
+**             are handed back in a deterministic (sorted, depth-first) order
+**             through a tree-shaped reorder buffer. Small files are visited
+**             in batches, relative to an open fd of their directory.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_WALK_H_
+#define HMS_SC_MD5_WALK_H_
+
+#include "MD5.h"
+#include "MD5_pool.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_WALK_BATCH_SIZE            ( 32U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** A regular file found by the walker. The walker fills in the path and the
+** file identity, the visit routine fills in the result.
+*/
+typedef struct MD5_WALK_File
+{
+   char* pacPath;
+   int iDirFd;          /* During the visit: directory fd (or AT_FDCWD) ... */
+   const char* pacName; /* ... and the file name relative to it */
+   UINT64 lSize;
+   UINT64 lDevice;
+   UINT64 lInode;
+   UINT64 lMtimeNs;     /* Modification and status change time, ns since */
+   UINT64 lCtimeNs;     /* the epoch */
+   int iError;    /* errno of the failed operation, 0 on success */
+   BOOL fSkipped; /* Hard link to a file that was already visited */
+   UINT8 abDigest[ MD5_DIGEST_SIZE ];
+} MD5_WALK_FileType;
+
+/*
+** Called on a pool worker for every regular file (unless skipped).
+*/
+typedef void ( *MD5_WALK_VisitFunc )( MD5_WALK_FileType* psFile, UINT16 iWorker, void* pxCtx );
+
+/*
+** Optional, called on a pool worker with up to MD5_WALK_BATCH_SIZE files of
+** one directory that are no larger than lBatchFileSize.
+*/
+typedef void ( *MD5_WALK_VisitBatchFunc )( MD5_WALK_FileType* apsFiles[], UINT16 iNumFiles,
+                                           UINT16 iWorker, void* pxCtx );
+
+/*
+** Called in deterministic order, one call at a time, for every visited file,
+** every skipped hard link and every directory that could not be read.
+*/
+typedef void ( *MD5_WALK_EmitFunc )( const MD5_WALK_FileType* psFile, void* pxCtx );
+
+/*
+** Optional, called on a pool worker for every file larger than
+** lBatchFileSize. Returns the worker that should preferably visit a file on
+** the given device, or -1 for any worker.
+*/
+typedef int ( *MD5_WALK_PickFunc )( UINT64 lDevice, void* pxCtx );
+
+typedef struct MD5_WALK_Config
+{
+   MD5_WALK_VisitFunc pnVisit;
+   MD5_WALK_VisitBatchFunc pnVisitBatch; /* NULL: pnVisit for every file */
+   MD5_WALK_EmitFunc pnEmit;
+   void* pxCtx;
+   UINT64 lBatchFileSize;                /* Larger files get a job of their own */
+   BOOL fSkipHardLinks;
+   MD5_WALK_PickFunc pnPickWorker;       /* NULL: any worker */
+} MD5_WALK_ConfigType;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Walks the tree below pacRoot (or the single file pacRoot) and returns once
+** every file has been visited and emitted. Symbolic links are not followed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psPool  - Pool to run the directory scans and file visits on. The pool
+**              must not be running other jobs while the walk is active.
+**    pacRoot - Directory (or file) to walk
+**    psCfg   - Visit/emit routines and options
+**
+** Returns:
+**    BOOL - FALSE if the walk could not be started or memory ran out
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WALK_Run( MD5_POOL_Type* psPool, const char* pacRoot, const MD5_WALK_ConfigType* psCfg );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_WALK_H_ */
@@ -0,0 +1,640 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_watch.c
+**    Summary: Change notification for a directory tree on top of inotify.
+**             inotify watches single directories and reports names relative
+**             to them, so a table maps every watch descriptor to the path of
+**             its directory.
+**
+**             A directory moved out of the tree keeps its watches (they
+**             follow the inode), so they are removed when the move is seen;
+**             events already queued for them are reported under the old
+**             path, which no longer exists. The caller is expected to look
+**             at a path before trusting an event.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#include "MD5_watch.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+#include <errno.h>
+#include <stdlib.h>
+
+#if defined( __linux__ )
+
+#include <dirent.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+#define MD5_WATCH_INITIAL_DIRS         ( 64U )
+
+/*
+** Events of a watched directory. Files are only of interest once they are
+** closed after writing (or moved in complete); created files are not.
+*/
+#define MD5_WATCH_MASK                 ( IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                                         IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                                         IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK )
+
+/*******************************************************************************
+** Forward declarations
+********************************************************************************
+*/
+
+static char* MD5_WATCH_JoinPath( const char* pacDir, const char* pacName );
+static UINT32 MD5_WATCH_FindDir( const MD5_WATCH_Type* psWatch, int iWd, BOOL* pfFound );
+static BOOL MD5_WATCH_AddDir( MD5_WATCH_Type* psWatch, const char* pacPath );
+static void MD5_WATCH_RemoveDir( MD5_WATCH_Type* psWatch, UINT32 dwIndex );
+static void MD5_WATCH_RemoveTree( MD5_WATCH_Type* psWatch, const char* pacPath );
+static BOOL MD5_WATCH_Scan( MD5_WATCH_Type* psWatch, const char* pacPath,
+                            MD5_WATCH_EventFunc pnEvent, void* pxCtx );
+
+/*******************************************************************************
+** Private Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Joins a directory path and a name.
+**------------------------------------------------------------------------------
+** Arguments:
+**    pacDir  - Directory
+**    pacName - Name within the directory
+**
+** Returns:
+**    char* - Allocated path, NULL if memory ran out
+**------------------------------------------------------------------------------
+*/
+static char* MD5_WATCH_JoinPath( const char* pacDir, const char* pacName )
+{
+   size_t iDirLen  = strlen( pacDir );
+   size_t iNameLen = strlen( pacName );
+   char* pacPath   = malloc( iDirLen + iNameLen + 2 );
+
+   if( pacPath == NULL )
+   {
+      return NULL;
+   }
+
+   memcpy( pacPath, pacDir, iDirLen );
+
+   if( ( iDirLen > 0 ) && ( pacDir[ iDirLen - 1 ] != '/' ) )
+   {
+      pacPath[ iDirLen++ ] = '/';
+   }
+
+   memcpy( pacPath + iDirLen, pacName, iNameLen + 1 );
+
+   return pacPath;
+}
+
+/*------------------------------------------------------------------------------
+** Binary search for a watch descriptor in the directory table.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to search
+**    iWd     - Watch descriptor
+**    pfFound - Receives TRUE if the descriptor is in the table
+**
+** Returns:
+**    UINT32 - Index of the directory, or where it would be inserted
+**------------------------------------------------------------------------------
+*/
+static UINT32 MD5_WATCH_FindDir( const MD5_WATCH_Type* psWatch, int iWd, BOOL* pfFound )
+{
+   UINT32 dwLow  = 0;
+   UINT32 dwHigh = psWatch->dwNumDirs;
+
+   while( dwLow < dwHigh )
+   {
+      UINT32 dwMiddle = dwLow + ( dwHigh - dwLow ) / 2;
+
+      if( psWatch->asDirs[ dwMiddle ].iWd < iWd )
+      {
+         dwLow = dwMiddle + 1;
+      }
+      else
+      {
+         dwHigh = dwMiddle;
+      }
+   }
+
+   *pfFound = ( dwLow < psWatch->dwNumDirs ) && ( psWatch->asDirs[ dwLow ].iWd == iWd );
+
+   return dwLow;
+}
+
+/*------------------------------------------------------------------------------
+** Watches a single directory. A directory that is already watched (under
+** another name) takes the new path.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to add the watch to
+**    pacPath - Directory
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set)
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_WATCH_AddDir( MD5_WATCH_Type* psWatch, const char* pacPath )
+{
+   char* pacCopy;
+   UINT32 dwIndex;
+   BOOL fFound;
+   int iWd;
+
+   pacCopy = malloc( strlen( pacPath ) + 1 );
+
+   if( pacCopy == NULL )
+   {
+      return FALSE;
+   }
+
+   strcpy( pacCopy, pacPath );
+
+   iWd = inotify_add_watch( psWatch->iFd, pacPath, MD5_WATCH_MASK );
+
+   if( iWd < 0 )
+   {
+      free( pacCopy );
+      return FALSE;
+   }
+
+   dwIndex = MD5_WATCH_FindDir( psWatch, iWd, &fFound );
+
+   if( fFound )
+   {
+      free( psWatch->asDirs[ dwIndex ].pacPath );
+      psWatch->asDirs[ dwIndex ].pacPath = pacCopy;
+      return TRUE;
+   }
+
+   if( psWatch->dwNumDirs == psWatch->dwAlloc )
+   {
+      UINT32 dwAlloc = ( psWatch->dwAlloc == 0 ) ? MD5_WATCH_INITIAL_DIRS : psWatch->dwAlloc * 2;
+      MD5_WATCH_DirType* asDirs = realloc( psWatch->asDirs, dwAlloc * sizeof( MD5_WATCH_DirType ) );
+
+      if( asDirs == NULL )
+      {
+         inotify_rm_watch( psWatch->iFd, iWd );
+         free( pacCopy );
+         errno = ENOMEM;
+         return FALSE;
+      }
+
+      psWatch->asDirs  = asDirs;
+      psWatch->dwAlloc = dwAlloc;
+   }
+
+   memmove( &psWatch->asDirs[ dwIndex + 1 ], &psWatch->asDirs[ dwIndex ],
+            ( psWatch->dwNumDirs - dwIndex ) * sizeof( MD5_WATCH_DirType ) );
+
+   psWatch->asDirs[ dwIndex ].iWd     = iWd;
+   psWatch->asDirs[ dwIndex ].pacPath = pacCopy;
+   psWatch->dwNumDirs++;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Drops a directory from the table. The watch itself is left alone.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to update
+**    dwIndex - Index of the directory
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WATCH_RemoveDir( MD5_WATCH_Type* psWatch, UINT32 dwIndex )
+{
+   free( psWatch->asDirs[ dwIndex ].pacPath );
+
+   psWatch->dwNumDirs--;
+   memmove( &psWatch->asDirs[ dwIndex ], &psWatch->asDirs[ dwIndex + 1 ],
+            ( psWatch->dwNumDirs - dwIndex ) * sizeof( MD5_WATCH_DirType ) );
+}
+
+/*------------------------------------------------------------------------------
+** Removes the watches of a directory and of every directory below it.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to update
+**    pacPath - Directory
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+static void MD5_WATCH_RemoveTree( MD5_WATCH_Type* psWatch, const char* pacPath )
+{
+   size_t iLen = strlen( pacPath );
+   UINT32 dwIndex = 0;
+
+   while( dwIndex < psWatch->dwNumDirs )
+   {
+      const char* pacDir = psWatch->asDirs[ dwIndex ].pacPath;
+
+      if( ( strncmp( pacDir, pacPath, iLen ) == 0 ) &&
+          ( ( pacDir[ iLen ] == '\0' ) || ( pacDir[ iLen ] == '/' ) ) )
+      {
+         inotify_rm_watch( psWatch->iFd, psWatch->asDirs[ dwIndex ].iWd );
+         MD5_WATCH_RemoveDir( psWatch, dwIndex );
+      }
+      else
+      {
+         dwIndex++;
+      }
+   }
+}
+
+/*------------------------------------------------------------------------------
+** Watches the directories below a watched directory and reports the regular
+** files found.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to add the watches to
+**    pacPath - Directory to scan
+**    pnEvent - Receives the files found, or NULL
+**    pxCtx   - Passed to pnEvent
+**
+** Returns:
+**    BOOL - FALSE if memory ran out or the watch limit was reached
+**------------------------------------------------------------------------------
+*/
+static BOOL MD5_WATCH_Scan( MD5_WATCH_Type* psWatch, const char* pacPath,
+                            MD5_WATCH_EventFunc pnEvent, void* pxCtx )
+{
+   DIR* psDir = opendir( pacPath );
+   struct dirent* psEntry;
+   BOOL fSuccess = TRUE;
+   int iError;
+
+   if( psDir == NULL )
+   {
+      /* Gone again already, the removal is reported on its own */
+      return TRUE;
+   }
+
+   while( fSuccess && ( ( psEntry = readdir( psDir ) ) != NULL ) )
+   {
+      unsigned char bType = psEntry->d_type;
+      struct stat sStat;
+      char* pacChild;
+
+      if( ( strcmp( psEntry->d_name, "." ) == 0 ) || ( strcmp( psEntry->d_name, ".." ) == 0 ) )
+      {
+         continue;
+      }
+
+      pacChild = MD5_WATCH_JoinPath( pacPath, psEntry->d_name );
+
+      if( pacChild == NULL )
+      {
+         fSuccess = FALSE;
+         break;
+      }
+
+      if( bType == DT_UNKNOWN )
+      {
+         if( lstat( pacChild, &sStat ) != 0 )
+         {
+            bType = DT_UNKNOWN;
+         }
+         else if( S_ISDIR( sStat.st_mode ) )
+         {
+            bType = DT_DIR;
+         }
+         else if( S_ISREG( sStat.st_mode ) )
+         {
+            bType = DT_REG;
+         }
+      }
+
+      if( bType == DT_DIR )
+      {
+         if( MD5_WATCH_AddDir( psWatch, pacChild ) )
+         {
+            fSuccess = MD5_WATCH_Scan( psWatch, pacChild, pnEvent, pxCtx );
+         }
+         else if( ( errno == ENOMEM ) || ( errno == ENOSPC ) )
+         {
+            fSuccess = FALSE;
+         }
+      }
+      else if( ( bType == DT_REG ) && ( pnEvent != NULL ) )
+      {
+         pnEvent( pacChild, MD5_WATCH_CHANGED, pxCtx );
+      }
+
+      free( pacChild );
+   }
+
+   iError = ( errno == ENOSPC ) ? ENOSPC : ENOMEM;
+   closedir( psDir );
+
+   if( !fSuccess )
+   {
+      errno = iError;
+   }
+
+   return fSuccess;
+}
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Opens a change notification instance without any watches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to open
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts without inotify)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WATCH_Open( MD5_WATCH_Type* psWatch )
+{
+   memset( psWatch, 0, sizeof( *psWatch ) );
+
+   psWatch->pbEvents = malloc( MD5_WATCH_EVENT_BUFFER_SIZE );
+
+   if( psWatch->pbEvents == NULL )
+   {
+      return FALSE;
+   }
+
+   psWatch->iFd = inotify_init1( IN_CLOEXEC );
+
+   if( psWatch->iFd < 0 )
+   {
+      free( psWatch->pbEvents );
+      psWatch->pbEvents = NULL;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------------
+** Closes an instance and removes all of its watches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_WATCH_Close( MD5_WATCH_Type* psWatch )
+{
+   UINT32 dwIndex;
+
+   /* Closing the instance removes the watches */
+   close( psWatch->iFd );
+
+   for( dwIndex = 0; dwIndex < psWatch->dwNumDirs; dwIndex++ )
+   {
+      free( psWatch->asDirs[ dwIndex ].pacPath );
+   }
+
+   free( psWatch->asDirs );
+   free( psWatch->pbEvents );
+   memset( psWatch, 0, sizeof( *psWatch ) );
+   psWatch->iFd = -1;
+}
+
+/*------------------------------------------------------------------------------
+** Watches a directory and every directory below it. Symbolic links are not
+** followed. With pnEvent set, every regular file found is reported as
+** changed; this catches files written before their directory was watched.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to add the watches to
+**    pacRoot - Directory to watch
+**    pnEvent - Receives the files found, or NULL
+**    pxCtx   - Passed to pnEvent
+**
+** Returns:
+**    BOOL - FALSE if pacRoot could not be watched or memory ran out (errno
+**           is set). Sub-directories that vanish while they are added are
+**           skipped.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WATCH_AddTree( MD5_WATCH_Type* psWatch, const char* pacRoot, MD5_WATCH_EventFunc pnEvent,
+                        void* pxCtx )
+{
+   if( !MD5_WATCH_AddDir( psWatch, pacRoot ) )
+   {
+      return FALSE;
+   }
+
+   return MD5_WATCH_Scan( psWatch, pacRoot, pnEvent, pxCtx );
+}
+
+/*------------------------------------------------------------------------------
+** Waits for events and reports them. Directories created or moved into the
+** tree are watched (see MD5_WATCH_AddTree()) before Read returns, the
+** watches of directories moved out of the tree are removed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch    - Instance to read
+**    lTimeoutMs - Longest time to wait for the first event, -1: no limit
+**    pnEvent    - Receives the events
+**    pxCtx      - Passed to pnEvent
+**
+** Returns:
+**    long - Number of events read (some of them may not have been relevant),
+**           0 on timeout, -1 on failure (errno is set, EINTR if a signal
+**           arrived while waiting)
+**------------------------------------------------------------------------------
+*/
+long MD5_WATCH_Read( MD5_WATCH_Type* psWatch, long lTimeoutMs, MD5_WATCH_EventFunc pnEvent,
+                     void* pxCtx )
+{
+   struct pollfd sPoll;
+   ssize_t iRead;
+   size_t iOffset = 0;
+   long lNumEvents = 0;
+   int iResult;
+
+   sPoll.fd      = psWatch->iFd;
+   sPoll.events  = POLLIN;
+   sPoll.revents = 0;
+
+   iResult = poll( &sPoll, 1, ( lTimeoutMs < 0 ) ? -1 : (int)lTimeoutMs );
+
+   if( iResult <= 0 )
+   {
+      return iResult;
+   }
+
+   iRead = read( psWatch->iFd, psWatch->pbEvents, MD5_WATCH_EVENT_BUFFER_SIZE );
+
+   if( iRead < 0 )
+   {
+      return -1;
+   }
+
+   while( iOffset + sizeof( struct inotify_event ) <= (size_t)iRead )
+   {
+      const struct inotify_event* psEvent =
+         (const struct inotify_event*)( psWatch->pbEvents + iOffset );
+      const char* pacDir;
+      char* pacPath;
+      UINT32 dwIndex;
+      BOOL fFound;
+
+      iOffset += sizeof( struct inotify_event ) + psEvent->len;
+      lNumEvents++;
+
+      if( psEvent->mask & IN_Q_OVERFLOW )
+      {
+         pnEvent( NULL, MD5_WATCH_OVERFLOW, pxCtx );
+         continue;
+      }
+
+      dwIndex = MD5_WATCH_FindDir( psWatch, psEvent->wd, &fFound );
+
+      if( !fFound )
+      {
+         /* A directory whose watch was removed while the event was queued */
+         continue;
+      }
+
+      if( psEvent->mask & IN_IGNORED )
+      {
+         MD5_WATCH_RemoveDir( psWatch, dwIndex );
+         continue;
+      }
+
+      pacDir = psWatch->asDirs[ dwIndex ].pacPath;
+
+      if( psEvent->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) )
+      {
+         /* Also reported by the parent, except for the root */
+         pacPath = malloc( strlen( pacDir ) + 1 );
+
+         if( pacPath != NULL )
+         {
+            strcpy( pacPath, pacDir );
+         }
+      }
+      else if( psEvent->len > 0 )
+      {
+         pacPath = MD5_WATCH_JoinPath( pacDir, psEvent->name );
+      }
+      else
+      {
+         continue;
+      }
+
+      if( pacPath == NULL )
+      {
+         errno = ENOMEM;
+         return -1;
+      }
+
+      if( psEvent->mask & ( IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF ) )
+      {
+         if( psEvent->mask & ( IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF ) )
+         {
+            MD5_WATCH_RemoveTree( psWatch, pacPath );
+         }
+
+         pnEvent( pacPath, MD5_WATCH_REMOVED, pxCtx );
+      }
+      else if( psEvent->mask & IN_ISDIR )
+      {
+         if( psEvent->mask & ( IN_CREATE | IN_MOVED_TO ) )
+         {
+            if( !MD5_WATCH_AddTree( psWatch, pacPath, pnEvent, pxCtx ) &&
+                ( ( errno == ENOMEM ) || ( errno == ENOSPC ) ) )
+            {
+               free( pacPath );
+               return -1;
+            }
+         }
+      }
+      else if( psEvent->mask & ( IN_CLOSE_WRITE | IN_MOVED_TO ) )
+      {
+         pnEvent( pacPath, MD5_WATCH_CHANGED, pxCtx );
+      }
+
+      free( pacPath );
+   }
+
+   return lNumEvents;
+}
+
+#else /* defined( __linux__ ) */
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*
+** Hosts without inotify: nothing can be watched
+*/
+BOOL MD5_WATCH_Open( MD5_WATCH_Type* psWatch )
+{
+   psWatch->iFd       = -1;
+   psWatch->asDirs    = NULL;
+   psWatch->dwNumDirs = 0;
+   psWatch->dwAlloc   = 0;
+   psWatch->pbEvents  = NULL;
+
+   errno = ENOSYS;
+   return FALSE;
+}
+
+void MD5_WATCH_Close( MD5_WATCH_Type* psWatch )
+{
+   (void)psWatch;
+}
+
+BOOL MD5_WATCH_AddTree( MD5_WATCH_Type* psWatch, const char* pacRoot, MD5_WATCH_EventFunc pnEvent,
+                        void* pxCtx )
+{
+   (void)psWatch;
+   (void)pacRoot;
+   (void)pnEvent;
+   (void)pxCtx;
+
+   errno = ENOSYS;
+   return FALSE;
+}
+
+long MD5_WATCH_Read( MD5_WATCH_Type* psWatch, long lTimeoutMs, MD5_WATCH_EventFunc pnEvent,
+                     void* pxCtx )
+{
+   (void)psWatch;
+   (void)lTimeoutMs;
+   (void)pnEvent;
+   (void)pxCtx;
+
+   errno = ENOSYS;
+   return -1;
+}
+
+#endif /* defined( __linux__ ) */
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
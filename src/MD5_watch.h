@@ -0,0 +1,141 @@
+/*******************************************************************************
+**    Copyright (C) 2018 HMS Industrial Networks Inc, all rights reserved
+********************************************************************************
+**
+**       File: MD5_watch.h
+**    Summary: Change notification for a directory tree (Linux inotify). Every
+**             directory of the tree is watched; the events are reduced to the
+**             paths whose content may have changed: files closed after being
+**             written and files or directories moved in, removed or moved
+**             out. Directories that appear are watched as they show up.
+**
+**             Other hosts have no implementation: MD5_WATCH_Open() fails
+**             with ENOSYS.
+**
+********************************************************************************
+********************************************************************************
+*/
+
+#ifndef HMS_SC_MD5_WATCH_H_
+#define HMS_SC_MD5_WATCH_H_
+
+#include "MD5.h"
+
+#if( MD5_USE_POSIX_HOST == 1 )
+
+/*******************************************************************************
+** Constants
+********************************************************************************
+*/
+
+/*
+** Events reported to MD5_WATCH_EventFunc
+*/
+#define MD5_WATCH_CHANGED              ( 0U ) /* File written or moved in */
+#define MD5_WATCH_REMOVED              ( 1U ) /* Path and everything below it gone */
+#define MD5_WATCH_OVERFLOW             ( 2U ) /* Events were lost, rescan the tree */
+
+#define MD5_WATCH_EVENT_BUFFER_SIZE    ( 64U * 1024U )
+
+/*******************************************************************************
+** Typedefs
+********************************************************************************
+*/
+
+/*
+** Called for every relevant change. pacPath is the root given to
+** MD5_WATCH_AddTree() joined with the path below it (NULL for
+** MD5_WATCH_OVERFLOW). A path may be reported more than once.
+*/
+typedef void ( *MD5_WATCH_EventFunc )( const char* pacPath, UINT8 bEvent, void* pxCtx );
+
+/*
+** A watched directory
+*/
+typedef struct MD5_WATCH_Dir
+{
+   int iWd;
+   char* pacPath;
+} MD5_WATCH_DirType;
+
+typedef struct MD5_WATCH
+{
+   int iFd;
+   MD5_WATCH_DirType* asDirs; /* Sorted by watch descriptor */
+   UINT32 dwNumDirs;
+   UINT32 dwAlloc;
+   UINT8* pbEvents;           /* Read buffer, MD5_WATCH_EVENT_BUFFER_SIZE bytes */
+} MD5_WATCH_Type;
+
+/*******************************************************************************
+** Public Services
+********************************************************************************
+*/
+
+/*------------------------------------------------------------------------------
+** Opens a change notification instance without any watches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to open
+**
+** Returns:
+**    BOOL - FALSE on failure (errno is set, ENOSYS on hosts without inotify)
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WATCH_Open( MD5_WATCH_Type* psWatch );
+
+/*------------------------------------------------------------------------------
+** Closes an instance and removes all of its watches.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to close
+**
+** Returns:
+**    None
+**------------------------------------------------------------------------------
+*/
+void MD5_WATCH_Close( MD5_WATCH_Type* psWatch );
+
+/*------------------------------------------------------------------------------
+** Watches a directory and every directory below it. Symbolic links are not
+** followed. With pnEvent set, every regular file found is reported as
+** changed; this catches files written before their directory was watched.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch - Instance to add the watches to
+**    pacRoot - Directory to watch
+**    pnEvent - Receives the files found, or NULL
+**    pxCtx   - Passed to pnEvent
+**
+** Returns:
+**    BOOL - FALSE if pacRoot could not be watched or memory ran out (errno
+**           is set). Sub-directories that vanish while they are added are
+**           skipped.
+**------------------------------------------------------------------------------
+*/
+BOOL MD5_WATCH_AddTree( MD5_WATCH_Type* psWatch, const char* pacRoot, MD5_WATCH_EventFunc pnEvent,
+                        void* pxCtx );
+
+/*------------------------------------------------------------------------------
+** Waits for events and reports them. Directories created or moved into the
+** tree are watched (see MD5_WATCH_AddTree()) before Read returns, the
+** watches of directories moved out of the tree are removed.
+**------------------------------------------------------------------------------
+** Arguments:
+**    psWatch    - Instance to read
+**    lTimeoutMs - Longest time to wait for the first event, -1: no limit
+**    pnEvent    - Receives the events
+**    pxCtx      - Passed to pnEvent
+**
+** Returns:
+**    long - Number of events read (some of them may not have been relevant),
+**           0 on timeout, -1 on failure (errno is set, EINTR if a signal
+**           arrived while waiting)
+**------------------------------------------------------------------------------
+*/
+long MD5_WATCH_Read( MD5_WATCH_Type* psWatch, long lTimeoutMs, MD5_WATCH_EventFunc pnEvent,
+                     void* pxCtx );
+
+#endif /* ( MD5_USE_POSIX_HOST == 1 ) */
+
+#endif /* HMS_SC_MD5_WATCH_H_ */